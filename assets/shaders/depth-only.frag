@@ -0,0 +1,7 @@
+#version 330 core
+
+// The depth pre-pass only writes the depth of the opaque objects, so nothing is computed per fragment.
+// It is linked with the vertex shader of each material so that the depth is exactly the same as in the shading pass
+// (which needs "invariant gl_Position" in the vertex shaders since they are linked into different programs).
+void main(){
+}
@@ -10,6 +10,8 @@ out vec4 frag_color;
 // How far (in the texture space) is the distance (on the x-axis) between
 // the pixels from which the red/green (or green/blue) channels are sampled
 #define STRENGTH 0.005
+// Scales the distance between the sampled pixels (it is set by the post-process chain, 0 leaves the scene unchanged)
+uniform float strength = 1.0;
 
 // Chromatic aberration mimics some old cameras where the lens disperses light
 // differently based on its wavelength. In this shader, we will implement a
@@ -21,6 +23,6 @@ void main(){
     // To get the red channel, we move by amount STRENGTH to the left then sample another pixel from which we take the red channel
     // To get the blue channel, we move by amount STRENGTH to the right then sample another pixel from which we take the blue channel
     frag_color = texture(tex, tex_coord);
-    frag_color.r = texture(tex, tex_coord - vec2(STRENGTH, 0)).r;
-    frag_color.b = texture(tex, tex_coord + vec2(STRENGTH, 0)).b;
+    frag_color.r = texture(tex, tex_coord - vec2(STRENGTH * strength, 0)).r;
+    frag_color.b = texture(tex, tex_coord + vec2(STRENGTH * strength, 0)).b;
 }
\ No newline at end of file
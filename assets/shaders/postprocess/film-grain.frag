@@ -1,9 +1,7 @@
 #version 330 core
 
-in vec2 tex_coord;
-out vec4 frag_color;
-
-uniform sampler2D tex; // The input texture containing the scene
+// Scales the intensity of the grain (0 leaves the scene unchanged)
+uniform float strength = 1.0;
 
 const float grainIntensity = 0.1; // Constant intensity of the grain effect
 const float grainSize = 1.0; // Constant size of individual grains
@@ -12,17 +10,26 @@ float rand(vec2 co) {
     return fract(sin(dot(co.xy, vec2(12.9898, 78.233))) * 43758.5453);
 }
 
-void main() {
-    vec4 color = texture(tex, tex_coord);
-
+// Adds a random grain to the pixel color (a fusible effect, see "postprocess-chain.hpp")
+vec4 effect(vec4 color, vec2 tex_coord) {
     // Generate a random value for each pixel
     float randVal = rand(tex_coord * gl_FragCoord.xy);
 
     // Adjust the random value to control the intensity and size of the grain
-    randVal = (randVal - 0.5) * grainIntensity * grainSize;
+    randVal = (randVal - 0.5) * grainIntensity * grainSize * strength;
 
     // Add the grain to the pixel color
     color.xyz += vec3(randVal);
+    return color;
+}
 
-    frag_color = color;
+#ifndef FUSED_PASS
+in vec2 tex_coord;
+out vec4 frag_color;
+
+uniform sampler2D tex; // The input texture containing the scene
+
+void main() {
+    frag_color = effect(texture(tex, tex_coord), tex_coord);
 }
+#endif
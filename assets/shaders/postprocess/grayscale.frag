@@ -1,5 +1,18 @@
 #version 330
 
+// How much of the effect is applied (0 keeps the scene colors, 1 is fully gray)
+uniform float strength = 1.0;
+
+// Moves the pixel color towards its gray level (a fusible effect, see "postprocess-chain.hpp")
+vec4 effect(vec4 color, vec2 tex_coord){
+    // To apply the grayscale effect, we compute the average of the red/blue/green channels
+    // and set that average value to all the channels
+    float gray = dot(color.rgb, vec3(1.0/3.0, 1.0/3.0, 1.0/3.0));
+    color.rgb = mix(color.rgb, vec3(gray), strength);
+    return color;
+}
+
+#ifndef FUSED_PASS
 // The texture holding the scene pixels
 uniform sampler2D tex;
 
@@ -8,9 +21,6 @@ in vec2 tex_coord;
 out vec4 frag_color;
 
 void main(){
-    // To apply the grayscale effect, we compute the average of the red/blue/green channels
-    // and set that average value to all the channels
-    frag_color = texture(tex, tex_coord);
-    float gray = dot(frag_color.rgb, vec3(1.0/3.0, 1.0/3.0, 1.0/3.0));
-    frag_color.rgb = vec3(gray);
-}
\ No newline at end of file
+    frag_color = effect(texture(tex, tex_coord), tex_coord);
+}
+#endif
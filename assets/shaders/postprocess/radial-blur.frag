@@ -11,11 +11,14 @@ out vec4 frag_color;
 #define STEPS 16
 // The strength of the blurring effect
 #define STRENGTH 0.2
+// Scales the length of the blur (it is set by the post-process chain, 0 leaves the scene unchanged)
+uniform float strength = 1.0;
 
 void main(){
     // To apply radial blur, we compute the direction outward from the center to the current pixel
-    vec2 step_vector = (tex_coord - 0.5) * (STRENGTH / STEPS);
+    vec2 step_vector = (tex_coord - 0.5) * (STRENGTH * strength / STEPS);
     // Then we sample multiple pixels along that direction and compute the average
+    frag_color = vec4(0.0);
     for(int i = 0; i < STEPS; i++){
         frag_color += texture(tex, tex_coord + step_vector * i);    
     }
@@ -1,25 +1,34 @@
 #version 330
 
-// The texture holding the scene pixels
-uniform sampler2D tex;
-
-// Read "assets/shaders/fullscreen.vert" to know what "tex_coord" holds;
-in vec2 tex_coord;
-
-out vec4 frag_color;
+// How much the corners are darkened (0 leaves the scene unchanged)
+uniform float strength = 1.0;
 
 // Vignette is a postprocessing effect that darkens the corners of the screen
 // to grab the attention of the viewer towards the center of the screen
 
-void main(){
+// Darkens the pixel by its distance from the center (a fusible effect, see "postprocess-chain.hpp")
+vec4 effect(vec4 color, vec2 tex_coord){
     //TODO: Modify this shader to apply vignette
     // To apply vignette, divide the scene color
     // by 1 + the squared length of the 2D pixel location the NDC space
     // Hint: remember that the NDC space ranges from -1 to 1
     // while the texture coordinate space ranges from 0 to 1
     // We have the pixel's texture coordinate, how can we compute its location in the NDC space?
-    frag_color = texture(tex, tex_coord);
     vec2 ndc = 2.0 * tex_coord - 1.0; // scale and shift tex_coord to NDC space
-    float vignette = 1.0 / (1.0 + dot(ndc, ndc)); // 1.0 / (1.0 + |ndc|^2)
-    frag_color *= vignette;
-}
\ No newline at end of file
+    float vignette = 1.0 / (1.0 + strength * dot(ndc, ndc)); // 1.0 / (1.0 + |ndc|^2)
+    return color * vignette;
+}
+
+#ifndef FUSED_PASS
+// The texture holding the scene pixels
+uniform sampler2D tex;
+
+// Read "assets/shaders/fullscreen.vert" to know what "tex_coord" holds;
+in vec2 tex_coord;
+
+out vec4 frag_color;
+
+void main(){
+    frag_color = effect(texture(tex, tex_coord), tex_coord);
+}
+#endif
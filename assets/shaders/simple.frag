@@ -1,6 +1,5 @@
 #version 330
 
-#define MAX_LIGHTS 16
 #define DIRECTIONAL 0
 #define POINT 1
 #define SPOT 2
@@ -38,26 +37,97 @@ struct Sky {
     vec3 top, horizon, bottom;
 };
 
+// The lights are assigned to a 3D grid of clusters (x & y tiles on the screen and slices along the view depth)
+// "lights" stores 5 texels per light, "grid" stores the offset & count of each cluster in "indices"
+// which stores the light indices of all the clusters. Directional lights come first and are not listed in the grid.
+struct Clusters {
+    ivec3 dimensions;
+    vec2 viewport_size;
+    int logarithmic;
+    float depth_scale, depth_bias;
+    samplerBuffer lights;
+    usamplerBuffer grid;
+    usamplerBuffer indices;
+};
 
-uniform Light lights[MAX_LIGHTS];
-uniform int light_count;
+uniform Clusters clusters;
+uniform int directional_light_count;
+uniform vec3 camera_position;
+uniform vec3 camera_forward;
 uniform Sky sky;
 uniform Material material;
+
+// If the maps are packed, they are layers of "texture_array": layers[0] holds the layers of the albedo, specular, emissive & roughness
+// and layers[1].x holds the layer of the ambient occlusion (the layers are negative if the maps are not packed)
+uniform sampler2DArray texture_array;
+#ifdef INDIRECT_DRAW
+// When drawing indirectly, the tint & the layers come from the draw data of each draw (see the vertex shader)
+flat in vec4 tint;
+flat in vec4 layers[2];
+#else
 uniform vec4 tint;
+uniform vec4 layers[2];
+#endif
+
+vec4 sample_map(sampler2D map, float layer){
+    return layer >= 0.0 ? texture(texture_array, vec3(fs_in.tex_coord, layer)) : texture(map, fs_in.tex_coord);
+}
+
+Light fetch_light(int index){
+    int base = index * 5;
+    vec4 texel0 = texelFetch(clusters.lights, base);
+    vec4 texel1 = texelFetch(clusters.lights, base + 1);
+    vec4 texel2 = texelFetch(clusters.lights, base + 2);
+    vec4 texel3 = texelFetch(clusters.lights, base + 3);
+    vec4 texel4 = texelFetch(clusters.lights, base + 4);
+    Light light;
+    light.type = int(texel0.w);
+    light.position = texel0.xyz;
+    light.direction = texel1.xyz;
+    light.diffuse = texel2.rgb;
+    light.specular = texel3.rgb;
+    light.attenuation = texel4.xyz;
+    light.cone_angles = vec2(texel1.w, texel2.w);
+    return light;
+}
+
+vec3 shade(Light light, vec3 normal, vec3 view, vec3 material_diffuse, vec3 material_specular, float material_shininess){
+    vec3 direction_to_light = -light.direction;
+    if(light.type != DIRECTIONAL){
+        direction_to_light = normalize(light.position - fs_in.world);
+    }
+
+    vec3 diffuse = light.diffuse * material_diffuse * max(0, dot(normal, direction_to_light));
+
+    vec3 reflected = reflect(-direction_to_light, normal);
+
+    vec3 specular = light.specular * material_specular * pow(max(0, dot(view, reflected)), material_shininess);
+
+    float attenuation = 1;
+    if(light.type != DIRECTIONAL){
+        float d = distance(light.position, fs_in.world);
+        attenuation /= dot(light.attenuation, vec3(d*d, d, 1));
+        if(light.type == SPOT){
+            float angle = acos(dot(-direction_to_light, light.direction));
+            attenuation *= smoothstep(light.cone_angles.y, light.cone_angles.x, angle);
+        }
+    }
 
+    return (diffuse + specular) * attenuation;
+}
 
 void main(){
     vec3 view = normalize(fs_in.view);
     vec3 normal = normalize(fs_in.normal);
 
-    vec3 material_diffuse = texture(material.albedo, fs_in.tex_coord).rgb;
-    vec3 material_specular = texture(material.specular, fs_in.tex_coord).rgb;
-    vec3 material_ambient = material_diffuse * texture(material.ambient_occlusion, fs_in.tex_coord).r;
+    vec3 material_diffuse = sample_map(material.albedo, layers[0].x).rgb;
+    vec3 material_specular = sample_map(material.specular, layers[0].y).rgb;
+    vec3 material_ambient = material_diffuse * sample_map(material.ambient_occlusion, layers[1].x).r;
 
-    float material_roughness = texture(material.roughness, fs_in.tex_coord).r;
+    float material_roughness = sample_map(material.roughness, layers[0].w).r;
     float material_shininess = 2.0 / pow(clamp(material_roughness, 0.001, 0.999), 4.0) - 2.0;
 
-    vec3 material_emissive = texture(material.emissive, fs_in.tex_coord).rgb;
+    vec3 material_emissive = sample_map(material.emissive, layers[0].z).rgb;
 
     vec3 sky_light = (normal.y > 0) ?
         mix(sky.horizon, sky.top, normal.y * normal.y) :
@@ -65,32 +135,26 @@ void main(){
 
     frag_color = tint * vec4(material_emissive + material_ambient * sky_light, 1.0);
 
-    int clamped_light_count = min(MAX_LIGHTS, light_count);
+    vec3 lighting = vec3(0);
 
-    for(int i = 0; i < clamped_light_count; i++){
-        Light light = lights[i];
-
-        vec3 direction_to_light = -light.direction;
-        if(light.type != DIRECTIONAL){
-            direction_to_light = normalize(light.position - fs_in.world);
-        }
-
-        vec3 diffuse = light.diffuse * material_diffuse * max(0, dot(normal, direction_to_light));
-
-        vec3 reflected = reflect(-direction_to_light, normal);
-
-        vec3 specular = light.specular * material_specular * pow(max(0, dot(view, reflected)), material_shininess);
-
-        float attenuation = 1;
-        if(light.type != DIRECTIONAL){
-            float d = distance(light.position, fs_in.world);
-            attenuation /= dot(light.attenuation, vec3(d*d, d, 1));
-            if(light.type == SPOT){
-                float angle = acos(dot(-direction_to_light, light.direction));
-                attenuation *= smoothstep(light.cone_angles.y, light.cone_angles.x, angle);
-            }
-        }
+    for(int i = 0; i < directional_light_count; i++){
+        lighting += shade(fetch_light(i), normal, view, material_diffuse, material_specular, material_shininess);
+    }
 
-        frag_color.rgb += tint.xyz * (diffuse + specular) * attenuation;
+    // Find the cluster containing this fragment from its screen position and its view-space depth
+    ivec2 tile = ivec2(gl_FragCoord.xy / clusters.viewport_size * vec2(clusters.dimensions.xy));
+    tile = clamp(tile, ivec2(0), clusters.dimensions.xy - 1);
+    float depth = dot(fs_in.world - camera_position, camera_forward);
+    if(clusters.logarithmic != 0) depth = log(max(depth, 1e-6));
+    int slice = int(floor(depth * clusters.depth_scale + clusters.depth_bias));
+    slice = clamp(slice, 0, clusters.dimensions.z - 1);
+
+    int cluster = tile.x + clusters.dimensions.x * (tile.y + clusters.dimensions.y * slice);
+    uvec2 range = texelFetch(clusters.grid, cluster).xy;
+    for(uint i = 0u; i < range.y; i++){
+        int light_index = int(texelFetch(clusters.indices, int(range.x + i)).r);
+        lighting += shade(fetch_light(light_index), normal, view, material_diffuse, material_specular, material_shininess);
     }
-}
\ No newline at end of file
+
+    frag_color.rgb += tint.xyz * lighting;
+}
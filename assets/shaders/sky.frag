@@ -0,0 +1,20 @@
+#version 330
+
+in vec4 near_point;
+in vec4 far_point;
+
+out vec4 frag_color;
+
+// The sky texture is an equirectangular map (the longitude along u & the latitude along v)
+uniform sampler2D tex;
+uniform vec4 tint;
+
+const float PI = 3.14159265359;
+
+void main(){
+    vec3 direction = normalize(far_point.xyz / far_point.w - near_point.xyz / near_point.w);
+    // These are the texture coordinates that the sky sphere (see "mesh_utils::sphere") had in this direction
+    // (the sampler repeats along u, so the negative longitudes wrap around)
+    vec2 tex_coord = vec2(atan(direction.z, direction.x) / (2.0 * PI), asin(clamp(direction.y, -1.0, 1.0)) / PI + 0.5);
+    frag_color = tint * texture(tex, tex_coord);
+}
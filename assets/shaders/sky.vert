@@ -0,0 +1,24 @@
+#version 330
+
+// The sky is drawn using a single triangle covering the whole screen at the far plane (z = 1 in NDC),
+// so with a GL_LEQUAL depth test, only the pixels that were not covered by any opaque object are shaded.
+// The direction of each pixel is reconstructed from the inverse of the view projection matrix.
+uniform mat4 inverse_VP;
+
+// The points of the pixel on the near & far planes in homogeneous world coordinates.
+// They are linear in screen space, so they are interpolated as they are and divided by w in the fragment shader.
+out vec4 near_point;
+out vec4 far_point;
+
+void main(){
+    // These positions define a fullscreen triangle
+    vec2 positions[] = vec2[](
+        vec2(-1.0, -1.0),
+        vec2( 3.0, -1.0),
+        vec2(-1.0,  3.0)
+    );
+    vec2 position = positions[gl_VertexID];
+    gl_Position = vec4(position, 1.0, 1.0);
+    near_point = inverse_VP * vec4(position, -1.0, 1.0);
+    far_point = inverse_VP * vec4(position, 1.0, 1.0);
+}
@@ -12,6 +12,9 @@ out Varyings {
     vec3 normal;
 } vs_out;
 
+// The position must be computed the same way in the depth pre-pass (which uses this shader with another fragment shader)
+invariant gl_Position;
+
 void main(){
     gl_Position =  vec4(position, 1.0);
     vs_out.position = position;
@@ -7,11 +7,22 @@ in Varyings {
 
 out vec4 frag_color;
 
-uniform vec4 tint;
 uniform sampler2D tex;
 
+// If the texture is packed, it is the layer "layers[0].x" of "texture_array" (the layer is negative if it is not packed)
+uniform sampler2DArray texture_array;
+#ifdef INDIRECT_DRAW
+// When drawing indirectly, the tint & the layers come from the draw data of each draw (see the vertex shader)
+flat in vec4 tint;
+flat in vec4 layers[2];
+#else
+uniform vec4 tint;
+uniform vec4 layers[2];
+#endif
+
 void main(){
     //TODO: (Req 7) Modify the following line to compute the fragment color
     // by multiplying the tint with the vertex color and with the texture color 
-    frag_color = tint*fs_in.color*texture(tex, fs_in.tex_coord);
+    vec4 texture_color = layers[0].x >= 0.0 ? texture(texture_array, vec3(fs_in.tex_coord, layers[0].x)) : texture(tex, fs_in.tex_coord);
+    frag_color = tint*fs_in.color*texture_color;
 }
\ No newline at end of file
@@ -3,17 +3,56 @@
 layout(location = 0) in vec3 position;
 layout(location = 1) in vec4 color;
 layout(location = 2) in vec2 tex_coord;
+layout(location = 4) in uint cell;
 
 out Varyings {
     vec4 color;
     vec2 tex_coord;
 } vs_out;
 
+// The position must be computed the same way in the depth pre-pass (which uses this shader with another fragment shader)
+invariant gl_Position;
+
 uniform mat4 transform;
 
+#ifdef INDIRECT_DRAW
+// When drawing indirectly, "transform" only contains the view projection matrix and the model matrix of each draw
+// is read from a buffer texture (11 texels per draw: M, M_IT, the tint then the texture layers) using the instanced "draw_id" attribute
+// The draws of several materials can share a call, so the tint & the texture layers of each draw are passed to the fragment shader
+layout(location = 5) in uint draw_id;
+uniform samplerBuffer draw_data;
+flat out vec4 tint;
+flat out vec4 layers[2];
+#endif
+
+// Static batches store the cell of each vertex, and the cells whose bit is not set in the mask are hidden
+// The mask has a bit per cell packed in 32-bit words (4 words per array element)
+uniform bool cell_mask_enabled;
+layout(std140) uniform CellMask {
+    uvec4 cell_mask[64];
+};
+
+bool is_cell_visible(uint cell){
+    uint word = cell >> 5u;
+    return ((cell_mask[word >> 2u][word & 3u] >> (cell & 31u)) & 1u) != 0u;
+}
+
 void main(){
     //TODO: (Req 7) Change the next line to apply the transformation matrix
+#ifdef INDIRECT_DRAW
+    int base = int(draw_id) * 11;
+    mat4 M = mat4(texelFetch(draw_data, base), texelFetch(draw_data, base + 1), texelFetch(draw_data, base + 2), texelFetch(draw_data, base + 3));
+    gl_Position = transform * M * vec4(position, 1.0);
+    tint = texelFetch(draw_data, base + 8);
+    layers[0] = texelFetch(draw_data, base + 9);
+    layers[1] = texelFetch(draw_data, base + 10);
+#else
     gl_Position = transform * vec4(position, 1.0) ;
+#endif
+    if(cell_mask_enabled && !is_cell_visible(cell)){
+        // Collapse the vertex to a point outside the clip volume so that the triangles of the cell are not rasterized
+        gl_Position = vec4(2.0, 2.0, 2.0, 1.0);
+    }
     vs_out.color = color;
     vs_out.tex_coord = tex_coord;
 }
\ No newline at end of file
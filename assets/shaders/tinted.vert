@@ -7,6 +7,9 @@ out Varyings {
     vec4 color;
 } vs_out;
 
+// The position must be computed the same way in the depth pre-pass (which uses this shader with another fragment shader)
+invariant gl_Position;
+
 uniform mat4 transform;
 
 void main(){
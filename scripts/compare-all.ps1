@@ -159,7 +159,14 @@ $requirement = "renderer-test"
 if( ($tests.Count -eq 0) -or ($tests -contains $requirement)){
     $files = @(
         "test-0.png",
-        "test-1.png"
+        "test-1.png",
+        "test-2.png",
+        "test-3.png",
+        "test-4.png",
+        "test-5.png",
+        "test-6.png",
+        "test-7.png",
+        "test-8.png"
     )
     Write-Output ""
     Write-Output "Comparing $requirement output:"
@@ -174,7 +181,8 @@ $requirement = "sky-test"
 if( ($tests.Count -eq 0) -or ($tests -contains $requirement)){
     $files = @(
         "test-0.png",
-        "test-1.png"
+        "test-1.png",
+        "test-2.png"
     )
     Write-Output ""
     Write-Output "Comparing $requirement output:"
@@ -191,7 +199,9 @@ if( ($tests.Count -eq 0) -or ($tests -contains $requirement)){
         "test-0.png",
         "test-1.png",
         "test-2.png",
-        "test-3.png"
+        "test-3.png",
+        "test-4.png",
+        "test-5.png"
     )
     Write-Output ""
     Write-Output "Comparing $requirement output:"
@@ -1,9 +1,9 @@
 param([string[]] $tests)
 
 function Invoke-Tests {
-    param([string[]] $configs)
+    param([string[]] $configs, [int] $frames = 2)
     foreach ($config in $configs){
-        ./bin/GAME_APPLICATION -f=2 -c="$config"
+        ./bin/GAME_APPLICATION -f="$frames" -c="$config"
     }
 }
 
@@ -165,12 +165,21 @@ if( ($tests.Count -eq 0) -or ($tests -contains "entity-test")){
 if( ($tests.Count -eq 0) -or ($tests -contains "renderer-test")){
     $configs = @(
         "config/renderer-test/test-0.jsonc",
-        "config/renderer-test/test-1.jsonc"
+        "config/renderer-test/test-1.jsonc",
+        "config/renderer-test/test-2.jsonc",
+        "config/renderer-test/test-3.jsonc",
+        "config/renderer-test/test-4.jsonc",
+        "config/renderer-test/test-5.jsonc",
+        "config/renderer-test/test-6.jsonc",
+        "config/renderer-test/test-8.jsonc"
     )
     Write-Output ""
     Write-Output "Running renderer-test:"
     Write-Output ""
     Invoke-Tests $configs
+    # The textures of this test are streamed within the per-frame budget (without flushing them for the screenshot),
+    # so it runs until they are all uploaded (in its first 4 frames) then takes its screenshot at frame 5
+    Invoke-Tests @("config/renderer-test/test-7.jsonc") 6
 }
 
 ###################################################
@@ -179,7 +188,8 @@ if( ($tests.Count -eq 0) -or ($tests -contains "renderer-test")){
 if( ($tests.Count -eq 0) -or ($tests -contains "sky-test")){
     $configs = @(
         "config/sky-test/test-0.jsonc",
-        "config/sky-test/test-1.jsonc"
+        "config/sky-test/test-1.jsonc",
+        "config/sky-test/test-2.jsonc"
     )
     Write-Output ""
     Write-Output "Running sky-test:"
@@ -195,7 +205,9 @@ if( ($tests.Count -eq 0) -or ($tests -contains "postprocess-test")){
         "config/postprocess-test/test-0.jsonc",
         "config/postprocess-test/test-1.jsonc",
         "config/postprocess-test/test-2.jsonc",
-        "config/postprocess-test/test-3.jsonc"
+        "config/postprocess-test/test-3.jsonc",
+        "config/postprocess-test/test-4.jsonc",
+        "config/postprocess-test/test-5.jsonc"
     )
     Write-Output ""
     Write-Output "Running postprocess-test:"
@@ -9,6 +9,7 @@
 #include <queue>
 #include <tuple>
 #include <filesystem>
+#include <algorithm>
 
 // Include the Dear ImGui implementation headers
 #define IMGUI_IMPL_OPENGL_LOADER_GLAD2
@@ -23,6 +24,14 @@
 #endif
 
 #include "texture/screenshot.hpp"
+#include "mesh/mesh-pool.hpp"
+#include "mesh/mesh-optimizer.hpp"
+#include "texture/texture-streamer.hpp"
+#include "shader/program-cache.hpp"
+#include "asset-loader.hpp"
+#include "utils/trace-recorder.hpp"
+#include "utils/frame-allocator.hpp"
+#include "utils/heap-counter.hpp"
 
 std::string default_screenshot_filepath() {
     std::stringstream stream;
@@ -186,6 +195,48 @@ int our::Application::run(int run_for_frames) {
     std::cout << "VERSION         : " << glGetString(GL_VERSION) << std::endl;
     std::cout << "GLSL VERSION    : " << glGetString(GL_SHADING_LANGUAGE_VERSION) << std::endl;
 
+    // The meshes use the packed vertex layout when it is precise enough unless it is disabled in the configuration
+    our::MeshPool::get().setPackingEnabled(app_config.value("packVertices", true));
+    // The vertex cache statistics of the imported meshes are only printed if "verboseMeshes" is set
+    our::mesh_optimizer::setVerbose(app_config.value("verboseMeshes", false));
+
+    // The assets released by the states stay resident (so entering a state again is fast) while they fit in this budget
+    our::AssetResidency::get().setBudget((size_t)app_config.value("assetBudgetMB", 256) << 20);
+
+    // The linked shader programs are saved to "cache/shaders" and loaded from there next time unless it is disabled in the configuration
+    our::program_cache::setEnabled(app_config.value("shaderCache", true));
+
+    // The job system runs the work that can be spread over the cores (e.g. decoding the assets & encoding the screenshots)
+    // "workers" is the number of worker threads (0 uses one per core except the core of the main thread)
+    // If "trace" is set, the jobs are recorded and saved to that file on exit in the Chrome trace event format
+    // Only the last "traceMaxEvents" events are kept (the begin & the end of a job are 2 events), so a long session doesn't keep growing
+    auto jobConfig = app_config.value("jobs", nlohmann::json::object());
+    std::unique_ptr<our::TraceRecorder> jobTrace;
+    std::string jobTracePath = jobConfig.value("trace", "");
+    if(!jobTracePath.empty()){
+        jobTrace = std::make_unique<our::TraceRecorder>(jobConfig.value("traceMaxEvents", (size_t)1 << 20));
+        our::JobSystem::get().setTraceHooks({
+            [recorder = jobTrace.get()](const char* name){ recorder->begin(name); },
+            [recorder = jobTrace.get()](const char* name){ recorder->end(name); }
+        });
+    }
+    our::JobSystem::get().start(jobConfig.value("workers", 0u));
+
+    // The transient data of each frame is allocated from a block that is reused every frame (it grows if a frame needs more)
+    our::FrameAllocator::get().reserve((size_t)(app_config.value("frameArenaKB", 256.0f) * 1024));
+
+    // The loaded textures are uploaded over the next frames through a ring of staging buffers unless it is disabled in the configuration
+    // "stagingMB" is the size of each staging buffer and "budgetMB" is the maximum size uploaded per frame
+    // While screenshots are requested, all the queued textures are uploaded every frame so that the screenshots are complete,
+    // unless "flushForScreenshots" is false (then the screenshots show what was streamed within the budget so far)
+    bool flushForScreenshots = true;
+    if(auto streaming = app_config.value("textureStreaming", nlohmann::json::object()); streaming.value("enabled", true)){
+        flushForScreenshots = streaming.value("flushForScreenshots", true);
+        our::TextureStreamer::get().initialize(
+            (GLsizeiptr)(streaming.value("stagingMB", 16.0f) * 1024 * 1024),
+            (size_t)(streaming.value("budgetMB", 8.0f) * 1024 * 1024));
+    }
+
 #if defined(ENABLE_OPENGL_DEBUG_MESSAGES)
     // if we have OpenGL debug messages enabled, set the message callback
     glDebugMessageCallback(opengl_callback, nullptr);
@@ -239,6 +290,15 @@ int our::Application::run(int run_for_frames) {
 
     if(currentState) currentState->onInitialize();
 
+    // In the render thread mode, a dedicated thread owns the OpenGL context and draws each frame while the main thread updates the next one.
+    // "latency" is the number of frames that the main thread can run ahead of the render thread (0 waits for each frame to be drawn).
+    auto renderThreadConfig = app_config.value("renderThread", nlohmann::json::object());
+    bool useRenderThread = renderThreadConfig.value("enabled", false);
+    int renderLatency = std::clamp(renderThreadConfig.value("latency", 1), 0, 1);
+    FrameData threadedFrames[2], immediateFrame;
+    // ImGui creates its OpenGL objects in its first frame which would be on the main thread, so they are created now while it has the context
+    if(useRenderThread) ImGui_ImplOpenGL3_CreateDeviceObjects();
+
     // The time at which the last frame started. But there was no frames yet, so we'll just pick the current time.
     double last_frame_time = glfwGetTime();
     int current_frame = 0;
@@ -246,8 +306,16 @@ int our::Application::run(int run_for_frames) {
     //Game loop
     while(!glfwWindowShouldClose(window)){
         if(run_for_frames != 0 && current_frame >= run_for_frames) break;
+        // The transient data of the last frame is no longer used, so its memory is reused for this frame
+        our::FrameAllocator::get().reset();
         glfwPollEvents(); // Read all the user events and call relevant callbacks.
 
+        // Only the states that support it are drawn by the render thread, the context is given to the main thread for the others
+        bool threaded = useRenderThread && currentState && currentState->canRenderOnThread();
+        if(threaded && !renderThread.isRunning()) renderThread.start(window);
+        else if(threaded) renderThread.resume();
+        else renderThread.pause();
+
         // Start a new ImGui frame
         ImGui_ImplOpenGL3_NewFrame();
         ImGui_ImplGlfw_NewFrame();
@@ -302,60 +370,50 @@ int our::Application::run(int run_for_frames) {
         // Render the ImGui commands we called (this doesn't actually draw to the screen yet.
         ImGui::Render();
 
-        // Just in case ImGui changed the OpenGL viewport (the portion of the window to which we render the geometry),
-        // we set it back to cover the whole window
-        auto frame_buffer_size = getFrameBufferSize();
-        glViewport(0, 0, frame_buffer_size.x, frame_buffer_size.y);
-
         // Get the current time (the time at which we are starting the current frame).
         double current_frame_time = glfwGetTime();
 
-        // Call onDraw, in which we will draw the current frame, and send to it the time difference between the last and current frame
-        if(currentState) currentState->onDraw(current_frame_time - last_frame_time);
+        // A frame drawn by the render thread stays in use until the next one is submitted, so the frames alternate between 2 buffers
+        FrameData& frame = threaded ? threadedFrames[current_frame % 2] : immediateFrame;
+        frame.state = currentState;
+        frame.deltaTime = current_frame_time - last_frame_time; // The time difference between the last and current frame
+        frame.threaded = threaded;
+        frame.frameBufferSize = getFrameBufferSize();
+        frame.flushTextures = flushForScreenshots && !requested_screenshots.empty();
+        frame.screenshots.clear();
         last_frame_time = current_frame_time; // Then update the last frame start time (this frame is now the last frame)
 
-#if defined(ENABLE_OPENGL_DEBUG_MESSAGES)
-        // Since ImGui causes many messages to be thrown, we are temporarily disabling the debug messages till we render the ImGui
-        glDisable(GL_DEBUG_OUTPUT);
-        glDisable(GL_DEBUG_OUTPUT_SYNCHRONOUS);
-#endif
-        ImGui_ImplOpenGL3_RenderDrawData(ImGui::GetDrawData()); // Render the ImGui to the framebuffer
-#if defined(ENABLE_OPENGL_DEBUG_MESSAGES)
-        // Re-enable the debug messages
-        glEnable(GL_DEBUG_OUTPUT);
-        glEnable(GL_DEBUG_OUTPUT_SYNCHRONOUS);
-#endif
-
         // If F12 is pressed, take a screenshot
-        if(keyboard.justPressed(GLFW_KEY_F12)){
-            glViewport(0, 0, frame_buffer_size.x, frame_buffer_size.y);
-            std::string path = default_screenshot_filepath();
-            if(our::screenshot_png(path)){
-                std::cout << "Screenshot saved to: " << path << std::endl;
-            } else {
-                std::cerr << "Failed to save a Screenshot" << std::endl;
-            }
-        }
+        if(keyboard.justPressed(GLFW_KEY_F12)) frame.screenshots.push_back(default_screenshot_filepath());
         // There are any requested screenshots, take them
         while(requested_screenshots.size()){ 
             if(const auto& request = requested_screenshots.top(); request.first == current_frame){
-                if(our::screenshot_png(request.second)){
-                    std::cout << "Screenshot saved to: " << request.second << std::endl;
-                } else {
-                    std::cerr << "Failed to save a screenshot to: " << request.second << std::endl;
-                }
+                frame.screenshots.push_back(request.second);
                 requested_screenshots.pop();
             } else break;
         }
 
-        // Swap the frame buffers
-        glfwSwapBuffers(window);
+        if(threaded){
+            // ImGui reuses its draw data in the next frame, so the render thread draws a copy
+            frame.gui.copy(ImGui::GetDrawData());
+            frame.guiDrawData = frame.gui.get();
+            // Update the state then let the render thread draw this frame while the next one is updated
+            if(currentState) currentState->onUpdate(frame.deltaTime);
+            renderThread.submit([this, &frame](){ drawFrame(frame); });
+            // Without latency, the main thread waits for the frame to be drawn before updating the next one
+            if(renderLatency == 0) renderThread.finish();
+        } else {
+            frame.guiDrawData = ImGui::GetDrawData();
+            drawFrame(frame);
+        }
 
         // Update the keyboard and mouse data
         keyboard.update();
         mouse.update();
 
         // If a scene change was requested, apply it
+        // The states create & delete OpenGL objects while changing, so the render thread gives the context back first
+        if(nextState) renderThread.pause();
         while(nextState){
             // If a scene was already running, destroy it (not delete since we can go back to it later)
             if(currentState) currentState->onDestroy();
@@ -364,13 +422,39 @@ int our::Application::run(int run_for_frames) {
             nextState = nullptr;
             // Initialize the new scene
             currentState->onInitialize();
+            // The new state fills its containers during its first frames, so they are not reported as per-frame allocations
+            our::HeapAllocationCheck::warmUp();
         }
 
         ++current_frame;
     }
 
+    // The render thread draws its last frame then the context goes back to the main thread
+    renderThread.stop();
+
     // Call for cleaning up
     if(currentState) currentState->onDestroy();
+    // The screenshots are written by the job system, so their errors are only known once they are done. A failed screenshot
+    // fails the run since the screenshot tests compare the files (and a missing file would only be noticed by the comparison).
+    std::vector<std::string> failedScreenshots = our::finish_screenshots();
+    for(const auto& filename : failedScreenshots) std::cerr << "ERROR: The screenshot \"" << filename << "\" couldn't be saved" << std::endl;
+    // Finish the remaining jobs
+    our::JobSystem::get().stop();
+    if(jobTrace){
+        our::JobSystem::get().setTraceHooks({});
+        if(jobTrace->save(jobTracePath)){
+            std::cout << "Saved " << jobTrace->getEventCount() / 2 << " job events to: " << jobTracePath;
+            if(size_t dropped = jobTrace->getDroppedCount()) std::cout << " (the oldest " << dropped / 2 << " were dropped)";
+            std::cout << std::endl;
+        } else {
+            std::cerr << "Failed to save the job trace to: " << jobTracePath << std::endl;
+        }
+    }
+    // The assets that are still resident are deleted before the buffers they live in
+    our::clearAllAssets();
+    // All the meshes are deleted now, so we can delete the shared mesh buffers
+    our::MeshPool::get().destroy();
+    our::TextureStreamer::get().destroy();
 
     // Shutdown ImGui & destroy the context
     ImGui_ImplOpenGL3_Shutdown();
@@ -382,10 +466,51 @@ int our::Application::run(int run_for_frames) {
 
     // And finally terminate GLFW
     glfwTerminate();
-    return 0; // Goodbye
+    return failedScreenshots.empty() ? 0 : 1; // Goodbye
+}
+
+void our::Application::drawFrame(FrameData& frame){
+    // Just in case ImGui changed the OpenGL viewport (the portion of the window to which we render the geometry),
+    // we set it back to cover the whole window
+    glViewport(0, 0, frame.frameBufferSize.x, frame.frameBufferSize.y);
+
+    // Upload some of the streamed textures. If a screenshot may be taken, we upload all of them so that the screenshot is complete.
+    if(frame.flushTextures) our::TextureStreamer::get().flush();
+    else our::TextureStreamer::get().update();
+
+    // Draw the current frame. If the state was updated by "onUpdate", only its drawing is left.
+    if(frame.state){
+        if(frame.threaded) frame.state->onRender();
+        else frame.state->onDraw(frame.deltaTime);
+    }
+
+#if defined(ENABLE_OPENGL_DEBUG_MESSAGES)
+    // Since ImGui causes many messages to be thrown, we are temporarily disabling the debug messages till we render the ImGui
+    glDisable(GL_DEBUG_OUTPUT);
+    glDisable(GL_DEBUG_OUTPUT_SYNCHRONOUS);
+#endif
+    ImGui_ImplOpenGL3_RenderDrawData(frame.guiDrawData); // Render the ImGui to the framebuffer
+#if defined(ENABLE_OPENGL_DEBUG_MESSAGES)
+    // Re-enable the debug messages
+    glEnable(GL_DEBUG_OUTPUT);
+    glEnable(GL_DEBUG_OUTPUT_SYNCHRONOUS);
+#endif
+
+    // Take the screenshots of this frame (F12 or requested in the configuration)
+    if(!frame.screenshots.empty()) glViewport(0, 0, frame.frameBufferSize.x, frame.frameBufferSize.y);
+    for(auto& path : frame.screenshots){
+        // The screenshot prints whether it was saved once its job is done
+        if(!our::screenshot_png(path)){
+            std::cerr << "Failed to save a screenshot to: " << path << std::endl;
+        }
+    }
+
+    // Swap the frame buffers
+    glfwSwapBuffers(window);
 }
 
 void our::Application::status(ImFont *font) const {
+    our::HeapAllocationCheck allocationCheck("Application::status");
     // Set the style for text
     ImGui::PushStyleColor(ImGuiCol_Text, ImVec4(1.0f, 0.5f, 0.0f, 1.0f)); // Orange text color
     ImGui::PushFont(font);
@@ -393,15 +518,14 @@ void our::Application::status(ImFont *font) const {
     // show the area currently covered by the player
     ImGui::SetCursorPosX(10);
     ImGui::SetCursorPosY(10);
+    // The text is formatted by ImGui (into its own buffer) so that no strings are allocated every frame
     int cappedArea = std::min(coveredArea, 100);
-    std::string areaString = "Area Covered: " + std::to_string(cappedArea) + "%";
-    ImGui::Text("%s", areaString.c_str());
+    ImGui::Text("Area Covered: %d%%", cappedArea);
 
     // show the number of lives
     ImGui::SetCursorPosX(1090);
     ImGui::SetCursorPosY(10);
-    std::string livesString = "Lives: " + std::to_string(lives);
-    ImGui::Text("%s", livesString.c_str());
+    ImGui::Text("Lives: %d", lives);
 
     // Pop the style changes
     ImGui::PopFont();
@@ -415,8 +539,7 @@ void our::Application::win(ImFont *font) {
 
     ImGui::SetCursorPosX(400);
     ImGui::SetCursorPosY(50);
-    std::string String = "YOU WIN!";
-    ImGui::Text("%s", String.c_str());
+    ImGui::TextUnformatted("YOU WIN!");
 
     // Pop the style changes
     ImGui::PopFont();
@@ -429,8 +552,7 @@ void our::Application::lose(ImFont *font) {
 
     ImGui::SetCursorPosX(350);
     ImGui::SetCursorPosY(50);
-    std::string String = "GAME OVER";
-    ImGui::Text("%s", String.c_str());
+    ImGui::TextUnformatted("GAME OVER");
 
     // Pop the style changes
     ImGui::PopFont();
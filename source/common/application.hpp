@@ -7,12 +7,15 @@
 
 #include <string>
 #include <unordered_map>
+#include <vector>
 #include <type_traits>
 #include <json/json.hpp>
 
 #include "input/keyboard.hpp"
 #include "input/mouse.hpp"
 #include "sound/sound.hpp"
+#include "utils/job-system.hpp"
+#include "render-thread.hpp"
 
 // constants
 #define ARENA_LENGTH 19
@@ -54,6 +57,14 @@ namespace our {
         virtual void onDraw(double deltaTime){}         // Called every frame in the game loop passing the time taken to draw the frame "Delta time".
         virtual void onDestroy(){}                      // Called once after the game loop ends for house cleaning.
 
+        // In the render thread mode, the frames of a state that can be rendered on the render thread are split in 2:
+        // "onUpdate" runs the simulation on the main thread & records what to draw (without calling OpenGL),
+        // then "onRender" draws the recorded frame on the render thread while the main thread updates the next frame.
+        // So the data used by "onRender" must be a copy that "onUpdate" doesn't modify in the next frame.
+        // The other states (and all the states if the mode is disabled) are drawn on the main thread using "onDraw".
+        virtual bool canRenderOnThread() const { return false; }
+        virtual void onUpdate(double deltaTime){}       // Called every frame on the main thread (only if "canRenderOnThread").
+        virtual void onRender(){}                       // Called every frame on the render thread after "onUpdate" (only if "canRenderOnThread").
 
         // Override these functions to get mouse and keyboard event.
         virtual void onKeyEvent(int key, int scancode, int action, int mods){}      
@@ -81,7 +92,23 @@ namespace our {
         State * currentState = nullptr;         // This will store the current scene that is being run
         State * nextState = nullptr;            // If it is requested to go to another scene, this will contain a pointer to that scene
 
-        
+        // The data needed to draw a frame after the state was updated.
+        // In the render thread mode, it is filled by the main thread then used by the render thread while the next one is filled.
+        struct FrameData {
+            State* state = nullptr;
+            double deltaTime = 0;
+            bool threaded = false;              // If true, the state was already updated so it is drawn using "onRender" instead of "onDraw"
+            glm::ivec2 frameBufferSize;
+            bool flushTextures = false;         // Whether all the streamed textures should be uploaded (since a screenshot may be taken)
+            std::vector<std::string> screenshots; // The paths of the screenshots to take after drawing the frame
+            GuiDrawData gui;                    // A copy of the ImGui draw data (only used on the render thread)
+            ImDrawData* guiDrawData = nullptr;
+        };
+        RenderThread renderThread;
+
+        // Draws a frame (on the thread that owns the OpenGL context) then swaps the frame buffers
+        void drawFrame(FrameData& frame);
+
         // Virtual functions to be overrode and change the default behaviour of the application
         // according to the example needs.
         virtual void configureOpenGL();                             // This function sets OpenGL Window Hints in GLFW.
@@ -147,6 +174,9 @@ namespace our {
 
         [[nodiscard]] const nlohmann::json& getConfig() const { return app_config; }
 
+        // The engine-wide job system (started by "run"). Any subsystem can submit work to it (see "job-system.hpp").
+        JobSystem& getJobSystem() { return JobSystem::get(); }
+
         // Get the size of the frame buffer of the window in pixels.
         glm::ivec2 getFrameBufferSize() {
             glm::ivec2 size;
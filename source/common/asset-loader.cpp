@@ -1,13 +1,24 @@
 #include "asset-loader.hpp"
 
 #include "shader/shader.hpp"
+#include "shader/program-cache.hpp"
 #include "texture/texture2d.hpp"
 #include "texture/texture-utils.hpp"
+#include "texture/texture-packer.hpp"
 #include "texture/sampler.hpp"
 #include "mesh/mesh.hpp"
 #include "mesh/mesh-utils.hpp"
 #include "material/material.hpp"
 #include "deserialize-utils.hpp"
+#include "utils/job-system.hpp"
+
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <iostream>
+#include <mutex>
+#include <unordered_set>
 
 namespace our {
 
@@ -23,8 +34,9 @@ namespace our {
                 auto shader = new ShaderProgram();
                 shader->attach(vsPath, GL_VERTEX_SHADER);
                 shader->attach(fsPath, GL_FRAGMENT_SHADER);
-                shader->link();
-                assets[name] = shader;
+                // The compilation errors of the files are reported when the program is linked
+                if(!shader->link()) std::cerr << "ERROR: Couldn't create the shader \"" << name << "\"" << std::endl;
+                set(name, shader);
             }
         }
     };
@@ -37,7 +49,7 @@ namespace our {
         if(data.is_object()){
             for(auto& [name, desc] : data.items()){
                 std::string path = desc.get<std::string>();
-                assets[name] = texture_utils::loadImage(path);
+                set(name, texture_utils::loadImage(path));
             }
         }
     };
@@ -55,7 +67,7 @@ namespace our {
             for(auto& [name, desc] : data.items()){
                 auto sampler = new Sampler();
                 sampler->deserialize(desc);
-                assets[name] = sampler;
+                set(name, sampler);
             }
         }
     };
@@ -68,7 +80,8 @@ namespace our {
         if(data.is_object()){
             for(auto& [name, desc] : data.items()){
                 std::string path = desc.get<std::string>();
-                assets[name] = mesh_utils::loadOBJ(path);
+                // The glTF files (".gltf" & ".glb") are read by the glTF loader and anything else is read as an OBJ
+                set(name, mesh_utils::loadMesh(path));
             }
         }
     };
@@ -92,31 +105,270 @@ namespace our {
                 std::string type = desc.value("type", "");
                 auto material = createMaterialFromType(type);
                 material->deserialize(desc);
-                assets[name] = material;
+                set(name, material);
+            }
+        }
+    };
+
+    // The workers push the GPU uploads of the assets they finished here, and the main thread runs them
+    // (the GL context is only current on the main thread)
+    class UploadQueue {
+        std::mutex mutex;
+        std::condition_variable condition;
+        std::deque<std::function<void()>> uploads;
+    public:
+        void push(std::function<void()> upload){
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                uploads.push_back(std::move(upload));
             }
+            condition.notify_one();
+        }
+        // Waits until an upload is available and returns it
+        std::function<void()> pop(){
+            std::unique_lock<std::mutex> lock(mutex);
+            condition.wait(lock, [this](){ return !uploads.empty(); });
+            auto upload = std::move(uploads.front());
+            uploads.pop_front();
+            return upload;
         }
     };
 
-    void deserializeAllAssets(const nlohmann::json& assetData){
-        if(!assetData.is_object()) return;
-        if(assetData.contains("shaders"))
-            AssetLoader<ShaderProgram>::deserialize(assetData["shaders"]);
-        if(assetData.contains("textures"))
-            AssetLoader<Texture2D>::deserialize(assetData["textures"]);
-        if(assetData.contains("samplers"))
-            AssetLoader<Sampler>::deserialize(assetData["samplers"]);
-        if(assetData.contains("meshes"))
-            AssetLoader<Mesh>::deserialize(assetData["meshes"]);
-        if(assetData.contains("materials"))
-            AssetLoader<Material>::deserialize(assetData["materials"]);
+    // Estimates the GPU memory used by a texture from the size of its first level (the mip levels add another third)
+    static size_t estimateTextureBytes(Texture2D* texture){
+        if(texture == nullptr) return 0;
+        GLint width = 0, height = 0, compressed = GL_FALSE, compressedSize = 0;
+        texture->bind();
+        glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_WIDTH, &width);
+        glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_HEIGHT, &height);
+        glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_COMPRESSED, &compressed);
+        if(compressed) glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_COMPRESSED_IMAGE_SIZE, &compressedSize);
+        Texture2D::unbind();
+        size_t bytes = compressed ? (size_t)compressedSize : (size_t)width * height * 4;
+        return bytes * 4 / 3;
+    }
+
+    // Returns the size of the range of the mesh pool used by a mesh
+    static size_t estimateMeshBytes(Mesh* mesh){
+        if(mesh == nullptr) return 0;
+        const MeshAllocation& allocation = mesh->getAllocation();
+        return (size_t)allocation.vertexCount * getVertexSize(allocation.format) + (size_t)allocation.elementCount * allocation.getIndexSize();
+    }
+
+    // Tracks an asset that was just stored in "AssetLoader<T>" under the given name.
+    // An asset that failed to load is not tracked, so it will be loaded again the next time it is needed.
+    template<typename T>
+    static AssetReference trackAsset(const std::string& type, const std::string& name, const std::string& description,
+                                     size_t bytes, std::vector<AssetReference> dependencies = {}){
+        T* asset = AssetLoader<T>::get(name);
+        if(asset == nullptr) return AssetReference();
+        return AssetResidency::get().track(type + ":" + name, description, asset, bytes,
+                                           [name](){ AssetLoader<T>::remove(name); }, std::move(dependencies));
+    }
+
+    std::vector<AssetReference> deserializeAllAssets(const nlohmann::json& assetData){
+        std::vector<AssetReference> references;
+        if(!assetData.is_object()) return references;
+        auto start = std::chrono::steady_clock::now();
+        program_cache::Statistics shaderStatistics = program_cache::getStatistics();
+
+        AssetResidency& residency = AssetResidency::get();
+        int reused = 0;
+        auto keep = [&references](AssetReference reference){
+            if(reference) references.push_back(std::move(reference));
+        };
+        // Returns true if the asset is resident and was loaded from the same description (then it is not loaded again)
+        auto reuse = [&](const std::string& key, const std::string& description){
+            AssetReference reference = residency.acquire(key, description);
+            if(!reference) return false;
+            references.push_back(std::move(reference));
+            reused++;
+            return true;
+        };
+
+        // The images are decoded & the meshes are parsed by the job system
+        UploadQueue queue;
+        JobSystem& jobs = JobSystem::get();
+        JobCounter loading;
+        size_t pendingUploads = 0;
+
+        // Start decoding the images and parsing the meshes first so that the workers are busy while the main thread compiles the shaders
+        static const nlohmann::json noTextures = nlohmann::json::object();
+        const nlohmann::json& textures = assetData.contains("textures") ? assetData["textures"] : noTextures;
+        // The textures that are not resident and must be uploaded before the materials using them are created
+        std::unordered_set<std::string> pendingTextures;
+        // Called on the main thread after each texture upload (defined below with the materials)
+        std::function<void(const std::string&)> onTextureUploaded;
+        for(auto& [name, desc] : textures.items()){
+            std::string path = desc.get<std::string>();
+            if(reuse("texture:" + name, path)) continue;
+            pendingTextures.insert(name);
+            jobs.submit([&queue, &onTextureUploaded, name = name, path](){
+                auto data = std::make_shared<texture_utils::TextureData>();
+                // If a worker fails without pushing an upload, the main thread would wait forever, so any exception counts as a failure
+                bool prepared = false;
+                try { prepared = texture_utils::prepareTexture(path, *data); } catch(const std::exception& error) { std::cerr << "Failed to load image: " << path << " (" << error.what() << ")" << std::endl; }
+                queue.push([&onTextureUploaded, name, data, prepared](){
+                    AssetLoader<Texture2D>::set(name, prepared ? texture_utils::createTexture(*data) : nullptr);
+                    onTextureUploaded(name);
+                });
+            }, &loading, "decode texture");
+            pendingUploads++;
+        }
+        if(assetData.contains("meshes") && assetData["meshes"].is_object()){
+            for(auto& [name, desc] : assetData["meshes"].items()){
+                std::string path = desc.get<std::string>();
+                if(reuse("mesh:" + name, path)) continue;
+                jobs.submit([&queue, &keep, name = name, path](){
+                    auto data = std::make_shared<mesh_utils::MeshData>();
+                    bool prepared = false;
+                    try { prepared = mesh_utils::prepareMesh(path, *data); } catch(const std::exception& error) { std::cerr << "Failed to load mesh: " << path << " (" << error.what() << ")" << std::endl; }
+                    queue.push([&keep, name, path, data, prepared](){
+                        AssetLoader<Mesh>::set(name, prepared ? mesh_utils::createMesh(*data) : nullptr);
+                        keep(trackAsset<Mesh>("mesh", name, path, estimateMeshBytes(AssetLoader<Mesh>::get(name))));
+                    });
+                }, &loading, "parse mesh");
+                pendingUploads++;
+            }
+        }
+
+        // The shaders & the samplers are loaded one by one so that only the missing ones are loaded
+        if(assetData.contains("shaders") && assetData["shaders"].is_object()){
+            for(auto& [name, desc] : assetData["shaders"].items()){
+                if(reuse("shader:" + name, desc.dump())) continue;
+                AssetLoader<ShaderProgram>::deserialize(nlohmann::json::object({{name, desc}}));
+                keep(trackAsset<ShaderProgram>("shader", name, desc.dump(), 0));
+            }
+        }
+        if(assetData.contains("samplers") && assetData["samplers"].is_object()){
+            for(auto& [name, desc] : assetData["samplers"].items()){
+                if(reuse("sampler:" + name, desc.dump())) continue;
+                AssetLoader<Sampler>::deserialize(nlohmann::json::object({{name, desc}}));
+                keep(trackAsset<Sampler>("sampler", name, desc.dump(), 0));
+            }
+        }
+
+        static const nlohmann::json noMaterials = nlohmann::json::object();
+        const nlohmann::json& materialData = assetData.contains("materials") && assetData["materials"].is_object() ? assetData["materials"] : noMaterials;
+
+        // The texture array is reused only if all the materials of the set are resident (the packed materials depend on it).
+        // Otherwise, it is evicted along with the packed materials, and they are all loaded and packed again.
+        bool packing = assetData.contains("packing") && assetData["packing"].is_object() && assetData["packing"].value("enabled", true);
+        bool packed = false;
+        if(packing){
+            std::string description = assetData["packing"].dump();
+            packed = residency.contains("texture_array:packed", description);
+            for(auto& [name, desc] : materialData.items()) packed = packed && residency.contains("material:" + name, desc.dump());
+            if(packed){
+                reuse("texture_array:packed", description);
+            } else if(!residency.evict("texture_array:packed")){
+                // The old array is still used by materials outside this set, so the textures are not packed again (they are drawn unpacked)
+                std::cerr << "WARNING: The packed textures changed but the old texture array is still in use, so the textures are not packed" << std::endl;
+                packing = false;
+            }
+        }
+
+        // A material depends on the textures (of this asset set) whose names appear as values in its description.
+        // It is created once all of them are uploaded (the shaders & the samplers are already loaded by then).
+        struct PendingMaterial {
+            std::string name;
+            const nlohmann::json* desc;
+            int remaining = 0;
+        };
+        std::vector<PendingMaterial> materials;
+        std::unordered_map<std::string, std::vector<size_t>> dependents; // texture name -> indices of the materials waiting for it
+        auto resolveMaterial = [&](const PendingMaterial& material){
+            AssetLoader<Material>::deserialize(nlohmann::json::object({{material.name, *material.desc}}));
+            // The material references the resident assets it uses, so they can't be evicted before it
+            std::vector<AssetReference> dependencies;
+            for(auto& value : *material.desc){
+                if(!value.is_string()) continue;
+                for(const char* type : {"texture:", "shader:", "sampler:"}){
+                    if(AssetReference dependency = residency.find(type + value.get<std::string>())) dependencies.push_back(std::move(dependency));
+                }
+            }
+            keep(trackAsset<Material>("material", material.name, material.desc->dump(), 0, std::move(dependencies)));
+        };
+        for(auto& [name, desc] : materialData.items()){
+            if(reuse("material:" + name, desc.dump())) continue;
+            size_t index = materials.size();
+            materials.push_back({name, &desc, 0});
+            std::unordered_set<std::string> dependencies;
+            for(auto& value : desc){
+                if(value.is_string() && pendingTextures.count(value.get<std::string>())) dependencies.insert(value.get<std::string>());
+            }
+            for(auto& texture : dependencies) dependents[texture].push_back(index);
+            materials[index].remaining = (int)dependencies.size();
+            if(materials[index].remaining == 0) resolveMaterial(materials[index]);
+        }
+
+        onTextureUploaded = [&](const std::string& texture){
+            std::string path = textures[texture].get<std::string>();
+            keep(trackAsset<Texture2D>("texture", texture, path, estimateTextureBytes(AssetLoader<Texture2D>::get(texture))));
+            if(auto it = dependents.find(texture); it != dependents.end()){
+                for(size_t index : it->second) if(--materials[index].remaining == 0) resolveMaterial(materials[index]);
+            }
+        };
+
+        // Upload the assets in the order they finish (the materials are resolved by the texture uploads)
+        for(; pendingUploads > 0; pendingUploads--){
+            queue.pop()();
+        }
+        // A job may still be returning after pushing its upload, so wait for all of them before the queue is destroyed
+        jobs.wait(loading);
+
+        // The small textures are packed into a texture array once the textures & the materials are loaded (if enabled by the set)
+        if(packing && !packed){
+            if(TextureArray* array = texture_packer::pack(assetData, assetData["packing"])){
+                AssetLoader<TextureArray>::set("packed", array);
+                size_t bytes = (size_t)array->getSize() * array->getSize() * array->getLayerCount() * 4 * 4 / 3;
+                AssetReference arrayReference = trackAsset<TextureArray>("texture_array", "packed", assetData["packing"].dump(), bytes);
+                for(auto& [name, desc] : materialData.items()){
+                    auto material = dynamic_cast<TexturedMaterial*>(AssetLoader<Material>::get(name));
+                    if(material == nullptr || material->textureArray != array) continue;
+                    if(AssetReference resident = residency.find("material:" + name)) resident.getAsset()->dependencies.push_back(arrayReference);
+                }
+                keep(std::move(arrayReference));
+            }
+        }
+
+        // The assets of the previous states that are not used by this set are only evicted if they don't fit in the budget
+        residency.trim();
+
+        auto duration = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        std::cout << "Loaded the assets in " << duration << " ms using " << jobs.getWorkerCount() << " worker threads ("
+                  << reused << " of " << references.size() << " assets were already resident)" << std::endl;
+        program_cache::logStatistics("Asset shaders", shaderStatistics);
+        return references;
+    }
+
+    AssetHandle<Texture2D> acquireTexture(const std::string& filename, bool generateMipmap){
+        // The texture is stored in the asset loader under its file name
+        std::string description = generateMipmap ? filename : filename + " (no mipmaps)";
+        if(AssetReference reference = AssetResidency::get().acquire("texture:" + filename, description)) return AssetHandle<Texture2D>(reference);
+        AssetLoader<Texture2D>::set(filename, texture_utils::loadImage(filename, generateMipmap));
+        Texture2D* texture = AssetLoader<Texture2D>::get(filename);
+        return AssetHandle<Texture2D>(trackAsset<Texture2D>("texture", filename, description, estimateTextureBytes(texture)));
+    }
+
+    AssetHandle<ShaderProgram> acquireShader(const std::string& vertexShader, const std::string& fragmentShader){
+        // The shader is stored in the asset loader under the names of its files and described like the shaders of the asset sets
+        std::string name = vertexShader + " + " + fragmentShader;
+        nlohmann::json desc = {{"vs", vertexShader}, {"fs", fragmentShader}};
+        if(AssetReference reference = AssetResidency::get().acquire("shader:" + name, desc.dump())) return AssetHandle<ShaderProgram>(reference);
+        AssetLoader<ShaderProgram>::deserialize(nlohmann::json::object({{name, desc}}));
+        return AssetHandle<ShaderProgram>(trackAsset<ShaderProgram>("shader", name, desc.dump(), 0));
     }
 
     void clearAllAssets(){
+        // The resident assets are deleted with the asset loaders below
+        AssetResidency::get().clear();
         AssetLoader<ShaderProgram>::clear();
         AssetLoader<Texture2D>::clear();
         AssetLoader<Sampler>::clear();
         AssetLoader<Mesh>::clear();
         AssetLoader<Material>::clear();
+        AssetLoader<TextureArray>::clear();
     }
 
-}
\ No newline at end of file
+}
@@ -3,9 +3,13 @@
 #include <unordered_map>
 #include <string>
 #include <json/json.hpp>
+#include "asset-residency.hpp"
 
 namespace our {
 
+    class Texture2D;
+    class ShaderProgram;
+
     // This static template class will hold the loaded assets
     // and can be called from anywhere to get an asset by its name.
     // Since we have different types of assets, this declared as a template class
@@ -32,6 +36,29 @@ namespace our {
             }
             return nullptr;
         };
+        // Returns all the loaded assets of this type (e.g. to prepare something for each of them)
+        static const std::unordered_map<std::string, T*>& getAll() { return assets; }
+        // This function stores an asset under the given name (the loader takes the ownership of the asset)
+        // It is used when the asset is created outside "deserialize" (e.g. by the parallel loader in "deserializeAllAssets")
+        // If another asset is stored under the name (it is still in use, so the residency manager couldn't evict it),
+        // the stored asset is kept and the given one is deleted, so the pointers to the stored asset stay valid.
+        // Returns the asset stored under the name.
+        static T* set(const std::string& name, T* asset) {
+            auto [it, inserted] = assets.try_emplace(name, asset);
+            if(!inserted && it->second != asset){
+                // A name whose asset failed to load holds a nullptr which can be replaced
+                if(it->second == nullptr) it->second = asset;
+                else delete asset;
+            }
+            return it->second;
+        }
+        // This function deletes the asset with the given name and removes it from the map (used when the residency manager evicts it)
+        static void remove(const std::string& name) {
+            if(auto it = assets.find(name); it != assets.end()){
+                delete it->second;
+                assets.erase(it);
+            }
+        }
         // This function deletes all the assets held by this class and clear the assets map 
         static void clear(){
             for(auto& [name, asset] : assets){
@@ -42,10 +69,20 @@ namespace our {
     };
 
     // Given a json holding the data for all the assets
-    // This function will call "AssetLoader<T>::deserialize" for all the different asset types T
-    // For example, a json in the form {"shaders": ... , "textures": ... } will call "deserialize" for:
-    // AssetLoader<ShaderProgram> and AssetLoader<Texture2D>
-    void deserializeAllAssets(const nlohmann::json& assetData);
-    // This will call "AssetLoader<T>::clear" for all the different asset types T
+    // This function will load the assets of all the different asset types T into "AssetLoader<T>"
+    // For example, a json in the form {"shaders": ... , "textures": ... } will load the shaders and the textures.
+    // The images are decoded and the meshes are parsed on a thread pool while the main thread compiles the shaders,
+    // then the main thread uploads them as they finish. Each material is created as soon as its textures are uploaded.
+    // If the json has a "packing" object, the small textures are then packed into a texture array (see "texture/texture-packer.hpp").
+    // Every asset is tracked by the residency manager (see "asset-residency.hpp"): the assets that are still resident
+    // and were loaded from the same description are reused instead of being loaded again.
+    // The returned references keep the assets of the set resident, so the caller should hold them while it uses the assets.
+    std::vector<AssetReference> deserializeAllAssets(const nlohmann::json& assetData);
+    // Returns a handle to the texture loaded from the given file. The texture is only loaded if it is not resident already
+    // and it is kept by the residency manager like the textures of the asset sets.
+    AssetHandle<Texture2D> acquireTexture(const std::string& filename, bool generateMipmap = true);
+    // Returns a handle to the shader program linked from the given files. Like "acquireTexture", it is only loaded if it is not resident already.
+    AssetHandle<ShaderProgram> acquireShader(const std::string& vertexShader, const std::string& fragmentShader);
+    // This will call "AssetLoader<T>::clear" for all the different asset types T (and forget the resident assets)
     void clearAllAssets();
 }
\ No newline at end of file
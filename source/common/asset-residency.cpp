@@ -0,0 +1,102 @@
+#include "asset-residency.hpp"
+
+#include <iostream>
+
+namespace our {
+
+    size_t AssetResidency::getResidentBytes() const {
+        size_t bytes = 0;
+        for(auto& [key, asset] : assets) bytes += asset->bytes;
+        return bytes;
+    }
+
+    bool AssetResidency::contains(const std::string& key, const std::string& description) const {
+        auto it = assets.find(key);
+        return it != assets.end() && it->second->description == description;
+    }
+
+    AssetReference AssetResidency::acquire(const std::string& key, const std::string& description){
+        auto it = assets.find(key);
+        if(it == assets.end()) return AssetReference();
+        if(it->second->description != description){
+            // The asset must be reloaded, so the stale one is evicted first (if it is still in use, it is kept as it is)
+            if(!evict(key)){
+                std::cerr << "WARNING: \"" << key << "\" changed but it is still in use, so the old asset is kept" << std::endl;
+                it = assets.find(key);
+                it->second->lastUse = ++clock;
+                return AssetReference(it->second);
+            }
+            return AssetReference();
+        }
+        it->second->lastUse = ++clock;
+        return AssetReference(it->second);
+    }
+
+    AssetReference AssetResidency::find(const std::string& key) const {
+        auto it = assets.find(key);
+        return it == assets.end() ? AssetReference() : AssetReference(it->second);
+    }
+
+    AssetReference AssetResidency::track(const std::string& key, const std::string& description, void* pointer, size_t bytes,
+                                         std::function<void()> destroy, std::vector<AssetReference> dependencies){
+        // If the key is already tracked (its asset was kept since it couldn't be evicted), the entry is reused
+        // so that its destroy function isn't called while the new entry is still referenced
+        if(auto it = assets.find(key); it != assets.end()){
+            it->second->lastUse = ++clock;
+            return AssetReference(it->second);
+        }
+        auto asset = std::make_shared<ResidentAsset>();
+        asset->key = key;
+        asset->description = description;
+        asset->pointer = pointer;
+        asset->bytes = bytes;
+        asset->lastUse = ++clock;
+        asset->destroy = std::move(destroy);
+        asset->dependencies = std::move(dependencies);
+        assets[key] = asset;
+        return AssetReference(asset);
+    }
+
+    bool AssetResidency::evict(const std::string& key){
+        auto it = assets.find(key);
+        if(it == assets.end()) return true;
+        std::shared_ptr<ResidentAsset> asset = it->second;
+
+        // The assets using this asset hold a reference to it, so they are evicted first
+        std::vector<std::string> dependents;
+        for(auto& [otherKey, other] : assets){
+            for(auto& dependency : other->dependencies){
+                if(dependency.getAsset() == asset.get()) dependents.push_back(otherKey);
+            }
+        }
+        for(auto& dependent : dependents) evict(dependent);
+
+        // The references left are the one in the map and the local one
+        if(asset.use_count() > 2) return false;
+        asset->destroy();
+        assets.erase(key);
+        return true;
+    }
+
+    void AssetResidency::trim(){
+        int evicted = 0;
+        size_t evictedBytes = 0;
+        while(getResidentBytes() > budget){
+            ResidentAsset* coldest = nullptr;
+            for(auto& [key, asset] : assets){
+                if(asset.use_count() == 1 && (coldest == nullptr || asset->lastUse < coldest->lastUse)) coldest = asset.get();
+            }
+            // Everything left is in use
+            if(coldest == nullptr) break;
+            evictedBytes += coldest->bytes;
+            std::string key = coldest->key;
+            evict(key);
+            evicted++;
+        }
+        if(evicted > 0){
+            std::cout << "Evicted " << evicted << " assets (" << evictedBytes / 1024 << " KB), "
+                      << getResidentBytes() / 1024 << " KB are still resident" << std::endl;
+        }
+    }
+
+}
@@ -0,0 +1,94 @@
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace our {
+
+    class ResidentAsset;
+
+    // A counted reference to a resident asset. While a reference exists, the asset is never evicted by the residency manager.
+    class AssetReference {
+    protected:
+        std::shared_ptr<ResidentAsset> asset;
+    public:
+        AssetReference() = default;
+        explicit AssetReference(std::shared_ptr<ResidentAsset> asset) : asset(std::move(asset)) {}
+
+        ResidentAsset* getAsset() const { return asset.get(); }
+        void reset() { asset.reset(); }
+        explicit operator bool() const { return asset != nullptr; }
+    };
+
+    // An asset loaded by the asset loader along with the data needed to decide when to evict it
+    class ResidentAsset {
+    public:
+        std::string key;                            // "<type>:<name>" (e.g. "texture:player")
+        std::string description;                    // The description the asset was loaded from (the asset is reloaded if it changes)
+        void* pointer = nullptr;                    // The asset itself (owned by its asset loader)
+        size_t bytes = 0;                           // An estimate of the GPU memory used by the asset
+        uint64_t lastUse = 0;                       // When the asset was last acquired (a counter, not a time)
+        std::vector<AssetReference> dependencies;   // The assets used by this asset (e.g. the textures of a material)
+        std::function<void()> destroy;              // Deletes the asset and removes it from its asset loader
+    };
+
+    // A typed reference which gives access to the asset
+    template<typename T>
+    class AssetHandle : public AssetReference {
+    public:
+        AssetHandle() = default;
+        explicit AssetHandle(const AssetReference& reference) : AssetReference(reference) {}
+
+        T* get() const { return asset ? static_cast<T*>(asset->pointer) : nullptr; }
+        T* operator->() const { return get(); }
+    };
+
+    // The residency manager keeps the loaded assets in memory after the states that used them are destroyed,
+    // so that entering a state again only loads the assets that were evicted or whose description changed.
+    // The assets that are not referenced stay resident until the estimated memory of all the resident assets exceeds the budget,
+    // then the least recently used ones are evicted. An asset that is used by another resident asset (e.g. the texture of a material)
+    // is referenced by it, so it is only evicted after the assets using it.
+    class AssetResidency {
+        // The map holds a reference too, so an asset is not referenced by anything else if its use count is 1
+        std::unordered_map<std::string, std::shared_ptr<ResidentAsset>> assets;
+        size_t budget = (size_t)256 << 20;
+        uint64_t clock = 0;
+
+        AssetResidency() = default;
+    public:
+        static AssetResidency& get(){
+            static AssetResidency instance;
+            return instance;
+        }
+
+        void setBudget(size_t bytes){ budget = bytes; }
+        size_t getBudget() const { return budget; }
+        size_t getResidentBytes() const;
+
+        // Returns true if the asset with the given key is resident and was loaded from the given description
+        bool contains(const std::string& key, const std::string& description) const;
+        // Returns a reference to the asset with the given key if it was loaded from the given description and marks it as used.
+        // If the asset was loaded from another description, it is evicted (along with the assets that use it) and an empty reference is returned.
+        AssetReference acquire(const std::string& key, const std::string& description);
+        // Returns a reference to the asset with the given key (or an empty reference if it is not resident)
+        AssetReference find(const std::string& key) const;
+
+        // Starts tracking an asset that was just loaded. "destroy" must delete the asset and remove it from its asset loader.
+        // If the key is already tracked, a reference to the existing entry is returned instead.
+        AssetReference track(const std::string& key, const std::string& description, void* pointer, size_t bytes,
+                             std::function<void()> destroy, std::vector<AssetReference> dependencies = {});
+
+        // Evicts the given asset after evicting the assets that use it. Returns false if the asset (or one of the assets using it)
+        // is still referenced from outside the residency manager, then it stays resident.
+        bool evict(const std::string& key);
+        // Evicts the least recently used assets that are not referenced until the resident assets fit in the budget
+        void trim();
+        // Forgets all the assets without deleting them (used when the asset loaders are cleared)
+        void clear(){ assets.clear(); }
+    };
+
+}
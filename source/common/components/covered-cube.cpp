@@ -1,20 +1,11 @@
 #include "covered-cube.hpp"
 #include "../ecs/entity.hpp"
-#include <iostream>
+#include "../deserialize-utils.hpp"
 namespace our {
     void CoveredCubeComponent::deserialize(const nlohmann::json& data){
         if(!data.is_object()) return;
         cubeType = data.value("cubeType", cubeType);
-        auto it = data.find("position");
-        if(it == data.end()){
-            std::cout<<"Not Found Position\n";
-        }else{
-            short i =0;
-            for(auto temp : *it){
-               position[i++] = temp;
-            }
-        }
-
-
+        // The position is the position of the entity unless it is given (the cubes created from a prefab don't give it)
+        position = data.value("position", getOwner() ? getOwner()->localTransform.position : position);
     }
-}
\ No newline at end of file
+}
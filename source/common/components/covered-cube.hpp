@@ -10,7 +10,7 @@ namespace our {
     class CoveredCubeComponent : public Component {
     public:
         std::string cubeType = "Covered";
-        glm::vec3 position;
+        glm::vec3 position = glm::vec3(0.0f);
 
         static std::string getID() { return "CoveredCube"; }
 
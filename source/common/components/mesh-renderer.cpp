@@ -13,5 +13,11 @@ namespace our {
         // Look at "source/common/asset-loader.hpp" to know how to use the static class AssetLoader.
         mesh = AssetLoader<Mesh>::get(data["mesh"].get<std::string>());             // get mesh name
         material = AssetLoader<Material>::get(data["material"].get<std::string>()); // get material
+        // A mesh with sub-meshes (e.g. a glTF mesh with multiple primitives) can have a material per sub-mesh
+        // given by the optional array "materials" (in the order of the sub-meshes)
+        materials.clear();
+        if(data.contains("materials") && data["materials"].is_array()){
+            for(auto& name : data["materials"]) materials.push_back(AssetLoader<Material>::get(name.get<std::string>()));
+        }
     }
 }
\ No newline at end of file
@@ -4,6 +4,7 @@
 #include "../mesh/mesh.hpp"
 #include "../material/material.hpp"
 #include "../asset-loader.hpp"
+#include <vector>
 
 namespace our {
 
@@ -12,6 +13,14 @@ namespace our {
     public:
         Mesh* mesh; // The mesh that should be drawn
         Material* material; // The material used to draw the mesh
+        // The materials of the sub-meshes of the mesh (a sub-mesh without a material here uses "material")
+        std::vector<Material*> materials;
+
+        // Returns the material used to draw the given sub-mesh
+        Material* getMaterial(int submesh) const {
+            if(submesh >= 0 && submesh < (int)materials.size() && materials[submesh]) return materials[submesh];
+            return material;
+        }
 
         // The ID of this component type is "Mesh Renderer"
         static std::string getID() { return "Mesh Renderer"; }
@@ -0,0 +1,432 @@
+#include "compiled-scene.hpp"
+#include "world.hpp"
+#include "prefab.hpp"
+#include "../asset-loader.hpp"
+#include "../components/component-deserializer.hpp"
+#include "../utils/hash.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <unordered_map>
+
+namespace our::compiled_scene {
+
+    static const char MAGIC[4] = {'A', 'X', 'S', 'C'};
+
+    size_t getElementSize(Section section){
+        switch(section){
+            case STRING_OFFSETS: return sizeof(uint32_t);
+            case STRINGS: return sizeof(char);
+            case ENTITIES: return sizeof(EntityRecord);
+            case COMPONENTS: return sizeof(ComponentReference);
+            case NAME_LISTS: return sizeof(uint32_t);
+            case CAMERAS: return sizeof(CameraRecord);
+            case FREE_CAMERA_CONTROLLERS: return sizeof(FreeCameraControllerRecord);
+            case MESH_RENDERERS: return sizeof(MeshRendererRecord);
+            case MOVEMENTS: return sizeof(MovementRecord);
+            case KEYBOARD_MOVEMENTS: return sizeof(KeyboardMovementRecord);
+            case ENEMIES: return sizeof(EnemyRecord);
+            case COVERED_CUBES: return sizeof(CoveredCubeRecord);
+            case DOTS: return sizeof(DotRecord);
+            case LIGHTS: return sizeof(LightingRecord);
+            default: return 0;
+        }
+    }
+
+    std::string getPath(const std::string& worldPath){
+        // The hash of the path (including the json pointer) is added to the name to separate the worlds which have the same file name
+        // in different folders and the worlds of the same file
+        size_t separator = worldPath.find('#');
+        std::filesystem::path filename(worldPath.substr(0, separator));
+        std::string pointer = separator == std::string::npos ? "" : worldPath.substr(separator);
+        std::stringstream stream;
+        stream << "cache/scenes/" << filename.stem().string() << "-" << std::hex << std::setw(16) << std::setfill('0')
+               << hashFNV1a(filename.generic_string() + pointer) << ".scene";
+        return stream.str();
+    }
+
+    // Collects the sections of a scene while its json is walked
+    class SceneBuilder {
+    public:
+        std::vector<uint32_t> stringOffsets;
+        std::vector<char> strings;
+        std::unordered_map<std::string, uint32_t> stringIndices; // Each distinct string is stored once
+        std::vector<EntityRecord> entities;
+        std::vector<ComponentReference> components;
+        std::vector<uint32_t> nameLists;
+        std::vector<CameraRecord> cameras;
+        std::vector<FreeCameraControllerRecord> freeCameraControllers;
+        std::vector<MeshRendererRecord> meshRenderers;
+        std::vector<MovementRecord> movements;
+        std::vector<KeyboardMovementRecord> keyboardMovements;
+        std::vector<EnemyRecord> enemies;
+        std::vector<CoveredCubeRecord> coveredCubes;
+        std::vector<DotRecord> dots;
+        std::vector<LightingRecord> lights;
+        PrefabMap prefabs;
+        // The component types found in the world that can't be stored, so the world can't be compiled
+        std::vector<std::string> unsupportedTypes;
+
+        SceneBuilder(){ addString(""); }
+
+        uint32_t addString(const std::string& text){
+            auto [it, inserted] = stringIndices.try_emplace(text, (uint32_t)stringOffsets.size());
+            if(inserted){
+                stringOffsets.push_back((uint32_t)strings.size());
+                strings.insert(strings.end(), text.begin(), text.end());
+                strings.push_back('\0');
+            }
+            return it->second;
+        }
+
+        template<typename T>
+        void addRecord(ComponentType type, std::vector<T>& records, const T& record){
+            components.push_back({type, (uint32_t)records.size()});
+            records.push_back(record);
+        }
+
+        // The components are read by their own deserializers (like "deserializeComponent" does) then their fields are copied into a record.
+        // The mesh renderer is the exception since it holds the assets, so the names are stored instead to be looked up at load time.
+        // The transform is the transform of the entity which will own the component.
+        void addComponent(const nlohmann::json& data, const Transform& transform){
+            std::string type = data.value("type", "");
+            if(type == CameraComponent::getID()){
+                CameraComponent camera;
+                camera.deserialize(data);
+                addRecord(ComponentType::CAMERA, cameras, {(uint32_t)camera.cameraType, camera.near, camera.far, camera.fovY, camera.orthoHeight});
+            } else if(type == FreeCameraControllerComponent::getID()){
+                FreeCameraControllerComponent controller;
+                controller.deserialize(data);
+                addRecord(ComponentType::FREE_CAMERA_CONTROLLER, freeCameraControllers,
+                          {controller.rotationSensitivity, controller.fovSensitivity, controller.positionSensitivity, controller.speedupFactor});
+            } else if(type == MeshRendererComponent::getID()){
+                MeshRendererRecord record;
+                record.mesh = addString(data["mesh"].get<std::string>());
+                record.material = addString(data["material"].get<std::string>());
+                record.firstMaterial = (uint32_t)nameLists.size();
+                if(data.contains("materials") && data["materials"].is_array()){
+                    for(auto& name : data["materials"]) nameLists.push_back(addString(name.get<std::string>()));
+                }
+                record.materialCount = (uint32_t)nameLists.size() - record.firstMaterial;
+                addRecord(ComponentType::MESH_RENDERER, meshRenderers, record);
+            } else if(type == MovementComponent::getID()){
+                MovementComponent movement;
+                movement.deserialize(data);
+                addRecord(ComponentType::MOVEMENT, movements, {movement.linearVelocity, movement.angularVelocity});
+            } else if(type == KeyboardMovementComponent::getID()){
+                KeyboardMovementComponent movement;
+                movement.deserialize(data);
+                addRecord(ComponentType::KEYBOARD_MOVEMENT, keyboardMovements, {movement.positionSensitivity});
+            } else if(type == EnemyComponent::getID()){
+                EnemyComponent enemy;
+                enemy.deserialize(data);
+                addRecord(ComponentType::ENEMY, enemies, {addString(enemy.enemyType)});
+            } else if(type == CoveredCubeComponent::getID()){
+                // The component has no owner here, so it gets the position of its entity before reading its data (like it does when it is owned)
+                CoveredCubeComponent cube;
+                cube.position = transform.position;
+                cube.deserialize(data);
+                addRecord(ComponentType::COVERED_CUBE, coveredCubes, {addString(cube.cubeType), cube.position});
+            } else if(type == DotComponent::getID()){
+                DotComponent dot;
+                dot.deserialize(data);
+                addRecord(ComponentType::DOT, dots, {addString(dot.dotType)});
+            } else if(type == LightingComponent::getID()){
+                LightingComponent light;
+                light.deserialize(data);
+                addRecord(ComponentType::LIGHTING, lights,
+                          {light.kind, light.diffuse, light.specular, light.direction, light.position, light.attenuation, light.cone_angles});
+            } else if(std::find(unsupportedTypes.begin(), unsupportedTypes.end(), type) == unsupportedTypes.end()) {
+                // Dropping the component would make the compiled scene differ from its source, so the scene is not compiled at all
+                std::cerr << "ERROR: The component type \"" << type << "\" can't be stored in a compiled scene" << std::endl;
+                unsupportedTypes.push_back(type);
+            }
+        }
+
+        void addComponents(const nlohmann::json& data, const Transform& transform){
+            if(!data.is_object() || !data.contains("components") || !data["components"].is_array()) return;
+            for(auto& component : data["components"]) addComponent(component, transform);
+        }
+
+        // Walks the entities like "World::deserialize" does (including the prefabs & the lattices),
+        // so the compiled scene only holds plain entities and the parents are always added before their children
+        void addEntities(const nlohmann::json& data, int32_t parent){
+            if(data.is_object()){
+                if(data.contains("prefabs")) readPrefabs(data["prefabs"], prefabs);
+                if(data.contains("entities")) addEntities(data["entities"], parent);
+                return;
+            }
+            if(!data.is_array()) return;
+            for(const auto& entityData : data) addEntity(entityData, parent);
+        }
+
+        void addEntity(const nlohmann::json& entityData, int32_t parent){
+            const nlohmann::json* prefab = findPrefab(entityData, prefabs);
+            for(const glm::vec3& offset : getLatticeOffsets(entityData)){
+                Transform transform;
+                std::string name;
+                for(const nlohmann::json* source : {prefab, &entityData}){
+                    if(source == nullptr || !source->is_object()) continue;
+                    name = source->value("name", name);
+                    transform.deserialize(*source);
+                }
+                transform.position += offset;
+                uint32_t firstComponent = (uint32_t)components.size();
+                if(prefab) addComponents(*prefab, transform);
+                addComponents(entityData, transform);
+                int32_t index = (int32_t)entities.size();
+                entities.push_back({parent, addString(name), transform.position, transform.rotation, transform.scale,
+                                    firstComponent, (uint32_t)components.size() - firstComponent});
+                if(prefab && prefab->contains("children")) addEntities((*prefab)["children"], index);
+                if(entityData.is_object() && entityData.contains("children")) addEntities(entityData["children"], index);
+            }
+        }
+    };
+
+    Compiler::Compiler() : builder(std::make_unique<SceneBuilder>()) {}
+    Compiler::~Compiler() = default;
+
+    void Compiler::addPrefabs(const nlohmann::json& prefabs){
+        readPrefabs(prefabs, builder->prefabs);
+    }
+
+    void Compiler::addEntity(const nlohmann::json& entityData){
+        builder->addEntity(entityData, -1);
+    }
+
+    std::vector<unsigned char> Compiler::finish(uint64_t sourceHash){
+        SceneBuilder& builder = *this->builder;
+        if(!builder.unsupportedTypes.empty()) return {};
+        Header header = {};
+        std::memcpy(header.magic, MAGIC, sizeof(MAGIC));
+        header.version = VERSION;
+        header.sourceHash = sourceHash;
+
+        std::vector<unsigned char> data(sizeof(Header));
+        auto append = [&](Section section, const void* elements, size_t count){
+            // Every section starts at a multiple of 4 so that its elements can be read in place from the mapped file
+            data.resize((data.size() + 3) & ~(size_t)3);
+            header.sections[section] = {(uint32_t)data.size(), (uint32_t)count};
+            const unsigned char* bytes = static_cast<const unsigned char*>(elements);
+            if(count > 0) data.insert(data.end(), bytes, bytes + count * getElementSize(section));
+        };
+        append(STRING_OFFSETS, builder.stringOffsets.data(), builder.stringOffsets.size());
+        append(STRINGS, builder.strings.data(), builder.strings.size());
+        append(ENTITIES, builder.entities.data(), builder.entities.size());
+        append(COMPONENTS, builder.components.data(), builder.components.size());
+        append(NAME_LISTS, builder.nameLists.data(), builder.nameLists.size());
+        append(CAMERAS, builder.cameras.data(), builder.cameras.size());
+        append(FREE_CAMERA_CONTROLLERS, builder.freeCameraControllers.data(), builder.freeCameraControllers.size());
+        append(MESH_RENDERERS, builder.meshRenderers.data(), builder.meshRenderers.size());
+        append(MOVEMENTS, builder.movements.data(), builder.movements.size());
+        append(KEYBOARD_MOVEMENTS, builder.keyboardMovements.data(), builder.keyboardMovements.size());
+        append(ENEMIES, builder.enemies.data(), builder.enemies.size());
+        append(COVERED_CUBES, builder.coveredCubes.data(), builder.coveredCubes.size());
+        append(DOTS, builder.dots.data(), builder.dots.size());
+        append(LIGHTS, builder.lights.data(), builder.lights.size());
+        std::memcpy(data.data(), &header, sizeof(Header));
+        return data;
+    }
+
+    bool save(const std::string& path, const std::vector<unsigned char>& data){
+        // We write to a temporary file then rename it, so a partially written file is never read
+        // (its name is unique to the writer, so two processes compiling the same world don't write to the same file)
+        std::error_code error;
+        std::filesystem::create_directories(std::filesystem::path(path).parent_path(), error);
+        std::string temporaryPath = getTemporaryPath(path);
+        bool written;
+        {
+            std::ofstream file(temporaryPath, std::ios::binary | std::ios::trunc);
+            file.write(reinterpret_cast<const char*>(data.data()), data.size());
+            file.close();
+            written = !file.fail();
+        }
+        if(written) std::filesystem::rename(temporaryPath, path, error);
+        if(!written || error){
+            std::filesystem::remove(temporaryPath, error);
+            return false;
+        }
+        return true;
+    }
+
+    // Checks that every index stored in the file points inside the section it refers to
+    static bool validate(const CompiledScene& scene){
+        uint32_t stringCount = scene.getCount(STRING_OFFSETS), characterCount = scene.getCount(STRINGS);
+        if(stringCount == 0 || characterCount == 0 || scene.getSection<char>(STRINGS)[characterCount - 1] != '\0') return false;
+        for(uint32_t index = 0; index < stringCount; index++){
+            if(scene.getSection<uint32_t>(STRING_OFFSETS)[index] >= characterCount) return false;
+        }
+        auto isString = [&](uint32_t index){ return index < stringCount; };
+
+        const EntityRecord* entities = scene.getSection<EntityRecord>(ENTITIES);
+        uint32_t componentCount = scene.getCount(COMPONENTS);
+        for(uint32_t index = 0; index < scene.getCount(ENTITIES); index++){
+            const EntityRecord& entity = entities[index];
+            if(entity.parent < -1 || entity.parent >= (int32_t)index || !isString(entity.name)) return false;
+            if(entity.firstComponent > componentCount || entity.componentCount > componentCount - entity.firstComponent) return false;
+        }
+        const ComponentReference* components = scene.getSection<ComponentReference>(COMPONENTS);
+        for(uint32_t index = 0; index < componentCount; index++){
+            if(components[index].type >= ComponentType::COUNT) return false;
+            Section section = (Section)(CAMERAS + (uint32_t)components[index].type);
+            if(components[index].index >= scene.getCount(section)) return false;
+        }
+
+        uint32_t nameCount = scene.getCount(NAME_LISTS);
+        for(uint32_t index = 0; index < nameCount; index++){
+            if(!isString(scene.getSection<uint32_t>(NAME_LISTS)[index])) return false;
+        }
+        for(uint32_t index = 0; index < scene.getCount(MESH_RENDERERS); index++){
+            const MeshRendererRecord& record = scene.getSection<MeshRendererRecord>(MESH_RENDERERS)[index];
+            if(!isString(record.mesh) || !isString(record.material)) return false;
+            if(record.firstMaterial > nameCount || record.materialCount > nameCount - record.firstMaterial) return false;
+        }
+        for(uint32_t index = 0; index < scene.getCount(ENEMIES); index++){
+            if(!isString(scene.getSection<EnemyRecord>(ENEMIES)[index].enemyType)) return false;
+        }
+        for(uint32_t index = 0; index < scene.getCount(COVERED_CUBES); index++){
+            if(!isString(scene.getSection<CoveredCubeRecord>(COVERED_CUBES)[index].cubeType)) return false;
+        }
+        for(uint32_t index = 0; index < scene.getCount(DOTS); index++){
+            if(!isString(scene.getSection<DotRecord>(DOTS)[index].dotType)) return false;
+        }
+        return true;
+    }
+
+    bool open(const std::string& path, uint64_t sourceHash, CompiledScene& scene){
+        MappedFile& file = scene.file;
+        if(!file.open(path)) return false;
+        scene.header = reinterpret_cast<const Header*>(file.getData());
+        const Header& header = *scene.header;
+        bool valid = file.getSize() >= sizeof(Header) && std::memcmp(header.magic, MAGIC, sizeof(MAGIC)) == 0 &&
+                     header.version == VERSION && header.sourceHash == sourceHash;
+        for(uint32_t section = 0; valid && section < SECTION_COUNT; section++){
+            const SectionInfo& info = header.sections[section];
+            valid = info.offset % 4 == 0 && info.offset >= sizeof(Header) && info.offset <= file.getSize() &&
+                    (uint64_t)info.count * getElementSize((Section)section) <= file.getSize() - info.offset;
+        }
+        if(!valid || !validate(scene)){
+            file.close();
+            scene.header = nullptr;
+            return false;
+        }
+        return true;
+    }
+
+    void instantiate(const CompiledScene& scene, World* world, Entity* parent){
+        uint32_t entityCount = scene.getCount(ENTITIES);
+        const EntityRecord* entities = scene.getSection<EntityRecord>(ENTITIES);
+        const ComponentReference* components = scene.getSection<ComponentReference>(COMPONENTS);
+        const uint32_t* nameLists = scene.getSection<uint32_t>(NAME_LISTS);
+
+        // Many components use the same assets, so each name is looked up in the asset loader once
+        uint32_t stringCount = scene.getCount(STRING_OFFSETS);
+        std::vector<Mesh*> meshes(stringCount, nullptr);
+        std::vector<Material*> materials(stringCount, nullptr);
+        std::vector<bool> meshFound(stringCount, false), materialFound(stringCount, false);
+        auto getMesh = [&](uint32_t name){
+            if(!meshFound[name]){ meshes[name] = AssetLoader<Mesh>::get(scene.getString(name)); meshFound[name] = true; }
+            return meshes[name];
+        };
+        auto getMaterial = [&](uint32_t name){
+            if(!materialFound[name]){ materials[name] = AssetLoader<Material>::get(scene.getString(name)); materialFound[name] = true; }
+            return materials[name];
+        };
+
+        world->reserve(entityCount);
+        std::vector<Entity*> created(entityCount);
+        for(uint32_t index = 0; index < entityCount; index++){
+            const EntityRecord& record = entities[index];
+            Entity* entity = world->add();
+            created[index] = entity;
+            entity->parent = record.parent < 0 ? parent : created[record.parent];
+            entity->name = scene.getString(record.name);
+            entity->localTransform.position = record.position;
+            entity->localTransform.rotation = record.rotation;
+            entity->localTransform.scale = record.scale;
+
+            for(uint32_t offset = 0; offset < record.componentCount; offset++){
+                const ComponentReference& reference = components[record.firstComponent + offset];
+                switch(reference.type){
+                    case ComponentType::CAMERA: {
+                        const CameraRecord& data = scene.getSection<CameraRecord>(CAMERAS)[reference.index];
+                        auto camera = entity->addComponent<CameraComponent>();
+                        camera->cameraType = (CameraType)data.cameraType;
+                        camera->near = data.near;
+                        camera->far = data.far;
+                        camera->fovY = data.fovY;
+                        camera->orthoHeight = data.orthoHeight;
+                        break;
+                    }
+                    case ComponentType::FREE_CAMERA_CONTROLLER: {
+                        const FreeCameraControllerRecord& data = scene.getSection<FreeCameraControllerRecord>(FREE_CAMERA_CONTROLLERS)[reference.index];
+                        auto controller = entity->addComponent<FreeCameraControllerComponent>();
+                        controller->rotationSensitivity = data.rotationSensitivity;
+                        controller->fovSensitivity = data.fovSensitivity;
+                        controller->positionSensitivity = data.positionSensitivity;
+                        controller->speedupFactor = data.speedupFactor;
+                        break;
+                    }
+                    case ComponentType::MESH_RENDERER: {
+                        const MeshRendererRecord& data = scene.getSection<MeshRendererRecord>(MESH_RENDERERS)[reference.index];
+                        auto meshRenderer = entity->addComponent<MeshRendererComponent>();
+                        meshRenderer->mesh = getMesh(data.mesh);
+                        meshRenderer->material = getMaterial(data.material);
+                        for(uint32_t material = 0; material < data.materialCount; material++){
+                            meshRenderer->materials.push_back(getMaterial(nameLists[data.firstMaterial + material]));
+                        }
+                        break;
+                    }
+                    case ComponentType::MOVEMENT: {
+                        const MovementRecord& data = scene.getSection<MovementRecord>(MOVEMENTS)[reference.index];
+                        auto movement = entity->addComponent<MovementComponent>();
+                        movement->linearVelocity = data.linearVelocity;
+                        movement->angularVelocity = data.angularVelocity;
+                        break;
+                    }
+                    case ComponentType::KEYBOARD_MOVEMENT: {
+                        const KeyboardMovementRecord& data = scene.getSection<KeyboardMovementRecord>(KEYBOARD_MOVEMENTS)[reference.index];
+                        entity->addComponent<KeyboardMovementComponent>()->positionSensitivity = data.positionSensitivity;
+                        break;
+                    }
+                    case ComponentType::ENEMY: {
+                        const EnemyRecord& data = scene.getSection<EnemyRecord>(ENEMIES)[reference.index];
+                        entity->addComponent<EnemyComponent>()->enemyType = scene.getString(data.enemyType);
+                        break;
+                    }
+                    case ComponentType::COVERED_CUBE: {
+                        const CoveredCubeRecord& data = scene.getSection<CoveredCubeRecord>(COVERED_CUBES)[reference.index];
+                        auto cube = entity->addComponent<CoveredCubeComponent>();
+                        cube->cubeType = scene.getString(data.cubeType);
+                        cube->position = data.position;
+                        break;
+                    }
+                    case ComponentType::DOT: {
+                        const DotRecord& data = scene.getSection<DotRecord>(DOTS)[reference.index];
+                        entity->addComponent<DotComponent>()->dotType = scene.getString(data.dotType);
+                        break;
+                    }
+                    case ComponentType::LIGHTING: {
+                        const LightingRecord& data = scene.getSection<LightingRecord>(LIGHTS)[reference.index];
+                        auto light = entity->addComponent<LightingComponent>();
+                        light->kind = data.kind;
+                        light->diffuse = data.diffuse;
+                        light->specular = data.specular;
+                        light->direction = data.direction;
+                        light->position = data.position;
+                        light->attenuation = data.attenuation;
+                        light->cone_angles = data.coneAngles;
+                        break;
+                    }
+                    default: break;
+                }
+            }
+        }
+    }
+
+}
@@ -0,0 +1,167 @@
+#pragma once
+
+#include "../utils/mapped-file.hpp"
+
+#include <glm/glm.hpp>
+#include <json/json.hpp>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace our {
+    class World;
+    class Entity;
+}
+
+namespace our::compiled_scene {
+
+    // Increment this whenever the file layout or the meaning of a record changes so that the old files are rejected
+    constexpr uint32_t VERSION = 1;
+
+    // The sections of a ".scene" file. Each one is an array of fixed size elements (see "getElementSize").
+    // The components are stored by type: each component type has its own array of records,
+    // so loading a component is a copy from its record without any string compares or json lookups.
+    enum Section : uint32_t {
+        STRING_OFFSETS = 0, // uint32_t per string: where the string starts in STRINGS (string 0 is always "")
+        STRINGS,            // char: the characters of all the strings (each one is null terminated)
+        ENTITIES,           // EntityRecord per entity (a parent always comes before its children)
+        COMPONENTS,         // ComponentReference per component (the components of each entity are contiguous)
+        NAME_LISTS,         // uint32_t: string indices referenced by the records as ranges (e.g. the sub-mesh materials)
+        CAMERAS,            // The record arrays of each component type (in the same order as ComponentType)
+        FREE_CAMERA_CONTROLLERS,
+        MESH_RENDERERS,
+        MOVEMENTS,
+        KEYBOARD_MOVEMENTS,
+        ENEMIES,
+        COVERED_CUBES,
+        DOTS,
+        LIGHTS,
+        SECTION_COUNT
+    };
+
+    // The component types that can be stored. The type of a component is also the index of its record array relative to CAMERAS.
+    enum class ComponentType : uint32_t {
+        CAMERA = 0,
+        FREE_CAMERA_CONTROLLER,
+        MESH_RENDERER,
+        MOVEMENT,
+        KEYBOARD_MOVEMENT,
+        ENEMY,
+        COVERED_CUBE,
+        DOT,
+        LIGHTING,
+        COUNT
+    };
+
+    struct SectionInfo {
+        uint32_t offset;    // From the start of the file (a multiple of 4)
+        uint32_t count;     // In elements
+    };
+
+    // The header at the start of every ".scene" file. It is followed by the sections.
+    struct Header {
+        char magic[4];          // "AXSC"
+        uint32_t version;       // Must be equal to VERSION
+        uint64_t sourceHash;    // The FNV-1a hash of the source JSONC file followed by the json pointer of the world in it
+        SectionInfo sections[SECTION_COUNT];
+    };
+
+    // The entity hierarchy is stored as parent indices and the transform is stored as the entity uses it (the rotation is in radians)
+    struct EntityRecord {
+        int32_t parent;             // The index of the parent entity or -1 for a root entity
+        uint32_t name;              // String index
+        glm::vec3 position, rotation, scale;
+        uint32_t firstComponent, componentCount;
+    };
+
+    struct ComponentReference {
+        ComponentType type;
+        uint32_t index;             // The index of the record in the array of its type
+    };
+
+    // The component records hold the values after the defaults are applied & the units are converted by the component deserializer
+    struct CameraRecord {
+        uint32_t cameraType;
+        float near, far, fovY, orthoHeight;
+    };
+    struct FreeCameraControllerRecord {
+        float rotationSensitivity, fovSensitivity;
+        glm::vec3 positionSensitivity;
+        float speedupFactor;
+    };
+    struct MeshRendererRecord {
+        uint32_t mesh, material;                    // String indices (the assets are looked up by name when the scene is loaded)
+        uint32_t firstMaterial, materialCount;      // A range of NAME_LISTS holding the material of each sub-mesh
+    };
+    struct MovementRecord {
+        glm::vec3 linearVelocity, angularVelocity;
+    };
+    struct KeyboardMovementRecord {
+        glm::vec3 positionSensitivity;
+    };
+    struct EnemyRecord {
+        uint32_t enemyType;         // String index
+    };
+    struct CoveredCubeRecord {
+        uint32_t cubeType;          // String index
+        glm::vec3 position;
+    };
+    struct DotRecord {
+        uint32_t dotType;           // String index
+    };
+    struct LightingRecord {
+        int32_t kind;
+        glm::vec3 diffuse, specular, direction, position, attenuation;
+        glm::vec2 coneAngles;
+    };
+
+    // Returns the size of an element of the given section
+    size_t getElementSize(Section section);
+
+    // Returns the path of the compiled file of a world given like "World::load" takes it (a file followed by an optional json pointer).
+    // The compiled scenes are stored in "cache/scenes", so loading the worlds of the test configurations doesn't write to the config folders.
+    std::string getPath(const std::string& worldPath);
+
+    class SceneBuilder;
+
+    // Builds the contents of a ".scene" file from a world description given piece by piece,
+    // so a world can be compiled while it is streamed (see "world-stream.hpp").
+    // The prefabs & the lattices are expanded, and the components are read by their own deserializers,
+    // so the compiled scene is loaded exactly like its source.
+    class Compiler {
+        std::unique_ptr<SceneBuilder> builder;
+    public:
+        Compiler();
+        ~Compiler();
+        // Adds the prefabs that can be used by the entities added after them
+        void addPrefabs(const nlohmann::json& prefabs);
+        // Adds a root entity (and its children)
+        void addEntity(const nlohmann::json& entityData);
+        // Returns the contents of the ".scene" file, or an empty vector if the world has a component type that can't be compiled
+        // (the type is logged when it is added and the world must be loaded from its source)
+        std::vector<unsigned char> finish(uint64_t sourceHash);
+    };
+
+    // Writes the compiled scene to the given path. Returns false if it failed.
+    bool save(const std::string& path, const std::vector<unsigned char>& data);
+
+    // A validated ".scene" file which stays mapped while the entities are created
+    struct CompiledScene {
+        MappedFile file;
+        const Header* header = nullptr;
+
+        template<typename T>
+        const T* getSection(Section section) const { return reinterpret_cast<const T*>(file.getData() + header->sections[section].offset); }
+        uint32_t getCount(Section section) const { return header->sections[section].count; }
+        const char* getString(uint32_t index) const { return getSection<char>(STRINGS) + getSection<uint32_t>(STRING_OFFSETS)[index]; }
+    };
+
+    // Maps the given file and checks it. Returns false if the file doesn't exist, is invalid,
+    // is from another version or doesn't match the source hash.
+    bool open(const std::string& path, uint64_t sourceHash, CompiledScene& scene);
+
+    // Creates all the entities of the compiled scene in the world (the root entities get the given parent)
+    void instantiate(const CompiledScene& scene, World* world, Entity* parent = nullptr);
+
+}
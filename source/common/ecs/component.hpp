@@ -12,7 +12,7 @@ namespace our {
     // For example, an entity with a camera component specifies that this entity should be used as a camera
     // Thus any renderer system should look for an entity holding a camera component in order to compute the camera related uniforms (e.g. VP matrix)
     class Component {
-        Entity* owner; // A pointer to the entity that owns this component
+        Entity* owner = nullptr; // A pointer to the entity that owns this component
         friend Entity; // The entity is a friend since it is the only one allowed to set itself as an owner of a certain component.
     public:
         // This static method returns a unique string that identifies each type of components
@@ -24,9 +24,20 @@ namespace our {
 
     // Deserializes the entity data and components from a json object
     void Entity::deserialize(const nlohmann::json& data){
+        deserializeAttributes(data);
+        deserializeComponents(data);
+    }
+
+    // Deserializes the name & the transform from a json object (the missing values are left as they are)
+    void Entity::deserializeAttributes(const nlohmann::json& data){
         if(!data.is_object()) return;
         name = data.value("name", name);
         localTransform.deserialize(data);
+    }
+
+    // Deserializes the components from a json object
+    void Entity::deserializeComponents(const nlohmann::json& data){
+        if(!data.is_object()) return;
         if(data.contains("components")){
             if(const auto& components = data["components"]; components.is_array()){
                 for(auto& component: components){
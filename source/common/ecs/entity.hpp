@@ -29,6 +29,8 @@ namespace our {
 
         glm::mat4 getLocalToWorldMatrix() const; // Computes and returns the transformation from the entities local space to the world space
         void deserialize(const nlohmann::json&); // Deserializes the entity data and components from a json object
+        void deserializeAttributes(const nlohmann::json&); // Deserializes the name & the transform only
+        void deserializeComponents(const nlohmann::json&); // Deserializes the components only (and adds them after the existing ones)
         
         // This template method create a component of type T,
         // adds it to the components map and returns a pointer to it 
@@ -0,0 +1,77 @@
+#pragma once
+
+#include "../deserialize-utils.hpp"
+
+#include <glm/glm.hpp>
+#include <json/json.hpp>
+#include <iostream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace our {
+
+    // A prefab is an entity description (name, transform, components & children) defined once in a world file
+    // and instantiated by the entities that name it in their "prefab" key. For example:
+    //    {
+    //      "prefabs": { "cube": { "scale": [0.5, 0.5, 0.5], "components": [ { "type": "Mesh Renderer", "mesh": "cube", "material": "wood" } ] } },
+    //      "entities": [ { "prefab": "cube", "position": [0, 1, 0] } ]
+    //    }
+    // The entity overrides the name & the transform of its prefab and its components are added after the prefab's components.
+    // A prefab can't use another prefab. Since the world files are streamed (see "world-stream.hpp"),
+    // the prefabs must come before the entities that use them.
+    typedef std::unordered_map<std::string, nlohmann::json> PrefabMap;
+
+    // Reads the prefabs defined in the given json object ({prefab_name: entity_description, ...}) into the map
+    inline void readPrefabs(const nlohmann::json& data, PrefabMap& prefabs){
+        if(!data.is_object()) return;
+        for(auto& [name, desc] : data.items()) prefabs[name] = desc;
+    }
+
+    // Returns the prefab used by the given entity description (or nullptr if it doesn't use one)
+    inline const nlohmann::json* findPrefab(const nlohmann::json& entityData, const PrefabMap& prefabs){
+        if(!entityData.is_object() || !entityData.contains("prefab")) return nullptr;
+        std::string name = entityData["prefab"].get<std::string>();
+        if(auto it = prefabs.find(name); it != prefabs.end()) return &it->second;
+        std::cerr << "Unknown prefab: " << name << std::endl;
+        return nullptr;
+    }
+
+    // An entity description with a "lattice" is instantiated once per cell of a 3D grid instead of once. For example:
+    //    { "prefab": "cube", "position": [-19.5, 0, -19.5], "lattice": { "count": [40, 1, 40], "spacing": [1, 1, 1], "border": 2 } }
+    // creates the cubes of a ring 2 cells thick around a 40x40 square where:
+    //      "count" is the number of cells along each axis (default: [1, 1, 1])
+    //      "spacing" is the distance between 2 neighboring cells along each axis (default: [1, 1, 1])
+    //      "border" (optional) keeps only the cells within this number of cells of the sides of the lattice (0 keeps all the cells).
+    //              The axes that have a single cell have no sides.
+    // The position of the description is the position of the first cell and the offset of each cell is added to it
+    // (in the space of the parent, so the lattice is not rotated with the entity).
+    // This function returns the offset of each cell (or a single zero offset if the description has no lattice).
+    inline std::vector<glm::vec3> getLatticeOffsets(const nlohmann::json& entityData){
+        if(!entityData.is_object() || !entityData.contains("lattice")) return {glm::vec3(0.0f)};
+        const nlohmann::json& lattice = entityData["lattice"];
+        glm::ivec3 count = glm::max(lattice.value("count", glm::ivec3(1)), glm::ivec3(0));
+        glm::vec3 spacing = lattice.value("spacing", glm::vec3(1.0f));
+        int border = lattice.value("border", 0);
+
+        std::vector<glm::vec3> offsets;
+        offsets.reserve((size_t)count.x * count.y * count.z);
+        for(int x = 0; x < count.x; x++){
+            for(int y = 0; y < count.y; y++){
+                for(int z = 0; z < count.z; z++){
+                    glm::ivec3 cell(x, y, z);
+                    if(border > 0){
+                        bool onBorder = false;
+                        for(int axis = 0; axis < 3; axis++){
+                            if(count[axis] > 1 && (cell[axis] < border || cell[axis] >= count[axis] - border)) onBorder = true;
+                        }
+                        if(!onBorder) continue;
+                    }
+                    offsets.push_back(glm::vec3(cell) * spacing);
+                }
+            }
+        }
+        return offsets;
+    }
+
+}
@@ -0,0 +1,149 @@
+#include "world-stream.hpp"
+
+#include <iostream>
+
+namespace our {
+
+    void WorldStreamReader::ValueBuilder::add(nlohmann::json&& value, bool container){
+        if(discard){
+            // Only the depth matters for a discarded value
+            if(container) containers.push_back(nullptr);
+            return;
+        }
+        nlohmann::json* target;
+        if(containers.empty()){
+            root = std::move(value);
+            target = &root;
+        } else if(containers.back()->is_array()){
+            containers.back()->push_back(std::move(value));
+            target = &containers.back()->back();
+        } else {
+            *slot = std::move(value);
+            target = slot;
+        }
+        // The pointer stays valid while the container is open since the values of its parent are not modified until it is closed
+        if(container) containers.push_back(target);
+    }
+
+    void WorldStreamReader::ValueBuilder::key(const std::string& name){
+        if(!discard) slot = &(*containers.back())[name];
+    }
+
+    WorldStreamReader::WorldStreamReader(const std::string& pointer, WorldStreamCallback onPrefabs, WorldStreamCallback onEntity):
+        onPrefabs(std::move(onPrefabs)), onEntity(std::move(onEntity)) {
+        // Every token starts with "/", and the escapes are decoded after the pointer is split so that "~1" doesn't split a key
+        for(size_t start = pointer.find('/'); start != std::string::npos;){
+            size_t end = pointer.find('/', start + 1);
+            std::string token = pointer.substr(start + 1, end == std::string::npos ? std::string::npos : end - start - 1);
+            std::string decoded;
+            for(size_t index = 0; index < token.size(); index++){
+                if(token[index] == '~' && index + 1 < token.size() && (token[index + 1] == '0' || token[index + 1] == '1')){
+                    decoded += token[++index] == '0' ? '~' : '/';
+                } else {
+                    decoded += token[index];
+                }
+            }
+            pointerTokens.push_back(std::move(decoded));
+            start = end;
+        }
+    }
+
+    bool WorldStreamReader::isNextAtPointer() const {
+        if(frames.size() != pointerTokens.size()) return false;
+        for(size_t index = 0; index < frames.size(); index++){
+            const Frame& frame = frames[index];
+            if((frame.isArray ? std::to_string(frame.count) : frame.key) != pointerTokens[index]) return false;
+        }
+        return true;
+    }
+
+    bool WorldStreamReader::begin(nlohmann::json&& value, bool container){
+        if(inItem){
+            addToItem(std::move(value), container);
+            return true;
+        }
+        if(!scopes.empty()){
+            // Every value inside the world is an item (an entity, the prefabs or something to skip) except the array of entities
+            if(scopes.back() == Scope::ENTITIES){
+                itemKind = onEntity ? ItemKind::ENTITY : ItemKind::SKIPPED;
+            } else if(worldKey == "entities" && value.is_array()){
+                scopes.push_back(Scope::ENTITIES);
+                return true;
+            } else {
+                itemKind = (worldKey == "prefabs" && onPrefabs) ? ItemKind::PREFABS : ItemKind::SKIPPED;
+            }
+            inItem = true;
+            item.discard = itemKind == ItemKind::SKIPPED;
+            addToItem(std::move(value), container);
+            return true;
+        }
+
+        // The value is part of the document, unless it is the world
+        bool isWorld = container && !found && isNextAtPointer();
+        if(!frames.empty() && frames.back().isArray) frames.back().count++;
+        if(isWorld){
+            found = true;
+            document.add(nullptr, false);
+            scopes.push_back(value.is_array() ? Scope::ENTITIES : Scope::WORLD_OBJECT);
+            return true;
+        }
+        if(container) frames.push_back({value.is_array(), 0, ""});
+        document.add(std::move(value), container);
+        return true;
+    }
+
+    bool WorldStreamReader::end(){
+        if(inItem){
+            item.close();
+            if(!item.isOpen()) finishItem();
+        } else if(!scopes.empty()){
+            scopes.pop_back();
+        } else {
+            frames.pop_back();
+            document.close();
+        }
+        return true;
+    }
+
+    bool WorldStreamReader::key(string_t& name){
+        if(inItem) item.key(name);
+        else if(!scopes.empty()) worldKey = name;
+        else {
+            frames.back().key = name;
+            document.key(name);
+        }
+        return true;
+    }
+
+    void WorldStreamReader::addToItem(nlohmann::json&& value, bool container){
+        item.add(std::move(value), container);
+        // A scalar item is complete as soon as it is added
+        if(!item.isOpen()) finishItem();
+    }
+
+    void WorldStreamReader::finishItem(){
+        if(itemKind == ItemKind::ENTITY) onEntity(item.get());
+        else if(itemKind == ItemKind::PREFABS) onPrefabs(item.get());
+        item.reset();
+        inItem = false;
+    }
+
+    bool WorldStreamReader::parse_error(std::size_t, const std::string&, const nlohmann::detail::exception& exception){
+        error = exception.what();
+        return false;
+    }
+
+    bool streamWorld(const char* begin, const char* end, WorldStreamReader& reader){
+        // The comments are allowed since the config & world files are JSONC
+        bool parsed = nlohmann::json::sax_parse(begin, end, &reader, nlohmann::json::input_format_t::json, true, true);
+        if(!parsed) std::cerr << "Failed to parse json: " << reader.getError() << std::endl;
+        return parsed;
+    }
+
+    bool streamWorld(std::istream& stream, WorldStreamReader& reader){
+        bool parsed = nlohmann::json::sax_parse(stream, &reader, nlohmann::json::input_format_t::json, true, true);
+        if(!parsed) std::cerr << "Failed to parse json: " << reader.getError() << std::endl;
+        return parsed;
+    }
+
+}
@@ -0,0 +1,106 @@
+#pragma once
+
+#include <json/json.hpp>
+#include <functional>
+#include <istream>
+#include <string>
+#include <vector>
+
+namespace our {
+
+    // Called with the prefabs of a streamed world and with each of its entities
+    typedef std::function<void(const nlohmann::json&)> WorldStreamCallback;
+
+    // Streams a JSONC document with the SAX interface of nlohmann::json instead of parsing it into a single json object.
+    // The world found at the given json pointer (an array of entities or an object with "prefabs" & "entities", see "prefab.hpp")
+    // is never held as a whole: "onPrefabs" is called with the prefabs once they are read and "onEntity" is called with each
+    // entity (including its children) once it is read, so only one entity is held in memory at a time.
+    // The rest of the document is read into "document" where the world is replaced by null.
+    // If a callback is empty, the matching values are skipped without being built.
+    // Since the entities are handed over as they are read, the prefabs must come before the entities in the world object.
+    class WorldStreamReader : public nlohmann::json::json_sax_t {
+        // Builds a json value from the events of its tokens (or only follows its depth if "discard" is true)
+        class ValueBuilder {
+            nlohmann::json root;
+            std::vector<nlohmann::json*> containers; // The containers that are still open (the last one receives the values)
+            nlohmann::json* slot = nullptr; // Where the next value of the last container goes if it is an object (set by "key")
+        public:
+            bool discard = false;
+
+            // Adds a scalar value or opens a container
+            void add(nlohmann::json&& value, bool container);
+            void key(const std::string& name);
+            void close() { containers.pop_back(); }
+            bool isOpen() const { return !containers.empty(); }
+            nlohmann::json& get() { return root; }
+            void reset() { root = nullptr; containers.clear(); slot = nullptr; discard = false; }
+        };
+
+        // Where the events go when they are not part of an entity or the prefabs
+        enum class Scope { WORLD_OBJECT, ENTITIES };
+        // What the value that is currently built will be given to
+        enum class ItemKind { ENTITY, PREFABS, SKIPPED };
+
+        // An open container of the document (used to know the json pointer of the next value)
+        struct Frame {
+            bool isArray;
+            size_t count;       // The number of values added to the array so far
+            std::string key;    // The key of the next value of the object
+        };
+
+        // The reference tokens of the json pointer of the world (decoded, so "~1" is "/" and "~0" is "~")
+        std::vector<std::string> pointerTokens;
+        WorldStreamCallback onPrefabs, onEntity;
+
+        ValueBuilder document;
+        std::vector<Frame> frames;
+        std::vector<Scope> scopes; // Empty while the events are outside the world
+        std::string worldKey;      // The key of the next value of the world object
+
+        ValueBuilder item;
+        bool inItem = false;
+        ItemKind itemKind = ItemKind::SKIPPED;
+
+        bool found = false;
+        std::string error;
+
+        // Routes the start of a value (a scalar or a container) to the document, the world or the current item
+        bool begin(nlohmann::json&& value, bool container);
+        bool end();
+        void addToItem(nlohmann::json&& value, bool container);
+        void finishItem();
+        // Returns true if the next value of the document is the one the json pointer refers to
+        bool isNextAtPointer() const;
+
+    public:
+        // The pointer follows RFC 6901 (e.g. "/scene/world", or "/a~1b" for the key "a/b"). An empty pointer is the whole document.
+        WorldStreamReader(const std::string& pointer, WorldStreamCallback onPrefabs, WorldStreamCallback onEntity);
+
+        // The document without the world (valid after the stream is parsed)
+        nlohmann::json& getDocument() { return document.get(); }
+        // Returns true if the world was found at the pointer
+        bool foundWorld() const { return found; }
+        // The parse error message (empty if the document was parsed successfully)
+        const std::string& getError() const { return error; }
+
+        bool null() override { return begin(nullptr, false); }
+        bool boolean(bool value) override { return begin(value, false); }
+        bool number_integer(number_integer_t value) override { return begin(value, false); }
+        bool number_unsigned(number_unsigned_t value) override { return begin(value, false); }
+        bool number_float(number_float_t value, const string_t&) override { return begin(value, false); }
+        bool string(string_t& value) override { return begin(std::move(value), false); }
+        bool binary(binary_t& value) override { return begin(nlohmann::json::binary(std::move(value)), false); }
+        bool start_object(std::size_t) override { return begin(nlohmann::json::object(), true); }
+        bool key(string_t& name) override;
+        bool end_object() override { return end(); }
+        bool start_array(std::size_t) override { return begin(nlohmann::json::array(), true); }
+        bool end_array() override { return end(); }
+        bool parse_error(std::size_t position, const std::string& lastToken, const nlohmann::detail::exception& exception) override;
+    };
+
+    // Streams a JSONC document (given as a range of characters or as a stream) using a "WorldStreamReader".
+    // Returns false and prints the error if the document is not valid JSONC.
+    bool streamWorld(const char* begin, const char* end, WorldStreamReader& reader);
+    bool streamWorld(std::istream& stream, WorldStreamReader& reader);
+
+}
@@ -1,5 +1,10 @@
 #include <iostream>
+#include <chrono>
 #include "world.hpp"
+#include "compiled-scene.hpp"
+#include "world-stream.hpp"
+#include "../utils/hash.hpp"
+#include "../utils/mapped-file.hpp"
 
 namespace our {
 
@@ -7,19 +12,94 @@ namespace our {
     // If parent pointer is not null, the new entities will be have their parent set to that given pointer
     // If any of the entities has children, this function will be called recursively for these children
     void World::deserialize(const nlohmann::json& data, Entity* parent){
+        if(data.is_string()){
+            load(data.get<std::string>(), parent);
+            return;
+        }
+        if(data.is_object()){
+            if(data.contains("prefabs")) readPrefabs(data["prefabs"], prefabs);
+            if(data.contains("entities")) deserialize(data["entities"], parent);
+            return;
+        }
         if(!data.is_array()) return;
-        for(const auto& entityData : data){
+        for(const auto& entityData : data) deserializeEntity(entityData, parent);
+    }
+
+    void World::deserializeEntity(const nlohmann::json& entityData, Entity* parent){
+        const nlohmann::json* prefab = findPrefab(entityData, prefabs);
+        std::vector<glm::vec3> offsets = getLatticeOffsets(entityData);
+        reserve(offsets.size());
+        for(const glm::vec3& offset : offsets){
             //TODO: (Req 8) Create an entity, make its parent "parent" and call its deserialize with "entityData".
             Entity* entity = add();
             entity->parent = parent;
-            entity->deserialize(entityData);
-            if(entityData.contains("children")){
+            // The description overrides the name & the transform of its prefab. The transform is complete
+            // before the components are read since some components use the position of their entity.
+            if(prefab) entity->deserializeAttributes(*prefab);
+            entity->deserializeAttributes(entityData);
+            entity->localTransform.position += offset;
+            if(prefab) entity->deserializeComponents(*prefab);
+            entity->deserializeComponents(entityData);
+            if(prefab && prefab->contains("children")) deserialize((*prefab)["children"], entity);
+            if(entityData.is_object() && entityData.contains("children")){
                 //TODO: (Req 8) Recursively call this world's "deserialize" using the children data
                 // and the current entity as the parent
                 deserialize(entityData["children"], entity);
-                
             }
         }
     }
 
+    void World::load(const std::string& path, Entity* parent){
+        auto start = std::chrono::steady_clock::now();
+        // The path can point to a world inside a bigger json file by a json pointer after "#" (e.g. "config/app.jsonc#/scene/world")
+        size_t separator = path.find('#');
+        std::string filename = path.substr(0, separator);
+        std::string pointer = separator == std::string::npos ? "" : path.substr(separator + 1);
+        MappedFile source(filename);
+        if(!source.isOpen()){
+            std::cerr << "Couldn't open the world file: " << filename << std::endl;
+            return;
+        }
+        // The compiled scene stores the hash of its source, so it is only used if the source didn't change since it was compiled
+        // (the pointer is hashed too since the file can hold other worlds)
+        uint64_t sourceHash = hashFNV1a(pointer, hashFNV1a(source.getData(), source.getSize()));
+        std::string compiledPath = compiled_scene::getPath(path);
+        compiled_scene::CompiledScene scene;
+        if(compiled_scene::open(compiledPath, sourceHash, scene)){
+            compiled_scene::instantiate(scene, this, parent);
+            auto duration = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+            std::cout << "Loaded " << scene.getCount(compiled_scene::ENTITIES) << " entities from \"" << compiledPath << "\" in " << duration << " ms" << std::endl;
+            return;
+        }
+
+        // The world is streamed: each entity is created (and compiled) as soon as it is read, so the file is never held as a single json object
+        size_t entityCount = entities.size();
+        compiled_scene::Compiler compiler;
+        WorldStreamReader reader(pointer, [&](const nlohmann::json& data){
+            readPrefabs(data, prefabs);
+            compiler.addPrefabs(data);
+        }, [&](const nlohmann::json& entityData){
+            deserializeEntity(entityData, parent);
+            compiler.addEntity(entityData);
+        });
+        const char* text = reinterpret_cast<const char*>(source.getData());
+        if(!streamWorld(text, text + source.getSize(), reader)){
+            std::cerr << "Couldn't parse the world file: " << filename << std::endl;
+            return;
+        }
+        if(!reader.foundWorld()){
+            std::cerr << "Couldn't find the world \"" << pointer << "\" in: " << filename << std::endl;
+            return;
+        }
+        auto duration = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        std::cout << "Loaded " << entities.size() - entityCount << " entities from \"" << path << "\" in " << duration << " ms" << std::endl;
+        // The compiled scene is written to the cache for the next time (the scene compiler tool can also be used to compile it ahead of time)
+        std::vector<unsigned char> compiled = compiler.finish(sourceHash);
+        if(compiled.empty()){
+            std::cerr << "WARNING: Couldn't compile \"" << path << "\", it will be loaded from its source" << std::endl;
+        } else if(compiled_scene::save(compiledPath, compiled)){
+            std::cout << "Compiled \"" << filename << "\" to \"" << compiledPath << "\"" << std::endl;
+        }
+    }
+
 }
\ No newline at end of file
@@ -3,6 +3,7 @@
 #include <unordered_set>
 #include <vector>
 #include "entity.hpp"
+#include "prefab.hpp"
 
 namespace our {
 
@@ -14,6 +15,7 @@ namespace our {
         std::unordered_set<Entity*> markedForRemoval; // These are the entities that are awaiting to be deleted
                                                       // when deleteMarkedEntities is called
         std::vector<std::vector<short>> grid; // The grid of the board
+        PrefabMap prefabs; // The prefabs defined by the deserialized world files (see "prefab.hpp")
     public:
 
         World() {
@@ -23,7 +25,23 @@ namespace our {
         // This will deserialize a json array of entities and add the new entities to the current world
         // If parent pointer is not null, the new entities will be have their parent set to that given pointer
         // If any of the entities has children, this function will be called recursively for these children
+        // If data is a string, it is the path of a world file to load (see "load")
+        // If data is an object, it holds the "prefabs" and the array of "entities" that can use them (see "prefab.hpp")
+        // An entity with a "lattice" is created once per cell of the lattice
         void deserialize(const nlohmann::json& data, Entity* parent = nullptr);
+        // This will deserialize a single entity description (and its children) using the prefabs read so far
+        void deserializeEntity(const nlohmann::json& entityData, Entity* parent = nullptr);
+
+        // This will load the entities from a world file (a JSONC file holding the array of entities or an object with prefabs & entities).
+        // The world can also be a part of a bigger file given by a json pointer after "#" (e.g. "config/app.jsonc#/scene/world").
+        // If the file has an up to date compiled scene (see "compiled-scene.hpp"), the entities are created from it instead
+        // of parsing the JSONC. Otherwise, the JSONC is streamed (see "world-stream.hpp") and compiled so that the next load uses the compiled scene.
+        void load(const std::string& path, Entity* parent = nullptr);
+
+        // This reserves space for the given number of new entities (used when many entities are added at once)
+        void reserve(size_t count) {
+            entities.reserve(entities.size() + count);
+        }
 
         // This adds an entity to the entities set and returns a pointer to that entity
         // WARNING The entity is owned by this world so don't use "delete" to delete it, instead, call "markForRemoval"
@@ -74,6 +92,7 @@ namespace our {
             }
             entities.clear();
             markedForRemoval.clear();
+            prefabs.clear();
         }
 
         //Since the world owns all of its entities, they should be deleted alongside it.
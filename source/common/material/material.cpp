@@ -3,6 +3,8 @@
 #include "../asset-loader.hpp"
 #include "deserialize-utils.hpp"
 
+#include <typeinfo>
+
 namespace our {
 
     // This function should setup the pipeline state and set the shader to be used
@@ -38,6 +40,19 @@ namespace our {
         tint = data.value("tint", glm::vec4(1.0f, 1.0f, 1.0f, 1.0f));
     }
 
+    MaterialDrawData TintedMaterial::getDrawData() const {
+        MaterialDrawData data;
+        data.tint = tint;
+        return data;
+    }
+
+    // The tint is per draw, so two tinted materials can share a draw if they have the same type, shader & pipeline state
+    bool TintedMaterial::canShareDraw(const Material* other) const {
+        if(other == this) return true;
+        if(other == nullptr || typeid(*other) != typeid(*this)) return false;
+        return other->shader == shader && other->transparent == transparent && other->pipelineState == pipelineState;
+    }
+
     // This function should call the setup of its parent and
     // set the "alphaThreshold" uniform to the value in the member variable alphaThreshold
     // Then it should bind the texture and sampler to a texture unit and send the unit number to the uniform variable "tex" 
@@ -45,7 +60,19 @@ namespace our {
         //TODO: (Req 7) Write this function
         TintedMaterial::setup();
         shader->set("alphaThreshold",alphaThreshold);
-        if(texture != nullptr && sampler !=nullptr)
+        // The texture array sampler always reads its own unit, even if nothing is packed, so it never shares a unit with a sampler2D
+        shader->set("texture_array", TEXTURE_ARRAY_UNIT);
+        MaterialDrawData data = getDrawData();
+        shader->set("layers[0]", data.layers[0]);
+        shader->set("layers[1]", data.layers[1]);
+        if(textureArray != nullptr && sampler != nullptr)
+        {
+            glActiveTexture(GL_TEXTURE0 + TEXTURE_ARRAY_UNIT);
+            textureArray->bind();
+            sampler->bind(TEXTURE_ARRAY_UNIT);
+            glActiveTexture(GL_TEXTURE0);
+        }
+        else if(texture != nullptr && sampler !=nullptr)
         {
             glActiveTexture(GL_TEXTURE0);
             texture->bind();
@@ -63,11 +90,28 @@ namespace our {
         sampler = AssetLoader<Sampler>::get(data.value("sampler", ""));
     }
 
+    MaterialDrawData TexturedMaterial::getDrawData() const {
+        MaterialDrawData data = TintedMaterial::getDrawData();
+        if(textureArray != nullptr) data.layers[0].x = (float)layer;
+        return data;
+    }
+
+    // The packed materials only need the same texture array, the others must have the same texture
+    bool TexturedMaterial::canShareDraw(const Material* other) const {
+        if(!TintedMaterial::canShareDraw(other)) return false;
+        auto textured = static_cast<const TexturedMaterial*>(other);
+        if(textured->sampler != sampler || textured->alphaThreshold != alphaThreshold) return false;
+        if(textureArray != nullptr) return textured->textureArray == textureArray;
+        return textured->textureArray == nullptr && textured->texture == texture;
+    }
+
 
     // setup of the lightMaterial to create the needed textures based on the type
     void LightingMaterial::setup() const
     {
         TexturedMaterial::setup();
+        // If the maps are packed, the texture array bound by the textured material holds all of them
+        if (textureArray != nullptr) return;
 
         if (albedo != nullptr)
         {
@@ -139,4 +183,28 @@ namespace our {
         ambient_occlusion = AssetLoader<Texture2D>::get(data.value("ambient_occlusion", ""));
     }
 
+
+    MaterialDrawData LightingMaterial::getDrawData() const
+    {
+        MaterialDrawData data = TintedMaterial::getDrawData();
+        if (textureArray != nullptr)
+        {
+            data.layers[0] = glm::vec4(albedoLayer, specularLayer, emissiveLayer, roughnessLayer);
+            data.layers[1].x = (float)ambientOcclusionLayer;
+        }
+        return data;
+    }
+
+    // The lit materials can only share a draw if all their maps are packed in the same texture array or if they have the same maps
+    bool LightingMaterial::canShareDraw(const Material *other) const
+    {
+        // The texture of the textured material is not read by the lighting shader, so it is not compared
+        if (!TintedMaterial::canShareDraw(other)) return false;
+        auto lit = static_cast<const LightingMaterial *>(other);
+        if (lit->sampler != sampler || lit->alphaThreshold != alphaThreshold) return false;
+        if (textureArray != nullptr) return lit->textureArray == textureArray;
+        return lit->textureArray == nullptr && lit->albedo == albedo && lit->specular == specular && lit->emissive == emissive &&
+            lit->roughness == roughness && lit->ambient_occlusion == ambient_occlusion;
+    }
+
 }
\ No newline at end of file
@@ -2,6 +2,7 @@
 
 #include "pipeline-state.hpp"
 #include "../texture/texture2d.hpp"
+#include "../texture/texture-array.hpp"
 #include "../texture/sampler.hpp"
 #include "../shader/shader.hpp"
 
@@ -10,6 +11,19 @@
 
 namespace our {
 
+    // The texture unit used to bind the texture array of the packed materials
+    // (a unit of its own since a sampler2D and a sampler2DArray can't read the same unit)
+    constexpr GLint TEXTURE_ARRAY_UNIT = 8;
+
+    // The data of a material that can change from one draw to the next when the objects of several materials share a draw
+    // (see "Material::canShareDraw"). It is sent as uniforms by "setup" and written per draw by the indirect renderer.
+    struct MaterialDrawData {
+        glm::vec4 tint = glm::vec4(1.0f);
+        // The layers of the material textures in its texture array (negative if the textures are not packed)
+        // The textured materials use layers[0].x and the lit materials use the order: albedo, specular, emissive, roughness, ambient occlusion
+        glm::vec4 layers[2] = {glm::vec4(-1.0f), glm::vec4(-1.0f)};
+    };
+
     // This is the base class for all the materials
     // It contains the 3 essential components required by any material
     // 1- The pipeline state when drawing objects using this material
@@ -26,6 +40,14 @@ namespace our {
         virtual void setup() const;
         // This function read a material from a json object
         virtual void deserialize(const nlohmann::json& data);
+
+        // Returns the data of this material that is allowed to differ between the materials sharing a draw
+        virtual MaterialDrawData getDrawData() const { return MaterialDrawData(); }
+        // Returns true if the objects of the given material can be drawn after "setup" is called on this material,
+        // given that the data returned by "getDrawData" is supplied per draw (the shaders read it when drawing indirectly)
+        virtual bool canShareDraw(const Material* other) const { return other == this; }
+
+        virtual ~Material() = default;
     };
 
     // This material adds a uniform for a tint (a color that will be sent to the shader)
@@ -36,6 +58,8 @@ namespace our {
 
         void setup() const override;
         void deserialize(const nlohmann::json& data) override;
+        MaterialDrawData getDrawData() const override;
+        bool canShareDraw(const Material* other) const override;
     };
 
     // This material adds two uniforms (besides the tint from Tinted Material)
@@ -43,14 +67,21 @@ namespace our {
     // - "tex" which is a Sampler2D. "texture" and "sampler" will be bound to it.
     // - "alphaThreshold" which defined the alpha limit below which the pixel should be discarded
     // An example where this material can be used is when the object has a texture
+    // If the texture packer placed the texture in a layer of a texture array, the array is bound instead of the texture
+    // so that the objects of the materials packed into the same array can share a draw
     class TexturedMaterial : public TintedMaterial {
     public:
         Texture2D* texture;
         Sampler* sampler;
         float alphaThreshold;
+        // The texture array holding the textures of this material and the layer of "texture" in it (set by the texture packer)
+        TextureArray* textureArray = nullptr;
+        int layer = -1;
 
         void setup() const override;
         void deserialize(const nlohmann::json& data) override;
+        MaterialDrawData getDrawData() const override;
+        bool canShareDraw(const Material* other) const override;
     };
 
     class LightingMaterial : public TexturedMaterial {
@@ -61,9 +92,13 @@ namespace our {
         Texture2D *roughness;
         Texture2D *ambient_occlusion;
         Sampler* sampler;
+        // The layers of the maps in "textureArray" (only used if all the maps are packed)
+        int albedoLayer = -1, specularLayer = -1, emissiveLayer = -1, roughnessLayer = -1, ambientOcclusionLayer = -1;
 
         void setup() const override;
         void deserialize(const nlohmann::json& data) override;
+        MaterialDrawData getDrawData() const override;
+        bool canShareDraw(const Material* other) const override;
     };
     // This function returns a new material instance based on the given type
     inline Material* createMaterialFromType(const std::string& type){
@@ -77,6 +77,19 @@ namespace our {
 
         // Given a json object, this function deserializes a PipelineState structure
         void deserialize(const nlohmann::json& data);
+
+        // Two states are equal if they configure OpenGL in the same way (used to find the materials that can share a draw)
+        bool operator==(const PipelineState& other) const {
+            if(faceCulling.enabled != other.faceCulling.enabled) return false;
+            if(faceCulling.enabled && (faceCulling.culledFace != other.faceCulling.culledFace || faceCulling.frontFace != other.faceCulling.frontFace)) return false;
+            if(depthTesting.enabled != other.depthTesting.enabled) return false;
+            if(depthTesting.enabled && depthTesting.function != other.depthTesting.function) return false;
+            if(blending.enabled != other.blending.enabled) return false;
+            if(blending.enabled && (blending.equation != other.blending.equation || blending.sourceFactor != other.blending.sourceFactor ||
+                blending.destinationFactor != other.blending.destinationFactor || blending.constantColor != other.blending.constantColor)) return false;
+            return colorMask == other.colorMask && depthMask == other.depthMask;
+        }
+        bool operator!=(const PipelineState& other) const { return !(*this == other); }
     };
 
 }
\ No newline at end of file
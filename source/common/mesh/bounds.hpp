@@ -0,0 +1,55 @@
+#pragma once
+
+#include <glm/glm.hpp>
+#include <limits>
+
+namespace our {
+
+    // An axis aligned bounding box defined by its minimum and maximum corners
+    // An empty box has its minimum greater than its maximum so that expanding it with any point gives a valid box
+    struct AABB {
+        glm::vec3 min = glm::vec3(std::numeric_limits<float>::max());
+        glm::vec3 max = glm::vec3(std::numeric_limits<float>::lowest());
+
+        AABB() = default;
+        AABB(const glm::vec3& min, const glm::vec3& max) : min(min), max(max) {}
+
+        bool isEmpty() const { return min.x > max.x || min.y > max.y || min.z > max.z; }
+
+        glm::vec3 getCenter() const { return (min + max) * 0.5f; }
+        glm::vec3 getExtents() const { return (max - min) * 0.5f; }
+
+        // The surface area is used as the cost metric while building the bounding volume hierarchy
+        float getSurfaceArea() const {
+            glm::vec3 size = max - min;
+            return 2.0f * (size.x * size.y + size.y * size.z + size.z * size.x);
+        }
+
+        // Grows the box to include the given point
+        void expand(const glm::vec3& point){
+            min = glm::min(min, point);
+            max = glm::max(max, point);
+        }
+
+        // Returns true if the given box is completely inside this box
+        bool contains(const AABB& other) const {
+            return glm::all(glm::lessThanEqual(min, other.min)) && glm::all(glm::greaterThanEqual(max, other.max));
+        }
+
+        // Returns the smallest box containing the two given boxes
+        static AABB merge(const AABB& a, const AABB& b){
+            return AABB(glm::min(a.min, b.min), glm::max(a.max, b.max));
+        }
+
+        // Returns the axis aligned box containing this box after being transformed by the given matrix
+        // Instead of transforming the 8 corners, we transform the center and project the extents on the world axes (Arvo's method)
+        AABB transformed(const glm::mat4& matrix) const {
+            if(isEmpty()) return *this;
+            glm::vec3 center = glm::vec3(matrix * glm::vec4(getCenter(), 1.0f));
+            glm::mat3 absolute = glm::mat3(glm::abs(glm::vec3(matrix[0])), glm::abs(glm::vec3(matrix[1])), glm::abs(glm::vec3(matrix[2])));
+            glm::vec3 extents = absolute * getExtents();
+            return AABB(center - extents, center + extents);
+        }
+    };
+
+}
@@ -0,0 +1,268 @@
+#include "mesh-utils.hpp"
+#include "mesh-optimizer.hpp"
+
+// We will use "Tiny glTF" to read ".gltf" and ".glb" files. We only need the geometry,
+// so the images are neither decoded nor loaded from external files (the textures are loaded by the texture loader)
+#define TINYGLTF_IMPLEMENTATION
+#define TINYGLTF_NO_STB_IMAGE
+#define TINYGLTF_NO_STB_IMAGE_WRITE
+#define TINYGLTF_NO_EXTERNAL_IMAGE
+#include <tinygltf/tiny_gltf.h>
+
+#include <glm/gtc/type_ptr.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+#include <glm/gtc/quaternion.hpp>
+#include <glm/gtx/quaternion.hpp>
+#include <iostream>
+#include <sstream>
+#include <functional>
+#include <filesystem>
+#include <algorithm>
+
+namespace {
+
+    // The images are skipped, so the image loader does nothing
+    bool skipImage(tinygltf::Image*, const int, std::string*, std::string*, int, int, const unsigned char*, int, void*){
+        return true;
+    }
+
+    // Returns the local transform of a node (either given as a matrix or as TRS)
+    glm::mat4 getNodeTransform(const tinygltf::Node& node){
+        if(node.matrix.size() == 16) return glm::mat4(glm::make_mat4(node.matrix.data()));
+        glm::mat4 transform(1.0f);
+        if(node.translation.size() == 3) transform = glm::translate(transform, glm::vec3(node.translation[0], node.translation[1], node.translation[2]));
+        // glTF stores the quaternions as (x, y, z, w) while glm::quat takes (w, x, y, z)
+        if(node.rotation.size() == 4) transform *= glm::toMat4(glm::quat((float)node.rotation[3], (float)node.rotation[0], (float)node.rotation[1], (float)node.rotation[2]));
+        if(node.scale.size() == 3) transform = glm::scale(transform, glm::vec3(node.scale[0], node.scale[1], node.scale[2]));
+        return transform;
+    }
+
+    // Gives direct access to the elements of an accessor inside its buffer (no copies are made)
+    struct AccessorView {
+        const unsigned char* data = nullptr;
+        size_t count = 0, stride = 0;
+        int componentType = 0, components = 0;
+        bool normalized = false;
+
+        bool open(const tinygltf::Model& model, int index){
+            if(index < 0 || index >= (int)model.accessors.size()) return false;
+            const tinygltf::Accessor& accessor = model.accessors[index];
+            if(accessor.bufferView < 0 || accessor.bufferView >= (int)model.bufferViews.size() || accessor.sparse.isSparse) return false;
+            const tinygltf::BufferView& view = model.bufferViews[accessor.bufferView];
+            if(view.buffer < 0 || view.buffer >= (int)model.buffers.size()) return false;
+            const tinygltf::Buffer& buffer = model.buffers[view.buffer];
+            int byteStride = accessor.ByteStride(view);
+            int componentSize = tinygltf::GetComponentSizeInBytes(accessor.componentType);
+            int componentCount = tinygltf::GetNumComponentsInType(accessor.type);
+            if(byteStride <= 0 || componentSize <= 0 || componentCount <= 0) return false;
+            // The files can be truncated or malicious, so every element (including the whole last one) must be inside the view & the buffer
+            if(view.byteOffset > buffer.data.size() || view.byteLength > buffer.data.size() - view.byteOffset) return false;
+            if(accessor.byteOffset > view.byteLength) return false;
+            size_t offset = view.byteOffset + accessor.byteOffset;
+            if(accessor.count > 0){
+                if(accessor.count - 1 > buffer.data.size() / (size_t)byteStride) return false;
+                size_t end = offset + (accessor.count - 1) * (size_t)byteStride + (size_t)componentCount * componentSize;
+                if(end > view.byteOffset + view.byteLength || end > buffer.data.size()) return false;
+            }
+            data = buffer.data.data() + offset;
+            count = accessor.count;
+            stride = (size_t)byteStride;
+            componentType = accessor.componentType;
+            components = componentCount;
+            normalized = accessor.normalized;
+            return true;
+        }
+
+        // Reads a component of an element as a float (the integer components are normalized if needed)
+        float read(size_t element, int component) const {
+            // The accessor may have less components than expected (e.g. a 2D position), so the missing ones are read as 0
+            if(component >= components) return 0.0f;
+            const unsigned char* pointer = data + element * stride;
+            switch(componentType){
+                case TINYGLTF_COMPONENT_TYPE_FLOAT: return reinterpret_cast<const float*>(pointer)[component];
+                case TINYGLTF_COMPONENT_TYPE_UNSIGNED_BYTE: { float value = pointer[component]; return normalized ? value / 255.0f : value; }
+                case TINYGLTF_COMPONENT_TYPE_UNSIGNED_SHORT: { float value = reinterpret_cast<const uint16_t*>(pointer)[component]; return normalized ? value / 65535.0f : value; }
+                case TINYGLTF_COMPONENT_TYPE_BYTE: { float value = reinterpret_cast<const int8_t*>(pointer)[component]; return normalized ? glm::max(value / 127.0f, -1.0f) : value; }
+                case TINYGLTF_COMPONENT_TYPE_SHORT: { float value = reinterpret_cast<const int16_t*>(pointer)[component]; return normalized ? glm::max(value / 32767.0f, -1.0f) : value; }
+                default: return 0.0f;
+            }
+        }
+
+        // Reads an element of an index accessor
+        GLuint readIndex(size_t element) const {
+            const unsigned char* pointer = data + element * stride;
+            switch(componentType){
+                case TINYGLTF_COMPONENT_TYPE_UNSIGNED_BYTE: return *pointer;
+                case TINYGLTF_COMPONENT_TYPE_UNSIGNED_SHORT: return *reinterpret_cast<const uint16_t*>(pointer);
+                case TINYGLTF_COMPONENT_TYPE_UNSIGNED_INT: return *reinterpret_cast<const uint32_t*>(pointer);
+                default: return 0;
+            }
+        }
+    };
+
+    // Returns the index of the given attribute in a primitive or -1 if the primitive doesn't have it
+    int findAttribute(const tinygltf::Primitive& primitive, const char* name){
+        auto it = primitive.attributes.find(name);
+        return it == primitive.attributes.end() ? -1 : it->second;
+    }
+
+    // Appends the vertices & elements of a primitive after transforming it by the given matrix.
+    // Returns false if the primitive is not a triangle list or if its data is invalid.
+    bool appendPrimitive(const tinygltf::Model& model, const tinygltf::Primitive& primitive, const glm::mat4& transform,
+                         std::vector<our::Vertex>& vertices, std::vector<GLuint>& elements){
+        if(primitive.mode != TINYGLTF_MODE_TRIANGLES) return false;
+
+        AccessorView positions, normals, tex_coords, colors, indices;
+        if(!positions.open(model, findAttribute(primitive, "POSITION"))) return false;
+        bool hasNormals = normals.open(model, findAttribute(primitive, "NORMAL")) && normals.count == positions.count;
+        bool hasTexCoords = tex_coords.open(model, findAttribute(primitive, "TEXCOORD_0")) && tex_coords.count == positions.count;
+        bool hasColors = colors.open(model, findAttribute(primitive, "COLOR_0")) && colors.count == positions.count;
+        int colorComponents = hasColors && model.accessors[primitive.attributes.at("COLOR_0")].type == TINYGLTF_TYPE_VEC4 ? 4 : 3;
+        bool hasIndices = primitive.indices >= 0;
+        if(hasIndices && !indices.open(model, primitive.indices)) return false;
+
+        // The normals are transformed by the inverse transpose so that non-uniform scales don't skew them
+        glm::mat3 normalMatrix = glm::transpose(glm::inverse(glm::mat3(transform)));
+        // A negative determinant mirrors the primitive, so the triangle winding must be flipped to keep them CCW
+        bool flip = glm::determinant(glm::mat3(transform)) < 0.0f;
+
+        GLuint baseVertex = (GLuint)vertices.size();
+        vertices.reserve(vertices.size() + positions.count);
+        for(size_t index = 0; index < positions.count; index++){
+            our::Vertex vertex = {};
+            glm::vec3 position(positions.read(index, 0), positions.read(index, 1), positions.read(index, 2));
+            vertex.position = glm::vec3(transform * glm::vec4(position, 1.0f));
+            if(hasNormals){
+                glm::vec3 normal = normalMatrix * glm::vec3(normals.read(index, 0), normals.read(index, 1), normals.read(index, 2));
+                float length = glm::length(normal);
+                vertex.normal = length > 0.0f ? normal / length : glm::vec3(0, 1, 0);
+            } else {
+                vertex.normal = glm::vec3(0, 1, 0);
+            }
+            // glTF puts the origin of the texture space at the top left while OpenGL puts it at the bottom left
+            if(hasTexCoords) vertex.tex_coord = glm::vec2(tex_coords.read(index, 0), 1.0f - tex_coords.read(index, 1));
+            if(hasColors){
+                glm::vec4 color(colors.read(index, 0), colors.read(index, 1), colors.read(index, 2), colorComponents == 4 ? colors.read(index, 3) : 1.0f);
+                vertex.color = our::Color(glm::clamp(color, 0.0f, 1.0f) * 255.0f);
+            } else {
+                vertex.color = our::Color(255, 255, 255, 255);
+            }
+            vertices.push_back(vertex);
+        }
+
+        // A primitive without indices draws its vertices in order
+        size_t elementCount = hasIndices ? indices.count : positions.count;
+        elementCount -= elementCount % 3;
+        elements.reserve(elements.size() + elementCount);
+        for(size_t index = 0; index < elementCount; index += 3){
+            GLuint triangle[3];
+            for(int corner = 0; corner < 3; corner++){
+                GLuint element = hasIndices ? indices.readIndex(index + corner) : (GLuint)(index + corner);
+                if(element >= positions.count) return false;
+                triangle[corner] = baseVertex + element;
+            }
+            if(flip) std::swap(triangle[1], triangle[2]);
+            elements.insert(elements.end(), triangle, triangle + 3);
+        }
+        return true;
+    }
+
+}
+
+bool our::mesh_utils::importGLTF(const std::string& filename, std::vector<Vertex>& vertices, std::vector<GLuint>& elements, std::vector<SubMesh>& submeshes) {
+    vertices.clear();
+    elements.clear();
+    submeshes.clear();
+
+    tinygltf::Model model;
+    tinygltf::TinyGLTF loader;
+    loader.SetImageLoader(skipImage, nullptr);
+    std::string warn, err;
+
+    // A ".glb" stores the buffers in a binary chunk which is read as is, so only the small JSON chunk is parsed
+    // The extension is compared in lower case like in "mesh_utils::prepareMesh" which routes both ".glb" & ".GLB" to this loader
+    auto extension = std::filesystem::path(filename).extension().string();
+    std::transform(extension.begin(), extension.end(), extension.begin(), ::tolower);
+    bool binary = extension == ".glb";
+    bool loaded = binary ? loader.LoadBinaryFromFile(&model, &err, &warn, filename) : loader.LoadASCIIFromFile(&model, &err, &warn, filename);
+    if(!warn.empty()) {
+        std::cout << "WARN while loading gltf file \"" << filename << "\": " << warn << std::endl;
+    }
+    if(!loaded) {
+        std::cerr << "Failed to load gltf file \"" << filename << "\" due to error: " << err << std::endl;
+        return false;
+    }
+
+    // The node transforms are baked into the vertices since the mesh is placed in the world by its entity
+    auto appendMesh = [&](int meshIndex, const glm::mat4& transform){
+        if(meshIndex < 0 || meshIndex >= (int)model.meshes.size()) return;
+        for(const auto& primitive : model.meshes[meshIndex].primitives){
+            size_t vertexCount = vertices.size(), firstElement = elements.size();
+            if(!appendPrimitive(model, primitive, transform, vertices, elements)){
+                std::cout << "WARN while loading gltf file \"" << filename << "\": skipped a primitive of mesh " << meshIndex << std::endl;
+                vertices.resize(vertexCount);
+                elements.resize(firstElement);
+                continue;
+            }
+            // Every primitive becomes a sub-mesh so that it can be drawn with its own material
+            submeshes.push_back({(GLuint)firstElement, (GLuint)(elements.size() - firstElement)});
+        }
+    };
+
+    int sceneIndex = model.defaultScene >= 0 ? model.defaultScene : 0;
+    if(sceneIndex < (int)model.scenes.size()){
+        std::function<void(int, const glm::mat4&)> visit = [&](int nodeIndex, const glm::mat4& parent){
+            if(nodeIndex < 0 || nodeIndex >= (int)model.nodes.size()) return;
+            const tinygltf::Node& node = model.nodes[nodeIndex];
+            glm::mat4 transform = parent * getNodeTransform(node);
+            appendMesh(node.mesh, transform);
+            for(int child : node.children) visit(child, transform);
+        };
+        for(int node : model.scenes[sceneIndex].nodes) visit(node, glm::mat4(1.0f));
+    } else {
+        // Without a scene, we take all the meshes as they are
+        for(int mesh = 0; mesh < (int)model.meshes.size(); mesh++) appendMesh(mesh, glm::mat4(1.0f));
+    }
+
+    if(submeshes.empty()){
+        std::cerr << "Failed to load gltf file \"" << filename << "\" due to error: no triangles were found" << std::endl;
+        return false;
+    }
+    return true;
+}
+
+our::Mesh* our::mesh_utils::loadGLTF(const std::string& filename) {
+    MeshData data;
+    if(!prepareGLTF(filename, data)) return nullptr;
+    return createMesh(data);
+}
+
+bool our::mesh_utils::prepareGLTF(const std::string& filename, MeshData& data) {
+    std::vector<our::Vertex>& vertices = data.vertices;
+    std::vector<GLuint>& elements = data.elements;
+    std::vector<SubMesh>& submeshes = data.submeshes;
+    if(!importGLTF(filename, vertices, elements, submeshes)) return false;
+
+    // Each sub-mesh is optimized separately since its triangles must stay together,
+    // then the vertices of the whole mesh are reordered in the order they are used
+    // The statistics are only computed & printed in verbose mode (see "mesh_optimizer::setVerbose")
+    bool verbose = mesh_optimizer::isVerbose();
+    mesh_optimizer::VertexCacheStats before;
+    if(verbose) before = mesh_optimizer::analyzeVertexCache(elements, vertices.size());
+    for(const SubMesh& submesh : submeshes){
+        auto first = elements.begin() + submesh.firstElement;
+        std::vector<GLuint> range(first, first + submesh.elementCount);
+        if(mesh_optimizer::optimizeTriangleOrder(range, vertices)) std::copy(range.begin(), range.end(), first);
+    }
+    mesh_optimizer::optimizeVertexFetch(vertices, elements);
+    if(verbose){
+        auto after = mesh_optimizer::analyzeVertexCache(elements, vertices.size());
+        // The message is written at once since the meshes can be prepared by multiple threads
+        std::ostringstream message;
+        message << "Optimized \"" << filename << "\" (" << vertices.size() << " vertices, " << elements.size() / 3 << " triangles, "
+                << submeshes.size() << " sub-meshes): "
+                << "ACMR " << before.acmr << " -> " << after.acmr << ", ATVR " << before.atvr << " -> " << after.atvr << "\n";
+        std::cout << message.str() << std::flush;
+    }
+    return true;
+}
@@ -0,0 +1,105 @@
+#include "mesh-cache.hpp"
+#include "mesh-optimizer.hpp"
+#include "../utils/hash.hpp"
+
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+
+namespace our::mesh_cache {
+
+    static const char MAGIC[4] = {'A', 'X', 'M', 'C'};
+    static_assert(sizeof(Header) % alignof(Vertex) == 0, "The vertices must be aligned after the header");
+
+    std::string getCachePath(const std::string& sourceFilename){
+        // The hash of the path is added to the name to separate the files which have the same name in different folders
+        std::filesystem::path path(sourceFilename);
+        std::stringstream stream;
+        stream << "cache/meshes/" << path.stem().string() << "-" << std::hex << std::setw(16) << std::setfill('0')
+               << hashFNV1a(path.generic_string()) << ".mesh";
+        return stream.str();
+    }
+
+    bool open(const std::string& cachePath, uint64_t sourceHash, CachedMesh& cached){
+        MappedFile& file = cached.file;
+        if(!file.open(cachePath)) return false;
+        if(file.getSize() < sizeof(Header)){ file.close(); return false; }
+
+        Header header;
+        std::memcpy(&header, file.getData(), sizeof(Header));
+        size_t vertexBytes = (size_t)header.vertexCount * sizeof(Vertex);
+        size_t elementBytes = (size_t)header.elementCount * sizeof(GLuint);
+        bool valid = std::memcmp(header.magic, MAGIC, sizeof(MAGIC)) == 0 &&
+                     header.version == VERSION && header.vertexSize == sizeof(Vertex) &&
+                     // If the meshes are optimized differently now, the cache is stale too
+                     header.settingsHash == mesh_optimizer::getSettingsHash() &&
+                     // If the source changed since the cache was written, the cache is stale
+                     header.sourceHash == sourceHash &&
+                     file.getSize() == sizeof(Header) + vertexBytes + elementBytes;
+        if(!valid){ file.close(); return false; }
+
+        // The data will be uploaded straight from the mapped pages
+        cached.vertices = reinterpret_cast<const Vertex*>(file.getData() + sizeof(Header));
+        cached.vertexCount = header.vertexCount;
+        cached.elements = reinterpret_cast<const GLuint*>(file.getData() + sizeof(Header) + vertexBytes);
+        cached.elementCount = header.elementCount;
+        cached.bounds = AABB(glm::vec3(header.boundsMin[0], header.boundsMin[1], header.boundsMin[2]),
+                             glm::vec3(header.boundsMax[0], header.boundsMax[1], header.boundsMax[2]));
+        return true;
+    }
+
+    Mesh* upload(const CachedMesh& cached){
+        return new Mesh(cached.vertices, cached.vertexCount, cached.elements, cached.elementCount, cached.bounds);
+    }
+
+    Mesh* load(const std::string& cachePath, uint64_t sourceHash){
+        CachedMesh cached;
+        if(!open(cachePath, sourceHash, cached)) return nullptr;
+        return upload(cached);
+    }
+
+    bool save(const std::string& cachePath, uint64_t sourceHash, const std::vector<Vertex>& vertices, const std::vector<GLuint>& elements){
+        AABB bounds;
+        for(const auto& vertex : vertices) bounds.expand(vertex.position);
+
+        Header header = {};
+        std::memcpy(header.magic, MAGIC, sizeof(MAGIC));
+        header.version = VERSION;
+        header.sourceHash = sourceHash;
+        header.settingsHash = mesh_optimizer::getSettingsHash();
+        header.vertexSize = sizeof(Vertex);
+        header.vertexCount = (uint32_t)vertices.size();
+        header.elementCount = (uint32_t)elements.size();
+        for(int axis = 0; axis < 3; axis++){
+            header.boundsMin[axis] = bounds.min[axis];
+            header.boundsMax[axis] = bounds.max[axis];
+        }
+
+        std::error_code error;
+        std::filesystem::create_directories(std::filesystem::path(cachePath).parent_path(), error);
+        // We write to a temporary file then rename it, so a partially written file is never read.
+        // The temporary file is unique to this thread, since the same mesh can be saved by other threads or processes at the same time.
+        std::string temporaryPath = getTemporaryPath(cachePath);
+        bool written;
+        {
+            std::ofstream file(temporaryPath, std::ios::binary | std::ios::trunc);
+            file.write(reinterpret_cast<const char*>(&header), sizeof(Header));
+            file.write(reinterpret_cast<const char*>(vertices.data()), vertices.size() * sizeof(Vertex));
+            file.write(reinterpret_cast<const char*>(elements.data()), elements.size() * sizeof(GLuint));
+            file.close();
+            written = !file.fail();
+        }
+        if(written) std::filesystem::rename(temporaryPath, cachePath, error);
+        if(!written || error){
+            // The temporary file is never left behind
+            std::filesystem::remove(temporaryPath, error);
+            std::cerr << "Failed to write the mesh cache \"" << cachePath << "\"" << std::endl;
+            return false;
+        }
+        return true;
+    }
+
+}
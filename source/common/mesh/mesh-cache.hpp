@@ -0,0 +1,55 @@
+#pragma once
+
+#include "mesh.hpp"
+#include "../utils/mapped-file.hpp"
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace our::mesh_cache {
+
+    // Increment this whenever the file layout or the way the meshes are optimized changes so that the old cache files are rebuilt
+    // (the changes of the optimizer settings & the vertex size are detected using "mesh_optimizer::getSettingsHash")
+    constexpr uint32_t VERSION = 3;
+
+    // The header at the start of every cache file. It is followed by the vertices then the elements.
+    struct Header {
+        char magic[4];          // "AXMC"
+        uint32_t version;       // Must be equal to VERSION
+        uint64_t sourceHash;    // The FNV-1a hash of the source file content
+        uint64_t settingsHash;  // Must be equal to mesh_optimizer::getSettingsHash()
+        uint32_t vertexSize;    // Must be equal to sizeof(Vertex)
+        uint32_t vertexCount;
+        uint32_t elementCount;
+        uint32_t reserved;
+        float boundsMin[3], boundsMax[3];
+    };
+
+    // Returns the path of the cache file of the given source file (the cache files are stored in "cache/meshes")
+    std::string getCachePath(const std::string& sourceFilename);
+
+    // A validated cache file which stays mapped until its data is uploaded
+    struct CachedMesh {
+        MappedFile file;
+        const Vertex* vertices = nullptr;
+        uint32_t vertexCount = 0;
+        const GLuint* elements = nullptr;
+        uint32_t elementCount = 0;
+        AABB bounds;
+    };
+
+    // Maps the given cache file and checks it without touching OpenGL (so it can be called from any thread).
+    // Returns false if the file doesn't exist, is invalid, is from another version or doesn't match the source hash.
+    bool open(const std::string& cachePath, uint64_t sourceHash, CachedMesh& cached);
+
+    // Uploads the data of an opened cache file directly from the mapped pages to a new mesh
+    Mesh* upload(const CachedMesh& cached);
+
+    // Maps the given cache file and uploads its data directly to a new mesh.
+    // Returns nullptr if the file can't be opened (see "open").
+    Mesh* load(const std::string& cachePath, uint64_t sourceHash);
+
+    // Writes the given (already imported) mesh data to the given cache file
+    bool save(const std::string& cachePath, uint64_t sourceHash, const std::vector<Vertex>& vertices, const std::vector<GLuint>& elements);
+
+}
@@ -0,0 +1,245 @@
+#include "mesh-optimizer.hpp"
+#include "../utils/hash.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <numeric>
+
+namespace our::mesh_optimizer {
+
+    // The meshes are imported by the worker threads, so the flag is atomic
+    static std::atomic<bool> verbose{false};
+
+    void setVerbose(bool enabled){ verbose.store(enabled, std::memory_order_relaxed); }
+    bool isVerbose(){ return verbose.load(std::memory_order_relaxed); }
+
+    uint64_t getSettingsHash(){
+        uint64_t hash = FNV1A_OFFSET_BASIS;
+        auto add = [&hash](const auto& value){ hash = hashFNV1a(&value, sizeof(value), hash); };
+        add(CACHE_SIZE);
+        add(OVERDRAW_THRESHOLD);
+        add(MIN_CLUSTER_TRIANGLES);
+        add(sizeof(Vertex));
+        return hash;
+    }
+
+    VertexCacheStats analyzeVertexCache(const std::vector<GLuint>& elements, size_t vertexCount, int cacheSize){
+        VertexCacheStats stats;
+        if(elements.empty() || vertexCount == 0) return stats;
+
+        // Instead of storing the cache content, we store the time at which each vertex entered the cache.
+        // A vertex is in a FIFO cache if less than "cacheSize" vertices entered the cache after it.
+        std::vector<size_t> entryTime(vertexCount, 0);
+        size_t time = cacheSize + 1, misses = 0;
+        for(GLuint element : elements){
+            if(time - entryTime[element] > (size_t)cacheSize){
+                entryTime[element] = time++;
+                misses++;
+            }
+        }
+
+        // Only the vertices used by the triangles are counted
+        std::vector<bool> used(vertexCount, false);
+        size_t usedCount = 0;
+        for(GLuint element : elements) if(!used[element]){ used[element] = true; usedCount++; }
+
+        stats.acmr = (float)misses / (elements.size() / 3);
+        stats.atvr = (float)misses / usedCount;
+        return stats;
+    }
+
+    void optimizeVertexCache(std::vector<GLuint>& elements, size_t vertexCount, std::vector<size_t>& clusters, int cacheSize){
+        clusters.clear();
+        size_t triangleCount = elements.size() / 3;
+        if(triangleCount == 0) return;
+
+        // Build the vertex-triangle adjacency (the triangles of vertex v are adjacency[offsets[v]..offsets[v+1]])
+        std::vector<GLuint> offsets(vertexCount + 1, 0);
+        for(GLuint element : elements) offsets[element + 1]++;
+        std::partial_sum(offsets.begin(), offsets.end(), offsets.begin());
+        std::vector<GLuint> adjacency(elements.size());
+        std::vector<GLuint> cursor(offsets.begin(), offsets.end() - 1);
+        for(size_t index = 0; index < elements.size(); index++) adjacency[cursor[elements[index]]++] = (GLuint)(index / 3);
+
+        // The number of triangles that still need each vertex
+        std::vector<int> live(vertexCount);
+        for(size_t vertex = 0; vertex < vertexCount; vertex++) live[vertex] = (int)(offsets[vertex + 1] - offsets[vertex]);
+
+        std::vector<size_t> entryTime(vertexCount, 0);
+        size_t time = cacheSize + 1;
+        std::vector<bool> emitted(triangleCount, false);
+        std::vector<GLuint> deadEnds; // The recently used vertices, used to find a new fanning vertex when we reach a dead end
+        std::vector<GLuint> candidates;
+        std::vector<GLuint> result;
+        result.reserve(elements.size());
+
+        long long fanning = 0;
+        size_t nextVertex = 1; // Used to scan the vertices in order when the dead end stack is empty
+        clusters.push_back(0);
+
+        while(fanning >= 0){
+            // Emit all the remaining triangles around the fanning vertex
+            candidates.clear();
+            for(GLuint a = offsets[fanning]; a < offsets[fanning + 1]; a++){
+                GLuint triangle = adjacency[a];
+                if(emitted[triangle]) continue;
+                for(int corner = 0; corner < 3; corner++){
+                    GLuint vertex = elements[3 * triangle + corner];
+                    result.push_back(vertex);
+                    deadEnds.push_back(vertex);
+                    candidates.push_back(vertex);
+                    live[vertex]--;
+                    if(time - entryTime[vertex] > (size_t)cacheSize) entryTime[vertex] = time++;
+                }
+                emitted[triangle] = true;
+            }
+
+            // Pick the next fanning vertex among the vertices of the emitted triangles. We prefer the oldest vertex
+            // that will still be in the cache after emitting all its remaining triangles.
+            long long best = -1;
+            int bestPriority = -1;
+            for(GLuint vertex : candidates){
+                if(live[vertex] <= 0) continue;
+                int priority = 0;
+                if((long long)(time - entryTime[vertex]) + 2 * live[vertex] <= cacheSize) priority = (int)(time - entryTime[vertex]);
+                if(priority > bestPriority){
+                    bestPriority = priority;
+                    best = vertex;
+                }
+            }
+
+            if(best == -1){
+                // We reached a dead end, so we look for a recently used vertex which still has triangles,
+                // and if there is none, we take the next vertex (in the input order) which still has triangles
+                while(!deadEnds.empty() && best == -1){
+                    GLuint vertex = deadEnds.back();
+                    deadEnds.pop_back();
+                    if(live[vertex] > 0) best = vertex;
+                }
+                while(best == -1 && nextVertex < vertexCount){
+                    if(live[nextVertex] > 0) best = (long long)nextVertex;
+                    nextVertex++;
+                }
+                // A dead end breaks the locality, so it is a natural place to start a new cluster
+                if(best != -1 && result.size() / 3 < triangleCount) clusters.push_back(result.size() / 3);
+            }
+            fanning = best;
+        }
+
+        elements.swap(result);
+    }
+
+    void optimizeOverdraw(std::vector<GLuint>& elements, const std::vector<Vertex>& vertices, const std::vector<size_t>& clusters, float threshold, int cacheSize){
+        size_t triangleCount = elements.size() / 3;
+        if(triangleCount == 0 || clusters.empty()) return;
+        float meshAcmr = analyzeVertexCache(elements, vertices.size(), cacheSize).acmr;
+
+        // Split the clusters further: a new cluster can start wherever the cache efficiency of the current cluster
+        // (simulated from an empty cache) is already close to the efficiency of the whole mesh,
+        // so that the reordering doesn't cost many extra cache misses
+        std::vector<size_t> boundaries;
+        std::vector<size_t> entryTime(vertices.size(), 0);
+        size_t time = cacheSize + 1;
+        for(size_t cluster = 0; cluster < clusters.size(); cluster++){
+            size_t start = clusters[cluster];
+            size_t end = cluster + 1 < clusters.size() ? clusters[cluster + 1] : triangleCount;
+            size_t clusterStart = start, misses = 0;
+            boundaries.push_back(start);
+            time += cacheSize + 1; // Empty the simulated cache
+            for(size_t triangle = start; triangle < end; triangle++){
+                for(int corner = 0; corner < 3; corner++){
+                    GLuint vertex = elements[3 * triangle + corner];
+                    if(time - entryTime[vertex] > (size_t)cacheSize){
+                        entryTime[vertex] = time++;
+                        misses++;
+                    }
+                }
+                size_t clusterTriangles = triangle + 1 - clusterStart;
+                if(triangle + 1 < end && clusterTriangles >= MIN_CLUSTER_TRIANGLES && (float)misses / clusterTriangles <= meshAcmr * threshold){
+                    clusterStart = triangle + 1;
+                    misses = 0;
+                    boundaries.push_back(clusterStart);
+                    time += cacheSize + 1;
+                }
+            }
+        }
+
+        // The center of the mesh (the average of the triangle centroids weighted by their area)
+        auto getTriangle = [&](size_t triangle, glm::vec3& a, glm::vec3& b, glm::vec3& c){
+            a = vertices[elements[3 * triangle + 0]].position;
+            b = vertices[elements[3 * triangle + 1]].position;
+            c = vertices[elements[3 * triangle + 2]].position;
+        };
+        glm::vec3 meshCenter(0.0f);
+        float meshArea = 0.0f;
+        for(size_t triangle = 0; triangle < triangleCount; triangle++){
+            glm::vec3 a, b, c;
+            getTriangle(triangle, a, b, c);
+            float area = glm::length(glm::cross(b - a, c - a));
+            meshCenter += (a + b + c) * (area / 3.0f);
+            meshArea += area;
+        }
+        if(meshArea > 0.0f) meshCenter /= meshArea;
+
+        // The occlusion potential of a cluster is how far its center is from the mesh center along its average normal
+        // (the clusters on the outside facing away from the center are likely to hide the others)
+        std::vector<std::pair<float, size_t>> order;
+        for(size_t cluster = 0; cluster < boundaries.size(); cluster++){
+            size_t start = boundaries[cluster];
+            size_t end = cluster + 1 < boundaries.size() ? boundaries[cluster + 1] : triangleCount;
+            glm::vec3 center(0.0f), normal(0.0f);
+            float area = 0.0f;
+            for(size_t triangle = start; triangle < end; triangle++){
+                glm::vec3 a, b, c;
+                getTriangle(triangle, a, b, c);
+                glm::vec3 weightedNormal = glm::cross(b - a, c - a); // Its length is twice the triangle area
+                float triangleArea = glm::length(weightedNormal);
+                center += (a + b + c) * (triangleArea / 3.0f);
+                normal += weightedNormal;
+                area += triangleArea;
+            }
+            float potential = 0.0f;
+            if(area > 0.0f && glm::length(normal) > 0.0f){
+                potential = glm::dot(center / area - meshCenter, glm::normalize(normal));
+            }
+            order.emplace_back(potential, cluster);
+        }
+        std::stable_sort(order.begin(), order.end(), [](const auto& first, const auto& second){ return first.first > second.first; });
+
+        std::vector<GLuint> result;
+        result.reserve(elements.size());
+        for(auto& [potential, cluster] : order){
+            size_t start = boundaries[cluster];
+            size_t end = cluster + 1 < boundaries.size() ? boundaries[cluster + 1] : triangleCount;
+            result.insert(result.end(), elements.begin() + 3 * start, elements.begin() + 3 * end);
+        }
+        elements.swap(result);
+    }
+
+    bool optimizeTriangleOrder(std::vector<GLuint>& elements, const std::vector<Vertex>& vertices, int cacheSize){
+        float originalAcmr = analyzeVertexCache(elements, vertices.size(), cacheSize).acmr;
+        std::vector<GLuint> reordered = elements;
+        std::vector<size_t> clusters;
+        optimizeVertexCache(reordered, vertices.size(), clusters, cacheSize);
+        optimizeOverdraw(reordered, vertices, clusters, OVERDRAW_THRESHOLD, cacheSize);
+        if(analyzeVertexCache(reordered, vertices.size(), cacheSize).acmr >= originalAcmr) return false;
+        elements.swap(reordered);
+        return true;
+    }
+
+    void optimizeVertexFetch(std::vector<Vertex>& vertices, std::vector<GLuint>& elements){
+        const GLuint UNUSED = ~0u;
+        std::vector<GLuint> remap(vertices.size(), UNUSED);
+        std::vector<Vertex> result;
+        result.reserve(vertices.size());
+        for(GLuint& element : elements){
+            if(remap[element] == UNUSED){
+                remap[element] = (GLuint)result.size();
+                result.push_back(vertices[element]);
+            }
+            element = remap[element];
+        }
+        vertices.swap(result);
+    }
+
+}
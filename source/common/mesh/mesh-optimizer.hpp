@@ -0,0 +1,56 @@
+#pragma once
+
+#include "vertex.hpp"
+#include <glad/gl.h>
+#include <vector>
+
+namespace our::mesh_optimizer {
+
+    // The number of vertices in the simulated post-transform cache (a FIFO like the ones in most GPUs)
+    constexpr int CACHE_SIZE = 16;
+    // How much worse than the whole mesh the cache efficiency of a cluster may get when optimizeOverdraw splits the clusters
+    constexpr float OVERDRAW_THRESHOLD = 1.05f;
+    // Every cluster starts with a cold cache once the clusters are reordered, so very small clusters
+    // would cost more cache misses than the overdraw they save
+    constexpr size_t MIN_CLUSTER_TRIANGLES = 64;
+
+    // Returns a hash of the settings above (and of the vertex layout). It is part of the key of the mesh cache,
+    // so the cached meshes are imported again whenever the settings change.
+    uint64_t getSettingsHash();
+
+    // The statistics of a simulated post-transform vertex cache
+    struct VertexCacheStats {
+        // The average number of transformed vertices per triangle (0.5 is the best possible, 3 is the worst)
+        float acmr = 0;
+        // The average number of times each vertex is transformed (1 is the best possible)
+        float atvr = 0;
+    };
+
+    // Enables or disables printing the vertex cache statistics of each mesh optimized by the importers (disabled by default)
+    void setVerbose(bool enabled);
+    bool isVerbose();
+
+    // Simulates a FIFO post-transform cache of the given size while drawing the given triangles
+    VertexCacheStats analyzeVertexCache(const std::vector<GLuint>& elements, size_t vertexCount, int cacheSize = CACHE_SIZE);
+
+    // Reorders the triangles to improve the post-transform cache hit rate using the Tipsify algorithm
+    // (Sander, Nehab & Barczak, "Fast Triangle Reordering for Vertex Locality and Reduced Overdraw").
+    // The triangle index where each cluster starts is written to "clusters" (the clusters are used by optimizeOverdraw).
+    void optimizeVertexCache(std::vector<GLuint>& elements, size_t vertexCount, std::vector<size_t>& clusters, int cacheSize = CACHE_SIZE);
+
+    // Reorders the clusters produced by optimizeVertexCache such that the clusters that are likely to occlude the others
+    // (the ones on the outside of the mesh facing away from its center) are drawn first.
+    // The clusters are split further as long as the cache efficiency of each one stays within "threshold" of the whole mesh.
+    void optimizeOverdraw(std::vector<GLuint>& elements, const std::vector<Vertex>& vertices, const std::vector<size_t>& clusters, float threshold = OVERDRAW_THRESHOLD, int cacheSize = CACHE_SIZE);
+
+    // Runs optimizeVertexCache then optimizeOverdraw, but keeps the original triangle order if the reordered triangles
+    // don't have a lower ACMR (e.g. a mesh that was already exported in a cache friendly order), since reordering them
+    // would change the order in which the overlapping triangles are blended without making the mesh any faster to draw.
+    // Returns true if the triangles were reordered.
+    bool optimizeTriangleOrder(std::vector<GLuint>& elements, const std::vector<Vertex>& vertices, int cacheSize = CACHE_SIZE);
+
+    // Reorders the vertices in the order in which they are first used by the triangles so that the vertex fetches
+    // are mostly sequential. The elements are remapped accordingly and the unused vertices are removed.
+    void optimizeVertexFetch(std::vector<Vertex>& vertices, std::vector<GLuint>& elements);
+
+}
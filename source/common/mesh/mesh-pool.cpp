@@ -0,0 +1,240 @@
+#include "mesh-pool.hpp"
+
+#include <glm/glm.hpp>
+
+namespace our {
+
+    // The initial sizes of the pools (they grow when needed)
+    static constexpr GLuint INITIAL_VERTICES = 1 << 16;
+    static constexpr GLuint INITIAL_ELEMENT_SLOTS = 1 << 19;
+    // The number of 16-bit slots taken by each index in the element buffer
+    static GLuint getSlotsPerIndex(GLenum indexType){ return indexType == GL_UNSIGNED_SHORT ? 1 : 2; }
+
+    bool RangeAllocator::allocate(GLuint count, GLuint& offset, GLuint alignment){
+        for(auto it = freeRanges.begin(); it != freeRanges.end(); it++){
+            GLuint start = it->first, size = it->second;
+            GLuint aligned = (start + alignment - 1) / alignment * alignment;
+            GLuint padding = aligned - start;
+            if(size < padding + count) continue;
+            freeRanges.erase(it);
+            // The space skipped for alignment and the space left after the allocation stay free
+            if(padding > 0) freeRanges[start] = padding;
+            GLuint remaining = size - padding - count;
+            if(remaining > 0) freeRanges[aligned + count] = remaining;
+            offset = aligned;
+            return true;
+        }
+        return false;
+    }
+
+    void RangeAllocator::free(GLuint offset, GLuint count){
+        if(count == 0) return;
+        auto next = freeRanges.lower_bound(offset);
+        // Merge with the next free range if it starts where this one ends
+        if(next != freeRanges.end() && next->first == offset + count){
+            count += next->second;
+            next = freeRanges.erase(next);
+        }
+        // Merge with the previous free range if it ends where this one starts
+        if(next != freeRanges.begin()){
+            auto previous = std::prev(next);
+            if(previous->first + previous->second == offset){
+                previous->second += count;
+                return;
+            }
+        }
+        freeRanges[offset] = count;
+    }
+
+    void RangeAllocator::grow(GLuint newCapacity){
+        if(newCapacity <= capacity) return;
+        free(capacity, newCapacity - capacity);
+        capacity = newCapacity;
+    }
+
+    bool MeshPool::canPack(const Vertex* vertices, size_t vertexCount, const AABB& bounds) const {
+        if(!packingEnabled || bounds.isEmpty()) return false;
+        // The half floats have an 11-bit mantissa so their error grows with the magnitude of the value.
+        // We accept the position error if it is less than 0.1% of the mesh size, and the texture coordinate error
+        // if it is less than half a texel of a 1024x1024 texture.
+        float maxPositionError = glm::max(glm::length(bounds.max - bounds.min) * 1e-3f, 1e-5f);
+        const float maxTexCoordError = 0.5f / 1024.0f;
+        for(size_t index = 0; index < vertexCount; index++){
+            const Vertex& vertex = vertices[index];
+            Vertex unpacked = PackedVertex(vertex).unpack();
+            glm::vec3 positionError = glm::abs(unpacked.position - vertex.position);
+            glm::vec2 texCoordError = glm::abs(unpacked.tex_coord - vertex.tex_coord);
+            if(glm::max(positionError.x, glm::max(positionError.y, positionError.z)) > maxPositionError) return false;
+            if(glm::max(texCoordError.x, texCoordError.y) > maxTexCoordError) return false;
+        }
+        return true;
+    }
+
+    void MeshPool::setupAttributes(VertexFormat format) const {
+        const Pool& pool = pools[(int)format];
+        // An attribute can't point to buffer 0 in a core profile. The attributes are set up again when the buffers are created.
+        if(pool.vertexBuffer == 0) return;
+        GLsizei stride = getVertexSize(format);
+        glBindBuffer(GL_ARRAY_BUFFER, pool.vertexBuffer);
+        if(isPackedFormat(format)){
+            // The GPU converts the half floats and the 10-10-10-2 normal to floats, so the shaders don't change
+            glVertexAttribPointer(ATTRIB_LOC_POSITION, 3, GL_HALF_FLOAT, GL_FALSE, stride, (void*)offsetof(PackedVertex, position));
+            glVertexAttribPointer(ATTRIB_LOC_COLOR, 4, GL_UNSIGNED_BYTE, GL_TRUE, stride, (void*)offsetof(PackedVertex, color));
+            glVertexAttribPointer(ATTRIB_LOC_TEXCOORD, 2, GL_HALF_FLOAT, GL_FALSE, stride, (void*)offsetof(PackedVertex, tex_coord));
+            glVertexAttribPointer(ATTRIB_LOC_NORMAL, 4, GL_INT_2_10_10_10_REV, GL_TRUE, stride, (void*)offsetof(PackedVertex, normal));
+        } else {
+            glVertexAttribPointer(ATTRIB_LOC_POSITION, 3, GL_FLOAT, GL_FALSE, stride, (void*)offsetof(Vertex, position));
+            glVertexAttribPointer(ATTRIB_LOC_COLOR, 4, GL_UNSIGNED_BYTE, GL_TRUE, stride, (void*)offsetof(Vertex, color));
+            glVertexAttribPointer(ATTRIB_LOC_TEXCOORD, 2, GL_FLOAT, GL_FALSE, stride, (void*)offsetof(Vertex, tex_coord));
+            glVertexAttribPointer(ATTRIB_LOC_NORMAL, 3, GL_FLOAT, GL_FALSE, stride, (void*)offsetof(Vertex, normal));
+        }
+        glEnableVertexAttribArray(ATTRIB_LOC_POSITION);
+        glEnableVertexAttribArray(ATTRIB_LOC_COLOR);
+        glEnableVertexAttribArray(ATTRIB_LOC_TEXCOORD);
+        glEnableVertexAttribArray(ATTRIB_LOC_NORMAL);
+
+        // The cells are read as integers from their own buffer, the base vertex applies to both buffers
+        if(hasCellStream(format)){
+            glBindBuffer(GL_ARRAY_BUFFER, pool.cellBuffer);
+            glVertexAttribIPointer(ATTRIB_LOC_CELL, 1, GL_UNSIGNED_INT, sizeof(GLuint), (void*)0);
+            glEnableVertexAttribArray(ATTRIB_LOC_CELL);
+        }
+
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, pool.elementBuffer);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+    }
+
+    void MeshPool::growBuffer(GLuint& buffer, GLsizeiptr oldSize, GLsizeiptr newSize){
+        GLuint newBuffer;
+        glGenBuffers(1, &newBuffer);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, newBuffer);
+        glBufferData(GL_COPY_WRITE_BUFFER, newSize, nullptr, GL_STATIC_DRAW);
+        if(buffer){
+            // The copy happens on the GPU side, so the data never goes through the RAM
+            glBindBuffer(GL_COPY_READ_BUFFER, buffer);
+            if(oldSize > 0) glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0, oldSize);
+            glBindBuffer(GL_COPY_READ_BUFFER, 0);
+            glDeleteBuffers(1, &buffer);
+        }
+        glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+        buffer = newBuffer;
+    }
+
+    void MeshPool::growVertices(VertexFormat format, GLuint required){
+        Pool& pool = pools[(int)format];
+        GLuint oldCapacity = pool.vertices.getCapacity();
+        GLuint newCapacity = glm::max(glm::max(oldCapacity * 2, oldCapacity + required), INITIAL_VERTICES);
+        GLsizei vertexSize = getVertexSize(format);
+        growBuffer(pool.vertexBuffer, (GLsizeiptr)oldCapacity * vertexSize, (GLsizeiptr)newCapacity * vertexSize);
+        if(hasCellStream(format)){
+            growBuffer(pool.cellBuffer, (GLsizeiptr)oldCapacity * sizeof(GLuint), (GLsizeiptr)newCapacity * sizeof(GLuint));
+        }
+        pool.vertices.grow(newCapacity);
+        if(pool.vertexArray == 0) glGenVertexArrays(1, &pool.vertexArray);
+        glBindVertexArray(pool.vertexArray);
+        setupAttributes(format);
+        glBindVertexArray(0);
+        generation++;
+    }
+
+    void MeshPool::growElements(VertexFormat format, GLuint required){
+        Pool& pool = pools[(int)format];
+        GLuint oldCapacity = pool.elements.getCapacity();
+        GLuint newCapacity = glm::max(glm::max(oldCapacity * 2, oldCapacity + required), INITIAL_ELEMENT_SLOTS);
+        growBuffer(pool.elementBuffer, (GLsizeiptr)oldCapacity * sizeof(GLushort), (GLsizeiptr)newCapacity * sizeof(GLushort));
+        pool.elements.grow(newCapacity);
+        if(pool.vertexArray == 0) glGenVertexArrays(1, &pool.vertexArray);
+        glBindVertexArray(pool.vertexArray);
+        setupAttributes(format);
+        glBindVertexArray(0);
+        generation++;
+    }
+
+    MeshAllocation MeshPool::allocate(VertexFormat format, const Vertex* vertices, size_t vertexCount, const GLuint* elements, size_t elementCount, const GLuint* cells){
+        Pool& pool = pools[(int)format];
+        MeshAllocation allocation;
+        allocation.format = format;
+        allocation.indexType = vertexCount < 65536 ? GL_UNSIGNED_SHORT : GL_UNSIGNED_INT;
+        allocation.vertexCount = (GLuint)vertexCount;
+        allocation.elementCount = (GLuint)elementCount;
+
+        // If there is no free range large enough, the pool grows and the new space is at its end
+        if(!pool.vertices.allocate(allocation.vertexCount, allocation.firstVertex)){
+            growVertices(format, allocation.vertexCount);
+            pool.vertices.allocate(allocation.vertexCount, allocation.firstVertex);
+        }
+        // The elements are allocated in 16-bit slots, and the 32-bit indices must be aligned to their size
+        GLuint slotsPerIndex = getSlotsPerIndex(allocation.indexType);
+        GLuint slots = allocation.elementCount * slotsPerIndex, firstSlot;
+        if(!pool.elements.allocate(slots, firstSlot, slotsPerIndex)){
+            growElements(format, slots + slotsPerIndex);
+            pool.elements.allocate(slots, firstSlot, slotsPerIndex);
+        }
+        allocation.firstElement = firstSlot / slotsPerIndex;
+
+        // We use the copy write target to avoid modifying the element buffer bound to the current vertex array
+        glBindBuffer(GL_COPY_WRITE_BUFFER, pool.vertexBuffer);
+        GLintptr vertexOffset = (GLintptr)allocation.firstVertex * getVertexSize(format);
+        if(isPackedFormat(format)){
+            std::vector<PackedVertex> packed(vertices, vertices + vertexCount);
+            glBufferSubData(GL_COPY_WRITE_BUFFER, vertexOffset, packed.size() * sizeof(PackedVertex), packed.data());
+        } else {
+            glBufferSubData(GL_COPY_WRITE_BUFFER, vertexOffset, vertexCount * sizeof(Vertex), vertices);
+        }
+        if(hasCellStream(format)){
+            glBindBuffer(GL_COPY_WRITE_BUFFER, pool.cellBuffer);
+            glBufferSubData(GL_COPY_WRITE_BUFFER, (GLintptr)allocation.firstVertex * sizeof(GLuint), vertexCount * sizeof(GLuint), cells);
+        }
+        glBindBuffer(GL_COPY_WRITE_BUFFER, pool.elementBuffer);
+        if(allocation.indexType == GL_UNSIGNED_SHORT){
+            std::vector<GLushort> shortElements(elements, elements + elementCount);
+            glBufferSubData(GL_COPY_WRITE_BUFFER, allocation.getElementOffset(), shortElements.size() * sizeof(GLushort), shortElements.data());
+        } else {
+            glBufferSubData(GL_COPY_WRITE_BUFFER, allocation.getElementOffset(), elementCount * sizeof(GLuint), elements);
+        }
+        glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+        return allocation;
+    }
+
+    void MeshPool::free(const MeshAllocation& allocation){
+        Pool& pool = pools[(int)allocation.format];
+        GLuint slotsPerIndex = getSlotsPerIndex(allocation.indexType);
+        pool.vertices.free(allocation.firstVertex, allocation.vertexCount);
+        pool.elements.free(allocation.firstElement * slotsPerIndex, allocation.elementCount * slotsPerIndex);
+    }
+
+    void MeshPool::readBack(const MeshAllocation& allocation, std::vector<Vertex>& vertices, std::vector<GLuint>& elements) const {
+        const Pool& pool = pools[(int)allocation.format];
+        vertices.resize(allocation.vertexCount);
+        elements.resize(allocation.elementCount);
+        glBindBuffer(GL_COPY_READ_BUFFER, pool.vertexBuffer);
+        GLintptr vertexOffset = (GLintptr)allocation.firstVertex * getVertexSize(allocation.format);
+        if(isPackedFormat(allocation.format)){
+            std::vector<PackedVertex> packed(allocation.vertexCount);
+            glGetBufferSubData(GL_COPY_READ_BUFFER, vertexOffset, packed.size() * sizeof(PackedVertex), packed.data());
+            for(size_t index = 0; index < packed.size(); index++) vertices[index] = packed[index].unpack();
+        } else {
+            glGetBufferSubData(GL_COPY_READ_BUFFER, vertexOffset, vertices.size() * sizeof(Vertex), vertices.data());
+        }
+        glBindBuffer(GL_COPY_READ_BUFFER, pool.elementBuffer);
+        if(allocation.indexType == GL_UNSIGNED_SHORT){
+            std::vector<GLushort> shortElements(allocation.elementCount);
+            glGetBufferSubData(GL_COPY_READ_BUFFER, allocation.getElementOffset(), shortElements.size() * sizeof(GLushort), shortElements.data());
+            elements.assign(shortElements.begin(), shortElements.end());
+        } else {
+            glGetBufferSubData(GL_COPY_READ_BUFFER, allocation.getElementOffset(), elements.size() * sizeof(GLuint), elements.data());
+        }
+        glBindBuffer(GL_COPY_READ_BUFFER, 0);
+    }
+
+    void MeshPool::destroy(){
+        for(auto& pool : pools){
+            GLuint buffers[] = {pool.vertexBuffer, pool.elementBuffer, pool.cellBuffer};
+            glDeleteBuffers(3, buffers);
+            if(pool.vertexArray) glDeleteVertexArrays(1, &pool.vertexArray);
+            pool = Pool();
+        }
+        generation++;
+    }
+
+}
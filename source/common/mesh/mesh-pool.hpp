@@ -0,0 +1,125 @@
+#pragma once
+
+#include <glad/gl.h>
+#include <map>
+#include <vector>
+#include "vertex.hpp"
+#include "bounds.hpp"
+
+namespace our {
+
+    #define ATTRIB_LOC_POSITION 0
+    #define ATTRIB_LOC_COLOR    1
+    #define ATTRIB_LOC_TEXCOORD 2
+    #define ATTRIB_LOC_NORMAL   3
+    #define ATTRIB_LOC_CELL     4
+
+    // The vertex formats supported by the mesh pool. Each format has its own buffers and vertex array.
+    enum class VertexFormat {
+        STANDARD = 0,   // Vertex only
+        CELLS,          // Vertex + an integer per vertex (used by static batches to store the cell of each vertex)
+        PACKED,         // PackedVertex only
+        PACKED_CELLS,   // PackedVertex + an integer per vertex
+        COUNT
+    };
+
+    inline bool isPackedFormat(VertexFormat format){ return format == VertexFormat::PACKED || format == VertexFormat::PACKED_CELLS; }
+    inline bool hasCellStream(VertexFormat format){ return format == VertexFormat::CELLS || format == VertexFormat::PACKED_CELLS; }
+    inline GLsizei getVertexSize(VertexFormat format){ return isPackedFormat(format) ? sizeof(PackedVertex) : sizeof(Vertex); }
+
+    // The ranges of vertices & elements that a mesh occupies in the buffers of its format
+    struct MeshAllocation {
+        VertexFormat format = VertexFormat::STANDARD;
+        GLenum indexType = GL_UNSIGNED_INT; // GL_UNSIGNED_SHORT if the mesh has less than 65536 vertices
+        GLuint firstVertex = 0, vertexCount = 0;
+        GLuint firstElement = 0, elementCount = 0; // In units of the index type
+
+        GLsizei getIndexSize() const { return indexType == GL_UNSIGNED_SHORT ? sizeof(GLushort) : sizeof(GLuint); }
+        // The byte offset of the first element in the element buffer
+        GLintptr getElementOffset() const { return (GLintptr)firstElement * getIndexSize(); }
+    };
+
+    // A first-fit allocator over a range of items which keeps the free ranges sorted by offset
+    // so that the adjacent free ranges can be merged when an allocation is freed
+    class RangeAllocator {
+        std::map<GLuint, GLuint> freeRanges; // offset -> size
+        GLuint capacity = 0;
+    public:
+        // Finds a free range of the given size whose offset is a multiple of the alignment.
+        // Returns false if there is none (the allocator must grow).
+        bool allocate(GLuint count, GLuint& offset, GLuint alignment = 1);
+        void free(GLuint offset, GLuint count);
+        // Adds the range [capacity, newCapacity) to the free ranges
+        void grow(GLuint newCapacity);
+        GLuint getCapacity() const { return capacity; }
+        void clear(){ freeRanges.clear(); capacity = 0; }
+    };
+
+    // Instead of giving every mesh its own vertex array, vertex buffer and element buffer,
+    // all the meshes of the same vertex format are sub-allocated from one large vertex buffer and one element buffer.
+    // The elements of each mesh are relative to its first vertex and are drawn using glDrawElementsBaseVertex,
+    // so all the meshes of a format are drawn using the same vertex array.
+    // The element buffer is allocated in 16-bit slots so that 16-bit and 32-bit indices can share it
+    // (the 32-bit indices take 2 aligned slots each).
+    // When a pool is full, its buffers are reallocated with a larger size (which invalidates the buffer names).
+    class MeshPool {
+        struct Pool {
+            GLuint vertexArray = 0, vertexBuffer = 0, elementBuffer = 0;
+            GLuint cellBuffer = 0; // A second vertex stream for the formats with cells (indexed like the vertex buffer)
+            RangeAllocator vertices, elements;
+        };
+        Pool pools[(int)VertexFormat::COUNT];
+        // Incremented whenever the buffers of a pool are reallocated
+        unsigned int generation = 0;
+        // If false, all the meshes use the standard formats
+        bool packingEnabled = true;
+
+        // Reallocates the given buffer with a larger size while keeping its content
+        void growBuffer(GLuint& buffer, GLsizeiptr oldSize, GLsizeiptr newSize);
+        void growVertices(VertexFormat format, GLuint required);
+        void growElements(VertexFormat format, GLuint required);
+
+        MeshPool() = default;
+    public:
+        // The pool is shared by all the meshes
+        static MeshPool& get(){
+            static MeshPool pool;
+            return pool;
+        }
+
+        // Enables or disables the packed formats for the meshes created after this call
+        void setPackingEnabled(bool enabled){ packingEnabled = enabled; }
+        // Returns true if the given vertices can use PackedVertex without a visible loss of precision
+        bool canPack(const Vertex* vertices, size_t vertexCount, const AABB& bounds) const;
+
+        // Copies the given data into the pool of the given format and returns where it was stored.
+        // 16-bit indices are used if there are less than 65536 vertices.
+        // The data is read from the given arrays ("cells" must have a value per vertex if the format has cells)
+        MeshAllocation allocate(VertexFormat format, const Vertex* vertices, size_t vertexCount, const GLuint* elements, size_t elementCount, const GLuint* cells = nullptr);
+        // Returns the ranges to the pool (the data is not cleared)
+        void free(const MeshAllocation& allocation);
+
+        // Binds the vertex array of the given format
+        void bind(VertexFormat format){
+            glBindVertexArray(pools[(int)format].vertexArray);
+        }
+        // Points the attributes of the currently bound vertex array to the buffers of the given format
+        // (this can be used to create other vertex arrays that read the pool buffers)
+        void setupAttributes(VertexFormat format) const;
+
+        // Reads the vertex & element data of an allocation back from the VRAM (the elements are relative to the first vertex)
+        // The packed vertices are unpacked and the 16-bit indices are widened
+        void readBack(const MeshAllocation& allocation, std::vector<Vertex>& vertices, std::vector<GLuint>& elements) const;
+
+        // The generation changes whenever the pool buffers are reallocated, so the vertex arrays created
+        // using setupAttributes must be set up again
+        unsigned int getGeneration() const { return generation; }
+
+        // Deletes all the buffers and vertex arrays (all the meshes must be deleted before calling this)
+        void destroy();
+
+        MeshPool(MeshPool const &) = delete;
+        MeshPool &operator=(MeshPool const &) = delete;
+    };
+
+}
@@ -1,18 +1,66 @@
 #include "mesh-utils.hpp"
+#include "mesh-optimizer.hpp"
+#include "../utils/hash.hpp"
+#include "../utils/mapped-file.hpp"
 
 // We will use "Tiny OBJ Loader" to read and process '.obj" files
 #define TINYOBJLOADER_IMPLEMENTATION
 #include <tinyobj/tiny_obj_loader.h>
 
 #include <iostream>
+#include <sstream>
 #include <vector>
 #include <unordered_map>
+#include <filesystem>
+#include <algorithm>
+#include <cctype>
 
 our::Mesh* our::mesh_utils::loadOBJ(const std::string& filename) {
+    MeshData data;
+    if(!prepareOBJ(filename, data)) return nullptr;
+    return createMesh(data);
+}
+
+our::Mesh* our::mesh_utils::loadMesh(const std::string& filename) {
+    MeshData data;
+    if(!prepareMesh(filename, data)) return nullptr;
+    return createMesh(data);
+}
+
+bool our::mesh_utils::prepareMesh(const std::string& filename, MeshData& data) {
+    auto extension = std::filesystem::path(filename).extension().string();
+    std::transform(extension.begin(), extension.end(), extension.begin(), ::tolower);
+    if(extension == ".gltf" || extension == ".glb") return prepareGLTF(filename, data);
+    return prepareOBJ(filename, data);
+}
+
+our::Mesh* our::mesh_utils::createMesh(const MeshData& data) {
+    if(data.cached) return mesh_cache::upload(*data.cached);
+    auto mesh = new our::Mesh(data.vertices, data.elements);
+    mesh->setSubMeshes(data.submeshes);
+    return mesh;
+}
+
+bool our::mesh_utils::prepareOBJ(const std::string& filename, MeshData& data) {
+
+    // If the OBJ was already imported and didn't change since then, we load the imported data from the cache
+    uint64_t sourceHash = 0;
+    {
+        MappedFile source(filename);
+        if(source.isOpen()) sourceHash = hashFNV1a(source.getData(), source.getSize());
+    }
+    std::string cachePath = mesh_cache::getCachePath(filename);
+    if(sourceHash != 0){
+        auto cached = std::make_unique<mesh_cache::CachedMesh>();
+        if(mesh_cache::open(cachePath, sourceHash, *cached)){
+            data.cached = std::move(cached);
+            return true;
+        }
+    }
 
     // The data that we will use to initialize our mesh
-    std::vector<our::Vertex> vertices;
-    std::vector<GLuint> elements;
+    std::vector<our::Vertex>& vertices = data.vertices;
+    std::vector<GLuint>& elements = data.elements;
 
     // Since the OBJ can have duplicated vertices, we make them unique using this map
     // The key is the vertex, the value is its index in the vector "vertices".
@@ -27,7 +75,7 @@ our::Mesh* our::mesh_utils::loadOBJ(const std::string& filename) {
 
     if (!tinyobj::LoadObj(&attrib, &shapes, &materials, &warn, &err, filename.c_str())) {
         std::cerr << "Failed to load obj file \"" << filename << "\" due to error: " << err << std::endl;
-        return nullptr;
+        return false;
     }
     if (!warn.empty()) {
         std::cout << "WARN while loading obj file \"" << filename << "\": " << warn << std::endl;
@@ -81,7 +129,27 @@ our::Mesh* our::mesh_utils::loadOBJ(const std::string& filename) {
         }
     }
 
-    return new our::Mesh(vertices, elements);
+    // Reorder the triangles for the post-transform vertex cache and to reduce overdraw (unless it doesn't improve the cache hit rate),
+    // then reorder the vertices in the order they are used so that the vertex fetches are mostly sequential
+    // The statistics are only computed & printed in verbose mode (see "mesh_optimizer::setVerbose")
+    bool verbose = mesh_optimizer::isVerbose();
+    mesh_optimizer::VertexCacheStats before;
+    if(verbose) before = mesh_optimizer::analyzeVertexCache(elements, vertices.size());
+    mesh_optimizer::optimizeTriangleOrder(elements, vertices);
+    mesh_optimizer::optimizeVertexFetch(vertices, elements);
+    if(verbose){
+        auto after = mesh_optimizer::analyzeVertexCache(elements, vertices.size());
+        // The message is written at once since the meshes can be prepared by multiple threads
+        std::ostringstream message;
+        message << "Optimized \"" << filename << "\" (" << vertices.size() << " vertices, " << elements.size() / 3 << " triangles): "
+                << "ACMR " << before.acmr << " -> " << after.acmr << ", ATVR " << before.atvr << " -> " << after.atvr << "\n";
+        std::cout << message.str() << std::flush;
+    }
+
+    // Store the imported data so that the next loads skip the parsing and the optimization
+    if(sourceHash != 0) mesh_cache::save(cachePath, sourceHash, vertices, elements);
+
+    return true;
 }
 
 // Create a sphere (the vertex order in the triangles are CCW from the outside)
@@ -1,12 +1,39 @@
 #pragma once
 
 #include "mesh.hpp"
+#include "mesh-cache.hpp"
+#include <memory>
 #include <string>
+#include <vector>
 
 namespace our::mesh_utils {
     // Load an ".obj" file into the mesh
     Mesh* loadOBJ(const std::string& filename);
+    // Load a ".gltf" or ".glb" file into the mesh where every primitive becomes a sub-mesh
+    // (the node transforms of the default scene are baked into the vertices)
+    Mesh* loadGLTF(const std::string& filename);
+    // Load a mesh file using the loader that matches its extension (".gltf" & ".glb" use the glTF loader and anything else is read as an OBJ)
+    Mesh* loadMesh(const std::string& filename);
+    // Reads the triangles of a ".gltf" or ".glb" file without creating a mesh (used by loadGLTF)
+    // The elements of each sub-mesh are stored consecutively. Returns false if the file couldn't be read.
+    bool importGLTF(const std::string& filename, std::vector<Vertex>& vertices, std::vector<GLuint>& elements, std::vector<SubMesh>& submeshes);
+
+    // The imported data of a mesh before it is uploaded to the GPU
+    struct MeshData {
+        std::vector<Vertex> vertices;
+        std::vector<GLuint> elements;
+        std::vector<SubMesh> submeshes;
+        // If the mesh was found in the mesh cache, the data is read from the mapped cache file instead of the vectors
+        std::unique_ptr<mesh_cache::CachedMesh> cached;
+    };
+    // These functions read, optimize and cache a mesh file without touching OpenGL, so they can be called from any thread
+    bool prepareOBJ(const std::string& filename, MeshData& data);
+    bool prepareGLTF(const std::string& filename, MeshData& data);
+    bool prepareMesh(const std::string& filename, MeshData& data);
+    // Creates a mesh from the prepared data (this must be called on the thread which owns the GL context)
+    Mesh* createMesh(const MeshData& data);
+
     // Create a sphere (the vertex order in the triangles are CCW from the outside)
     // Segments define the number of divisions on the both the latitude and the longitude
     Mesh* sphere(const glm::ivec2& segments);
-}
\ No newline at end of file
+}
@@ -2,93 +2,108 @@
 
 #include <glad/gl.h>
 #include "vertex.hpp"
+#include "bounds.hpp"
+#include "mesh-pool.hpp"
 
 namespace our {
 
-    #define ATTRIB_LOC_POSITION 0
-    #define ATTRIB_LOC_COLOR    1
-    #define ATTRIB_LOC_TEXCOORD 2
-    #define ATTRIB_LOC_NORMAL   3
+    // A range of the elements of a mesh that is drawn with its own material (e.g. a primitive of a glTF mesh)
+    struct SubMesh {
+        GLuint firstElement = 0; // Relative to the first element of the mesh
+        GLuint elementCount = 0;
+    };
 
     class Mesh {
-        // Here, we store the object names of the 3 main components of a mesh:
-        // A vertex array object, A vertex buffer and an element buffer
-        unsigned int VBO, EBO;
-        unsigned int VAO;
-        // We need to remember the number of elements that will be draw by glDrawElements 
-        GLsizei elementCount;
+        // Instead of owning a vertex array, a vertex buffer and an element buffer, every mesh is a range
+        // inside the shared buffers of the mesh pool (see MeshPool). All the meshes of the same vertex format
+        // are drawn using the same vertex array so no vertex array switches are needed between them.
+        MeshAllocation allocation;
+        // The bounding box of the vertices in the local space of the mesh (used for culling)
+        AABB bounds;
+        // The sub-meshes (if empty, the whole mesh is a single sub-mesh)
+        std::vector<SubMesh> submeshes;
+
+        void create(const Vertex* vertices, size_t vertexCount, const GLuint* elements, size_t elementCount, const GLuint* cells){
+            // The layout is chosen per mesh: the packed layout is used if it doesn't lose visible precision,
+            // and the meshes with cells use the formats that have an extra vertex stream
+            bool packed = MeshPool::get().canPack(vertices, vertexCount, bounds);
+            VertexFormat format;
+            if(!cells) format = packed ? VertexFormat::PACKED : VertexFormat::STANDARD;
+            else format = packed ? VertexFormat::PACKED_CELLS : VertexFormat::CELLS;
+            allocation = MeshPool::get().allocate(format, vertices, vertexCount, elements, elementCount, cells);
+        }
     public:
 
         // The constructor takes two vectors:
         // - vertices which contain the vertex data.
         // - elements which contain the indices of the vertices out of which each rectangle will be constructed.
-        // The mesh class does not keep a these data on the RAM. Instead, it should create
-        // a vertex buffer to store the vertex data on the VRAM,
-        // an element buffer to store the element data on the VRAM,
-        // a vertex array object to define how to read the vertex & element buffer during rendering 
-        Mesh(const std::vector<Vertex>& vertices, const std::vector<unsigned int>& elements)
+        // The mesh class does not keep a these data on the RAM. Instead, it copies them into the shared
+        // vertex & element buffers of the mesh pool on the VRAM.
+        // Optionally, "cells" can contain an integer per vertex which will be sent to the shader at ATTRIB_LOC_CELL
+        Mesh(const std::vector<Vertex>& vertices, const std::vector<unsigned int>& elements, const std::vector<GLuint>& cells = {})
         {
-            //TODO: (Req 2) Write this function
-            // remember to store the number of elements in "elementCount" since you will need it for drawing
-            // For the attribute locations, use the constants defined above: ATTRIB_LOC_POSITION, ATTRIB_LOC_COLOR, etc
-            elementCount = elements.size();
-
-            // Generate and bind Vertex Array Object (VAO)
-            glGenVertexArrays(1, &VAO);
-            glBindVertexArray(VAO);
-
-            // Generate and bind Vertex Buffer Object (VBO)
-            glGenBuffers(1, &VBO);
-            glBindBuffer(GL_ARRAY_BUFFER, VBO);
-            glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(Vertex), vertices.data(), GL_STATIC_DRAW);
-
-            // Generate and bind Element Buffer Object (EBO)
-            glGenBuffers(1, &EBO);
-            glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
-            glBufferData(GL_ELEMENT_ARRAY_BUFFER, elements.size() * sizeof(unsigned int), elements.data(), GL_STATIC_DRAW);
-
-            // Set up vertex attribute pointers
-            // Enable and specify position attribute
-            glVertexAttribPointer(ATTRIB_LOC_POSITION, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, position));
-            glEnableVertexAttribArray(ATTRIB_LOC_POSITION);
-
-            // Enable and specify color attribute
-            glVertexAttribPointer(ATTRIB_LOC_COLOR, 4, GL_UNSIGNED_BYTE, GL_TRUE, sizeof(Vertex), (void*)offsetof(Vertex, color));
-            glEnableVertexAttribArray(ATTRIB_LOC_COLOR);
-
-            //Enable and specify tex coord
-            glEnableVertexAttribArray(ATTRIB_LOC_TEXCOORD);
-            glVertexAttribPointer(ATTRIB_LOC_TEXCOORD, 2, GL_FLOAT , GL_FALSE, sizeof(Vertex),  (void*)offsetof(Vertex, tex_coord));
-
-            //Enable and specify normal
-            glEnableVertexAttribArray(ATTRIB_LOC_NORMAL);
-            glVertexAttribPointer(ATTRIB_LOC_NORMAL, 3,  GL_FLOAT, GL_FALSE, sizeof(Vertex),  (void*)offsetof(Vertex, normal));
-
-            glBindVertexArray(0);
+            // Since the vertices are not kept on the RAM, we compute their bounding box now
+            for(const auto& vertex : vertices) bounds.expand(vertex.position);
+            create(vertices.data(), vertices.size(), elements.data(), elements.size(), cells.empty() ? nullptr : cells.data());
+        }
 
+        // This constructor reads the data from arrays whose bounding box is already known (e.g. a memory mapped mesh cache),
+        // so the data is uploaded without being copied into vectors first
+        Mesh(const Vertex* vertices, size_t vertexCount, const unsigned int* elements, size_t elementCount, const AABB& bounds)
+            : bounds(bounds)
+        {
+            create(vertices, vertexCount, elements, elementCount, nullptr);
         }
 
         // this function should render the mesh
         void draw() 
         {
-            //TODO: (Req 2) Write this function
-            // Bind the vertex array object (VAO)
-            glBindVertexArray(VAO);
+            // The vertex array of the pool is shared by all the meshes of this format, so we don't unbind it after drawing
+            // (the code that draws without a mesh binds its own vertex array).
+            // The elements are relative to the first vertex of the mesh, so it is passed as the base vertex.
+            MeshPool::get().bind(allocation.format);
+            glDrawElementsBaseVertex(GL_TRIANGLES, allocation.elementCount, allocation.indexType,
+                (void*)allocation.getElementOffset(), allocation.firstVertex);
+        }
+
+        // Draws only the given sub-mesh (a negative index draws the whole mesh)
+        void draw(int submesh)
+        {
+            if(submesh < 0 || submeshes.empty()) return draw();
+            const SubMesh& range = submeshes[submesh];
+            MeshPool::get().bind(allocation.format);
+            glDrawElementsBaseVertex(GL_TRIANGLES, range.elementCount, allocation.indexType,
+                (void*)(allocation.getElementOffset() + (GLintptr)range.firstElement * allocation.getIndexSize()), allocation.firstVertex);
+        }
+
+        // Splits the mesh into sub-meshes that can be drawn with different materials
+        void setSubMeshes(const std::vector<SubMesh>& submeshes){ this->submeshes = submeshes; }
+        // Returns the number of sub-meshes (at least 1)
+        int getSubMeshCount() const { return submeshes.empty() ? 1 : (int)submeshes.size(); }
+        // Returns the range of the given sub-mesh (a negative index returns the whole mesh)
+        SubMesh getSubMesh(int submesh) const {
+            if(submesh < 0 || submeshes.empty()) return SubMesh{0, allocation.elementCount};
+            return submeshes[submesh];
+        }
+
+        // Returns the bounding box of the mesh in its local space
+        const AABB& getBounds() const { return bounds; }
+
+        // Returns true if this mesh has a cell per vertex
+        bool hasCells() const { return hasCellStream(allocation.format); }
 
-            // Draw the elements using the element buffer object (EBO)
-            glDrawElements(GL_TRIANGLES, elementCount, GL_UNSIGNED_INT, 0);
+        // Returns where the mesh is stored in the mesh pool (used to draw it indirectly)
+        const MeshAllocation& getAllocation() const { return allocation; }
 
-            // Unbind the vertex array object (VAO)
-            glBindVertexArray(0);
+        // Reads the vertex & element data back from the VRAM
+        // This is slow and should only be used while building other meshes from this one (e.g. static batches)
+        void readBack(std::vector<Vertex>& vertices, std::vector<unsigned int>& elements) const {
+            MeshPool::get().readBack(allocation, vertices, elements);
         }
 
-        // this function should delete the vertex & element buffers and the vertex array object
+        // this function should return the ranges of the mesh to the pool
         ~Mesh(){
-            //TODO: (Req 2) Write this function
-            // Delete the vertex buffer object
-            glDeleteBuffers(1, &VBO);
-            glDeleteBuffers(1, &EBO);
-            glDeleteVertexArrays(1, &VAO);
+            MeshPool::get().free(allocation);
         }
 
         Mesh(Mesh const &) = delete;
@@ -2,6 +2,7 @@
 
 #include <glm/glm.hpp>
 #include <glm/gtx/hash.hpp>
+#include <glm/gtc/packing.hpp>
 
 namespace our {
 
@@ -24,6 +25,35 @@ namespace our {
         }
     };
 
+    // A compact version of Vertex (20 bytes instead of 36) which the GPU unpacks while fetching the attributes,
+    // so the shaders still receive the same vec3/vec4/vec2/vec3 inputs:
+    // - The position and the texture coordinates are half floats (GL_HALF_FLOAT).
+    // - The normal is a signed normalized 10-10-10-2 integer (GL_INT_2_10_10_10_REV).
+    struct PackedVertex {
+        glm::u16vec4 position;  // x, y & z as half floats (w is only padding to keep the next attributes aligned)
+        Color color;
+        glm::u16vec2 tex_coord;
+        glm::uint32 normal;
+
+        PackedVertex() = default;
+        explicit PackedVertex(const Vertex& vertex){
+            position = glm::u16vec4(glm::packHalf1x16(vertex.position.x), glm::packHalf1x16(vertex.position.y), glm::packHalf1x16(vertex.position.z), 0);
+            color = vertex.color;
+            tex_coord = glm::u16vec2(glm::packHalf1x16(vertex.tex_coord.x), glm::packHalf1x16(vertex.tex_coord.y));
+            normal = glm::packSnorm3x10_1x2(glm::vec4(vertex.normal, 0.0f));
+        }
+
+        Vertex unpack() const {
+            Vertex vertex;
+            vertex.position = glm::vec3(glm::unpackHalf1x16(position.x), glm::unpackHalf1x16(position.y), glm::unpackHalf1x16(position.z));
+            vertex.color = color;
+            vertex.tex_coord = glm::vec2(glm::unpackHalf1x16(tex_coord.x), glm::unpackHalf1x16(tex_coord.y));
+            vertex.normal = glm::vec3(glm::unpackSnorm3x10_1x2(normal));
+            return vertex;
+        }
+    };
+    static_assert(sizeof(PackedVertex) == 20, "PackedVertex must be tightly packed");
+
 }
 
 // We plan to use struct Vertex as a key for a map so we need to define a hash function for it
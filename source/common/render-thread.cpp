@@ -0,0 +1,120 @@
+#include "render-thread.hpp"
+#include "utils/frame-allocator.hpp"
+
+namespace our {
+
+    GuiDrawData::~GuiDrawData(){
+        for(auto list : lists) IM_DELETE(list);
+    }
+
+    void GuiDrawData::copy(const ImDrawData* source){
+        data = *source;
+        while((int)lists.size() < source->CmdListsCount) lists.push_back(IM_NEW(ImDrawList)(ImGui::GetDrawListSharedData()));
+        for(int index = 0; index < source->CmdListsCount; index++){
+            const ImDrawList* from = source->CmdLists[index];
+            ImDrawList* to = lists[index];
+            // Only the output of the draw list is needed to render it (assigning an ImVector reuses its buffer if it is big enough)
+            to->CmdBuffer = from->CmdBuffer;
+            to->IdxBuffer = from->IdxBuffer;
+            to->VtxBuffer = from->VtxBuffer;
+            to->Flags = from->Flags;
+        }
+        data.CmdLists = lists.data();
+    }
+
+    void RenderThread::start(GLFWwindow* window){
+        if(isRunning()) return;
+        this->window = window;
+        busy = false;
+        pauseRequested = paused = stopping = released = false;
+        // A context can only be current on one thread at a time
+        glfwMakeContextCurrent(nullptr);
+        thread = std::thread(&RenderThread::loop, this);
+    }
+
+    void RenderThread::stop(){
+        if(!isRunning()) return;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        condition.notify_all();
+        thread.join();
+        glfwMakeContextCurrent(window);
+        released = false;
+    }
+
+    void RenderThread::submit(std::function<void()> frame){
+        std::unique_lock<std::mutex> lock(mutex);
+        condition.wait(lock, [this](){ return !busy; });
+        this->frame = std::move(frame);
+        busy = true;
+        lock.unlock();
+        condition.notify_all();
+    }
+
+    void RenderThread::finish(){
+        std::unique_lock<std::mutex> lock(mutex);
+        condition.wait(lock, [this](){ return !busy; });
+    }
+
+    void RenderThread::pause(){
+        if(!isRunning() || released) return;
+        std::unique_lock<std::mutex> lock(mutex);
+        pauseRequested = true;
+        condition.notify_all();
+        // The render thread finishes its frame before it releases the context
+        condition.wait(lock, [this](){ return paused; });
+        lock.unlock();
+        glfwMakeContextCurrent(window);
+        released = true;
+    }
+
+    void RenderThread::resume(){
+        if(!isRunning() || !released) return;
+        glfwMakeContextCurrent(nullptr);
+        released = false;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            paused = false;
+        }
+        condition.notify_all();
+    }
+
+    void RenderThread::loop(){
+        glfwMakeContextCurrent(window);
+        // The frames of the render thread end at a different time than the frames of the main thread, so they use their own allocator
+        FrameAllocator allocator;
+        FrameAllocator::setThreadAllocator(&allocator);
+
+        std::unique_lock<std::mutex> lock(mutex);
+        while(true){
+            condition.wait(lock, [this](){ return frame || pauseRequested || stopping; });
+            if(frame){
+                std::function<void()> current = std::move(frame);
+                frame = nullptr;
+                lock.unlock();
+                allocator.reset();
+                current();
+                lock.lock();
+                busy = false;
+                condition.notify_all();
+            } else if(pauseRequested){
+                pauseRequested = false;
+                glfwMakeContextCurrent(nullptr);
+                paused = true;
+                condition.notify_all();
+                condition.wait(lock, [this](){ return !paused || stopping; });
+                // If it is stopped while paused, the context stays on the main thread
+                if(stopping) break;
+                glfwMakeContextCurrent(window);
+            } else {
+                // Stopping (the submitted frame was drawn above)
+                glfwMakeContextCurrent(nullptr);
+                break;
+            }
+        }
+        FrameAllocator::setThreadAllocator(nullptr);
+    }
+
+}
@@ -0,0 +1,77 @@
+#pragma once
+
+#include <glad/gl.h>
+#include <GLFW/glfw3.h>
+#include <imgui.h>
+
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace our {
+
+    // A copy of the ImGui draw data of a frame. ImGui reuses its draw lists in the next frame, which the main thread builds
+    // while the render thread draws this one. The copied draw lists are kept between frames so that their buffers are reused.
+    class GuiDrawData {
+        ImDrawData data;
+        std::vector<ImDrawList*> lists;
+    public:
+        GuiDrawData() = default;
+        ~GuiDrawData();
+
+        // Copies the draw data returned by ImGui::GetDrawData() (after ImGui::Render())
+        void copy(const ImDrawData* source);
+        ImDrawData* get() { return &data; }
+
+        GuiDrawData(const GuiDrawData&) = delete;
+        GuiDrawData& operator=(const GuiDrawData&) = delete;
+    };
+
+    // A thread that owns the OpenGL context of the window and draws the frames submitted by the main thread,
+    // so that the main thread can update the next frame while the current one is drawn.
+    // Only one frame is drawn at a time and "submit" waits for the previous frame to finish before queuing the next one,
+    // so the data of a frame must stay valid until the next frame is submitted (2 buffers are enough: one drawn & one being filled).
+    // The context can be given back to the main thread (e.g. to load the assets of a new state) using "pause" & "resume".
+    // The render thread has its own frame allocator which is reset before each frame.
+    class RenderThread {
+        GLFWwindow* window = nullptr;
+        std::thread thread;
+        std::mutex mutex;
+        std::condition_variable condition;
+        // The frame waiting to be drawn. It should be small enough to be stored in the std::function without allocating (e.g. [this, index]).
+        std::function<void()> frame;
+        bool busy = false;          // A frame was submitted & is not finished yet
+        bool pauseRequested = false;
+        bool paused = false;        // The render thread released the context & waits for "resume"
+        bool stopping = false;
+        bool released = false;      // Only used by the main thread: whether it has the context because of "pause"
+
+        void loop();
+    public:
+        RenderThread() = default;
+        ~RenderThread() { stop(); }
+
+        // Moves the context of the window (which must be current on the calling thread) to a new render thread
+        void start(GLFWwindow* window);
+        // Draws the submitted frame (if any) then makes the context current on the calling thread again
+        void stop();
+        bool isRunning() const { return thread.joinable(); }
+
+        // Waits until the previous frame is drawn then queues the given frame
+        void submit(std::function<void()> frame);
+        // Waits until the submitted frame is drawn
+        void finish();
+
+        // Waits until the submitted frame is drawn then makes the context current on the calling thread until "resume" is called
+        void pause();
+        // Gives the context back to the render thread
+        void resume();
+        bool isPaused() const { return released; }
+
+        RenderThread(const RenderThread&) = delete;
+        RenderThread& operator=(const RenderThread&) = delete;
+    };
+
+}
@@ -0,0 +1,117 @@
+#include "program-cache.hpp"
+#include "../utils/hash.hpp"
+#include "../utils/mapped-file.hpp"
+
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+
+namespace our::program_cache {
+
+    static const char MAGIC[4] = {'A', 'X', 'P', 'B'};
+    static bool enabled = false;
+    static Statistics statistics;
+
+    void setEnabled(bool enable){
+        GLint formats = 0;
+        if(enable && (GLAD_GL_VERSION_4_1 || GLAD_GL_ARB_get_program_binary)) glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formats);
+        enabled = formats > 0;
+        if(enable && !enabled) std::cout << "The driver can't return program binaries, the shaders will be compiled every time" << std::endl;
+    }
+
+    bool isEnabled(){ return enabled; }
+
+    uint64_t computeKey(const std::vector<std::pair<std::string, GLenum>>& stages){
+        uint64_t key = hashFNV1a(&VERSION, sizeof(VERSION));
+        for(GLenum name : {GL_VENDOR, GL_RENDERER, GL_VERSION}){
+            const char* value = reinterpret_cast<const char*>(glGetString(name));
+            key = hashFNV1a(std::string(value ? value : ""), key);
+        }
+        for(const auto& [code, type] : stages){
+            key = hashFNV1a(&type, sizeof(type), key);
+            key = hashFNV1a(code, key);
+        }
+        return key;
+    }
+
+    std::string getCachePath(uint64_t key){
+        std::stringstream stream;
+        stream << "cache/shaders/" << std::hex << std::setw(16) << std::setfill('0') << key << ".bin";
+        return stream.str();
+    }
+
+    bool load(GLuint program, uint64_t key){
+        MappedFile file(getCachePath(key));
+        if(!file.isOpen() || file.getSize() < sizeof(Header)) return false;
+
+        Header header;
+        std::memcpy(&header, file.getData(), sizeof(Header));
+        bool valid = std::memcmp(header.magic, MAGIC, sizeof(MAGIC)) == 0 && header.version == VERSION &&
+                     header.key == key && file.getSize() == sizeof(Header) + header.binarySize;
+        if(!valid) return false;
+
+        // The driver may reject a binary that it created (e.g. after a driver update), then the link status is false
+        glProgramBinary(program, header.binaryFormat, file.getData() + sizeof(Header), (GLsizei)header.binarySize);
+        GLint status = GL_FALSE;
+        glGetProgramiv(program, GL_LINK_STATUS, &status);
+        return status == GL_TRUE;
+    }
+
+    bool save(GLuint program, uint64_t key){
+        GLint length = 0;
+        glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+        if(length <= 0) return false;
+        std::vector<char> binary(length);
+        Header header = {};
+        std::memcpy(header.magic, MAGIC, sizeof(MAGIC));
+        header.version = VERSION;
+        header.key = key;
+        glGetProgramBinary(program, length, &length, &header.binaryFormat, binary.data());
+        header.binarySize = (uint32_t)length;
+
+        std::string cachePath = getCachePath(key);
+        std::error_code error;
+        std::filesystem::create_directories(std::filesystem::path(cachePath).parent_path(), error);
+        // We write to a temporary file then rename it, so a partially written file is never read
+        // (its name is unique to the writer, so two processes caching the same program don't write to the same file)
+        std::string temporaryPath = getTemporaryPath(cachePath);
+        bool written;
+        {
+            std::ofstream file(temporaryPath, std::ios::binary | std::ios::trunc);
+            file.write(reinterpret_cast<const char*>(&header), sizeof(Header));
+            file.write(binary.data(), header.binarySize);
+            file.close();
+            written = !file.fail();
+        }
+        if(written) std::filesystem::rename(temporaryPath, cachePath, error);
+        if(!written || error){
+            std::filesystem::remove(temporaryPath, error);
+            std::cerr << "Failed to write the program cache \"" << cachePath << "\"" << std::endl;
+            return false;
+        }
+        return true;
+    }
+
+    void record(bool loaded, double milliseconds){
+        if(loaded){
+            statistics.loaded++;
+            statistics.loadMilliseconds += milliseconds;
+        } else {
+            statistics.compiled++;
+            statistics.compileMilliseconds += milliseconds;
+        }
+    }
+
+    const Statistics& getStatistics(){ return statistics; }
+
+    void logStatistics(const std::string& label, const Statistics& since){
+        std::cout << label << ": " << statistics.compiled - since.compiled << " programs compiled in "
+                  << statistics.compileMilliseconds - since.compileMilliseconds << " ms, "
+                  << statistics.loaded - since.loaded << " loaded from the program cache in "
+                  << statistics.loadMilliseconds - since.loadMilliseconds << " ms" << std::endl;
+    }
+
+}
@@ -0,0 +1,53 @@
+#pragma once
+
+#include <glad/gl.h>
+#include <cstdint>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace our::program_cache {
+
+    // Increment this whenever the file layout or the way the key is computed changes so that the old files are ignored
+    constexpr uint32_t VERSION = 1;
+
+    // The header at the start of every cache file. It is followed by the program binary.
+    struct Header {
+        char magic[4];          // "AXPB"
+        uint32_t version;       // Must be equal to VERSION
+        uint64_t key;           // The key of the program (see "computeKey")
+        GLenum binaryFormat;    // The driver specific format returned by glGetProgramBinary
+        uint32_t binarySize;
+    };
+
+    // The time spent creating the programs since the start of the application.
+    // A program is either compiled from its sources or loaded from the cache.
+    struct Statistics {
+        int compiled = 0, loaded = 0;
+        double compileMilliseconds = 0, loadMilliseconds = 0;
+    };
+
+    // Enables or disables the cache. The cache is only used if the driver can return program binaries
+    // (OpenGL 4.1 or ARB_get_program_binary with at least one binary format), so this must be called after creating the context.
+    void setEnabled(bool enabled);
+    bool isEnabled();
+
+    // Computes the key of a program from the code of its stages (after the defines are inserted) and the driver strings,
+    // since a binary can only be loaded by the driver (and usually the driver version) which created it
+    uint64_t computeKey(const std::vector<std::pair<std::string, GLenum>>& stages);
+    // Returns the path of the cache file of the given key (the cache files are stored in "cache/shaders")
+    std::string getCachePath(uint64_t key);
+
+    // Loads the cached binary of the given key into the program. Returns false if there is no valid cache file
+    // or if the driver rejected the binary (e.g. after a driver update), then the program must be compiled and linked.
+    bool load(GLuint program, uint64_t key);
+    // Saves the binary of the given linked program. The program should be linked with GL_PROGRAM_BINARY_RETRIEVABLE_HINT.
+    bool save(GLuint program, uint64_t key);
+
+    // Records the time spent creating a program
+    void record(bool loaded, double milliseconds);
+    const Statistics& getStatistics();
+    // Prints the programs created since the given statistics were taken (e.g. "Asset shaders: 3 compiled in 40 ms, 2 loaded from the cache in 1 ms")
+    void logStatistics(const std::string& label, const Statistics& since);
+
+}
@@ -1,6 +1,9 @@
 #include "shader.hpp"
+#include "program-cache.hpp"
 
+#include <algorithm>
 #include <cassert>
+#include <chrono>
 #include <iostream>
 #include <fstream>
 #include <string>
@@ -9,7 +12,7 @@
 std::string checkForShaderCompilationErrors(GLuint shader);
 std::string checkForLinkingErrors(GLuint program);
 
-bool our::ShaderProgram::attach(const std::string &filename, GLenum type) const {
+bool our::ShaderProgram::attach(const std::string &filename, GLenum type, const std::vector<std::string>& defines) {
     // Here, we open the file and read a string from it containing the GLSL code of our shader
     std::ifstream file(filename);
     if(!file){
@@ -17,52 +20,119 @@ bool our::ShaderProgram::attach(const std::string &filename, GLenum type) const
         return false;
     }
     std::string sourceString = std::string(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
-    const char* sourceCStr = sourceString.c_str();
     file.close();
+    attachSource(std::move(sourceString), type, filename, defines);
+    return true;
+}
 
-    //TODO: Complete this function
-    //Note: The function "checkForShaderCompilationErrors" checks if there is
-    // an error in the given shader. You should use it to check if there is a
-    // compilation error and print it so that you can know what is wrong with
-    // the shader. The returned string will be empty if there is no errors.
-    GLuint shader = glCreateShader(type);
-    glShaderSource(shader, 1, &sourceCStr, nullptr);
-    glCompileShader(shader);
-    std::string errors = checkForShaderCompilationErrors(shader);
-    std::cout<<("Errors Compile:"+errors)<<std::endl;
-    if(!errors.empty()) {
-        std::cerr << "ERROR: Couldn't compile shader: " << filename << std::endl;
-        std::cerr << errors << std::endl;
-        glDeleteShader(shader);
-        return false;
+void our::ShaderProgram::attachSource(std::string sourceString, GLenum type, const std::string& name, const std::vector<std::string>& defines) {
+    sources.push_back({name, type, defines});
+
+    // The defines must come after the "#version" directive (which must be the first line of the shader)
+    if(!defines.empty()){
+        std::string defineString;
+        for(const auto& define : defines) defineString += "#define " + define + "\n";
+        size_t versionStart = sourceString.find("#version");
+        size_t insertAt = versionStart == std::string::npos ? 0 : sourceString.find('\n', versionStart);
+        if(insertAt == std::string::npos){
+            sourceString += "\n";
+            insertAt = sourceString.size();
+        } else if(versionStart != std::string::npos) {
+            insertAt++;
+        }
+        sourceString.insert(insertAt, defineString);
     }
-    glAttachShader(program, shader);
-    glDeleteShader(shader);
-    //We return true if the compilation succeeded
-    return true;
+    stages.emplace_back(std::move(sourceString), type);
 }
 
 
 
-bool our::ShaderProgram::link() const {
+bool our::ShaderProgram::link() {
+    auto start = std::chrono::steady_clock::now();
+    auto elapsed = [&start](){ return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count(); };
+    // The code of the stages is not needed once the program is linked
+    auto stageList = std::move(stages);
+    stages.clear();
+
+    uint64_t key = 0;
+    bool cached = program_cache::isEnabled();
+    if(cached){
+        key = program_cache::computeKey(stageList);
+        if(program_cache::load(program, key)){
+            bindSharedUniformBlocks();
+            program_cache::record(true, elapsed());
+            return true;
+        }
+    }
+
+    for(size_t index = 0; index < stageList.size(); index++){
+        const auto& [code, type] = stageList[index];
+        // The stages are the last attached files
+        const std::string& filename = sources[sources.size() - stageList.size() + index].filename;
+        const char* sourceCStr = code.c_str();
+
+        //TODO: Complete this function
+        //Note: The function "checkForShaderCompilationErrors" checks if there is
+        // an error in the given shader. You should use it to check if there is a
+        // compilation error and print it so that you can know what is wrong with
+        // the shader. The returned string will be empty if there is no errors.
+        GLuint shader = glCreateShader(type);
+        glShaderSource(shader, 1, &sourceCStr, nullptr);
+        glCompileShader(shader);
+        std::string errors = checkForShaderCompilationErrors(shader);
+        if(!errors.empty()) {
+            std::cerr << "ERROR: Couldn't compile shader: " << filename << std::endl;
+            std::cerr << errors << std::endl;
+            glDeleteShader(shader);
+            return false;
+        }
+        glAttachShader(program, shader);
+        glDeleteShader(shader);
+    }
+
     //TODO: Complete this function
     //Note: The function "checkForLinkingErrors" checks if there is
     // an error in the given program. You should use it to check if there is a
     // linking error and print it so that you can know what is wrong with the
     // program. The returned string will be empty if there is no errors.
+    // The binary must be marked as retrievable before linking to be saved to the cache
+    if(cached) glProgramParameteri(program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
     glLinkProgram(program);
     std::string errors = checkForLinkingErrors(program);
-    std::cout<<("Errors Link:"+errors)<<std::endl;
-
     if(!errors.empty()) {
         std::cerr << "ERROR: Couldn't link shader program" << std::endl;
         std::cerr << errors << std::endl;
         return false;
     }
+    bindSharedUniformBlocks();
+    if(cached) program_cache::save(program, key);
+    program_cache::record(false, elapsed());
     //We return true if the linking succeeded
     return true;
 }
 
+void our::ShaderProgram::bindSharedUniformBlocks() {
+    bindUniformBlock("CellMask", CELL_MASK_BINDING);
+}
+
+our::ShaderProgram* our::ShaderProgram::createVariant(const std::vector<std::string>& extraDefines, const std::vector<std::pair<std::string, GLenum>>& replacedStages) const {
+    auto variant = new ShaderProgram();
+    bool success = !sources.empty();
+    for(const auto& source : sources){
+        // Each file keeps its own defines (e.g. the renamed functions of a fused postprocessing effect)
+        std::vector<std::string> variantDefines = source.defines;
+        variantDefines.insert(variantDefines.end(), extraDefines.begin(), extraDefines.end());
+        // If a file is given for this stage, it is used instead of the attached one
+        auto replaced = std::find_if(replacedStages.begin(), replacedStages.end(), [&source](const auto& stage){ return stage.second == source.type; });
+        success = success && variant->attach(replaced != replacedStages.end() ? replaced->first : source.filename, source.type, variantDefines);
+    }
+    if(!success || !variant->link()){
+        delete variant;
+        return nullptr;
+    }
+    return variant;
+}
+
 ////////////////////////////////////////////////////////////////////
 // Function to check for compilation and linking error in shaders //
 ////////////////////////////////////////////////////////////////////
@@ -2,6 +2,8 @@
 #define SHADER_HPP
 
 #include <string>
+#include <vector>
+#include <utility>
 
 #include <glad/gl.h>
 #include <glm/glm.hpp>
@@ -9,11 +11,28 @@
 
 namespace our {
 
+    // The uniform buffer binding point of the cell mask used while drawing meshes that have a cell per vertex
+    constexpr GLuint CELL_MASK_BINDING = 0;
+
     class ShaderProgram {
 
     private:
         //Shader Program Handle (OpenGL object name)
         GLuint program;
+        // An attached shader file, its stage and the defines it was compiled with (used to create variants)
+        struct Source {
+            std::string filename;
+            GLenum type;
+            std::vector<std::string> defines;
+        };
+        std::vector<Source> sources;
+        // The code of each attached stage (with the defines inserted). The stages are only compiled by "link"
+        // if the program binary is not found in the program cache (see "program-cache.hpp").
+        std::vector<std::pair<std::string, GLenum>> stages;
+
+        // Assigns the binding points of the uniform blocks shared by the engine's shaders (e.g. "CellMask").
+        // A block binding is part of the program state, so it is only set once after the program is linked (or loaded from the cache).
+        void bindSharedUniformBlocks();
 
     public:
         ShaderProgram(){
@@ -27,61 +46,100 @@ namespace our {
                 glDeleteProgram(program);
         }
 
-        bool attach(const std::string &filename, GLenum type) const;
-
-        bool link() const;
+        // Reads the given shader file and adds it to the stages of the program. It returns false only if the file can't be read:
+        // the stage is not compiled here (a cached binary may make compiling unnecessary), so the compilation errors are
+        // reported by "link" with the name of the file, and the result of "link" is the one to check.
+        // The given defines are inserted after the "#version" line as "#define NAME" (so a define can also be "NAME VALUE")
+        bool attach(const std::string &filename, GLenum type, const std::vector<std::string>& defines = {});
+        // Adds the given GLSL code as a stage of the program (e.g. code generated at runtime). "name" is only used in the error messages.
+        // A program can have multiple shaders of the same stage (their functions & uniforms are linked together),
+        // but the programs with code stages can't create variants since their code is not in a file.
+        void attachSource(std::string source, GLenum type, const std::string& name, const std::vector<std::string>& defines = {});
+
+        // Loads the program binary from the program cache if the same stages were linked before by the same driver,
+        // otherwise compiles the stages, links them and saves the binary to the cache. Returns false if the program failed to compile or link.
+        bool link();
+
+        // Creates a new program from the same shader files with some extra defines (e.g. to enable an optional feature in the shaders)
+        // The given stages replace the attached files of the same stage (e.g. to draw the depth only using an empty fragment shader)
+        // Returns nullptr if the variant failed to compile or link
+        ShaderProgram* createVariant(const std::vector<std::string>& extraDefines, const std::vector<std::pair<std::string, GLenum>>& replacedStages = {}) const;
 
         void use() { 
             glUseProgram(program);
         }
 
-        GLuint getUniformLocation(const std::string &name) {
+        // The uniform names are taken as C strings since most of them are literals,
+        // so no std::string is allocated for the long names every time a uniform is set
+        GLuint getUniformLocation(const char* name) {
             //TODO: (Req 1) Return the location of the uniform with the given name
-            return glGetUniformLocation(program, name.c_str());
+            return glGetUniformLocation(program, name);
         }
 
-        void set(const std::string &uniform, GLfloat value) {
+        void set(const char* uniform, GLfloat value) {
             //TODO: (Req 1) Send the given float value to the given uniform
             GLuint location = getUniformLocation(uniform);
             glUniform1f(location, value);
         }
 
-        void set(const std::string &uniform, GLuint value) {
+        void set(const char* uniform, GLuint value) {
             //TODO: (Req 1) Send the given unsigned integer value to the given uniform
             GLuint location = getUniformLocation(uniform);
             glUniform1ui(location, value);
         }
 
-        void set(const std::string &uniform, GLint value) {
+        void set(const char* uniform, GLint value) {
             //TODO: (Req 1) Send the given integer value to the given uniform
             GLuint location = getUniformLocation(uniform);
             glUniform1i(location, value);
         }
 
-        void set(const std::string &uniform, glm::vec2 value) {
+        void set(const char* uniform, glm::vec2 value) {
             //TODO: (Req 1) Send the given 2D vector value to the given uniform
             GLuint location = getUniformLocation(uniform);
             glUniform2fv(location, 1, glm::value_ptr(value));
         }
 
-        void set(const std::string &uniform, glm::vec3 value) {
+        void set(const char* uniform, glm::vec3 value) {
             //TODO: (Req 1) Send the given 3D vector value to the given uniform
             GLuint location = getUniformLocation(uniform);
             glUniform3fv(location, 1, glm::value_ptr(value));
         }
 
-        void set(const std::string &uniform, glm::vec4 value) {
+        void set(const char* uniform, glm::vec4 value) {
             //TODO: (Req 1) Send the given 4D vector value to the given uniform
             GLuint location = getUniformLocation(uniform);
             glUniform4fv(location, 1, glm::value_ptr(value));
         }
 
-        void set(const std::string &uniform, glm::mat4 matrix) {
+        void set(const char* uniform, glm::ivec2 value) {
+            GLuint location = getUniformLocation(uniform);
+            glUniform2iv(location, 1, glm::value_ptr(value));
+        }
+
+        void set(const char* uniform, glm::ivec3 value) {
+            GLuint location = getUniformLocation(uniform);
+            glUniform3iv(location, 1, glm::value_ptr(value));
+        }
+
+        void set(const char* uniform, glm::mat4 matrix) {
             //TODO: (Req 1) Send the given matrix 4x4 value to the given uniform
             GLuint location = getUniformLocation(uniform);
             glUniformMatrix4fv(location, 1, false, glm::value_ptr(matrix));
         }
 
+        // Sets a uniform whose name is built at runtime (e.g. from a json file)
+        template<typename T>
+        void set(const std::string &uniform, T value) {
+            set(uniform.c_str(), value);
+        }
+
+        // Assigns the given binding point to the uniform block with the given name (if the program has it)
+        void bindUniformBlock(const char* block, GLuint binding) {
+            GLuint index = glGetUniformBlockIndex(program, block);
+            if(index != GL_INVALID_INDEX) glUniformBlockBinding(program, index, binding);
+        }
+
         //TODO: (Req 1) Delete the copy constructor and assignment operator.
         //Question: Why do we delete the copy constructor and assignment operator?
         //Answer: Because we don't want to copy the shader program object. We want to keep it unique.
@@ -9,6 +9,7 @@
 #include "../components/covered-cube.hpp"
 #include "../components/enemy.hpp"
 #include "../components/dot.hpp"
+#include "arena-batch.hpp"
 
 
 #include <glm/glm.hpp>
@@ -30,10 +31,12 @@ namespace our {
         /*
          * =================================CONSTANTS=================================
          * GRID_DIMENSION: The dimension of the grid (40x40)
+         * GRID_OFFSET: Added to a coordinate to get the index of its cell (the first cells are at -(ARENA_LENGTH + 0.5))
          * RESET_STARTPOS: Dummy Invalid position (indication of not covering area at the moment)
          * EPS: A small value for floating point comparison
          */
         const int GRID_DIMENSION = 40;
+        const double GRID_OFFSET = ARENA_LENGTH + 0.5;
         const glm::vec2 RESET_STARTPOS = glm::vec2(-1, -1);
         const glm::vec3 RESET_DOT = glm::vec3(10, -3.05 ,15);
         const float EPS = 1e-4;
@@ -75,9 +78,29 @@ namespace our {
         // Flag to check if there exits at least 2 in the grid (for the DFS)
         bool found2 = false;
 
+        // The static batch drawing the cubes (if any). Raising a cube only sets its bit in the batch mask.
+        ArenaBatch* arenaBatch = nullptr;
+
         // When a state enters, it should call this function and give it the pointer to the application
-        void enter(Application* app){
+        // If the arena cubes are drawn using a static batch, it should be given too
+        void enter(Application* app, ArenaBatch* arenaBatch = nullptr){
             this->app = app;
+            this->arenaBatch = arenaBatch;
+        }
+
+        // Raises the cube at the given cell (the cube of a drawn cell is always raised)
+        void raiseCube(int x, int z){
+            if(arenaBatch){
+                arenaBatch->setRaised(x, z, true);
+            } else if(cubes[x][z]){
+                cubes[x][z]->localTransform.position = glm::vec3(cubes[x][z]->localTransform.position.x, 0,
+                                                                 cubes[x][z]->localTransform.position.z);
+            }
+        }
+
+        // Returns true if the cube at the given cell is raised (its cell is drawn)
+        bool isCubeRaised(int x, int z) const {
+            return grid[x][z] == 1;
         }
 
         AreaCoverageSystem() {
@@ -142,8 +165,8 @@ namespace our {
 
             if (player) {
                 // getting their place in the 2d vector
-                int x = glm::round(playerPosition.x + 19.5);
-                int z = glm::round(playerPosition.z + 19.5);
+                int x = glm::round(playerPosition.x + GRID_OFFSET);
+                int z = glm::round(playerPosition.z + GRID_OFFSET);
 
                 // Index Limit Check (player's position may exceed the grid's limits)
                 if (x < 0) x = 0;
@@ -226,10 +249,7 @@ namespace our {
                 grid[x][y] == 2)
                 return;
             grid[x][y] = 1;
-            if (cubes[x][y]) {
-                cubes[x][y]->localTransform.position = glm::vec3(cubes[x][y]->localTransform.position.x, 0,
-                                                                 cubes[x][y]->localTransform.position.z);
-            }
+            raiseCube(x, y);
             dfsAndDraw(x + 1, y);
             dfsAndDraw(x - 1, y);
             dfsAndDraw(x, y + 1);
@@ -238,15 +258,14 @@ namespace our {
 
         void fillBorderAfterCovering() {
             for(int i = curDot-1; i>=0;  i--){
-                int x = glm::round(dots[i]->localTransform.position.x + 19.5);
-                int z = glm::round(dots[i]->localTransform.position.z + 19.5);
+                int x = glm::round(dots[i]->localTransform.position.x + GRID_OFFSET);
+                int z = glm::round(dots[i]->localTransform.position.z + GRID_OFFSET);
                 if(x < 0) x = 0;
                 if(z < 0) z = 0;
                 if(x >= GRID_DIMENSION) x = GRID_DIMENSION - 1;
                 if(z >= GRID_DIMENSION) z = GRID_DIMENSION - 1;
 
-                cubes[x][z]->localTransform.position = glm::vec3(cubes[x][z]->localTransform.position.x, 0,
-                                                                 cubes[x][z]->localTransform.position.z);
+                raiseCube(x, z);
                 grid[x][z] = 1;
                 dots[i]->localTransform.position = RESET_DOT;
                 curDot=0;
@@ -256,8 +275,8 @@ namespace our {
 
         void dieReset(World* world){
             for(int i = curDot-1; i>=0;  i--){
-                int x = glm::round(dots[i]->localTransform.position.x + 19.5);
-                int z = glm::round(dots[i]->localTransform.position.z + 19.5);
+                int x = glm::round(dots[i]->localTransform.position.x + GRID_OFFSET);
+                int z = glm::round(dots[i]->localTransform.position.z + GRID_OFFSET);
                 if(x < 0) x = 0;
                 if(z < 0) z = 0;
                 if(x >= GRID_DIMENSION) x = GRID_DIMENSION - 1;
@@ -291,8 +310,8 @@ namespace our {
                 auto *coveredCube = entity->getComponent<CoveredCubeComponent>();
                 if (coveredCube) {
                     glm::vec3 coveredCubePosition = entity->localTransform.position;
-                    int x = glm::round(coveredCubePosition.x + 19.5);
-                    int z = glm::round(coveredCubePosition.z + 19.5);
+                    int x = glm::round(coveredCubePosition.x + GRID_OFFSET);
+                    int z = glm::round(coveredCubePosition.z + GRID_OFFSET);
                     cubes[x][z] = entity;
                 }
             }
@@ -325,8 +344,8 @@ namespace our {
 
             for(auto entity: enemies){
                 glm::vec3 enemyPosition = entity->localTransform.position;
-                int enemyX = glm::round(enemyPosition.x + 19.5);
-                int enemyY = glm::round(enemyPosition.z + 19.5);
+                int enemyX = glm::round(enemyPosition.x + GRID_OFFSET);
+                int enemyY = glm::round(enemyPosition.z + GRID_OFFSET);
                 if(enemyX == x && enemyY == y){
                     return true;
                 }
@@ -418,8 +437,8 @@ namespace our {
         void printEnemy(){
             for(auto enemyEntity: enemies){
                 glm::vec3 enemyPosition = enemyEntity->localTransform.position;
-                int enemyX = glm::round(enemyPosition.x + 19.5);
-                int enemyY = glm::round(enemyPosition.z + 19.5);
+                int enemyX = glm::round(enemyPosition.x + GRID_OFFSET);
+                int enemyY = glm::round(enemyPosition.z + GRID_OFFSET);
                 std::cout << "Enemy AT: " << " X: " << enemyX << " ,Z: " << enemyY << "\n";
             }
         }
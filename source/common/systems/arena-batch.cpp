@@ -0,0 +1,129 @@
+#include "arena-batch.hpp"
+#include "../components/covered-cube.hpp"
+#include "../components/mesh-renderer.hpp"
+
+#include <glm/gtc/matrix_inverse.hpp>
+#include <cassert>
+#include <map>
+#include <tuple>
+
+namespace our {
+
+    // The data of a chunk while it is being built
+    struct ChunkGeometry {
+        std::vector<Vertex> vertices;
+        std::vector<GLuint> elements;
+        std::vector<GLuint> cells;
+    };
+
+    void ArenaBatch::build(World* world, int dimension, int chunkSize){
+        assert(dimension * dimension <= MAX_MASK_CELLS);
+        this->dimension = dimension;
+        mask.assign((dimension * dimension + 31) / 32, 0);
+        // The cubes are placed such that the cell (x, z) is centered at (x - offset, z - offset)
+        float offset = (dimension - 1) * 0.5f;
+
+        // The cubes are grouped by chunk, and then by mesh & material since a batch is drawn using a single material
+        std::map<std::tuple<int, Mesh*, Material*>, ChunkGeometry> chunks;
+        // The geometry of each source mesh is read back once
+        std::map<Mesh*, std::pair<std::vector<Vertex>, std::vector<GLuint>>> sources;
+        // Some cells have more than one cube (e.g. the corners), so we only bake the first one
+        std::vector<bool> baked(dimension * dimension, false);
+
+        for(auto entity : world->getEntities()){
+            if(!entity->getComponent<CoveredCubeComponent>()) continue;
+            auto meshRenderer = entity->getComponent<MeshRendererComponent>();
+            if(!meshRenderer) continue;
+
+            glm::vec3 position = entity->localTransform.position;
+            int x = (int)glm::round(position.x + offset);
+            int z = (int)glm::round(position.z + offset);
+            if(x < 0 || z < 0 || x >= dimension || z >= dimension) continue;
+            GLuint cell = x * dimension + z;
+            if(position.y >= 0) mask[cell >> 5] |= 1u << (cell & 31);
+            // A mesh with sub-meshes may use several materials, so it is left to be drawn on its own
+            if(meshRenderer->mesh->getSubMeshCount() > 1) continue;
+            // The cube is no longer drawn on its own, but the entity stays for the gameplay logic
+            Mesh* mesh = meshRenderer->mesh;
+            Material* material = meshRenderer->material;
+            entity->deleteComponent(meshRenderer);
+            if(baked[cell]) continue;
+            baked[cell] = true;
+
+            auto source = sources.find(mesh);
+            if(source == sources.end()){
+                source = sources.emplace(mesh, std::pair<std::vector<Vertex>, std::vector<GLuint>>()).first;
+                mesh->readBack(source->second.first, source->second.second);
+            }
+
+            // The cube is baked at its raised position, the mask decides if it is drawn or not
+            glm::mat4 localToWorld = entity->getLocalToWorldMatrix();
+            localToWorld[3].y -= position.y;
+            glm::mat3 normalMatrix = glm::inverseTranspose(glm::mat3(localToWorld));
+
+            int chunk = (x / chunkSize) * ((dimension + chunkSize - 1) / chunkSize) + (z / chunkSize);
+            ChunkGeometry& geometry = chunks[{chunk, mesh, material}];
+            GLuint base = (GLuint)geometry.vertices.size();
+            for(Vertex vertex : source->second.first){
+                vertex.position = glm::vec3(localToWorld * glm::vec4(vertex.position, 1.0f));
+                vertex.normal = glm::normalize(normalMatrix * vertex.normal);
+                geometry.vertices.push_back(vertex);
+                geometry.cells.push_back(cell);
+            }
+            for(GLuint element : source->second.second) geometry.elements.push_back(base + element);
+        }
+
+        // Create an entity at the origin to draw each chunk (the vertices are already in world space)
+        for(auto& [key, geometry] : chunks){
+            Mesh* mesh = new Mesh(geometry.vertices, geometry.elements, geometry.cells);
+            chunkMeshes.push_back(mesh);
+
+            Entity* entity = world->add();
+            entity->name = "arena_chunk";
+            entity->parent = nullptr;
+            auto meshRenderer = entity->addComponent<MeshRendererComponent>();
+            meshRenderer->mesh = mesh;
+            meshRenderer->material = std::get<2>(key);
+        }
+
+        // The mask is stored in a uniform buffer which always has the size of the uniform block declared in the shaders
+        glGenBuffers(1, &maskBuffer);
+        glBindBuffer(GL_UNIFORM_BUFFER, maskBuffer);
+        glBufferData(GL_UNIFORM_BUFFER, MAX_MASK_CELLS / 8, nullptr, GL_DYNAMIC_DRAW);
+        glBufferSubData(GL_UNIFORM_BUFFER, 0, mask.size() * sizeof(GLuint), mask.data());
+        glBindBuffer(GL_UNIFORM_BUFFER, 0);
+        dirty = false;
+    }
+
+    void ArenaBatch::upload(){
+        if(!dirty) return;
+        upload(mask);
+        dirty = false;
+    }
+
+    bool ArenaBatch::copyIfDirty(std::vector<GLuint>& copy){
+        if(!dirty) return false;
+        // The copy keeps its capacity between frames, so it is only allocated once
+        copy.assign(mask.begin(), mask.end());
+        dirty = false;
+        return true;
+    }
+
+    void ArenaBatch::upload(const std::vector<GLuint>& copy){
+        if(maskBuffer == 0) return;
+        // The whole mask is only a few hundred bytes so we upload all of it
+        glBindBuffer(GL_UNIFORM_BUFFER, maskBuffer);
+        glBufferSubData(GL_UNIFORM_BUFFER, 0, copy.size() * sizeof(GLuint), copy.data());
+        glBindBuffer(GL_UNIFORM_BUFFER, 0);
+    }
+
+    void ArenaBatch::destroy(){
+        for(auto mesh : chunkMeshes) delete mesh;
+        chunkMeshes.clear();
+        if(maskBuffer) glDeleteBuffers(1, &maskBuffer);
+        maskBuffer = 0;
+        mask.clear();
+        dirty = false;
+    }
+
+}
@@ -0,0 +1,66 @@
+#pragma once
+
+#include "../ecs/world.hpp"
+#include "../mesh/mesh.hpp"
+
+#include <glad/gl.h>
+#include <vector>
+
+namespace our {
+
+    // The maximum number of cells supported by the cell mask (it must match the size of the "CellMask" uniform block in the shaders)
+    constexpr int MAX_MASK_CELLS = 8192;
+
+    // The arena cubes never move, they are only raised (when their cell is covered) or hidden.
+    // So instead of drawing ~1600 entities and moving them when a region is filled,
+    // this class merges the cubes into a single mesh per chunk of the grid (a static batch).
+    // Every vertex stores the index of its cell, and the vertex shader reads a bitmask (stored in a uniform buffer)
+    // to collapse the cubes of the hidden cells. Raising a region only changes some bits in the mask.
+    class ArenaBatch {
+        int dimension = 0; // The number of cells on each side of the grid
+        std::vector<GLuint> mask; // A bit per cell (1: raised, 0: hidden)
+        bool dirty = false;
+        GLuint maskBuffer = 0;
+
+        // The meshes of the chunks and the entities used to draw them (the world owns the entities)
+        std::vector<Mesh*> chunkMeshes;
+
+    public:
+        // Merges all the entities with a CoveredCubeComponent into one mesh per chunk (chunkSize x chunkSize cells)
+        // and adds an entity to the world to draw each chunk. The mesh renderers of the cubes are removed.
+        // The cubes that are above the ground (y >= 0) start raised.
+        void build(World* world, int dimension, int chunkSize = 8);
+
+        // Raises or hides the cube at the given cell
+        void setRaised(int x, int z, bool raised){
+            if(mask.empty()) return;
+            GLuint cell = x * dimension + z;
+            GLuint bit = 1u << (cell & 31);
+            GLuint word = raised ? (mask[cell >> 5] | bit) : (mask[cell >> 5] & ~bit);
+            if(word != mask[cell >> 5]){
+                mask[cell >> 5] = word;
+                dirty = true;
+            }
+        }
+        bool isRaised(int x, int z) const {
+            if(mask.empty()) return false;
+            GLuint cell = x * dimension + z;
+            return (mask[cell >> 5] >> (cell & 31)) & 1u;
+        }
+
+        // Uploads the mask if it was modified since the last upload. This should be called once per frame before rendering.
+        void upload();
+        // Copies the mask if it was modified since the last upload (or copy) and returns whether it was copied.
+        // The copy is uploaded later using "upload(copy)" (e.g. by the render thread while the main thread keeps modifying the mask).
+        bool copyIfDirty(std::vector<GLuint>& copy);
+        void upload(const std::vector<GLuint>& copy);
+
+        // Returns the uniform buffer containing the cell mask (0 if the batch was not built)
+        GLuint getMaskBuffer() const { return maskBuffer; }
+        int getChunkCount() const { return (int)chunkMeshes.size(); }
+
+        // Deletes the meshes and the mask. The chunk entities are owned (and deleted) by the world.
+        void destroy();
+    };
+
+}
@@ -0,0 +1,206 @@
+#include "bounding-volume-hierarchy.hpp"
+
+#include <cassert>
+
+namespace our {
+
+    int BoundingVolumeHierarchy::allocateNode(){
+        // If there are no free nodes, we grow the node pool. Otherwise, we reuse the first free node.
+        if(freeList == NULL_NODE){
+            nodes.emplace_back();
+            return (int)nodes.size() - 1;
+        }
+        int node = freeList;
+        freeList = nodes[node].parent;
+        nodes[node] = Node();
+        return node;
+    }
+
+    void BoundingVolumeHierarchy::freeNode(int node){
+        nodes[node].parent = freeList;
+        nodes[node].userData = nullptr;
+        nodes[node].height = -1;
+        freeList = node;
+    }
+
+    AABB BoundingVolumeHierarchy::fatten(const AABB& box) const {
+        if(box.isEmpty()) return box;
+        glm::vec3 margin = (box.max - box.min) * relativeMargin + absoluteMargin;
+        return AABB(box.min - margin, box.max + margin);
+    }
+
+    int BoundingVolumeHierarchy::createProxy(const AABB& box, void* userData){
+        int proxy = allocateNode();
+        nodes[proxy].box = fatten(box);
+        nodes[proxy].userData = userData;
+        nodes[proxy].height = 0;
+        insertLeaf(proxy);
+        leafCount++;
+        return proxy;
+    }
+
+    void BoundingVolumeHierarchy::destroyProxy(int proxy){
+        assert(proxy >= 0 && proxy < (int)nodes.size() && nodes[proxy].isLeaf());
+        removeLeaf(proxy);
+        freeNode(proxy);
+        leafCount--;
+    }
+
+    bool BoundingVolumeHierarchy::moveProxy(int proxy, const AABB& box){
+        Node& leaf = nodes[proxy];
+        // Most frames, the object is still inside its fat box so the tree doesn't change
+        if(leaf.box.contains(box)) return false;
+
+        AABB fat = fatten(box);
+        // If the parent still contains the new box, the ancestors are still valid so we only update the leaf (a refit without any propagation)
+        if(leaf.parent != NULL_NODE && nodes[leaf.parent].box.contains(fat)){
+            leaf.box = fat;
+            return true;
+        }
+        // Otherwise, the object moved to another part of the scene so we reinsert it where it belongs
+        removeLeaf(proxy);
+        nodes[proxy].box = fat;
+        insertLeaf(proxy);
+        return true;
+    }
+
+    void BoundingVolumeHierarchy::insertLeaf(int leaf){
+        if(root == NULL_NODE){
+            root = leaf;
+            nodes[root].parent = NULL_NODE;
+            return;
+        }
+
+        // Find the best sibling for the new leaf by descending the tree while estimating the surface area cost
+        AABB leafBox = nodes[leaf].box;
+        int index = root;
+        while(!nodes[index].isLeaf()){
+            int left = nodes[index].left, right = nodes[index].right;
+            float area = nodes[index].box.getSurfaceArea();
+            float combinedArea = AABB::merge(nodes[index].box, leafBox).getSurfaceArea();
+
+            // The cost of creating a new parent for this node and the new leaf
+            float cost = 2.0f * combinedArea;
+            // The minimum cost of pushing the leaf further down the tree (all the ancestors will grow by this amount)
+            float inheritanceCost = 2.0f * (combinedArea - area);
+
+            auto descendCost = [&](int child){
+                float childCombinedArea = AABB::merge(nodes[child].box, leafBox).getSurfaceArea();
+                if(nodes[child].isLeaf()) return childCombinedArea + inheritanceCost;
+                return childCombinedArea - nodes[child].box.getSurfaceArea() + inheritanceCost;
+            };
+            float leftCost = descendCost(left), rightCost = descendCost(right);
+
+            if(cost < leftCost && cost < rightCost) break;
+            index = leftCost < rightCost ? left : right;
+        }
+        int sibling = index;
+
+        // Create a new parent which holds the sibling and the new leaf
+        int oldParent = nodes[sibling].parent;
+        int newParent = allocateNode();
+        nodes[newParent].parent = oldParent;
+        nodes[newParent].box = AABB::merge(leafBox, nodes[sibling].box);
+        nodes[newParent].height = nodes[sibling].height + 1;
+        nodes[newParent].left = sibling;
+        nodes[newParent].right = leaf;
+        nodes[sibling].parent = newParent;
+        nodes[leaf].parent = newParent;
+
+        if(oldParent != NULL_NODE){
+            if(nodes[oldParent].left == sibling) nodes[oldParent].left = newParent;
+            else nodes[oldParent].right = newParent;
+        } else {
+            root = newParent;
+        }
+
+        refitAncestors(nodes[leaf].parent);
+    }
+
+    void BoundingVolumeHierarchy::removeLeaf(int leaf){
+        if(leaf == root){
+            root = NULL_NODE;
+            return;
+        }
+
+        // The parent is removed and the sibling takes its place
+        int parent = nodes[leaf].parent;
+        int grandParent = nodes[parent].parent;
+        int sibling = nodes[parent].left == leaf ? nodes[parent].right : nodes[parent].left;
+
+        if(grandParent != NULL_NODE){
+            if(nodes[grandParent].left == parent) nodes[grandParent].left = sibling;
+            else nodes[grandParent].right = sibling;
+            nodes[sibling].parent = grandParent;
+            freeNode(parent);
+            refitAncestors(grandParent);
+        } else {
+            root = sibling;
+            nodes[sibling].parent = NULL_NODE;
+            freeNode(parent);
+        }
+        nodes[leaf].parent = NULL_NODE;
+    }
+
+    void BoundingVolumeHierarchy::refitAncestors(int node){
+        while(node != NULL_NODE){
+            node = balance(node);
+            int left = nodes[node].left, right = nodes[node].right;
+            nodes[node].height = 1 + glm::max(nodes[left].height, nodes[right].height);
+            nodes[node].box = AABB::merge(nodes[left].box, nodes[right].box);
+            node = nodes[node].parent;
+        }
+    }
+
+    int BoundingVolumeHierarchy::balance(int a){
+        // A is the given node, B & C are its children and F & G are the children of the taller child (C or B).
+        // If one child of A is taller than the other by more than one level, its taller grandchild is promoted.
+        if(nodes[a].isLeaf() || nodes[a].height < 2) return a;
+
+        int b = nodes[a].left, c = nodes[a].right;
+        int difference = nodes[c].height - nodes[b].height;
+        if(difference >= -1 && difference <= 1) return a;
+
+        // "up" is the taller child which will take the place of A, and A becomes its left child
+        bool rotateLeft = difference > 1;
+        int up = rotateLeft ? c : b;
+        int f = nodes[up].left, g = nodes[up].right;
+
+        // Swap A and its taller child
+        nodes[up].left = a;
+        nodes[up].parent = nodes[a].parent;
+        nodes[a].parent = up;
+
+        if(nodes[up].parent != NULL_NODE){
+            int upParent = nodes[up].parent;
+            if(nodes[upParent].left == a) nodes[upParent].left = up;
+            else nodes[upParent].right = up;
+        } else {
+            root = up;
+        }
+
+        // The taller grandchild stays with "up" while the shorter one replaces "up" below A
+        int stay = nodes[f].height > nodes[g].height ? f : g;
+        int move = stay == f ? g : f;
+        nodes[up].right = stay;
+        if(rotateLeft) nodes[a].right = move;
+        else nodes[a].left = move;
+        nodes[move].parent = a;
+
+        int aLeft = nodes[a].left, aRight = nodes[a].right;
+        nodes[a].box = AABB::merge(nodes[aLeft].box, nodes[aRight].box);
+        nodes[a].height = 1 + glm::max(nodes[aLeft].height, nodes[aRight].height);
+        nodes[up].box = AABB::merge(nodes[a].box, nodes[stay].box);
+        nodes[up].height = 1 + glm::max(nodes[a].height, nodes[stay].height);
+
+        return up;
+    }
+
+    void BoundingVolumeHierarchy::clear(){
+        nodes.clear();
+        root = NULL_NODE;
+        freeList = NULL_NODE;
+        leafCount = 0;
+    }
+
+}
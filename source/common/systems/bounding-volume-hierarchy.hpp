@@ -0,0 +1,97 @@
+#pragma once
+
+#include "../mesh/bounds.hpp"
+#include "frustum.hpp"
+
+#include <vector>
+
+namespace our {
+
+    // A dynamic bounding volume hierarchy (an AABB tree) over objects that can be added, moved and removed at any time.
+    // Each object is stored in a leaf whose box is "fat": it is slightly larger than the object so that small movements don't touch the tree.
+    // New leaves are inserted next to the sibling that increases the total surface area the least and the tree is kept balanced using rotations.
+    // This follows the design of the dynamic tree in Box2D.
+    class BoundingVolumeHierarchy {
+    public:
+        static constexpr int NULL_NODE = -1;
+
+    private:
+        struct Node {
+            AABB box;
+            void* userData = nullptr;
+            int parent = NULL_NODE; // Also used as the next free node when the node is in the free list
+            int left = NULL_NODE, right = NULL_NODE;
+            int height = 0; // Leaves have a height of 0 and free nodes have a height of -1
+            bool isLeaf() const { return left == NULL_NODE; }
+        };
+
+        std::vector<Node> nodes;
+        int root = NULL_NODE;
+        int freeList = NULL_NODE;
+        int leafCount = 0;
+        // How much the leaf boxes are enlarged (relative to the object size and as an absolute margin)
+        float relativeMargin, absoluteMargin;
+        // A stack reused by the queries to avoid allocating it every frame
+        std::vector<int> stack;
+
+        int allocateNode();
+        void freeNode(int node);
+        void insertLeaf(int leaf);
+        void removeLeaf(int leaf);
+        // Performs a rotation at the given node if it is unbalanced and returns the new root of its subtree
+        int balance(int node);
+        // Recomputes the boxes and heights of the ancestors of the given node
+        void refitAncestors(int node);
+        AABB fatten(const AABB& box) const;
+
+    public:
+        BoundingVolumeHierarchy(float relativeMargin = 0.1f, float absoluteMargin = 0.1f) : relativeMargin(relativeMargin), absoluteMargin(absoluteMargin) {}
+
+        // Adds an object with the given box and returns its proxy id
+        int createProxy(const AABB& box, void* userData);
+        // Removes the object with the given proxy id
+        void destroyProxy(int proxy);
+        // Updates the box of the given proxy. If the new box still fits in the fat box, nothing is done.
+        // Otherwise, the leaf is refitted in place if its parent still encloses it, or reinserted in the tree.
+        // Returns true if the tree was modified.
+        bool moveProxy(int proxy, const AABB& box);
+
+        void* getUserData(int proxy) const { return nodes[proxy].userData; }
+        const AABB& getFatBox(int proxy) const { return nodes[proxy].box; }
+
+        // Calls "callback(userData)" for every object whose fat box intersects the frustum
+        // Subtrees that are completely inside the frustum are reported without testing their children
+        template<typename Callback>
+        void query(const Frustum& frustum, Callback&& callback){
+            if(root == NULL_NODE) return;
+            // A negative entry on the stack means that the subtree is known to be inside the frustum
+            stack.clear();
+            stack.push_back(root);
+            while(!stack.empty()){
+                int entry = stack.back(); stack.pop_back();
+                bool inside = entry < 0;
+                int node = inside ? ~entry : entry;
+                const Node& current = nodes[node];
+                if(!inside){
+                    FrustumTest result = frustum.test(current.box);
+                    if(result == FrustumTest::OUTSIDE) continue;
+                    inside = result == FrustumTest::INSIDE;
+                }
+                if(current.isLeaf()){
+                    callback(current.userData);
+                } else {
+                    stack.push_back(inside ? ~current.left : current.left);
+                    stack.push_back(inside ? ~current.right : current.right);
+                }
+            }
+        }
+
+        // Removes all the objects
+        void clear();
+
+        int getProxyCount() const { return leafCount; }
+        int getNodeCount() const { return leafCount == 0 ? 0 : 2 * leafCount - 1; }
+        int getHeight() const { return root == NULL_NODE ? 0 : nodes[root].height; }
+    };
+
+}
@@ -8,6 +8,7 @@
 #include "components/camera.hpp"
 #include "components/dot.hpp"
 #include "../systems/area-coverage.hpp"
+#include "../utils/heap-counter.hpp"
 
 #include <glm/glm.hpp>
 #include <glm/gtc/constants.hpp>
@@ -36,8 +37,40 @@ namespace our
             this->app = app;
         }
 
+        // Searches the cells around the given entity for the nearest cube whose raised state is "raised"
+        // and whose squared distance (on the xz plane) is less than "hitbox".
+        // If found, it is stored in "nearestCube" and true is returned.
+        // Since the cubes are on a grid, only the cells within the hit-box are checked instead of all the cubes in the world.
+        bool findNearestCube(AreaCoverageSystem *areaCoverageSystem, Entity* entity, bool raised, double hitbox) {
+            const int dimension = areaCoverageSystem->GRID_DIMENSION;
+            glm::vec3& entityPosition = entity->localTransform.position;
+            int centerX = (int)glm::round(entityPosition.x + areaCoverageSystem->GRID_OFFSET);
+            int centerZ = (int)glm::round(entityPosition.z + areaCoverageSystem->GRID_OFFSET);
+            int range = (int)glm::ceil(glm::sqrt(hitbox)) + 1;
+
+            double leastDistance = hitbox;
+            bool cubeCollision = false;
+            for(int x = glm::max(0, centerX - range); x <= glm::min(dimension - 1, centerX + range); x++){
+                for(int z = glm::max(0, centerZ - range); z <= glm::min(dimension - 1, centerZ + range); z++){
+                    Entity* cube = areaCoverageSystem->cubes[x][z];
+                    if(!cube || areaCoverageSystem->isCubeRaised(x, z) != raised) continue;
+
+                    glm::vec3& cubePosition = cube->localTransform.position;
+                    double distance = pow(cubePosition.x - entityPosition.x, 2) + pow(cubePosition.z - entityPosition.z, 2);
+                    if(distance < leastDistance)
+                    {
+                        cubeCollision = true;
+                        leastDistance = distance;
+                        nearestCube[entity] = cube;
+                    }
+                }
+            }
+            return cubeCollision;
+        }
+
         // This should be called every frame to update all entities containing a MovementComponent.
         void update(World* world, AreaCoverageSystem *areaCoverageSystem) {
+            HeapAllocationCheck allocationCheck("CollisionSystem::update");
 
             // get the player (later used for collision calculations)
             KeyboardMovementComponent *move = nullptr;
@@ -102,24 +135,8 @@ namespace our
                         // Ball enemy collision with the walls
                         if(enemy->enemyType == "Ball"){
                             // Collision with the cubes
-                            double leastDistance = BALL_CUBE_HITBOX; // hit-box required for the ball and the cube to collide
-                            double distance;
-                            bool cubeCollision = false;
-                            for(auto cube : world->getEntities()){
-                                if (cube->getComponent<CoveredCubeComponent>())
-                                {
-                                    glm::vec3& cubePosition = cube->localTransform.position;
-                                    if(cubePosition.y < 0) continue;
-
-                                    distance = pow(cubePosition.x - entityPosition.x, 2) + pow(cubePosition.z - entityPosition.z, 2);
-                                    if(distance < leastDistance)
-                                    {
-                                        cubeCollision = true;
-                                        leastDistance = distance;
-                                        nearestCube[entity] = cube;
-                                    }
-                                }
-                            }
+                            // hit-box required for the ball and the cube to collide (only the raised cubes are walls for the ball)
+                            bool cubeCollision = findNearestCube(areaCoverageSystem, entity, true, BALL_CUBE_HITBOX);
                             if(cubeCollision)
                             {
                                 // If the current and previous cube the entity collided with are neighbours don't allow collision
@@ -174,24 +191,8 @@ namespace our
                             }
 
                             // Collision with the cubes (the hidden ones)
-                            double leastDistance = MINE_CUBE_HITBOX; // hit-box required for the ball and the cube to collide
-                            double distance;
-                            bool cubeCollision = false;
-                            for(auto cube : world->getEntities()){
-                                if (cube->getComponent<CoveredCubeComponent>())
-                                {
-                                    glm::vec3& cubePosition = cube->localTransform.position;
-                                    if(cubePosition.y > -1) continue;
-
-                                    distance = pow(cubePosition.x - entityPosition.x, 2) + pow(cubePosition.z - entityPosition.z, 2);
-                                    if(distance < leastDistance)
-                                    {
-                                        cubeCollision = true;
-                                        leastDistance = distance;
-                                        nearestCube[entity] = cube;
-                                    }
-                                }
-                            }
+                            // hit-box required for the mine and the cube to collide (only the hidden cubes are walls for the mine)
+                            bool cubeCollision = findNearestCube(areaCoverageSystem, entity, false, MINE_CUBE_HITBOX);
                             if(cubeCollision)
                             {
                                 // If the current and previous cube the entity collided with are neighbours don't allow collision
@@ -227,7 +228,8 @@ namespace our
                             }
 
                             // Enemy collision logic with the line the player is drawing
-                            std::vector<Entity*> dots = areaCoverageSystem->dots;
+                            // The dots are not copied since "dieReset" only moves them (it doesn't add or remove dots)
+                            const std::vector<Entity*>& dots = areaCoverageSystem->dots;
                             for(auto dot : dots)
                             {
                                 glm::vec3 dotPosition = dot->localTransform.position;
@@ -0,0 +1,96 @@
+#include "early-z.hpp"
+
+#include <iostream>
+
+namespace our {
+
+    const char* toString(DepthMode mode){
+        switch(mode){
+            case DepthMode::FRONT_TO_BACK: return "front to back";
+            case DepthMode::PREPASS: return "depth pre-pass";
+            default: return "none";
+        }
+    }
+
+    void DepthModeSelector::initialize(const std::string& mode){
+        automatic = mode == "auto";
+        DepthMode initial = DepthMode::NONE;
+        if(mode == "frontToBack") initial = DepthMode::FRONT_TO_BACK;
+        else if(mode == "prepass") initial = DepthMode::PREPASS;
+        else if(mode != "none" && !automatic) std::cerr << "WARNING: Unknown early depth mode \"" << mode << "\", using \"none\"" << std::endl;
+        this->mode.store((int)initial, std::memory_order_relaxed);
+
+        glGenQueries(QUERIES, queries);
+        for(int index = 0; index < QUERIES; index++) queryPending[index] = false;
+        for(int index = 0; index < (int)DepthMode::COUNT; index++){
+            totalMilliseconds[index] = 0;
+            measuredFrames[index] = 0;
+        }
+        nextQuery = 0;
+        measuring = false;
+        lastMilliseconds.store(0, std::memory_order_relaxed);
+    }
+
+    void DepthModeSelector::destroy(){
+        if(queries[0]) glDeleteQueries(QUERIES, queries);
+        for(auto& query : queries) query = 0;
+        automatic = false;
+    }
+
+    void DepthModeSelector::collect(){
+        for(int index = 0; index < QUERIES; index++){
+            if(!queryPending[index]) continue;
+            GLint available = GL_FALSE;
+            glGetQueryObjectiv(queries[index], GL_QUERY_RESULT_AVAILABLE, &available);
+            if(!available) continue;
+            GLuint64 nanoseconds = 0;
+            glGetQueryObjectui64v(queries[index], GL_QUERY_RESULT, &nanoseconds);
+            queryPending[index] = false;
+            float milliseconds = (float)(nanoseconds * 1e-6);
+            lastMilliseconds.store(milliseconds, std::memory_order_relaxed);
+            totalMilliseconds[(int)queryModes[index]] += milliseconds;
+            measuredFrames[(int)queryModes[index]]++;
+        }
+        if(!automatic) return;
+
+        // The modes are tried in order, the frames still in flight using the previous mode are counted for that mode
+        int current = mode.load(std::memory_order_relaxed);
+        if(measuredFrames[current] < TRIAL_FRAMES) return;
+        if(current + 1 < (int)DepthMode::COUNT){
+            mode.store(current + 1, std::memory_order_relaxed);
+            return;
+        }
+        // Every mode was tried, so the one with the lowest average time is kept
+        int best = 0;
+        for(int index = 1; index < (int)DepthMode::COUNT; index++){
+            if(totalMilliseconds[index] * measuredFrames[best] < totalMilliseconds[best] * measuredFrames[index]) best = index;
+        }
+        mode.store(best, std::memory_order_relaxed);
+        automatic = false;
+        std::cout << "Early depth mode: " << toString((DepthMode)best) << " (opaque pass:";
+        for(int index = 0; index < (int)DepthMode::COUNT; index++){
+            std::cout << " " << toString((DepthMode)index) << " " << totalMilliseconds[index] / measuredFrames[index] << " ms" << (index + 1 < (int)DepthMode::COUNT ? "," : ")");
+        }
+        std::cout << std::endl;
+    }
+
+    void DepthModeSelector::begin(DepthMode frameMode){
+        measuring = false;
+        if(!queries[0]) return;
+        collect();
+        // If the result of the oldest query is still not available, this frame is not measured (waiting for it would stall)
+        if(queryPending[nextQuery]) return;
+        queryModes[nextQuery] = frameMode;
+        glBeginQuery(GL_TIME_ELAPSED, queries[nextQuery]);
+        measuring = true;
+    }
+
+    void DepthModeSelector::end(){
+        if(!measuring) return;
+        glEndQuery(GL_TIME_ELAPSED);
+        queryPending[nextQuery] = true;
+        nextQuery = (nextQuery + 1) % QUERIES;
+        measuring = false;
+    }
+
+}
@@ -0,0 +1,67 @@
+#pragma once
+
+#include <glad/gl.h>
+#include <atomic>
+#include <string>
+
+namespace our {
+
+    // How the opaque objects are drawn to avoid shading the fragments that end up hidden by nearer objects
+    enum class DepthMode {
+        NONE,           // In the order they come from the hierarchy
+        FRONT_TO_BACK,  // Sorted from near to far, so most hidden fragments fail the early depth test before being shaded
+        PREPASS,        // Their depth is drawn first using an empty fragment shader, then they are shaded using GL_EQUAL without depth writes
+        COUNT
+    };
+
+    const char* toString(DepthMode mode);
+
+    // Picks the depth mode used to draw the opaque objects and measures the GPU time of the opaque pass using timer queries.
+    // If the mode is "auto" (which must be asked for explicitly), each mode is used for TRIAL_FRAMES measured frames (one after the other)
+    // then the fastest one is kept, so the frames drawn during the trials may differ in speed and in the order the objects are drawn.
+    // The results of the queries are only read once they are available (a few frames later), so measuring never stalls the pipeline.
+    class DepthModeSelector {
+    public:
+        // The number of measured frames used to evaluate each mode in the "auto" mode
+        static constexpr int TRIAL_FRAMES = 60;
+        // The number of queries in flight (a frame is not measured if the oldest one is still not available)
+        static constexpr int QUERIES = 4;
+
+    private:
+        // The mode of the next frames. It is read while extracting the frames (on the main thread if the render thread draws them).
+        std::atomic<int> mode{(int)DepthMode::NONE};
+        bool automatic = false;
+
+        GLuint queries[QUERIES] = {};
+        DepthMode queryModes[QUERIES] = {};
+        bool queryPending[QUERIES] = {};
+        int nextQuery = 0;
+        bool measuring = false;
+
+        // The total GPU time & the number of measured frames of each mode
+        double totalMilliseconds[(int)DepthMode::COUNT] = {};
+        int measuredFrames[(int)DepthMode::COUNT] = {};
+        // The GPU time of the last measured frame
+        std::atomic<float> lastMilliseconds{0};
+
+        // Reads the results of the queries that are available and (in the "auto" mode) moves to the next mode once one is evaluated
+        void collect();
+    public:
+        // "mode" is one of "none", "frontToBack", "prepass" and "auto"
+        void initialize(const std::string& mode);
+        void destroy();
+
+        // The mode to use for the next extracted frame
+        DepthMode getMode() const { return (DepthMode)mode.load(std::memory_order_relaxed); }
+        // Whether the given mode can be used by a frame (in the "auto" mode, every mode is tried)
+        bool mayUse(DepthMode frameMode) const { return automatic || getMode() == frameMode; }
+
+        // Measures the opaque pass of a frame drawn using the given mode (between "begin" & "end")
+        void begin(DepthMode frameMode);
+        void end();
+
+        // The GPU time of the opaque pass in the last measured frame
+        float getOpaqueMilliseconds() const { return lastMilliseconds.load(std::memory_order_relaxed); }
+    };
+
+}
@@ -1,54 +1,104 @@
 #include <iostream>
+#include <tuple>
 #include "forward-renderer.hpp"
-#include "../mesh/mesh-utils.hpp"
-#include "../texture/texture-utils.hpp"
+#include "arena-batch.hpp"
+#include "../shader/program-cache.hpp"
+#include "../utils/frame-allocator.hpp"
+#include "../utils/heap-counter.hpp"
+#include "../utils/job-system.hpp"
+#include "../utils/radix-sort.hpp"
 
 namespace our {
 
+    // The number of entities processed by each job while extracting the renderables & the lights
+    static const size_t ENTITY_CHUNK_SIZE = 256;
+    // The number of visible candidates turned into commands by each job
+    static const size_t COMMAND_CHUNK_SIZE = 128;
+
+    // What a chunk of entities contributes to the frame (they are allocated from the frame allocator by the job processing the chunk)
+    struct EntityChunk {
+        CameraComponent* camera = nullptr;
+        FrameVector<LightInstance> lights;
+        FrameVector<std::pair<MeshRendererComponent*, glm::mat4>> renderers;
+    };
+
+    // The commands built from a chunk of the visible candidates & where they go in the merged command lists
+    struct CommandChunk {
+        FrameVector<RenderCommand> opaque, transparent;
+        FrameVector<uint32_t> opaqueKeys, transparentKeys; // The sort key of each command (the opaque ones are only sorted front to back)
+        int visible = 0;
+        size_t opaqueOffset = 0, transparentOffset = 0;
+    };
+
     void ForwardRenderer::initialize(glm::ivec2 windowSize, const nlohmann::json& config){
         // First, we store the window size for later use
         this->windowSize = windowSize;
+        program_cache::Statistics shaderStatistics = program_cache::getStatistics();
+
+        // Create the buffers used to send the lights to the lighting shader
+        lightClusters.initialize();
+
+        // A draw must not read a uniform block without a buffer, so the scenes without a static batch get an empty cell mask
+        std::vector<GLubyte> noCells(MAX_MASK_CELLS / 8, 0);
+        glGenBuffers(1, &emptyCellMaskBuffer);
+        glBindBuffer(GL_UNIFORM_BUFFER, emptyCellMaskBuffer);
+        glBufferData(GL_UNIFORM_BUFFER, noCells.size(), noCells.data(), GL_STATIC_DRAW);
+        glBindBuffer(GL_UNIFORM_BUFFER, 0);
+
+        // The indirect path is used by default if the driver supports it, but it can be disabled from the configuration
+        useIndirectDraw = config.value("indirectDraw", true) && IndirectRenderer::isSupported();
+        if(useIndirectDraw) indirectRenderer.initialize();
+        std::cout << "Indirect drawing: " << (useIndirectDraw ? "enabled" : "disabled") << std::endl;
+
+        // The opaque objects are drawn in any order, from front to back or after a depth pre-pass ("none", "frontToBack" or "prepass").
+        // The default is sorting from front to back since it needs no extra pass. With "auto", each mode is measured for a few frames
+        // then the fastest one is used.
+        depthModes.initialize(config.value("earlyDepth", "frontToBack"));
+        // The depth only variants are compiled now instead of in the first frame that draws a pre-pass, so that frame doesn't stall.
+        // Only the materials loaded before the renderer get a variant (the others are not drawn in the pre-pass).
+        if(depthModes.mayUse(DepthMode::PREPASS)){
+            for(auto& [name, material] : AssetLoader<Material>::getAll()) createDepthVariants(material);
+        }
+
+        // The sky & the post-processing draw a fullscreen triangle whose vertices are generated in the vertex shader,
+        // but OpenGL still needs a vertex array to be bound to draw
+        glGenVertexArrays(1, &fullscreenVertexArray);
 
         // Then we check if there is a sky texture in the configuration
         if(config.contains("sky")){
-            // First, we create a sphere which will be used to draw the sky
-            this->skySphere = mesh_utils::sphere(glm::ivec2(16, 16));
-            
-            // We can draw the sky using the same shader used to draw textured objects
+            // The sky is a single fullscreen triangle that computes the direction of each pixel from the inverse view projection matrix
+            // and samples the sky texture (an equirectangular map) in that direction, so no sky geometry is processed
             ShaderProgram* skyShader = new ShaderProgram();
-            skyShader->attach("assets/shaders/textured.vert", GL_VERTEX_SHADER);
-            skyShader->attach("assets/shaders/textured.frag", GL_FRAGMENT_SHADER);
-            skyShader->link();
+            skyShader->attach("assets/shaders/sky.vert", GL_VERTEX_SHADER);
+            skyShader->attach("assets/shaders/sky.frag", GL_FRAGMENT_SHADER);
+            if(!skyShader->link()) std::cerr << "ERROR: Couldn't create the sky shader" << std::endl;
             
             //TODO: (Req 10) Pick the correct pipeline state to draw the sky
             // Hints: the sky will be draw after the opaque objects so we would need depth testing but which depth function should we pick?
-            // We will draw the sphere from the inside, so what options should we pick for the face culling.
             PipelineState skyPipelineState{};
 
-            // We choose GL_Front as the culled face and render the back face in order to see the inside of the sphere
-            skyPipelineState.faceCulling.enabled = true;
-            skyPipelineState.faceCulling.culledFace = GL_FRONT;
-
-            // We choose GL_LEQUAL as the depth testing function since we want to render the sky if the depth buffer
-            // hasn't been updated with a value less than 1 (which is the sky depth)
+            // The triangle is at the far plane (depth 1) and we choose GL_LEQUAL as the depth testing function since we want to
+            // render the sky only where the depth buffer hasn't been updated with a value less than 1 (by the opaque objects)
+            // The depth of the sky is not needed by anything drawn after it, so it isn't written
             skyPipelineState.depthTesting.enabled = true;
             skyPipelineState.depthTesting.function = GL_LEQUAL;
+            skyPipelineState.depthMask = false;
 
             // Load the sky texture (note that we don't need mipmaps since we want to avoid any unnecessary blurring while rendering the sky)
             std::string skyTextureFile = config.value<std::string>("sky", "");
-            Texture2D* skyTexture = texture_utils::loadImage(skyTextureFile, false);
+            skyTexture = acquireTexture(skyTextureFile, false);
 
-            // Setup a sampler for the sky 
+            // Setup a sampler for the sky (the longitude wraps around while the latitude stops at the poles)
             Sampler* skySampler = new Sampler();
             skySampler->set(GL_TEXTURE_MIN_FILTER, GL_LINEAR);
             skySampler->set(GL_TEXTURE_MAG_FILTER, GL_LINEAR);
             skySampler->set(GL_TEXTURE_WRAP_S, GL_REPEAT);
             skySampler->set(GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
 
-            // Combine all the aforementioned objects (except the mesh) into a material 
+            // Combine all the aforementioned objects into a material 
             this->skyMaterial = new TexturedMaterial();
             this->skyMaterial->shader = skyShader;
-            this->skyMaterial->texture = skyTexture;
+            this->skyMaterial->texture = skyTexture.get();
             this->skyMaterial->sampler = skySampler;
             this->skyMaterial->pipelineState = skyPipelineState;
             this->skyMaterial->tint = glm::vec4(1.0f, 1.0f, 1.0f, 1.0f);
@@ -56,105 +106,111 @@ namespace our {
             this->skyMaterial->transparent = false;
         }
 
-        // Then we check if there is a postprocessing shader in the configuration
-        if(config.contains("postprocess")){
-            //TODO: (Req 11) Create a framebuffer
-            glGenFramebuffers(1, &postprocessFrameBuffer);
-            glBindFramebuffer(GL_DRAW_FRAMEBUFFER, postprocessFrameBuffer);
-
-            //TODO: (Req 11) Create a color and a depth texture and attach them to the framebuffer
-            // Hints: The color format can be (Red, Green, Blue and Alpha components with 8 bits for each channel).
-            // The depth format can be (Depth component with 24 bits).
-            colorTarget = texture_utils::empty(GL_RGBA8, windowSize);
-            depthTarget = texture_utils::empty(GL_DEPTH_COMPONENT24, windowSize);
-            glFramebufferTexture2D(GL_DRAW_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, colorTarget->getOpenGLName(), 0);
-            glFramebufferTexture2D(GL_DRAW_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, depthTarget->getOpenGLName(), 0);
-
-            //TODO: (Req 11) Unbind the framebuffer just to be safe
-            glBindFramebuffer(GL_DRAW_FRAMEBUFFER, 0);
-
-            // Create a vertex array to use for drawing the texture
-            glGenVertexArrays(1, &postProcessVertexArray);
-
-            // Create a sampler to use for sampling the scene texture in the post-processing shader
-            Sampler* postprocessSampler = new Sampler();
-            postprocessSampler->set(GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-            postprocessSampler->set(GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-            postprocessSampler->set(GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-            postprocessSampler->set(GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-
-            // Create the post-processing shader
-            ShaderProgram* postprocessShader = new ShaderProgram();
-            postprocessShader->attach("assets/shaders/fullscreen.vert", GL_VERTEX_SHADER);
-            postprocessShader->attach(config.value<std::string>("postprocess", ""), GL_FRAGMENT_SHADER);
-            postprocessShader->link();
-
-            // Create a post-processing material
-            postprocessMaterial = new TexturedMaterial();
-            postprocessMaterial->shader = postprocessShader;
-            postprocessMaterial->texture = colorTarget;
-            postprocessMaterial->sampler = postprocessSampler;
-            // The default options are fine, but we don't need to interact with the depth buffer
-            // so it is more performant to disable the depth mask
-            postprocessMaterial->pipelineState.depthMask = false;
-        }
+        // Then we create the post-processing effects in the configuration (if any)
+        postprocess.initialize(windowSize, config);
+        program_cache::logStatistics("Renderer shaders", shaderStatistics);
     }
 
     void ForwardRenderer::destroy(){
+        lightClusters.destroy();
+        if(emptyCellMaskBuffer) glDeleteBuffers(1, &emptyCellMaskBuffer);
+        emptyCellMaskBuffer = 0;
+        if(useIndirectDraw) indirectRenderer.destroy();
+        depthModes.destroy();
+        for(auto& [shader, variant] : depthVariants) delete variant;
+        depthVariants.clear();
+        bvh.clear();
+        renderProxies.clear();
+        if(fullscreenVertexArray) glDeleteVertexArrays(1, &fullscreenVertexArray);
+        fullscreenVertexArray = 0;
         // Delete all objects related to the sky
         if(skyMaterial){
-            delete skySphere;
             delete skyMaterial->shader;
-            delete skyMaterial->texture;
+            // The texture is owned by the asset loader, we only release our reference to it
+            skyTexture.reset();
             delete skyMaterial->sampler;
             delete skyMaterial;
+            skyMaterial = nullptr;
         }
         // Delete all objects related to post-processing
-        if(postprocessMaterial){
-            glDeleteFramebuffers(1, &postprocessFrameBuffer);
-            glDeleteVertexArrays(1, &postProcessVertexArray);
-            delete colorTarget;
-            delete depthTarget;
-            delete postprocessMaterial->sampler;
-            delete postprocessMaterial->shader;
-            delete postprocessMaterial;
+        postprocess.destroy();
+    }
+
+    void ForwardRenderer::updateProxy(MeshRendererComponent* meshRenderer, const glm::mat4& localToWorld){
+        auto [it, inserted] = renderProxies.try_emplace(meshRenderer);
+        RenderProxy& proxy = it->second;
+        proxy.lastSeenFrame = frameIndex;
+        // If neither the transform nor the mesh changed, the world bounds in the tree are still valid
+        if(!inserted && proxy.mesh == meshRenderer->mesh && proxy.localToWorld == localToWorld) return;
+
+        proxy.renderer = meshRenderer;
+        proxy.mesh = meshRenderer->mesh;
+        proxy.localToWorld = localToWorld;
+        proxy.worldBounds = meshRenderer->mesh->getBounds().transformed(localToWorld);
+        if(inserted){
+            proxy.id = bvh.createProxy(proxy.worldBounds, &proxy);
+        } else if(bvh.moveProxy(proxy.id, proxy.worldBounds)){
+            stats.movedProxies++;
         }
     }
 
-    void ForwardRenderer::render(World* world){
+    void ForwardRenderer::extract(World* world, FramePacket& packet){
+        // The commands are stored in the persistent vectors of the packet and the temporary data is allocated from the frame allocator,
+        // so nothing should be allocated from the heap once the first frames are drawn
+        HeapAllocationCheck allocationCheck("ForwardRenderer::extract");
         // First of all, we search for a camera and for all the mesh renderers
         CameraComponent* camera = nullptr;
-        opaqueCommands.clear();
-        transparentCommands.clear();
-        Lights.clear();
-
-        for(auto entity : world->getEntities()){
-            // If we hadn't found a camera yet, we look for a camera in this entity
-            if(!camera) camera = entity->getComponent<CameraComponent>();
-            // If this entity has a mesh renderer component
-            if(auto meshRenderer = entity->getComponent<MeshRendererComponent>(); meshRenderer){
-                // We construct a command from it
-                RenderCommand command;
-                command.localToWorld = meshRenderer->getOwner()->getLocalToWorldMatrix();
-                command.center = glm::vec3(command.localToWorld * glm::vec4(0, 0, 0, 1));
-                command.mesh = meshRenderer->mesh;
-                command.material = meshRenderer->material;
-                // if it is transparent, we add it to the transparent commands list
-                if(command.material->transparent){
-                    transparentCommands.push_back(command);
-                } else {
-                // Otherwise, we add it to the opaque command list
-                    opaqueCommands.push_back(command);
+        packet.hasCamera = false;
+        packet.depthMode = depthModes.getMode();
+        packet.opaqueCommands.clear();
+        packet.transparentCommands.clear();
+        packet.lights.clear();
+        stats = RenderStats();
+        frameIndex++;
+
+        // The entities are split into chunks that are processed in parallel. Each chunk looks for the camera, the lights and
+        // the mesh renderers of its entities and computes their world matrices (which walks up their parents) into its own buffers.
+        JobSystem& jobs = JobSystem::get();
+        FrameVector<Entity*> entities(world->getEntities().begin(), world->getEntities().end());
+        FrameVector<EntityChunk> entityChunks((entities.size() + ENTITY_CHUNK_SIZE - 1) / ENTITY_CHUNK_SIZE);
+        jobs.parallelFor(0, entities.size(), ENTITY_CHUNK_SIZE, [&](size_t first, size_t last){
+            EntityChunk& chunk = entityChunks[first / ENTITY_CHUNK_SIZE];
+            chunk.renderers.reserve(last - first);
+            for(size_t index = first; index < last; index++){
+                Entity* entity = entities[index];
+                // If we hadn't found a camera yet, we look for a camera in this entity
+                if(!chunk.camera) chunk.camera = entity->getComponent<CameraComponent>();
+                if(auto meshRenderer = entity->getComponent<MeshRendererComponent>(); meshRenderer && meshRenderer->mesh){
+                    chunk.renderers.push_back({meshRenderer, entity->getLocalToWorldMatrix()});
+                }
+                // If this entity has a light component, we copy it with its position & direction in the world
+                if(auto lightComp = entity->getComponent<LightingComponent>(); lightComp){
+                    chunk.lights.emplace_back(lightComp);
                 }
             }
-            // If this entity has a light component
-            if (auto lightComp = entity->getComponent<LightingComponent>(); lightComp)
-            {
-                Lights.push_back(lightComp);
+        }, "extract entities");
+        // The chunks are merged in order (so the result is the same as a serial loop) and the hierarchy is only modified here
+        for(auto& chunk : entityChunks){
+            if(!camera) camera = chunk.camera;
+            packet.lights.insert(packet.lights.end(), chunk.lights.begin(), chunk.lights.end());
+            // We make sure that the bounds of the mesh renderers in the hierarchy are up to date
+            for(auto& [meshRenderer, localToWorld] : chunk.renderers) updateProxy(meshRenderer, localToWorld);
+        }
+
+        // Remove the proxies of the mesh renderers that no longer exist (they were not seen this frame)
+        for(auto it = renderProxies.begin(); it != renderProxies.end();){
+            if(it->second.lastSeenFrame != frameIndex){
+                bvh.destroyProxy(it->second.id);
+                it = renderProxies.erase(it);
+            } else {
+                it++;
             }
         }
+        stats.renderables = (int)renderProxies.size();
+        stats.hierarchyNodes = bvh.getNodeCount();
+        stats.hierarchyHeight = bvh.getHeight();
 
-        // If there is no camera, we return (we cannot render without a camera)
+        // If there is no camera, the packet is left empty (we cannot render without a camera)
         if(camera == nullptr) return;
 
         //TODO: (Req 9) Modify the following line such that "cameraForward" contains a vector pointing the camera forward direction
@@ -169,20 +225,114 @@ namespace our {
         glm::vec3 cameraForward = center - eye;
         cameraForward = glm::normalize(cameraForward);
 
-        std::sort(transparentCommands.begin(), transparentCommands.end(), [cameraForward](const RenderCommand& first, const RenderCommand& second){
-            //TODO: (Req 9) Finish this function
-            // HINT: the following return should return true if "first" should be drawn before "second".
-
-            // Project the centers of the objects onto the cameraForward axis
-            float distanceFirst = glm::dot(first.center, cameraForward);
-            float distanceSecond = glm::dot(second.center, cameraForward);
-            // Objects farther along the cameraForward axis should be drawn first
-            return distanceFirst > distanceSecond;
-        });
-
         //TODO: (Req 9) Get the camera ViewProjection matrix and store it in VP
         glm::mat4 VP =  camera->getProjectionMatrix(windowSize) * camera->getViewMatrix();
 
+        packet.hasCamera = true;
+        packet.view = camera->getViewMatrix();
+        packet.projection = camera->getProjectionMatrix(windowSize);
+        packet.VP = VP;
+        packet.eye = eye;
+        packet.cameraForward = cameraForward;
+
+        // Only the mesh renderers whose bounds intersect the camera frustum are turned into commands
+        // The hierarchy reports the objects whose (slightly larger) fat box is visible, so we test their exact world bounds too
+        Frustum frustum(VP);
+        FrameVector<RenderProxy*> candidates;
+        candidates.reserve(renderProxies.size());
+        bvh.query(frustum, [&](void* userData){ candidates.push_back(static_cast<RenderProxy*>(userData)); });
+
+        // The candidates are split into chunks that build their commands in parallel into their own buffers
+        bool sortOpaque = packet.depthMode == DepthMode::FRONT_TO_BACK;
+        FrameVector<CommandChunk> commandChunks((candidates.size() + COMMAND_CHUNK_SIZE - 1) / COMMAND_CHUNK_SIZE);
+        jobs.parallelFor(0, candidates.size(), COMMAND_CHUNK_SIZE, [&](size_t first, size_t last){
+            CommandChunk& chunk = commandChunks[first / COMMAND_CHUNK_SIZE];
+            chunk.opaque.reserve(last - first);
+            for(size_t index = first; index < last; index++){
+                RenderProxy* proxy = candidates[index];
+                if(!frustum.intersects(proxy->worldBounds)) continue;
+                chunk.visible++;
+                // We construct a command from it (a mesh with sub-meshes gives a command per sub-mesh since each can have its own material)
+                int submeshCount = proxy->mesh->getSubMeshCount();
+                for(int submesh = 0; submesh < submeshCount; submesh++){
+                    RenderCommand command;
+                    command.localToWorld = proxy->localToWorld;
+                    command.center = glm::vec3(command.localToWorld * glm::vec4(0, 0, 0, 1));
+                    command.mesh = proxy->mesh;
+                    command.material = proxy->renderer->getMaterial(submesh);
+                    command.submesh = submeshCount > 1 ? submesh : -1;
+                    // if it is transparent, we add it to the transparent commands list
+                    if(command.material->transparent){
+                        // The transparent objects farther along the cameraForward axis should be drawn first,
+                        // so the distance of the center on this axis is flipped into a key that is sorted in ascending order
+                        chunk.transparentKeys.push_back(~floatToRadixKey(glm::dot(command.center, cameraForward)));
+                        chunk.transparent.push_back(command);
+                    } else {
+                    // Otherwise, we add it to the opaque command list
+                        // (if they are sorted from near to far, the key is the distance of the center along the cameraForward axis)
+                        if(sortOpaque) chunk.opaqueKeys.push_back(floatToRadixKey(glm::dot(command.center, cameraForward)));
+                        chunk.opaque.push_back(command);
+                    }
+                }
+            }
+        }, "build render commands");
+
+        // The chunks are merged in order: each chunk copies its commands after the commands of the previous chunks
+        size_t opaqueCount = 0, transparentCount = 0;
+        for(auto& chunk : commandChunks){
+            chunk.opaqueOffset = opaqueCount;
+            chunk.transparentOffset = transparentCount;
+            opaqueCount += chunk.opaque.size();
+            transparentCount += chunk.transparent.size();
+            stats.visible += chunk.visible;
+        }
+        stats.culled = stats.renderables - stats.visible;
+        packet.opaqueCommands.resize(opaqueCount);
+        FrameVector<RenderCommand> unsortedOpaque(sortOpaque ? opaqueCount : 0), unsortedTransparent(transparentCount);
+        FrameVector<RadixSortItem> opaqueItems(sortOpaque ? opaqueCount : 0), sortItems(transparentCount);
+        FrameVector<RadixSortItem> sortScratch(std::max(opaqueItems.size(), sortItems.size()));
+        jobs.parallelFor(0, commandChunks.size(), 1, [&](size_t first, size_t last){
+            for(size_t index = first; index < last; index++){
+                CommandChunk& chunk = commandChunks[index];
+                std::copy(chunk.opaque.begin(), chunk.opaque.end(), (sortOpaque ? unsortedOpaque.data() : packet.opaqueCommands.data()) + chunk.opaqueOffset);
+                std::copy(chunk.transparent.begin(), chunk.transparent.end(), unsortedTransparent.begin() + chunk.transparentOffset);
+                for(size_t command = 0; command < chunk.opaqueKeys.size(); command++){
+                    uint32_t position = (uint32_t)(chunk.opaqueOffset + command);
+                    opaqueItems[position] = {chunk.opaqueKeys[command], position};
+                }
+                for(size_t command = 0; command < chunk.transparent.size(); command++){
+                    uint32_t position = (uint32_t)(chunk.transparentOffset + command);
+                    sortItems[position] = {chunk.transparentKeys[command], position};
+                }
+            }
+        }, "merge render commands");
+
+        // The commands are sorted by their precomputed keys then moved to their sorted order
+        if(sortOpaque){
+            radixSort(opaqueItems.data(), sortScratch.data(), opaqueCount);
+            for(size_t index = 0; index < opaqueCount; index++) packet.opaqueCommands[index] = unsortedOpaque[opaqueItems[index].index];
+        }
+        radixSort(sortItems.data(), sortScratch.data(), transparentCount);
+        packet.transparentCommands.resize(transparentCount);
+        for(size_t index = 0; index < transparentCount; index++) packet.transparentCommands[index] = unsortedTransparent[sortItems[index].index];
+    }
+
+    void ForwardRenderer::submit(const FramePacket& packet){
+        // The temporary data of the indirect path is allocated from the frame allocator of the drawing thread
+        HeapAllocationCheck allocationCheck("ForwardRenderer::submit");
+        frameDrawCalls = 0;
+        frameIndirectDraws = 0;
+        frameUniformsShader = nullptr;
+        // If there is no camera, we return (we cannot render without a camera)
+        if(!packet.hasCamera){
+            drawCalls.store(0, std::memory_order_relaxed);
+            indirectDraws.store(0, std::memory_order_relaxed);
+            return;
+        }
+        const glm::mat4& VP = packet.VP;
+        const glm::vec3& eye = packet.eye;
+        const glm::vec3& cameraForward = packet.cameraForward;
+
         //TODO: (Req 9) Set the OpenGL viewport using viewportStart and viewportSize
         glViewport(0, 0, windowSize.x, windowSize.y);
         
@@ -194,156 +344,255 @@ namespace our {
         glColorMask(true, true, true, true);
         glDepthMask(true);
 
-        // If there is a postprocess material, bind the framebuffer
-        if(postprocessMaterial){
+        // If there are post-processing effects, the scene is drawn to their input target
+        if(postprocess.isActive()){
             //TODO: (Req 11) bind the framebuffer
-            glBindFramebuffer(GL_DRAW_FRAMEBUFFER, postprocessFrameBuffer);
+            postprocess.begin();
         }
 
         //TODO: (Req 9) Clear the color and depth buffers
         glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
         
-        //TODO: (Req 9) Draw all the opaque commands
-        // Don't forget to set the "transform" uniform to be equal the model-view-projection matrix for each render command
-        for(auto& command : opaqueCommands){
-            command.material->setup();
-
-            if (auto light_material = dynamic_cast<LightingMaterial *>(command.material); light_material && command.center.y >= 0)
-            {
-                light_material->shader->set("VP", VP);
+        // Assign the lights to the clusters of the camera frustum and bind the result for the lighting shader
+        lightClusters.update(packet.lights, packet.view, packet.projection, windowSize);
+        lightClusters.bind();
+        glBindBufferBase(GL_UNIFORM_BUFFER, CELL_MASK_BINDING, cellMaskBuffer ? cellMaskBuffer : emptyCellMaskBuffer);
+
+        // The opaque commands that can be drawn indirectly are queued & drawn first, then the remaining ones are drawn one by one
+        // With a depth pre-pass, all of them are drawn twice: first their depth only, then their shading where their depth is equal
+        // The GPU time of the opaque pass is measured to find which depth mode is the fastest
+        depthModes.begin(packet.depthMode);
+        if(useIndirectDraw) queueIndirect(packet.opaqueCommands);
+        auto drawOpaque = [&](OpaquePass pass){
+            if(useIndirectDraw){
+                drawIndirect(VP, eye, cameraForward, pass);
+                for(auto command : directCommands) executeCommand(*command, VP, eye, cameraForward, pass);
+            } else {
+                //TODO: (Req 9) Draw all the opaque commands
+                // Don't forget to set the "transform" uniform to be equal the model-view-projection matrix for each render command
+                for(auto& command : packet.opaqueCommands){
+                    executeCommand(command, VP, eye, cameraForward, pass);
+                }
+            }
+        };
+        if(packet.depthMode == DepthMode::PREPASS){
+            drawOpaque(OpaquePass::DEPTH);
+            drawOpaque(OpaquePass::SHADING_AFTER_DEPTH);
+        } else {
+            drawOpaque(OpaquePass::SHADING);
+        }
+        if(!indirectGroups.empty()) indirectRenderer.endFrame();
+        depthModes.end();
+        
+        // If there is a sky material, draw the sky (after the opaque objects so only the uncovered pixels are shaded)
+        if(this->skyMaterial){
+            //TODO: (Req 10) setup the sky material
+            skyMaterial->setup();
+            // The sky is infinitely far, so the direction of a pixel is the same from any point on its ray
+            skyMaterial->shader->set("inverse_VP", glm::inverse(VP));
+            glBindVertexArray(fullscreenVertexArray);
+            glDrawArrays(GL_TRIANGLES, 0, 3);
+        }
 
-                light_material->shader->set("camera_position", eye);
+        //TODO: (Req 9) Draw all the transparent commands
+        // Don't forget to set the "transform" uniform to be equal the model-view-projection matrix for each render command
+        for(auto& command : packet.transparentCommands){
+            executeCommand(command, VP, eye, cameraForward);
+        }
 
-                light_material->shader->set("M", command.localToWorld);
+        // If there are post-processing effects, apply them & draw the result to the framebuffer that was bound when the frame started
+        if(postprocess.isActive()){
+            postprocess.apply(fullscreenVertexArray);
+        }
+        // The draws above don't unbind their vertex arrays, so the last one is unbound once the frame is drawn
+        glBindVertexArray(0);
 
-                light_material->shader->set("M_IT", glm::transpose(glm::inverse(command.localToWorld)));
+        drawCalls.store(frameDrawCalls, std::memory_order_relaxed);
+        indirectDraws.store(frameIndirectDraws, std::memory_order_relaxed);
+    }
 
-                light_material->shader->set("light_count", (int)Lights.size());
+    void ForwardRenderer::setFrameUniforms(Material* material, ShaderProgram* shader, const glm::mat4& VP, const glm::vec3& cameraPosition, const glm::vec3& cameraForward){
+        if(shader != frameUniformsShader && dynamic_cast<LightingMaterial *>(material)){
+            frameUniformsShader = shader;
+            // The light data is shared by all the lit objects and is read from the cluster buffers
+            shader->set("VP", VP);
+            shader->set("camera_position", cameraPosition);
+            shader->set("camera_forward", cameraForward);
 
-                light_material->shader->set("sky.top", glm::vec3(0.5, 0.5, 0.5));
-                light_material->shader->set("sky.horizon", glm::vec3(0.5, 0.5, 0.5));
-                light_material->shader->set("sky.bottom", glm::vec3(0.5, 0.5, 0.5));
+            shader->set("sky.top", glm::vec3(0.5, 0.5, 0.5));
+            shader->set("sky.horizon", glm::vec3(0.5, 0.5, 0.5));
+            shader->set("sky.bottom", glm::vec3(0.5, 0.5, 0.5));
 
-                for(int i = 0; i<Lights.size(); i++) {
+            lightClusters.setUniforms(shader);
+        }
+    }
 
-                    glm::vec3 light_position = Lights[i]->getOwner()->getLocalToWorldMatrix() * glm::vec4(0, 0, 0, 1);
-                    glm::vec3 light_direction = Lights[i]->getOwner()->getLocalToWorldMatrix() * glm::vec4(Lights[i]->direction, 0);
+    // Only the materials that write their depth using a less (or equal) depth test are drawn in the depth pre-pass
+    // (none of the fragment shaders discard fragments, so the depth only depends on the vertex shader)
+    static bool isDrawnInDepthPrepass(const Material* material){
+        const PipelineState& state = material->pipelineState;
+        if(!state.depthTesting.enabled || !state.depthMask || state.blending.enabled) return false;
+        return state.depthTesting.function == GL_LESS || state.depthTesting.function == GL_LEQUAL;
+    }
 
-                    light_material->shader->set("lights["+std::to_string(i)+"].type", (int)Lights[i]->kind);
-                    light_material->shader->set("lights["+std::to_string(i)+"].diffuse", Lights[i]->diffuse);
-                    light_material->shader->set("lights["+std::to_string(i)+"].specular", Lights[i]->specular);
-                    switch (Lights[i]->kind)
-                    {
-                        case 0:
-                            light_material->shader->set("lights["+std::to_string(i)+"].direction", light_direction);
-                            break;
-                        case 1:
-                            light_material->shader->set("lights["+std::to_string(i)+"].position", light_position);
-                            light_material->shader->set("lights["+std::to_string(i)+"].attenuation", Lights[i]->attenuation);
-                            break;
-                        case 2:
-                            light_material->shader->set("lights["+std::to_string(i)+"].position", Lights[i]->position);
-                            light_material->shader->set("lights["+std::to_string(i)+"].direction", light_direction);
-                            light_material->shader->set("lights["+std::to_string(i)+"].cone_angles", Lights[i]->cone_angles);
-                            light_material->shader->set("lights["+std::to_string(i)+"].attenuation", Lights[i]->attenuation);
-                            break;
+    void ForwardRenderer::createDepthVariants(const Material* material){
+        if(!material->shader || !isDrawnInDepthPrepass(material)) return;
+        std::vector<ShaderProgram*> shaders = {material->shader};
+        // The indirect draws of the material use the indirect variant of its shader
+        if(useIndirectDraw){
+            if(ShaderProgram* indirectVariant = indirectRenderer.getVariant(material->shader)) shaders.push_back(indirectVariant);
+        }
+        for(ShaderProgram* shader : shaders){
+            if(depthVariants.count(shader)) continue;
+            // The variant uses the same vertex shader (and defines) as the shader, so the depth is the same in both passes
+            ShaderProgram* variant = shader->createVariant({}, {{"assets/shaders/depth-only.frag", GL_FRAGMENT_SHADER}});
+            if(!variant) std::cerr << "WARNING: A shader has no depth only variant, its objects will not be drawn in the depth pre-pass" << std::endl;
+            depthVariants[shader] = variant;
+        }
+    }
 
-                    }
-                }
+    ShaderProgram* ForwardRenderer::getDepthVariant(const Material* material, ShaderProgram* shader){
+        if(!isDrawnInDepthPrepass(material)) return nullptr;
+        auto it = depthVariants.find(shader);
+        return it != depthVariants.end() ? it->second : nullptr;
+    }
 
-            } else {
-                command.material->shader->set("transform", VP * command.localToWorld); // sent transform matrix to shader
+    void ForwardRenderer::queueIndirect(const std::vector<RenderCommand>& opaqueCommands){
+        // Split the commands into the ones that can be drawn indirectly & the others (the packet is not modified since it is only read while drawing)
+        indirectCommands.clear();
+        directCommands.clear();
+        indirectGroups.clear();
+        for(auto& command : opaqueCommands){
+            bool indirect = indirectRenderer.canDraw(command.mesh) && indirectRenderer.getVariant(command.material->shader);
+            if(indirect) indirectCommands.push_back({0, &command});
+            else directCommands.push_back(&command);
+        }
+        if(indirectCommands.empty()) return;
+
+        // The materials that only differ by their per-draw data (the tint & the texture layers of the packed textures) share a draw,
+        // so each material is assigned to the first material it can share a draw with (its leader) then the draws of a leader
+        // that share a vertex format & an index type are issued by a single call
+        // Both are only used during this frame so they are allocated from the frame allocator
+        FrameUnorderedMap<Material*, uint64_t> batchLeaders; // material -> index of its leader
+        batchLeaders.reserve(indirectCommands.size());
+        FrameVector<Material*> leaders;
+        for(size_t index = 0; index < indirectCommands.size(); index++){
+            auto& [key, command] = indirectCommands[index];
+            auto it = batchLeaders.find(command->material);
+            if(it == batchLeaders.end()){
+                auto leader = std::find_if(leaders.begin(), leaders.end(), [&](Material* leader){ return leader->canShareDraw(command->material); });
+                if(leader == leaders.end()) leader = leaders.insert(leaders.end(), command->material);
+                it = batchLeaders.emplace(command->material, (uint64_t)(leader - leaders.begin())).first;
             }
-            command.mesh->draw(); // draw
-
+            // The index in the packet keeps the order of the packet (e.g. from front to back) between the commands of a batch
+            const MeshAllocation& allocation = command->mesh->getAllocation();
+            key = it->second << 40 | (uint64_t)allocation.format << 33 | (uint64_t)(allocation.indexType == GL_UNSIGNED_SHORT) << 32 | index;
         }
-        
-        // If there is a sky material, draw the sky
-        if(this->skyMaterial){
-            //TODO: (Req 10) setup the sky material
-            skyMaterial->setup();
-            //TODO: (Req 10) Get the camera position
-            glm::vec3 cameraPosition = M * glm::vec4(0, 0, 0, 1);
-            //TODO: (Req 10) Create a model matrix for the sky such that it always follows the camera (sky sphere center = camera position)
-            glm::mat4 skyModelMatrix = glm::translate(glm::mat4(1.0f), cameraPosition);
-            //TODO: (Req 10) We want the sky to be drawn behind everything (in NDC space, z=1)
-            // We can achieve this by multiplying by an extra matrix after the projection but what values should we put in it?
-            glm::mat4 alwaysBehindTransform = glm::mat4(
-                1.0f, 0.0f, 0.0f, 0.0f,
-                0.0f, 1.0f, 0.0f, 0.0f,
-                0.0f, 0.0f, 0.0f, 0.0f,
-                0.0f, 0.0f, 1.0f, 1.0f
-            );
-            //TODO: (Req 10) set the "transform" uniform
-            skyMaterial->shader->set("transform", alwaysBehindTransform * VP * skyModelMatrix);
-
-            //TODO: (Req 10) draw the sky sphere
-            skySphere->draw();
+        std::sort(indirectCommands.begin(), indirectCommands.end(), [](const IndirectCommand& first, const IndirectCommand& second){
+            return first.key < second.key;
+        });
+
+        // All the draws are queued before drawing, so the batches can be drawn more than once (e.g. for the depth pre-pass)
+        indirectRenderer.beginFrame((GLuint)indirectCommands.size());
+        for(size_t start = 0; start < indirectCommands.size();){
+            uint64_t leaderIndex = indirectCommands[start].key >> 40;
+            Material* material = leaders[leaderIndex];
+            IndirectGroup group{material, indirectRenderer.getVariant(material->shader), indirectRenderer.getBatchCount(), 0};
+            size_t end = start;
+            for(; end < indirectCommands.size() && indirectCommands[end].key >> 40 == leaderIndex; end++){
+                const RenderCommand& command = *indirectCommands[end].command;
+                if(!indirectRenderer.canBatch(command.mesh)) indirectRenderer.endBatch();
+                indirectRenderer.queue(command.mesh, command.localToWorld, command.material->getDrawData(), command.submesh);
+            }
+            indirectRenderer.endBatch();
+            group.lastBatch = indirectRenderer.getBatchCount();
+            indirectGroups.push_back(group);
+            frameIndirectDraws += (int)(end - start);
+            start = end;
         }
+    }
 
-        //TODO: (Req 9) Draw all the transparent commands
-        // Don't forget to set the "transform" uniform to be equal the model-view-projection matrix for each render command
-        for(auto& command : transparentCommands){
-            command.material->setup();
-            if (auto light_material = dynamic_cast<LightingMaterial *>(command.material); light_material&& command.center.y >= 0)
-            {
-                light_material->shader->set("VP", VP);
-
-                light_material->shader->set("camera_position", eye);
-
-                light_material->shader->set("M", command.localToWorld);
-
-                light_material->shader->set("M_IT", glm::transpose(glm::inverse(command.localToWorld)));
-
-                light_material->shader->set("light_count", (int)Lights.size());
-
-                light_material->shader->set("sky.top", glm::vec3(0.5, 0.5, 0.5));
-                light_material->shader->set("sky.horizon", glm::vec3(0.5, 0.5, 0.5));
-                light_material->shader->set("sky.bottom", glm::vec3(0.5, 0.5, 0.5));
-
-                for(int i = 0; i<Lights.size(); i++) {
-
-                    glm::vec3 light_position = Lights[i]->getOwner()->getLocalToWorldMatrix() * glm::vec4(0, 0, 0, 1);
-                    glm::vec3 light_direction = Lights[i]->getOwner()->getLocalToWorldMatrix() * glm::vec4(Lights[i]->direction, 0);
-
-                    light_material->shader->set("lights["+std::to_string(i)+"].type", (int)Lights[i]->kind);
-                    light_material->shader->set("lights["+std::to_string(i)+"].diffuse", Lights[i]->diffuse);
-                    light_material->shader->set("lights["+std::to_string(i)+"].specular", Lights[i]->specular);
-                    // light_material->shader->set("lights["+std::to_string(i)+"].attenuation", Lights[i]->attenuation);
-                    switch (Lights[i]->kind)
-                    {
-                        case 0:
-                            light_material->shader->set("lights["+std::to_string(i)+"].direction", light_direction);
-                            break;
-                        case 1:
-                            light_material->shader->set("lights["+std::to_string(i)+"].position", light_position);
-                            light_material->shader->set("lights["+std::to_string(i)+"].attenuation", Lights[i]->attenuation);
-                            break;
-                        case 2:
-                            light_material->shader->set("lights["+std::to_string(i)+"].position", light_position);
-                            light_material->shader->set("lights["+std::to_string(i)+"].direction", light_direction);
-                            light_material->shader->set("lights["+std::to_string(i)+"].cone_angles", Lights[i]->cone_angles);
-                            light_material->shader->set("lights["+std::to_string(i)+"].attenuation", Lights[i]->attenuation);
-                            break;
+    void ForwardRenderer::drawIndirect(const glm::mat4& VP, const glm::vec3& cameraPosition, const glm::vec3& cameraForward, OpaquePass pass){
+        for(auto& group : indirectGroups){
+            Material* material = group.leader;
+            ShaderProgram* variant = group.variant;
+            bool lit = dynamic_cast<LightingMaterial *>(material) != nullptr;
+            ShaderProgram* depthVariant = pass != OpaquePass::SHADING ? getDepthVariant(material, variant) : nullptr;
+
+            if(pass == OpaquePass::DEPTH){
+                if(!depthVariant) continue;
+                // Only the depth is written (using the culling & the depth test of the material)
+                material->pipelineState.setup();
+                glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+                depthVariant->use();
+                depthVariant->set(lit ? "VP" : "transform", VP);
+                depthVariant->set("cell_mask_enabled", (GLint)false);
+                for(size_t batch = group.firstBatch; batch < group.lastBatch; batch++) indirectRenderer.drawBatch(batch, depthVariant);
+                frameDrawCalls += (int)(group.lastBatch - group.firstBatch);
+                continue;
+            }
 
-                    }
-                }
+            // The material is set up using the variant of its shader (the material is shared so we restore its shader after)
+            ShaderProgram* shader = material->shader;
+            material->shader = variant;
+            material->setup();
+            material->shader = shader;
+            setFrameUniforms(material, variant, VP, cameraPosition, cameraForward);
+            // The unlit shaders receive the view projection matrix in "transform" and read the model matrix of each draw
+            if(!lit) variant->set("transform", VP);
+            variant->set("cell_mask_enabled", (GLint)false);
+            // If the depth pre-pass drew these objects, only their visible fragments are shaded
+            if(depthVariant){
+                glDepthFunc(GL_EQUAL);
+                glDepthMask(GL_FALSE);
+            }
+            for(size_t batch = group.firstBatch; batch < group.lastBatch; batch++) indirectRenderer.drawBatch(batch, variant);
+            frameDrawCalls += (int)(group.lastBatch - group.firstBatch);
+        }
+    }
 
+    void ForwardRenderer::executeCommand(const RenderCommand& command, const glm::mat4& VP, const glm::vec3& cameraPosition, const glm::vec3& cameraForward,
+        OpaquePass pass){
+        ShaderProgram* depthVariant = pass != OpaquePass::SHADING ? getDepthVariant(command.material, command.material->shader) : nullptr;
+        if(pass == OpaquePass::DEPTH){
+            if(!depthVariant) return;
+            // Only the depth is written (using the culling & the depth test of the material). The vertex shader needs the same uniforms.
+            command.material->pipelineState.setup();
+            glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+            depthVariant->use();
+            if(dynamic_cast<LightingMaterial *>(command.material)){
+                depthVariant->set("VP", VP);
+                depthVariant->set("M", command.localToWorld);
             } else {
-                command.material->shader->set("transform", VP * command.localToWorld); // sent transform matrix to shader
+                depthVariant->set("transform", VP * command.localToWorld);
             }
-            command.mesh->draw();
+            bool useCellMask = cellMaskBuffer && command.mesh->hasCells();
+            depthVariant->set("cell_mask_enabled", (GLint)useCellMask);
+            command.mesh->draw(command.submesh);
+            frameDrawCalls++;
+            return;
         }
 
-        // If there is a postprocess material, apply postprocessing
-        if(postprocessMaterial){
-            //TODO: (Req 11) Return to the default framebuffer
-            glBindFramebuffer(GL_DRAW_FRAMEBUFFER, 0);
-            //TODO: (Req 11) Setup the postprocess material and draw the fullscreen triangle
-            postprocessMaterial->setup();
-            glBindVertexArray(postProcessVertexArray);
-            glDrawArrays(GL_TRIANGLES, 0, 3);
+        command.material->setup();
+        // If the depth pre-pass drew this object, only its visible fragments are shaded
+        if(depthVariant){
+            glDepthFunc(GL_EQUAL);
+            glDepthMask(GL_FALSE);
+        }
+
+        if(auto light_material = dynamic_cast<LightingMaterial *>(command.material); light_material){
+            // Only the transformation uniforms change per object (the frame uniforms are only sent when the shader changes)
+            setFrameUniforms(command.material, light_material->shader, VP, cameraPosition, cameraForward);
+            light_material->shader->set("M", command.localToWorld);
+            light_material->shader->set("M_IT", glm::transpose(glm::inverse(command.localToWorld)));
+        } else {
+            command.material->shader->set("transform", VP * command.localToWorld); // sent transform matrix to shader
         }
+        // The meshes with a cell per vertex hide the vertices of the cells whose bit is not set in the cell mask
+        bool useCellMask = cellMaskBuffer && command.mesh->hasCells();
+        command.material->shader->set("cell_mask_enabled", (GLint)useCellMask);
+        command.mesh->draw(command.submesh);
+        frameDrawCalls++;
     }
 
 }
\ No newline at end of file
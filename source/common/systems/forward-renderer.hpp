@@ -5,14 +5,21 @@
 #include "../components/mesh-renderer.hpp"
 #include "../asset-loader.hpp"
 #include "components/lighting.hpp"
+#include "light-clusters.hpp"
+#include "bounding-volume-hierarchy.hpp"
+#include "indirect-renderer.hpp"
+#include "early-z.hpp"
+#include "postprocess-chain.hpp"
 
 #include <glad/gl.h>
 #include <vector>
+#include <unordered_map>
 #include <algorithm>
+#include <atomic>
 
 namespace our
 {
-    
+
     // The render command stores command that tells the renderer that it should draw
     // the given mesh at the given localToWorld matrix using the given material
     // The renderer will fill this struct using the mesh renderer components
@@ -21,6 +28,47 @@ namespace our
         glm::vec3 center;
         Mesh* mesh;
         Material* material;
+        int submesh = -1; // The sub-mesh to draw (-1 draws the whole mesh)
+    };
+
+    // The renderer keeps a proxy for every mesh renderer it has seen to cache its world bounds and its node in the bounding volume hierarchy.
+    // The cached transform lets us skip updating the hierarchy for the objects that didn't move since the last frame.
+    struct RenderProxy {
+        int id = BoundingVolumeHierarchy::NULL_NODE;
+        MeshRendererComponent* renderer = nullptr;
+        Mesh* mesh = nullptr;
+        glm::mat4 localToWorld;
+        AABB worldBounds;
+        unsigned int lastSeenFrame = 0;
+    };
+
+    // Some statistics about the last rendered frame
+    struct RenderStats {
+        int renderables = 0;      // The number of mesh renderers in the world
+        int visible = 0;          // The number of mesh renderers inside the camera frustum
+        int culled = 0;           // The number of mesh renderers outside the camera frustum
+        int movedProxies = 0;     // The number of objects that left their fat box and modified the hierarchy
+        int hierarchyNodes = 0;
+        int hierarchyHeight = 0;
+        int drawCalls = 0;        // The number of draw calls issued for the visible objects
+        int indirectDraws = 0;    // The number of objects drawn using the multi-draw indirect path
+        DepthMode depthMode = DepthMode::NONE; // How the opaque objects are drawn (see "DepthMode")
+        float opaqueMilliseconds = 0;          // The GPU time of the opaque pass
+    };
+
+    // Everything needed to draw a frame of a world, which is extracted from the world by "ForwardRenderer::extract".
+    // Once extracted, the packet is only read while it is drawn, so the world can be updated meanwhile
+    // (e.g. by the main thread while the render thread draws the previous frame). It only points to assets (meshes & materials)
+    // which must stay alive until it is drawn.
+    struct FramePacket {
+        bool hasCamera = false; // Nothing is drawn if the world has no camera
+        DepthMode depthMode = DepthMode::NONE; // The opaque commands are sorted from near to far if it is FRONT_TO_BACK
+        glm::mat4 view, projection, VP;
+        glm::vec3 eye, cameraForward;
+        // The vectors are kept between frames (the packets are reused) to prevent reallocating them every frame
+        std::vector<RenderCommand> opaqueCommands;
+        std::vector<RenderCommand> transparentCommands; // Sorted from far to near
+        std::vector<LightInstance> lights;
     };
 
     // A forward renderer is a renderer that draw the object final color directly to the framebuffer
@@ -30,19 +78,88 @@ namespace our
     class ForwardRenderer {
         // These window size will be used on multiple occasions (setting the viewport, computing the aspect ratio, etc.)
         glm::ivec2 windowSize;
-        // These are two vectors in which we will store the opaque and the transparent commands.
-        // We define them here (instead of being local to the "render" function) as an optimization to prevent reallocating them every frame
-        std::vector<RenderCommand> opaqueCommands;
-        std::vector<RenderCommand> transparentCommands;
-        // Objects used for rendering a skybox
-        Mesh* skySphere;
-        TexturedMaterial* skyMaterial;
-        // Objects used for Postprocessing
-        GLuint postprocessFrameBuffer, postProcessVertexArray;
-        Texture2D *colorTarget, *depthTarget;
-        TexturedMaterial* postprocessMaterial;
-
-        std::vector<LightingComponent*> Lights;
+        // The packet used by "render" which extracts & draws a frame immediately
+        FramePacket immediatePacket;
+        // An empty vertex array used to draw the fullscreen triangles (their vertices are generated in the vertex shaders)
+        GLuint fullscreenVertexArray = 0;
+        // The material used to draw the sky (a fullscreen triangle at the far plane which samples the sky in the direction of each pixel)
+        TexturedMaterial* skyMaterial = nullptr;
+        // The sky texture is kept by the residency manager so that it isn't loaded again when the renderer is initialized again
+        AssetHandle<Texture2D> skyTexture;
+        // The post-processing effects applied to the scene (if any) before it is shown
+        PostprocessChain postprocess;
+
+        // The lights are assigned to the clusters of the view frustum once per frame
+        // so that the lighting shader only loops over the lights near each fragment
+        LightClusters lightClusters;
+
+        // The bounding volume hierarchy over the mesh renderers which is used for frustum culling
+        // It is only used by "extract" while the members used by "submit" are only used while drawing,
+        // so a packet can be extracted on one thread while another packet is drawn on another.
+        BoundingVolumeHierarchy bvh;
+        std::unordered_map<MeshRendererComponent*, RenderProxy> renderProxies;
+        unsigned int frameIndex = 0;
+        RenderStats stats; // The statistics of the last extraction (the draw calls are counted separately while drawing)
+        int frameDrawCalls = 0, frameIndirectDraws = 0;
+        // The draw counts of the last drawn packet (they are read by the main thread while the render thread draws)
+        std::atomic<int> drawCalls{0}, indirectDraws{0};
+
+        // A uniform buffer containing a visibility bit per cell for the meshes that have a cell per vertex (static batches)
+        GLuint cellMaskBuffer = 0;
+        // A zero-filled cell mask bound instead when there is none, since the shaders declare the block whether they read it or not
+        GLuint emptyCellMaskBuffer = 0;
+
+        // If supported, the opaque objects are drawn using a multi-draw indirect call per group of materials that can share a draw
+        IndirectRenderer indirectRenderer;
+        bool useIndirectDraw = false;
+        // An opaque command drawn indirectly with the key it is sorted by, which packs (from the highest bits) the index of its batch leader,
+        // its vertex format, its index type and its index in the packet, so the sort only compares integers
+        struct IndirectCommand {
+            uint64_t key;
+            const RenderCommand* command;
+        };
+        // The opaque commands of the drawn packet which are drawn indirectly & the ones drawn one by one
+        std::vector<IndirectCommand> indirectCommands;
+        std::vector<const RenderCommand*> directCommands;
+        // The indirect draws of a material (and the materials that share its draws) are in the batches [firstBatch, lastBatch)
+        struct IndirectGroup {
+            Material* leader;
+            ShaderProgram* variant; // The variant of the leader's shader that supports indirect drawing
+            size_t firstBatch, lastBatch;
+        };
+        std::vector<IndirectGroup> indirectGroups;
+
+        // Chooses how the opaque objects are drawn & measures the opaque pass
+        DepthModeSelector depthModes;
+        // The variants of the shaders used in the depth pre-pass (nullptr if the variant failed to link), created by "initialize"
+        std::unordered_map<ShaderProgram*, ShaderProgram*> depthVariants;
+        // The passes in which the opaque objects are drawn
+        enum class OpaquePass {
+            SHADING,                // Drawn using their materials
+            DEPTH,                  // Only their depth is drawn (the depth pre-pass)
+            SHADING_AFTER_DEPTH     // Drawn using their materials but only where the depth pre-pass drew them (GL_EQUAL & no depth writes)
+        };
+
+        // Adds the given mesh renderer to the hierarchy or updates its bounds if it moved (to the given world matrix)
+        void updateProxy(MeshRendererComponent* meshRenderer, const glm::mat4& localToWorld);
+
+        // Sets up the material of the given command, sends its uniforms then draws its mesh
+        void executeCommand(const RenderCommand& command, const glm::mat4& VP, const glm::vec3& cameraPosition, const glm::vec3& cameraForward,
+            OpaquePass pass = OpaquePass::SHADING);
+        // Creates the variants that only draw the depth of the shaders used by the given material (if it is drawn in the depth pre-pass)
+        void createDepthVariants(const Material* material);
+        // Returns the variant of the given shader (of the given material) that only draws the depth
+        // or nullptr if the material is not drawn in the depth pre-pass (the variants are never created while drawing)
+        ShaderProgram* getDepthVariant(const Material* material, ShaderProgram* shader);
+        // The last shader that received the frame uniforms in the drawn packet (they stay in the program until the next packet)
+        ShaderProgram* frameUniformsShader = nullptr;
+        // Sends the uniforms that are shared by all the objects drawn using the given material in this frame
+        // (nothing is sent if they were just sent to the same shader)
+        void setFrameUniforms(Material* material, ShaderProgram* shader, const glm::mat4& VP, const glm::vec3& cameraPosition, const glm::vec3& cameraForward);
+        // Queues the opaque commands that can be drawn indirectly (grouped by material into "indirectGroups") and puts the others in "directCommands"
+        void queueIndirect(const std::vector<RenderCommand>& opaqueCommands);
+        // Draws the queued indirect draws (one call per batch) in the given pass
+        void drawIndirect(const glm::mat4& VP, const glm::vec3& cameraPosition, const glm::vec3& cameraForward, OpaquePass pass);
     public:
         // Initialize the renderer including the sky and the Postprocessing objects.
         // windowSize is the width & height of the window (in pixels).
@@ -50,7 +167,27 @@ namespace our
         // Clean up the renderer
         void destroy();
         // This function should be called every frame to draw the given world
-        void render(World* world);
+        void render(World* world) {
+            extract(world, immediatePacket);
+            submit(immediatePacket);
+        }
+        // Fills the packet with what is needed to draw the given world. It doesn't call OpenGL, so it can run on any thread.
+        void extract(World* world, FramePacket& packet);
+        // Draws a packet filled by "extract" (on the thread that owns the OpenGL context)
+        void submit(const FramePacket& packet);
+        // Sets the cell mask used to hide the cells of the meshes that have a cell attribute (0 to disable)
+        void setCellMask(GLuint buffer) { cellMaskBuffer = buffer; }
+        // Changes the strength of the post-processing effect at the given index of the configuration (on the thread that draws)
+        void setPostprocessStrength(size_t index, float strength) { postprocess.setStrength(index, strength); }
+        // Returns the statistics of the last extracted frame (the draw calls are the ones of the last drawn frame)
+        RenderStats getStats() const {
+            RenderStats result = stats;
+            result.drawCalls = drawCalls.load(std::memory_order_relaxed);
+            result.indirectDraws = indirectDraws.load(std::memory_order_relaxed);
+            result.depthMode = depthModes.getMode();
+            result.opaqueMilliseconds = depthModes.getOpaqueMilliseconds();
+            return result;
+        }
 
 
     };
@@ -0,0 +1,55 @@
+#pragma once
+
+#include "../mesh/bounds.hpp"
+
+#include <glm/glm.hpp>
+
+namespace our {
+
+    // The result of testing a bounding box against a frustum
+    enum class FrustumTest {
+        OUTSIDE,
+        INTERSECTING,
+        INSIDE
+    };
+
+    // A view frustum stored as 6 planes (ax + by + cz + d >= 0 for points inside the frustum)
+    struct Frustum {
+        glm::vec4 planes[6];
+
+        Frustum() = default;
+
+        // Extracts the frustum planes from a view-projection matrix (Gribb & Hartmann's method)
+        // A point is inside the clip volume if -w <= x, y, z <= w, so each plane is the sum or the difference of the last row and another row
+        explicit Frustum(const glm::mat4& VP){
+            glm::vec4 row[4];
+            for(int i = 0; i < 4; i++) row[i] = glm::vec4(VP[0][i], VP[1][i], VP[2][i], VP[3][i]);
+            planes[0] = row[3] + row[0]; // Left
+            planes[1] = row[3] - row[0]; // Right
+            planes[2] = row[3] + row[1]; // Bottom
+            planes[3] = row[3] - row[1]; // Top
+            planes[4] = row[3] + row[2]; // Near
+            planes[5] = row[3] - row[2]; // Far
+            for(auto& plane : planes) plane /= glm::length(glm::vec3(plane));
+        }
+
+        // Tests the given box against the frustum planes
+        // For each plane, we only check the box corner that is farthest along the plane normal (the positive vertex) to know if the box is outside
+        // and the opposite corner (the negative vertex) to know if the box is completely inside.
+        // This test can report boxes near the frustum corners as intersecting while they are outside, which is fine for culling.
+        FrustumTest test(const AABB& box) const {
+            FrustumTest result = FrustumTest::INSIDE;
+            for(const auto& plane : planes){
+                glm::vec3 normal = glm::vec3(plane);
+                glm::vec3 positive = glm::mix(box.min, box.max, glm::greaterThanEqual(normal, glm::vec3(0)));
+                if(glm::dot(normal, positive) + plane.w < 0) return FrustumTest::OUTSIDE;
+                glm::vec3 negative = glm::mix(box.max, box.min, glm::greaterThanEqual(normal, glm::vec3(0)));
+                if(glm::dot(normal, negative) + plane.w < 0) result = FrustumTest::INTERSECTING;
+            }
+            return result;
+        }
+
+        bool intersects(const AABB& box) const { return test(box) != FrustumTest::OUTSIDE; }
+    };
+
+}
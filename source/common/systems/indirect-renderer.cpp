@@ -0,0 +1,285 @@
+#include "indirect-renderer.hpp"
+
+#include <glm/gtc/matrix_inverse.hpp>
+#include <cstring>
+#include <iostream>
+#include <numeric>
+
+namespace our {
+
+    void IndirectRenderer::FrameRing::create(GLenum target, GLsizeiptr regionSize, bool persistent){
+        this->target = target;
+        this->regionSize = regionSize;
+        glGenBuffers(1, &buffer);
+        glBindBuffer(target, buffer);
+        if(persistent){
+            // The buffer stays mapped for its whole life and the writes are visible to the GPU without flushing (coherent)
+            GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+            glBufferStorage(target, regionSize * FRAME_REGIONS, nullptr, flags);
+            mapped = (char*)glMapBufferRange(target, 0, regionSize * FRAME_REGIONS, flags);
+        } else {
+            glBufferData(target, regionSize, nullptr, GL_STREAM_DRAW);
+        }
+        glBindBuffer(target, 0);
+    }
+
+    void IndirectRenderer::FrameRing::destroy(){
+        for(auto& fence : fences){
+            if(fence) glDeleteSync(fence);
+            fence = nullptr;
+        }
+        if(buffer){
+            if(mapped){
+                glBindBuffer(target, buffer);
+                glUnmapBuffer(target);
+                glBindBuffer(target, 0);
+            }
+            glDeleteBuffers(1, &buffer);
+        }
+        buffer = 0;
+        mapped = nullptr;
+    }
+
+    void IndirectRenderer::FrameRing::acquire(int region, bool persistent){
+        if(persistent){
+            // Wait until the GPU finishes the frame which last used this region (usually, it finished long ago)
+            if(fences[region]){
+                while(glClientWaitSync(fences[region], GL_SYNC_FLUSH_COMMANDS_BIT, 1000000) == GL_TIMEOUT_EXPIRED);
+                glDeleteSync(fences[region]);
+                fences[region] = nullptr;
+            }
+        } else {
+            // Orphan the buffer storage so that we don't wait for the GPU to finish reading the previous frame
+            glBindBuffer(target, buffer);
+            glBufferData(target, regionSize, nullptr, GL_STREAM_DRAW);
+            glBindBuffer(target, 0);
+        }
+    }
+
+    void IndirectRenderer::FrameRing::write(int region, GLintptr offset, const void* data, GLsizeiptr size, bool persistent){
+        if(size <= 0) return;
+        if(persistent){
+            std::memcpy(mapped + regionOffset(region, true) + offset, data, size);
+        } else {
+            glBindBuffer(target, buffer);
+            glBufferSubData(target, offset, size, data);
+            glBindBuffer(target, 0);
+        }
+    }
+
+    void IndirectRenderer::FrameRing::fence(int region){
+        if(!mapped) return;
+        if(fences[region]) glDeleteSync(fences[region]);
+        fences[region] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    }
+
+    bool IndirectRenderer::isSupported(){
+        // Besides the multi-draw itself, the path selects the draw data using the base instance of each draw (core in 4.2)
+        // and binds a region of the draw data ring using glTexBufferRange (core in 4.3)
+        bool multiDraw = GLAD_GL_VERSION_4_3 || GLAD_GL_ARB_multi_draw_indirect;
+        bool baseInstance = GLAD_GL_VERSION_4_2 || GLAD_GL_ARB_base_instance;
+        bool textureBufferRange = GLAD_GL_VERSION_4_3 || GLAD_GL_ARB_texture_buffer_range;
+        return multiDraw && baseInstance && textureBufferRange;
+    }
+
+    void IndirectRenderer::initialize(){
+        persistent = GLAD_GL_VERSION_4_4 != 0;
+        glGetIntegerv(GL_TEXTURE_BUFFER_OFFSET_ALIGNMENT, &textureBufferAlignment);
+        if(textureBufferAlignment < 1) textureBufferAlignment = 1;
+
+        // A vertex array is needed for each vertex format that can be drawn indirectly
+        for(int format = 0; format < (int)VertexFormat::COUNT; format++){
+            if(!hasCellStream((VertexFormat)format)) glGenVertexArrays(1, &vertexArrays[format]);
+        }
+        glGenTextures(1, &drawDataTexture);
+        // Start with enough space for a few hundred draws, the buffers grow when needed
+        reserveDraws(256);
+    }
+
+    void IndirectRenderer::destroy(){
+        for(auto& [shader, variant] : variants) delete variant;
+        variants.clear();
+        commandRing.destroy();
+        drawDataRing.destroy();
+        glDeleteBuffers(1, &drawIdBuffer);
+        stagedCommands.clear();
+        stagedDrawData.clear();
+        for(auto& vertexArray : vertexArrays){
+            if(vertexArray) glDeleteVertexArrays(1, &vertexArray);
+            vertexArray = 0;
+        }
+        glDeleteTextures(1, &drawDataTexture);
+        drawIdBuffer = drawDataTexture = 0;
+        poolGeneration = ~0u;
+        drawCapacity = 0;
+    }
+
+    void IndirectRenderer::setupVertexArrays(){
+        MeshPool& pool = MeshPool::get();
+        for(int format = 0; format < (int)VertexFormat::COUNT; format++){
+            if(!vertexArrays[format]) continue;
+            // The vertex array reads the pool buffers of its format in addition to the draw ids
+            glBindVertexArray(vertexArrays[format]);
+            pool.setupAttributes((VertexFormat)format);
+            glBindBuffer(GL_ARRAY_BUFFER, drawIdBuffer);
+            glVertexAttribIPointer(ATTRIB_LOC_DRAW_ID, 1, GL_UNSIGNED_INT, sizeof(GLuint), (void*)0);
+            glVertexAttribDivisor(ATTRIB_LOC_DRAW_ID, 1);
+            glEnableVertexAttribArray(ATTRIB_LOC_DRAW_ID);
+        }
+        glBindVertexArray(0);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+        poolGeneration = pool.getGeneration();
+    }
+
+    void IndirectRenderer::reserveDraws(GLuint draws){
+        if(draws <= drawCapacity) return;
+        GLuint newCapacity = glm::max(draws, drawCapacity * 2);
+
+        // The old rings may still be used by the GPU, but deleting a buffer in use is safe in OpenGL
+        commandRing.destroy();
+        drawDataRing.destroy();
+
+        // The draw data regions must respect the texture buffer offset alignment
+        GLsizeiptr drawDataSize = (GLsizeiptr)newCapacity * DRAW_DATA_TEXELS * sizeof(glm::vec4);
+        drawDataSize = (drawDataSize + textureBufferAlignment - 1) / textureBufferAlignment * textureBufferAlignment;
+        commandRing.create(GL_DRAW_INDIRECT_BUFFER, (GLsizeiptr)newCapacity * sizeof(DrawElementsIndirectCommand), persistent);
+        drawDataRing.create(GL_TEXTURE_BUFFER, drawDataSize, persistent);
+
+        // The draw ids are an instanced attribute containing 0, 1, 2, ... so the base instance of each draw selects its data
+        std::vector<GLuint> ids(newCapacity);
+        std::iota(ids.begin(), ids.end(), 0u);
+        if(drawIdBuffer) glDeleteBuffers(1, &drawIdBuffer);
+        glGenBuffers(1, &drawIdBuffer);
+        glBindBuffer(GL_ARRAY_BUFFER, drawIdBuffer);
+        glBufferData(GL_ARRAY_BUFFER, ids.size() * sizeof(GLuint), ids.data(), GL_STATIC_DRAW);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+        // The vertex arrays must point to the new draw id buffer
+        poolGeneration = ~0u;
+
+        // Without persistent mapping, the draws are written to the buffers in bulk from these arrays
+        if(!persistent){
+            stagedCommands.resize(newCapacity);
+            stagedDrawData.resize((size_t)newCapacity * DRAW_DATA_TEXELS);
+        }
+
+        drawCapacity = newCapacity;
+        region = 0;
+    }
+
+    ShaderProgram* IndirectRenderer::getVariant(ShaderProgram* shader){
+        auto it = variants.find(shader);
+        if(it != variants.end()) return it->second;
+
+        ShaderProgram* variant = shader->createVariant({"INDIRECT_DRAW"});
+        // If the shader doesn't read the draw data, it doesn't support the INDIRECT_DRAW define
+        if(variant && variant->getUniformLocation("draw_data") == (GLuint)-1){
+            delete variant;
+            variant = nullptr;
+        }
+        if(!variant) std::cerr << "WARNING: A shader doesn't support INDIRECT_DRAW, its objects will be drawn one by one" << std::endl;
+        return variants[shader] = variant;
+    }
+
+    void IndirectRenderer::beginFrame(GLuint maxDraws){
+        reserveDraws(maxDraws);
+        region = persistent ? (region + 1) % FRAME_REGIONS : 0;
+        commandRing.acquire(region, persistent);
+        drawDataRing.acquire(region, persistent);
+        frameDraws = flushedDraws = uploadedDraws = 0;
+        batches.clear();
+
+        // Bind this frame's region of the draw data to the buffer texture
+        glActiveTexture(GL_TEXTURE0 + DRAW_DATA_TEXTURE_UNIT);
+        glBindTexture(GL_TEXTURE_BUFFER, drawDataTexture);
+        glTexBufferRange(GL_TEXTURE_BUFFER, GL_RGBA32F, drawDataRing.buffer, drawDataRing.regionOffset(region, persistent), drawDataRing.regionSize);
+        glActiveTexture(GL_TEXTURE0);
+    }
+
+    bool IndirectRenderer::canBatch(const Mesh* mesh) const {
+        const MeshAllocation& allocation = mesh->getAllocation();
+        return frameDraws == flushedDraws || (allocation.format == pendingFormat && allocation.indexType == pendingIndexType);
+    }
+
+    void IndirectRenderer::queue(Mesh* mesh, const glm::mat4& localToWorld, const MaterialDrawData& material, int submesh){
+        if(frameDraws >= drawCapacity) return;
+        const MeshAllocation& allocation = mesh->getAllocation();
+        // The first queued draw decides the vertex format & the index type of the next flush
+        if(frameDraws == flushedDraws){
+            pendingFormat = allocation.format;
+            pendingIndexType = allocation.indexType;
+        }
+
+        // With persistent mapping, the draw is written directly to the mapped ring. Otherwise, it is staged until the draws are uploaded.
+        DrawElementsIndirectCommand stackCommand;
+        glm::vec4 stackDrawData[DRAW_DATA_TEXELS];
+        DrawElementsIndirectCommand& command = persistent ? stackCommand : stagedCommands[frameDraws];
+        glm::vec4* drawData = persistent ? stackDrawData : &stagedDrawData[(size_t)frameDraws * DRAW_DATA_TEXELS];
+        SubMesh range = mesh->getSubMesh(submesh);
+        command.count = range.elementCount;
+        command.instanceCount = 1;
+        command.firstIndex = allocation.firstElement + range.firstElement;
+        command.baseVertex = (GLint)allocation.firstVertex;
+        command.baseInstance = frameDraws; // This selects the draw data using the instanced draw id attribute
+
+        glm::mat4 normalMatrix = glm::transpose(glm::inverse(localToWorld));
+        for(int column = 0; column < 4; column++){
+            drawData[column] = localToWorld[column];
+            drawData[4 + column] = normalMatrix[column];
+        }
+        drawData[8] = material.tint;
+        drawData[9] = material.layers[0];
+        drawData[10] = material.layers[1];
+        if(persistent){
+            commandRing.write(region, (GLintptr)frameDraws * sizeof(DrawElementsIndirectCommand), &command, sizeof(command), true);
+            drawDataRing.write(region, (GLintptr)frameDraws * sizeof(stackDrawData), drawData, sizeof(stackDrawData), true);
+        }
+        frameDraws++;
+    }
+
+    void IndirectRenderer::uploadStagedDraws(){
+        if(persistent || uploadedDraws == frameDraws) return;
+        // The renderer queues all the draws of a frame before drawing any batch, so each buffer is usually written once per frame
+        GLuint draws = frameDraws - uploadedDraws;
+        commandRing.write(region, (GLintptr)uploadedDraws * sizeof(DrawElementsIndirectCommand),
+            &stagedCommands[uploadedDraws], (GLsizeiptr)draws * sizeof(DrawElementsIndirectCommand), false);
+        drawDataRing.write(region, (GLintptr)uploadedDraws * DRAW_DATA_TEXELS * sizeof(glm::vec4),
+            &stagedDrawData[(size_t)uploadedDraws * DRAW_DATA_TEXELS], (GLsizeiptr)draws * DRAW_DATA_TEXELS * sizeof(glm::vec4), false);
+        uploadedDraws = frameDraws;
+    }
+
+    bool IndirectRenderer::flush(ShaderProgram* variant){
+        if(!endBatch()) return false;
+        drawBatch(batches.size() - 1, variant);
+        return true;
+    }
+
+    bool IndirectRenderer::endBatch(){
+        GLuint draws = frameDraws - flushedDraws;
+        if(draws == 0) return false;
+        batches.push_back({pendingFormat, pendingIndexType, flushedDraws, draws});
+        flushedDraws = frameDraws;
+        return true;
+    }
+
+    void IndirectRenderer::drawBatch(size_t batch, ShaderProgram* variant){
+        const Batch& draws = batches[batch];
+        // Samplers must be set using a signed integer (glUniform1i)
+        variant->set("draw_data", (GLint)DRAW_DATA_TEXTURE_UNIT);
+
+        // The draws of the batch must be in the buffers before they are drawn
+        uploadStagedDraws();
+        // If meshes were added since the last flush, the pool may have reallocated its buffers
+        if(poolGeneration != MeshPool::get().getGeneration()) setupVertexArrays();
+        glBindVertexArray(vertexArrays[(int)draws.format]);
+        glBindBuffer(GL_DRAW_INDIRECT_BUFFER, commandRing.buffer);
+        GLintptr offset = commandRing.regionOffset(region, persistent) + (GLintptr)draws.first * sizeof(DrawElementsIndirectCommand);
+        glMultiDrawElementsIndirect(GL_TRIANGLES, draws.indexType, (void*)offset, draws.count, 0);
+        glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+    }
+
+    void IndirectRenderer::endFrame(){
+        commandRing.fence(region);
+        drawDataRing.fence(region);
+    }
+
+}
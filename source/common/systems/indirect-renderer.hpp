@@ -0,0 +1,140 @@
+#pragma once
+
+#include "../mesh/mesh.hpp"
+#include "../shader/shader.hpp"
+#include "../material/material.hpp"
+
+#include <glad/gl.h>
+#include <glm/glm.hpp>
+#include <unordered_map>
+#include <vector>
+
+namespace our {
+
+    // The texture unit used to bind the per-draw data (the model matrices) while drawing indirectly
+    constexpr GLuint DRAW_DATA_TEXTURE_UNIT = 9;
+    // The attribute location of the draw index (an instanced attribute offset by the base instance of each draw)
+    constexpr GLuint ATTRIB_LOC_DRAW_ID = 5;
+
+    // The layout of a single draw in the indirect buffer as defined by OpenGL
+    struct DrawElementsIndirectCommand {
+        GLuint count;
+        GLuint instanceCount;
+        GLuint firstIndex;
+        GLint baseVertex;
+        GLuint baseInstance;
+    };
+
+    // This class implements a draw submission path based on glMultiDrawElementsIndirect (OpenGL 4.3+).
+    // The meshes already live in the shared buffers of the mesh pool, so all the meshes of a vertex format
+    // can be drawn using a single vertex array which reads the pool buffers and the draw ids.
+    // A single call can only draw meshes that share a vertex format and an index type.
+    // Every frame, the draws are written as DrawElementsIndirectCommands into a buffer and the model matrices & the per-draw material data
+    // (see "MaterialDrawData") are written into a buffer texture, then all the draws whose materials can share a draw are issued using a single call.
+    // The shaders read the model matrix of each draw using an instanced "draw_id" attribute (since gl_DrawID needs OpenGL 4.6)
+    // and must support the "INDIRECT_DRAW" define. A variant of each shader is compiled with this define.
+    // If OpenGL 4.4 is available, the per-frame buffers are persistently mapped rings synchronized using fences,
+    // otherwise, they are orphaned every frame and the queued draws are copied into them by a single upload per buffer before they are drawn.
+    class IndirectRenderer {
+    public:
+        // The number of frames whose data can be in flight at the same time
+        static constexpr int FRAME_REGIONS = 3;
+        // The number of RGBA32F texels per draw in the draw data buffer (M, M_IT, the tint & the 2 texels of texture layers)
+        static constexpr int DRAW_DATA_TEXELS = 11;
+
+    private:
+        // A buffer split into regions where each frame writes in its own region while the GPU may still read the others
+        struct FrameRing {
+            GLenum target = 0;
+            GLuint buffer = 0;
+            GLsizeiptr regionSize = 0;
+            char* mapped = nullptr; // Only used if the buffer is persistently mapped
+            GLsync fences[FRAME_REGIONS] = {};
+
+            void create(GLenum target, GLsizeiptr regionSize, bool persistent);
+            void destroy();
+            // Makes sure that the GPU is done with the given region so that it can be written
+            void acquire(int region, bool persistent);
+            // Writes data at the given offset inside the given region
+            void write(int region, GLintptr offset, const void* data, GLsizeiptr size, bool persistent);
+            void fence(int region);
+            GLintptr regionOffset(int region, bool persistent) const { return persistent ? region * regionSize : 0; }
+        };
+
+        bool persistent = false;
+
+        // A vertex array per vertex format reading the mesh pool buffers and the draw ids
+        // (the formats with cells are drawn using the regular path so they don't have one)
+        GLuint vertexArrays[(int)VertexFormat::COUNT] = {};
+        GLuint drawIdBuffer = 0;
+        // The generation of the mesh pool when the vertex array was set up (the pool buffers change when it grows)
+        unsigned int poolGeneration = ~0u;
+
+        // The per-frame data
+        FrameRing commandRing, drawDataRing;
+        GLuint drawDataTexture = 0;
+        GLint textureBufferAlignment = 1;
+        GLuint drawCapacity = 0; // The maximum number of draws per frame
+        int region = 0;
+        GLuint frameDraws = 0;   // The number of draws written this frame
+        GLuint flushedDraws = 0; // The number of draws already put in a batch this frame
+        // Without persistent mapping, the draws are queued in these arrays (sized to the draw capacity) until they are uploaded
+        std::vector<DrawElementsIndirectCommand> stagedCommands;
+        std::vector<glm::vec4> stagedDrawData;
+        GLuint uploadedDraws = 0; // The number of draws of this frame already uploaded from the staged arrays
+        // The vertex format & the index type of the draws queued since the last flush
+        VertexFormat pendingFormat = VertexFormat::STANDARD;
+        GLenum pendingIndexType = GL_UNSIGNED_INT;
+
+        // The draws of this frame that are issued by a single call (they share a vertex format & an index type)
+        struct Batch {
+            VertexFormat format;
+            GLenum indexType;
+            GLuint first, count;
+        };
+        std::vector<Batch> batches;
+
+        // The variants of the material shaders compiled with INDIRECT_DRAW (nullptr if the shader doesn't support it)
+        std::unordered_map<ShaderProgram*, ShaderProgram*> variants;
+
+        // Points the vertex arrays to the current buffers of the mesh pool and to the draw ids
+        void setupVertexArrays();
+        // Recreates the per-frame buffers such that they can hold the given number of draws per frame
+        void reserveDraws(GLuint draws);
+        // Uploads the staged draws that were queued since the last upload (only used without persistent mapping)
+        void uploadStagedDraws();
+
+    public:
+        // Returns true if the current context supports this path (multi-draw indirect, base instance & texture buffer ranges)
+        static bool isSupported();
+
+        void initialize();
+        void destroy();
+
+        // Returns the variant of the given shader that supports indirect drawing (or nullptr if it doesn't support it)
+        ShaderProgram* getVariant(ShaderProgram* shader);
+        // Returns true if the given mesh can be drawn using this path
+        // (meshes with another vertex format such as static batches are drawn using the regular path)
+        bool canDraw(const Mesh* mesh) const { return !mesh->hasCells(); }
+        // Returns true if the given mesh can be drawn by the same call as the draws queued since the last flush
+        // (if not, the queued draws must be flushed or put in a batch first)
+        bool canBatch(const Mesh* mesh) const;
+
+        // Starts a new frame. "maxDraws" is the number of draws that will be queued this frame.
+        void beginFrame(GLuint maxDraws);
+        // Queues the given mesh (or one of its sub-meshes) to be drawn with the given model matrix & material data
+        void queue(Mesh* mesh, const glm::mat4& localToWorld, const MaterialDrawData& material, int submesh = -1);
+        // Issues the draws queued since the last flush using a single call (returns false if there was nothing to draw).
+        // The variant shader must be in use and its uniforms must be set.
+        bool flush(ShaderProgram* variant);
+        // Puts the draws queued since the last flush in a batch without issuing them (returns false if there was nothing to draw).
+        // The batches are issued later using "drawBatch" which can be called more than once per batch (e.g. for a depth pre-pass).
+        bool endBatch();
+        size_t getBatchCount() const { return batches.size(); }
+        // Issues the draws of the given batch using a single call. The variant shader must be in use and its uniforms must be set.
+        void drawBatch(size_t batch, ShaderProgram* variant);
+        // Ends the frame (the regions used this frame will not be written again until the GPU is done with them)
+        void endFrame();
+    };
+
+}
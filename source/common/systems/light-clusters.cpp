@@ -0,0 +1,253 @@
+#include "light-clusters.hpp"
+#include "../ecs/entity.hpp"
+#include "../shader/shader.hpp"
+
+#include <glm/gtc/matrix_inverse.hpp>
+#include <algorithm>
+#include <iostream>
+#include <limits>
+
+namespace our {
+
+    // Below this intensity, the contribution of a light is considered invisible (less than 1 step of an 8-bit color channel)
+    static constexpr float LIGHT_CUTOFF = 1.0f / 256.0f;
+
+    // Computes the distance after which the light contribution falls below LIGHT_CUTOFF
+    // The attenuation is 1 / (x*d^2 + y*d + z) as computed in the lighting shader
+    static float computeLightRange(const LightInstance& light){
+        float intensity = glm::max(glm::max(light.diffuse.r, glm::max(light.diffuse.g, light.diffuse.b)),
+                                   glm::max(light.specular.r, glm::max(light.specular.g, light.specular.b)));
+        if(intensity <= 0) return 0;
+        float a = light.attenuation.x, b = light.attenuation.y, c = light.attenuation.z - intensity / LIGHT_CUTOFF;
+        if(a > 0) return (-b + glm::sqrt(b * b - 4 * a * c)) / (2 * a);
+        if(b > 0) return glm::max(0.0f, -c / b);
+        // A light with no attenuation reaches everything
+        return std::numeric_limits<float>::infinity();
+    }
+
+    // Checks if a sphere intersects an axis aligned box
+    static bool sphereIntersectsBox(const glm::vec3& center, float radius, const glm::vec3& boxMin, const glm::vec3& boxMax){
+        glm::vec3 closest = glm::clamp(center, boxMin, boxMax);
+        glm::vec3 difference = closest - center;
+        return glm::dot(difference, difference) <= radius * radius;
+    }
+
+    LightInstance::LightInstance(const LightingComponent* light)
+        : kind(light->kind), diffuse(light->diffuse), specular(light->specular), attenuation(light->attenuation), cone_angles(light->cone_angles) {
+        glm::mat4 M = light->getOwner()->getLocalToWorldMatrix();
+        // The light position is defined relative to its owner (e.g. the bulb of a lamp model)
+        position = M * glm::vec4(light->position, 1);
+        direction = M * glm::vec4(light->direction, 0);
+        if(glm::dot(direction, direction) > 0) direction = glm::normalize(direction);
+    }
+
+    void LightClusters::initialize(glm::ivec3 dimensions){
+        this->dimensions = dimensions;
+        cachedProjection = glm::mat4(0.0f);
+
+        glGetIntegerv(GL_MAX_TEXTURE_BUFFER_SIZE, &maxTextureBufferSize);
+
+        GLuint buffers[3], textures[3];
+        glGenBuffers(3, buffers);
+        glGenTextures(3, textures);
+        lightBuffer = buffers[0]; gridBuffer = buffers[1]; indexBuffer = buffers[2];
+        lightTexture = textures[0]; gridTexture = textures[1]; indexTexture = textures[2];
+
+        // Each buffer texture views its buffer with the format expected by the shader
+        std::pair<GLuint, GLenum> views[] = {
+            {lightBuffer, GL_RGBA32F}, {gridBuffer, GL_RG32UI}, {indexBuffer, GL_R32UI}
+        };
+        for(int i = 0; i < 3; i++){
+            glBindBuffer(GL_TEXTURE_BUFFER, views[i].first);
+            // We allocate a small store so that the texture is complete even before the first update
+            glBufferData(GL_TEXTURE_BUFFER, 16, nullptr, GL_STREAM_DRAW);
+            glBindTexture(GL_TEXTURE_BUFFER, textures[i]);
+            glTexBuffer(GL_TEXTURE_BUFFER, views[i].second, views[i].first);
+        }
+        glBindTexture(GL_TEXTURE_BUFFER, 0);
+        glBindBuffer(GL_TEXTURE_BUFFER, 0);
+    }
+
+    void LightClusters::destroy(){
+        if(lightBuffer == 0) return;
+        GLuint buffers[3] = {lightBuffer, gridBuffer, indexBuffer};
+        GLuint textures[3] = {lightTexture, gridTexture, indexTexture};
+        glDeleteTextures(3, textures);
+        glDeleteBuffers(3, buffers);
+        lightBuffer = gridBuffer = indexBuffer = 0;
+        lightTexture = gridTexture = indexTexture = 0;
+    }
+
+    int LightClusters::depthToSlice(float depth) const {
+        float d = logarithmic ? glm::log(glm::max(depth, 1e-6f)) : depth;
+        return (int)glm::floor(d * depthScale + depthBias);
+    }
+
+    void LightClusters::buildClusterBounds(const glm::mat4& projection){
+        cachedProjection = projection;
+        glm::mat4 inverseProjection = glm::inverse(projection);
+
+        // A perspective projection has a zero at [3][3] while an orthographic projection has a one.
+        // Perspective clusters are sliced exponentially (uniform in log(depth)) since the perspective packs more details near the camera.
+        logarithmic = projection[3][3] == 0.0f;
+
+        // Since NDC z=-1 and z=1 maps to the near and far planes, we use them to read the depth range from the projection itself
+        auto unproject = [&](glm::vec3 ndc){
+            glm::vec4 point = inverseProjection * glm::vec4(ndc, 1.0f);
+            return glm::vec3(point) / point.w;
+        };
+        nearDepth = -unproject({0, 0, -1}).z;
+        farDepth = -unproject({0, 0, 1}).z;
+
+        if(logarithmic){
+            depthScale = dimensions.z / glm::log(farDepth / nearDepth);
+            depthBias = -glm::log(nearDepth) * depthScale;
+        } else {
+            depthScale = dimensions.z / (farDepth - nearDepth);
+            depthBias = -nearDepth * depthScale;
+        }
+
+        auto sliceDepth = [&](int slice){
+            float t = (float)slice / dimensions.z;
+            return logarithmic ? nearDepth * glm::pow(farDepth / nearDepth, t) : glm::mix(nearDepth, farDepth, t);
+        };
+
+        size_t count = (size_t)dimensions.x * dimensions.y * dimensions.z;
+        clusterMin.resize(count);
+        clusterMax.resize(count);
+        for(int y = 0; y < dimensions.y; y++){
+            for(int x = 0; x < dimensions.x; x++){
+                // The rays passing through the 4 corners of the tile are defined by their points on the near and far planes
+                glm::vec3 nearCorners[4], farCorners[4];
+                for(int corner = 0; corner < 4; corner++){
+                    glm::vec2 ndc = glm::vec2(x + (corner & 1), y + (corner >> 1)) / glm::vec2(dimensions) * 2.0f - 1.0f;
+                    nearCorners[corner] = unproject({ndc, -1});
+                    farCorners[corner] = unproject({ndc, 1});
+                }
+                for(int z = 0; z < dimensions.z; z++){
+                    glm::vec3 boxMin(std::numeric_limits<float>::max()), boxMax(std::numeric_limits<float>::lowest());
+                    for(float depth : {sliceDepth(z), sliceDepth(z + 1)}){
+                        for(int corner = 0; corner < 4; corner++){
+                            // Find the point on the ray at the given view-space depth (the depth is linear along the ray)
+                            float t = (depth - nearDepth) / (farDepth - nearDepth);
+                            glm::vec3 point = glm::mix(nearCorners[corner], farCorners[corner], t);
+                            boxMin = glm::min(boxMin, point);
+                            boxMax = glm::max(boxMax, point);
+                        }
+                    }
+                    size_t index = x + (size_t)dimensions.x * (y + (size_t)dimensions.y * z);
+                    clusterMin[index] = boxMin;
+                    clusterMax[index] = boxMax;
+                }
+            }
+        }
+    }
+
+    void LightClusters::update(const std::vector<LightInstance>& lights, const glm::mat4& view, const glm::mat4& projection, glm::ivec2 viewportSize){
+        if(projection != cachedProjection) buildClusterBounds(projection);
+        this->viewportSize = viewportSize;
+
+        lightData.clear();
+        assignments.clear();
+        directionalCount = 0;
+
+        // Directional lights come first since they affect every cluster, so they are never listed in the grid
+        auto pushLight = [&](const LightInstance& light){
+            lightData.emplace_back(light.position, (float)light.kind);
+            lightData.emplace_back(light.direction, light.cone_angles.x);
+            lightData.emplace_back(light.diffuse, light.cone_angles.y);
+            lightData.emplace_back(light.specular, 0);
+            lightData.emplace_back(light.attenuation, 0);
+        };
+        for(auto& light : lights){
+            if(light.kind != 0) continue;
+            pushLight(light);
+            directionalCount++;
+        }
+
+        for(auto& light : lights){
+            if(light.kind == 0) continue;
+            float range = computeLightRange(light);
+            if(range <= 0) continue;
+            auto lightIndex = (GLuint)(lightData.size() / LIGHT_TEXELS);
+            pushLight(light);
+
+            glm::vec3 center = view * glm::vec4(glm::vec3(lightData[lightIndex * LIGHT_TEXELS]), 1);
+            float depth = -center.z;
+            // Skip the lights whose sphere is completely outside the depth range of the clusters
+            if(depth + range < nearDepth || depth - range > farDepth) continue;
+            // A sphere that starts behind the near plane should still be tested against the first slice
+            int firstSlice = depth - range <= nearDepth ? 0 : glm::max(0, depthToSlice(depth - range));
+            int lastSlice = glm::min(dimensions.z - 1, depthToSlice(glm::min(depth + range, farDepth)));
+
+            for(int z = firstSlice; z <= lastSlice; z++){
+                for(int y = 0; y < dimensions.y; y++){
+                    for(int x = 0; x < dimensions.x; x++){
+                        GLuint cluster = x + dimensions.x * (y + dimensions.y * z);
+                        if(sphereIntersectsBox(center, range, clusterMin[cluster], clusterMax[cluster]))
+                            assignments.emplace_back(cluster, lightIndex);
+                    }
+                }
+            }
+        }
+
+        // Build the grid using a counting sort on the cluster index
+        size_t clusterCount = clusterMin.size();
+        grid.assign(clusterCount, glm::uvec2(0, 0));
+        for(auto& assignment : assignments) grid[assignment.x].y++;
+        // The index buffer cannot exceed the maximum texture buffer size, so the lights beyond the limit are dropped
+        size_t capacity = maxTextureBufferSize > 0 ? (size_t)maxTextureBufferSize : assignments.size();
+        GLuint offset = 0;
+        for(auto& cell : grid){
+            cell.y = (GLuint)glm::min<size_t>(cell.y, capacity - offset);
+            cell.x = offset;
+            offset += cell.y;
+        }
+        size_t dropped = assignments.size() - offset;
+        if(dropped > 0 && droppedAssignments == 0){
+            std::cerr << "WARNING: " << dropped << " light-cluster assignments exceeded the texture buffer size and were dropped" << std::endl;
+        }
+        droppedAssignments = dropped;
+        indices.resize(offset);
+        cursor.resize(clusterCount);
+        for(size_t i = 0; i < clusterCount; i++) cursor[i] = grid[i].x;
+        for(auto& assignment : assignments){
+            GLuint& position = cursor[assignment.x];
+            if(position < grid[assignment.x].x + grid[assignment.x].y) indices[position++] = assignment.y;
+        }
+
+        // Upload the data while orphaning the old buffer stores so that we don't wait for the previous frame to finish reading them
+        auto upload = [](GLuint buffer, const void* data, size_t size){
+            glBindBuffer(GL_TEXTURE_BUFFER, buffer);
+            glBufferData(GL_TEXTURE_BUFFER, glm::max<size_t>(size, 16), nullptr, GL_STREAM_DRAW);
+            if(size > 0) glBufferSubData(GL_TEXTURE_BUFFER, 0, size, data);
+        };
+        upload(lightBuffer, lightData.data(), lightData.size() * sizeof(glm::vec4));
+        upload(gridBuffer, grid.data(), grid.size() * sizeof(glm::uvec2));
+        upload(indexBuffer, indices.data(), indices.size() * sizeof(GLuint));
+        glBindBuffer(GL_TEXTURE_BUFFER, 0);
+    }
+
+    void LightClusters::bind() const {
+        glActiveTexture(GL_TEXTURE0 + CLUSTER_LIGHTS_TEXTURE_UNIT);
+        glBindTexture(GL_TEXTURE_BUFFER, lightTexture);
+        glActiveTexture(GL_TEXTURE0 + CLUSTER_GRID_TEXTURE_UNIT);
+        glBindTexture(GL_TEXTURE_BUFFER, gridTexture);
+        glActiveTexture(GL_TEXTURE0 + CLUSTER_INDICES_TEXTURE_UNIT);
+        glBindTexture(GL_TEXTURE_BUFFER, indexTexture);
+        glActiveTexture(GL_TEXTURE0);
+    }
+
+    void LightClusters::setUniforms(ShaderProgram* shader) const {
+        shader->set("clusters.lights", CLUSTER_LIGHTS_TEXTURE_UNIT);
+        shader->set("clusters.grid", CLUSTER_GRID_TEXTURE_UNIT);
+        shader->set("clusters.indices", CLUSTER_INDICES_TEXTURE_UNIT);
+        shader->set("clusters.dimensions", dimensions);
+        shader->set("clusters.viewport_size", viewportSize);
+        shader->set("clusters.logarithmic", (GLint)logarithmic);
+        shader->set("clusters.depth_scale", depthScale);
+        shader->set("clusters.depth_bias", depthBias);
+        shader->set("directional_light_count", (GLint)directionalCount);
+    }
+
+}
@@ -0,0 +1,95 @@
+#pragma once
+
+#include "components/lighting.hpp"
+
+#include <glad/gl.h>
+#include <glm/glm.hpp>
+#include <vector>
+
+namespace our {
+
+    // The texture units used to bind the cluster buffers while drawing lit objects
+    // Units 0 to 4 are reserved for the textures of the lighting material
+    constexpr GLint CLUSTER_LIGHTS_TEXTURE_UNIT  = 5;
+    constexpr GLint CLUSTER_GRID_TEXTURE_UNIT    = 6;
+    constexpr GLint CLUSTER_INDICES_TEXTURE_UNIT = 7;
+
+    class ShaderProgram;
+
+    // A copy of a light with its position & direction in world space. The lights are copied while the world is extracted,
+    // so the clusters can be built from them (on the render thread) while the world is being updated.
+    struct LightInstance {
+        int kind = 0;
+        glm::vec3 position = glm::vec3(0), direction = glm::vec3(0); // In world space (the direction is normalized)
+        glm::vec3 diffuse = glm::vec3(0), specular = glm::vec3(0), attenuation = glm::vec3(0);
+        glm::vec2 cone_angles = glm::vec2(0);
+
+        LightInstance() = default;
+        explicit LightInstance(const LightingComponent* light);
+    };
+
+    // This class implements the light assignment of clustered forward shading.
+    // The view frustum is divided into a 3D grid of clusters (froxels): x & y tiles in screen space times a number of depth slices.
+    // Every frame, each point & spot light is tested against the clusters it may touch and the result is uploaded to 3 texture buffers:
+    // - "lights" which contains the data of all the lights (LIGHT_TEXELS texels per light, directional lights come first).
+    // - "grid" which contains, for each cluster, the offset & count of its light indices.
+    // - "indices" which contains the light indices of all the clusters packed one after the other.
+    // The lighting shader finds the cluster containing the fragment and only loops over the lights listed for it.
+    class LightClusters {
+    public:
+        // The number of RGBA32F texels used to store a single light in the "lights" buffer
+        static constexpr int LIGHT_TEXELS = 5;
+
+    private:
+        glm::ivec3 dimensions;
+
+        // The OpenGL buffer objects & the buffer textures viewing them
+        GLuint lightBuffer = 0, gridBuffer = 0, indexBuffer = 0;
+        GLuint lightTexture = 0, gridTexture = 0, indexTexture = 0;
+        GLint maxTextureBufferSize = 0;
+
+        // The view-space bounding boxes of the clusters. They only change when the projection changes.
+        std::vector<glm::vec3> clusterMin, clusterMax;
+        glm::mat4 cachedProjection = glm::mat4(0.0f);
+
+        // The slice depth range in view space and how to map a fragment depth to a slice
+        float nearDepth = 0, farDepth = 0;
+        bool logarithmic = true;
+        float depthScale = 0, depthBias = 0;
+        glm::vec2 viewportSize;
+
+        // CPU side staging data which we keep between frames to avoid reallocating them
+        std::vector<glm::vec4> lightData;
+        std::vector<glm::uvec2> grid;
+        std::vector<GLuint> indices;
+        std::vector<glm::uvec2> assignments; // (cluster, light) pairs
+        std::vector<GLuint> cursor; // The next free index of each cluster while filling the index list
+        int directionalCount = 0;
+        size_t droppedAssignments = 0;
+
+        // Recomputes the view-space bounds of the clusters for the given projection
+        void buildClusterBounds(const glm::mat4& projection);
+        // Returns the slice containing the given view-space depth (not clamped)
+        int depthToSlice(float depth) const;
+
+    public:
+        // Creates the buffers. "dimensions" is the number of tiles on x & y and the number of depth slices.
+        void initialize(glm::ivec3 dimensions = glm::ivec3(16, 9, 24));
+        // Deletes the buffers
+        void destroy();
+
+        // Assigns the lights to the clusters of the given camera and uploads the result to the GPU
+        // This should be called once per frame before drawing any lit object
+        void update(const std::vector<LightInstance>& lights, const glm::mat4& view, const glm::mat4& projection, glm::ivec2 viewportSize);
+
+        // Binds the cluster buffers to their texture units
+        void bind() const;
+        // Sends the cluster uniforms to the given (lighting) shader
+        void setUniforms(ShaderProgram* shader) const;
+
+        // Some statistics about the last update
+        int getLightCount() const { return (int)(lightData.size() / LIGHT_TEXELS); }
+        size_t getAssignmentCount() const { return indices.size(); }
+    };
+
+}
@@ -0,0 +1,327 @@
+#include "postprocess-chain.hpp"
+#include "../texture/texture-utils.hpp"
+
+#include <algorithm>
+#include <cctype>
+#include <cstdint>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+
+namespace our {
+
+    // Returns the names of the functions, constants & uniforms declared at the global scope of the given GLSL code.
+    // The inputs & outputs are not included since they must match the vertex shader, nor are the uniform blocks & structures.
+    static std::vector<std::string> findGlobalNames(const std::string& source){
+        static const std::vector<std::string> skippedQualifiers = {
+            "in", "out", "layout", "precision", "flat", "smooth", "noperspective", "centroid", "invariant", "struct"
+        };
+        std::vector<std::string> names;
+        auto addName = [&names](const std::string& name){
+            if(name != "main" && std::find(names.begin(), names.end(), name) == names.end()) names.push_back(name);
+        };
+        // The state of the current global statement
+        std::vector<std::string> tokens;    // Its identifiers outside any parentheses, brackets or initializer
+        bool isFunction = false, isBlock = false, inInitializer = false;
+        int braces = 0, nesting = 0;        // The depth of the braces & of the parentheses or brackets
+        auto isSkipped = [&](){ return tokens.empty() || isBlock ||
+            std::find(skippedQualifiers.begin(), skippedQualifiers.end(), tokens[0]) != skippedQualifiers.end(); };
+        for(size_t index = 0; index < source.size();){
+            char character = source[index];
+            if(source.compare(index, 2, "//") == 0 || character == '#'){
+                // The comments & the preprocessor directives end with the line
+                index = source.find('\n', index);
+                if(index == std::string::npos) break;
+                continue;
+            } else if(source.compare(index, 2, "/*") == 0){
+                index = source.find("*/", index + 2);
+                if(index == std::string::npos) break;
+                index += 2;
+                continue;
+            } else if(std::isalpha((unsigned char)character) || character == '_'){
+                size_t end = index;
+                while(end < source.size() && (std::isalnum((unsigned char)source[end]) || source[end] == '_')) end++;
+                if(braces == 0 && nesting == 0 && !inInitializer) tokens.push_back(source.substr(index, end - index));
+                index = end;
+                continue;
+            } else if(std::isdigit((unsigned char)character) || character == '.'){
+                // A number (its suffix or exponent is not an identifier)
+                while(index < source.size() && (std::isalnum((unsigned char)source[index]) || source[index] == '.')) index++;
+                continue;
+            }
+            index++;
+            if(braces > 0){
+                // The code in a function body (or a block) is skipped
+                if(character == '{') braces++;
+                else if(character == '}' && --braces == 0 && isFunction){
+                    tokens.clear();
+                    isFunction = isBlock = false;
+                }
+            } else if(character == '(' || character == '['){
+                // "type name(" is a function, but "layout(" or "float values[" are not
+                if(character == '(' && nesting == 0 && !inInitializer && tokens.size() >= 2 && !isSkipped()){
+                    isFunction = true;
+                    addName(tokens.back());
+                }
+                nesting++;
+            } else if(character == ')' || character == ']'){
+                nesting--;
+            } else if(nesting > 0){
+                continue;
+            } else if(character == '{'){
+                braces++;
+                isBlock = !isFunction;
+            } else if(character == '=' && !isFunction){
+                inInitializer = true;
+            } else if(character == ',' || character == ';'){
+                // The end of a variable declaration (a statement can declare more than one variable)
+                if(!isFunction && !isSkipped()) addName(tokens.back());
+                inInitializer = false;
+                if(character == ';'){
+                    tokens.clear();
+                    isFunction = isBlock = false;
+                } else if(!isFunction && !tokens.empty()) {
+                    tokens.pop_back();
+                }
+            }
+        }
+        return names;
+    }
+
+    // Returns true if the shader applies a pointwise effect that can be fused with its neighbours (see "postprocess-chain.hpp")
+    // and fills the names that must be renamed to fuse it
+    static bool isFusible(const std::string& filename, std::vector<std::string>& globalNames){
+        std::ifstream file(filename);
+        if(!file) return false;
+        std::string source = std::string(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+        if(source.find("vec4 effect(") == std::string::npos || source.find("FUSED_PASS") == std::string::npos) return false;
+        globalNames = findGlobalNames(source);
+        return true;
+    }
+
+    void PostprocessChain::initialize(glm::ivec2 windowSize, const nlohmann::json& config){
+        this->windowSize = windowSize;
+        if(!config.contains("postprocess")) return;
+
+        // A single shader file is a full resolution effect
+        const nlohmann::json& list = config["postprocess"];
+        const nlohmann::json& items = list.is_array() ? list : nlohmann::json::array({list});
+        strengthSlots.assign(items.size(), {SIZE_MAX, 0});
+        std::vector<Effect> effects;
+        for(size_t index = 0; index < items.size(); index++){
+            const nlohmann::json& item = items[index];
+            Effect effect;
+            effect.index = index;
+            if(item.is_string()){
+                effect.shader = item.get<std::string>();
+            } else if(item.is_object()) {
+                if(!item.value("enabled", true)) continue;
+                effect.shader = item.value<std::string>("shader", "");
+                effect.scale = item.value("scale", 1.0f);
+                effect.strength = item.value("strength", 1.0f);
+            }
+            if(effect.shader.empty()){
+                std::cerr << "WARNING: Ignoring a post-processing effect without a shader" << std::endl;
+                continue;
+            }
+            if(effect.scale <= 0.0f || effect.scale > 1.0f){
+                std::cerr << "WARNING: The scale of \"" << effect.shader << "\" must be in (0, 1], using 1" << std::endl;
+                effect.scale = 1.0f;
+            }
+            // An effect with no strength is still compiled since its strength can be changed later (its pass is skipped meanwhile)
+            effect.fusible = isFusible(effect.shader, effect.globalNames);
+            effects.push_back(effect);
+        }
+        if(effects.empty()) return;
+
+        // Group the consecutive fusible effects of the same scale into passes. The same shader can't appear twice in a fused pass
+        // since it would be compiled twice with the same suffix.
+        for(size_t first = 0; first < effects.size();){
+            size_t last = first + 1;
+            while(effects[first].fusible && last < effects.size() && effects[last].fusible && effects[last].scale == effects[first].scale){
+                bool repeated = false;
+                for(size_t index = first; index < last; index++) repeated = repeated || effects[index].shader == effects[last].shader;
+                if(repeated) break;
+                last++;
+            }
+
+            Pass pass;
+            pass.program = createProgram(effects, first, last);
+            if(!pass.program){
+                first = last;
+                continue;
+            }
+            pass.size = glm::max(glm::ivec2(glm::round(glm::vec2(windowSize) * effects[first].scale)), glm::ivec2(1));
+            for(size_t index = first; index < last; index++){
+                std::string uniform = last - first == 1 ? "strength" : "strength_" + std::to_string(index - first);
+                strengthSlots[effects[index].index] = {passes.size(), pass.strengths.size()};
+                pass.strengths.emplace_back(uniform, effects[index].strength);
+            }
+            passes.push_back(std::move(pass));
+            first = last;
+        }
+
+        if(!passes.empty()){
+            // The scene is drawn at the window size with a depth buffer. Its color is the input of the first pass.
+            // Create a framebuffer with a color and a depth texture (RGBA with 8 bits per channel & a 24 bits depth)
+            sceneDepth = texture_utils::empty(GL_DEPTH_COMPONENT24, windowSize);
+            createTarget(windowSize);
+            glBindFramebuffer(GL_DRAW_FRAMEBUFFER, targets[0].framebuffer);
+            glFramebufferTexture2D(GL_DRAW_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, sceneDepth->getOpenGLName(), 0);
+            glBindFramebuffer(GL_DRAW_FRAMEBUFFER, 0);
+
+            // Since any pass can be skipped, a pass may read the result of any pass before it. A pass can't write to its input,
+            // so two targets are needed for the sizes of two passes or more (the scene target is one of them for the window size)
+            // and one for the sizes of a single pass (a pass never reads a target of its size then). Only the last pass never needs a target
+            // since it always writes to the output (unless it has a reduced resolution, then its result is stretched to the output).
+            for(size_t index = 0; index < passes.size(); index++){
+                glm::ivec2 size = passes[index].size;
+                if(index + 1 == passes.size() && size == windowSize) continue;
+                int existing = 0, needed = size == windowSize ? 2 : 1;
+                for(const auto& target : targets) if(target.size == size) existing++;
+                for(size_t other = 0; other < passes.size(); other++) if(other != index && passes[other].size == size) needed = 2;
+                if(existing < needed) createTarget(size);
+            }
+        }
+
+        // The reduced resolution results are upsampled bilinearly when they are read by the next pass
+        sampler = new Sampler();
+        sampler->set(GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        sampler->set(GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        sampler->set(GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        sampler->set(GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        // The default options are fine, but we don't need to interact with the depth buffer
+        // so it is more performant to disable the depth mask
+        pipelineState.depthMask = false;
+
+        std::cout << "Post-processing: " << effects.size() << " effect(s) in " << passes.size() << " pass(es), "
+            << targets.size() << " render target(s)" << std::endl;
+        // If no effect could be compiled, the scene is drawn directly to the window
+        if(passes.empty()) destroy();
+    }
+
+    void PostprocessChain::destroy(){
+        for(auto& pass : passes) delete pass.program;
+        passes.clear();
+        strengthSlots.clear();
+        for(auto& target : targets){
+            glDeleteFramebuffers(1, &target.framebuffer);
+            delete target.color;
+        }
+        targets.clear();
+        delete sceneDepth;
+        sceneDepth = nullptr;
+        delete sampler;
+        sampler = nullptr;
+    }
+
+    void PostprocessChain::setStrength(size_t index, float strength){
+        if(index >= strengthSlots.size() || strengthSlots[index].first == SIZE_MAX) return;
+        auto [pass, slot] = strengthSlots[index];
+        passes[pass].strengths[slot].second = strength;
+    }
+
+    int PostprocessChain::createTarget(glm::ivec2 size){
+        Target target;
+        target.size = size;
+        target.color = texture_utils::empty(GL_RGBA8, size);
+        glGenFramebuffers(1, &target.framebuffer);
+        glBindFramebuffer(GL_DRAW_FRAMEBUFFER, target.framebuffer);
+        glFramebufferTexture2D(GL_DRAW_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, target.color->getOpenGLName(), 0);
+        glBindFramebuffer(GL_DRAW_FRAMEBUFFER, 0);
+        targets.push_back(target);
+        return (int)targets.size() - 1;
+    }
+
+    int PostprocessChain::findTarget(glm::ivec2 size, int input) const {
+        for(size_t index = 0; index < targets.size(); index++){
+            if(targets[index].size == size && (int)index != input) return (int)index;
+        }
+        return -1;
+    }
+
+    ShaderProgram* PostprocessChain::createProgram(const std::vector<Effect>& effects, size_t first, size_t last){
+        auto program = new ShaderProgram();
+        bool success = program->attach("assets/shaders/fullscreen.vert", GL_VERTEX_SHADER);
+        if(last - first == 1){
+            success = success && program->attach(effects[first].shader, GL_FRAGMENT_SHADER);
+        } else {
+            // Each effect is compiled as a separate fragment shader whose global names are renamed with its suffix,
+            // then a generated main function reads the pixel once and passes it through all of them
+            std::string declarations, calls;
+            for(size_t index = first; index < last; index++){
+                std::string suffix = "_" + std::to_string(index - first);
+                std::vector<std::string> defines = {"FUSED_PASS"};
+                for(const auto& name : effects[index].globalNames) defines.push_back(name + " " + name + suffix);
+                success = success && program->attach(effects[index].shader, GL_FRAGMENT_SHADER, defines);
+                declarations += "vec4 effect" + suffix + "(vec4 color, vec2 tex_coord);\n";
+                calls += "    color = effect" + suffix + "(color, tex_coord);\n";
+            }
+            program->attachSource(
+                "#version 330\n"
+                "uniform sampler2D tex;\n"
+                "in vec2 tex_coord;\n"
+                "out vec4 frag_color;\n" + declarations +
+                "void main(){\n"
+                "    vec4 color = texture(tex, tex_coord);\n" + calls +
+                "    frag_color = color;\n"
+                "}\n", GL_FRAGMENT_SHADER, "fused post-processing pass");
+        }
+        if(!success || !program->link()){
+            std::cerr << "WARNING: Skipping the post-processing effect(s) starting with \"" << effects[first].shader << "\"" << std::endl;
+            delete program;
+            return nullptr;
+        }
+        return program;
+    }
+
+    void PostprocessChain::begin(){
+        // The result goes to whatever was bound when the frame started (the window, unless the caller draws to its own framebuffer)
+        glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &outputFramebuffer);
+        glBindFramebuffer(GL_DRAW_FRAMEBUFFER, targets[0].framebuffer);
+    }
+
+    void PostprocessChain::apply(GLuint fullscreenVertexArray){
+        // A pass does nothing in this frame if all of its effects have a strength of 0
+        auto isSkipped = [](const Pass& pass){
+            for(const auto& [uniform, strength] : pass.strengths) if(strength != 0.0f) return false;
+            return true;
+        };
+        size_t lastDrawn = passes.size();
+        for(size_t index = 0; index < passes.size(); index++) if(!isSkipped(passes[index])) lastDrawn = index;
+
+        pipelineState.setup();
+        glActiveTexture(GL_TEXTURE0);
+        sampler->bind(0);
+        glBindVertexArray(fullscreenVertexArray);
+
+        // The target holding the result so far (-1 once it is written to the output)
+        int input = 0;
+        for(size_t index = 0; index < passes.size(); index++){
+            Pass& pass = passes[index];
+            if(isSkipped(pass)) continue;
+            int target = index == lastDrawn && pass.size == windowSize ? -1 : findTarget(pass.size, input);
+            glBindFramebuffer(GL_DRAW_FRAMEBUFFER, target < 0 ? (GLuint)outputFramebuffer : targets[target].framebuffer);
+            glViewport(0, 0, pass.size.x, pass.size.y);
+            pass.program->use();
+            targets[input].color->bind();
+            pass.program->set("tex", 0);
+            for(const auto& [uniform, strength] : pass.strengths) pass.program->set(uniform, strength);
+            glDrawArrays(GL_TRIANGLES, 0, 3);
+            input = target;
+        }
+
+        // If the last drawn pass has a reduced resolution (or no pass was drawn), the result is stretched (or copied) to the output
+        if(input >= 0){
+            const Target& result = targets[input];
+            GLint readFramebuffer = 0;
+            glGetIntegerv(GL_READ_FRAMEBUFFER_BINDING, &readFramebuffer);
+            glBindFramebuffer(GL_READ_FRAMEBUFFER, result.framebuffer);
+            glBindFramebuffer(GL_DRAW_FRAMEBUFFER, outputFramebuffer);
+            glBlitFramebuffer(0, 0, result.size.x, result.size.y, 0, 0, windowSize.x, windowSize.y, GL_COLOR_BUFFER_BIT, GL_LINEAR);
+            glBindFramebuffer(GL_READ_FRAMEBUFFER, readFramebuffer);
+        }
+        glViewport(0, 0, windowSize.x, windowSize.y);
+    }
+
+}
@@ -0,0 +1,97 @@
+#pragma once
+
+#include "../shader/shader.hpp"
+#include "../texture/texture2d.hpp"
+#include "../texture/sampler.hpp"
+#include "../material/pipeline-state.hpp"
+
+#include <glad/gl.h>
+#include <glm/glm.hpp>
+#include <json/json.hpp>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace our {
+
+    // An ordered list of post-processing effects applied to the scene before it is shown.
+    // The "postprocess" configuration is either a fragment shader file (a single full resolution effect) or a list of effects:
+    //  "postprocess": [
+    //      { "shader": "assets/shaders/postprocess/radial-blur.frag", "scale": 0.5 },
+    //      { "shader": "assets/shaders/postprocess/chromatic-aberration.frag", "scale": 0.5, "strength": 0.5 },
+    //      "assets/shaders/postprocess/vignette.frag",
+    //      { "shader": "assets/shaders/postprocess/film-grain.frag", "enabled": false }
+    //  ]
+    // "scale" is the resolution of the effect relative to the window (the reduced resolution results are upsampled bilinearly by the next pass),
+    // and "strength" is sent to the "strength" uniform of the shader (it can be changed later using "setStrength").
+    // The disabled effects are not compiled, and the passes whose effects all have a strength of 0 are not drawn in the frames where it is so.
+    // If no effect remains, the scene is drawn directly to the window without any offscreen target.
+    // The effects that only read the pixel they write are fused with their neighbours of the same kind & scale into a single pass.
+    // To be fusible, a shader defines "vec4 effect(vec4 color, vec2 tex_coord)" which returns the new color of the pixel from its color
+    // and texture coordinate, and puts everything else ("tex", "tex_coord", "frag_color" & "main") inside "#ifndef FUSED_PASS"
+    // (see "vignette.frag"). A fused pass is compiled with FUSED_PASS defined, samples the pixel once and passes it through the
+    // "effect" of each of its effects in order.
+    // Each fused effect is compiled with its global functions, constants & uniforms renamed with a suffix (e.g. "rand" becomes "rand_1"),
+    // so the effects can use the same helper names (a global name must not be a swizzle like "x" since it would be renamed too).
+    // Each pass reads the result of the previous pass that was drawn and writes to a render target of its size (or directly to the output if it is the last one).
+    class PostprocessChain {
+        // An effect of the configuration that does something
+        struct Effect {
+            std::string shader;
+            float scale = 1, strength = 1;
+            bool fusible = false;
+            std::vector<std::string> globalNames; // The names renamed when the effect is fused
+            size_t index; // The index of the effect in the configuration
+        };
+        // A fullscreen triangle drawn by a program that applies one or more consecutive effects
+        struct Pass {
+            ShaderProgram* program = nullptr;
+            glm::ivec2 size;
+            // The name & value of the strength uniform of each effect (the fused effects have their own uniform)
+            std::vector<std::pair<std::string, float>> strengths;
+        };
+        // A framebuffer with a color texture. The first one is the scene target which also has a depth texture.
+        struct Target {
+            GLuint framebuffer = 0;
+            Texture2D* color = nullptr;
+            glm::ivec2 size;
+        };
+
+        glm::ivec2 windowSize;
+        std::vector<Pass> passes;
+        // The pass & the index in its strengths of each effect of the configuration (the pass is SIZE_MAX if the effect isn't drawn)
+        std::vector<std::pair<size_t, size_t>> strengthSlots;
+        std::vector<Target> targets;
+        Texture2D* sceneDepth = nullptr;
+        Sampler* sampler = nullptr;
+        PipelineState pipelineState;
+        // The framebuffer that receives the result (the one bound when "begin" was called, usually the window)
+        GLint outputFramebuffer = 0;
+
+        // Creates a target of the given size & returns its index
+        int createTarget(glm::ivec2 size);
+        // Returns a target of the given size other than the given one (the input of the pass). "initialize" creates enough targets
+        // for every pass to find one whichever passes are skipped.
+        int findTarget(glm::ivec2 size, int input) const;
+        // Creates the program that applies the effects [first, last) in a single pass
+        ShaderProgram* createProgram(const std::vector<Effect>& effects, size_t first, size_t last);
+    public:
+        // Reads the effects from the "postprocess" value of the renderer configuration (if any) & creates their passes and targets
+        void initialize(glm::ivec2 windowSize, const nlohmann::json& config);
+        void destroy();
+
+        // Whether there is an effect to apply (otherwise "begin" & "apply" must not be called)
+        bool isActive() const { return !passes.empty(); }
+        // The number of fullscreen passes (the ones whose effects all have a strength of 0 are not drawn)
+        size_t getPassCount() const { return passes.size(); }
+        // Changes the strength of the effect at the given index of the configuration (ignored if the effect isn't drawn)
+        void setStrength(size_t index, float strength);
+
+        // Binds the target in which the scene is drawn (it has the size of the window and a depth buffer)
+        void begin();
+        // Applies the effects to the drawn scene & writes the result to the framebuffer that was bound when "begin" was called
+        // (if every effect has a strength of 0, the scene is only copied). The given vertex array is bound to draw the fullscreen triangles
+        void apply(GLuint fullscreenVertexArray);
+    };
+
+}
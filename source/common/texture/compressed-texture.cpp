@@ -0,0 +1,317 @@
+#include "compressed-texture.hpp"
+#include "../utils/hash.hpp"
+
+#include <glm/glm.hpp>
+#include <algorithm>
+#include <cstring>
+#include <filesystem>
+
+namespace our::compressed_texture {
+
+    static const char MAGIC[4] = {'A', 'X', 'C', 'T'};
+
+    std::string getPath(const std::string& sourceFilename){
+        return std::filesystem::path(sourceFilename).replace_extension(".ctex").string();
+    }
+
+    bool getSourceStamp(const std::string& filename, SourceStamp& stamp){
+        std::error_code error;
+        auto size = std::filesystem::file_size(filename, error);
+        if(error) return false;
+        auto time = std::filesystem::last_write_time(filename, error);
+        if(error) return false;
+        stamp.size = size;
+        stamp.time = (int64_t)time.time_since_epoch().count();
+        return true;
+    }
+
+    // Returns true if the source image is the one the file was baked from
+    static bool matchesSource(const Header& header, const std::string& sourceFilename){
+        SourceStamp stamp;
+        if(!getSourceStamp(sourceFilename, stamp)) return false;
+        if(stamp == header.source) return true;
+        // The stamp changed, so the source may have changed too. It did if its content has another hash.
+        MappedFile source(sourceFilename);
+        return source.isOpen() && hashFNV1a(source.getData(), source.getSize()) == header.sourceHash;
+    }
+
+    bool open(const std::string& path, const std::string& sourceFilename, CompressedTexture& texture){
+        MappedFile& file = texture.file;
+        if(!file.open(path)) return false;
+        if(file.getSize() < sizeof(Header)){ file.close(); return false; }
+
+        Header header;
+        std::memcpy(&header, file.getData(), sizeof(Header));
+        bool valid = std::memcmp(header.magic, MAGIC, sizeof(MAGIC)) == 0 &&
+                     header.version == VERSION &&
+                     (header.format == Format::RGBA8 || isBlockCompressed(header.format)) &&
+                     header.width > 0 && header.height > 0 &&
+                     header.levels > 0 && header.levels <= getFullLevelCount(header.width, header.height);
+        if(!valid){ file.close(); return false; }
+
+        // Find where each level starts and make sure that the file holds all of them
+        texture.levels.clear();
+        size_t offset = sizeof(Header);
+        uint32_t width = header.width, height = header.height;
+        for(uint32_t level = 0; level < header.levels; level++){
+            texture.levels.push_back(file.getData() + offset);
+            offset += getLevelSize(header.format, width, height);
+            width = std::max(1u, width / 2);
+            height = std::max(1u, height / 2);
+        }
+        if(offset != file.getSize()){ file.close(); return false; }
+        // If the source changed since the file was baked, it is stale (checked last since it may read the whole source)
+        if(!matchesSource(header, sourceFilename)){ file.close(); return false; }
+
+        texture.format = header.format;
+        texture.width = header.width;
+        texture.height = header.height;
+        texture.source = header.source;
+        return true;
+    }
+
+    bool isFormatSupported(Format format){
+        if(!isBlockCompressed(format)) return true;
+        // S3TC is not in the core profile, but almost every desktop driver exposes it
+        return GLAD_GL_EXT_texture_compression_s3tc != 0;
+    }
+
+    Texture2D* upload(const CompressedTexture& texture){
+        bool compressed = isBlockCompressed(texture.format) && isFormatSupported(texture.format);
+        GLenum internalFormat = texture.format == Format::BC1 ? GL_COMPRESSED_RGB_S3TC_DXT1_EXT : GL_COMPRESSED_RGBA_S3TC_DXT5_EXT;
+
+        Texture2D* result = new Texture2D();
+        result->bind();
+        // The rows of the small levels are not multiples of 4 bytes
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+        std::vector<unsigned char> pixels;
+        uint32_t width = texture.width, height = texture.height;
+        for(size_t level = 0; level < texture.levels.size(); level++){
+            if(compressed){
+                GLsizei size = (GLsizei)getLevelSize(texture.format, width, height);
+                glCompressedTexImage2D(GL_TEXTURE_2D, (GLint)level, internalFormat, width, height, 0, size, texture.levels[level]);
+            } else {
+                // The driver can't sample the blocks, so they are decompressed (the baked mip levels are still used)
+                const unsigned char* data = texture.levels[level];
+                if(isBlockCompressed(texture.format)){
+                    decodeLevel(texture.format, data, width, height, pixels);
+                    data = pixels.data();
+                }
+                glTexImage2D(GL_TEXTURE_2D, (GLint)level, GL_RGBA8, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, data);
+            }
+            width = std::max(1u, width / 2);
+            height = std::max(1u, height / 2);
+        }
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+        // Only the stored levels can be sampled
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, (GLint)texture.levels.size() - 1);
+        Texture2D::unbind();
+        return result;
+    }
+
+    // The BC1 endpoints are stored as RGB 5:6:5
+    static uint16_t packColor(const glm::vec3& color){
+        glm::ivec3 quantized = glm::ivec3(glm::round(glm::clamp(color, 0.0f, 255.0f) * glm::vec3(31.0f, 63.0f, 31.0f) / 255.0f));
+        return (uint16_t)((quantized.r << 11) | (quantized.g << 5) | quantized.b);
+    }
+    static glm::ivec3 unpackColor(uint16_t color){
+        int r = (color >> 11) & 31, g = (color >> 5) & 63, b = color & 31;
+        // Replicate the high bits into the low bits so that the full range [0, 255] is covered
+        return {(r << 3) | (r >> 2), (g << 2) | (g >> 4), (b << 3) | (b >> 2)};
+    }
+
+    // Finds the closest palette entry of each color for the given endpoints (color0 > color1 such that the 4 color mode is used).
+    // Returns the total squared error.
+    static int fitIndices(const glm::vec3 colors[16], uint16_t color0, uint16_t color1, uint32_t& indices){
+        glm::ivec3 palette[4];
+        palette[0] = unpackColor(color0);
+        palette[1] = unpackColor(color1);
+        palette[2] = (2 * palette[0] + palette[1]) / 3;
+        palette[3] = (palette[0] + 2 * palette[1]) / 3;
+        int error = 0;
+        indices = 0;
+        for(int index = 0; index < 16; index++){
+            glm::ivec3 color = glm::ivec3(colors[index]);
+            int best = 0, bestDistance = INT32_MAX;
+            for(int entry = 0; entry < 4; entry++){
+                glm::ivec3 difference = color - palette[entry];
+                int distance = difference.r * difference.r + difference.g * difference.g + difference.b * difference.b;
+                if(distance < bestDistance){ bestDistance = distance; best = entry; }
+            }
+            indices |= (uint32_t)best << (2 * index);
+            error += bestDistance;
+        }
+        return error;
+    }
+
+    // Writes the color part of a block (used by both BC1 and BC3, the endpoints are ordered such that the 4 color mode is used)
+    static void encodeColors(const unsigned char pixels[64], unsigned char block[8]){
+        glm::vec3 colors[16], mean(0.0f), lower(255.0f), upper(0.0f);
+        for(int index = 0; index < 16; index++){
+            colors[index] = glm::vec3(pixels[4 * index], pixels[4 * index + 1], pixels[4 * index + 2]);
+            mean += colors[index];
+            lower = glm::min(lower, colors[index]);
+            upper = glm::max(upper, colors[index]);
+        }
+        mean /= 16.0f;
+
+        // The endpoints lie on the principal axis of the colors (found by a few power iterations on the covariance).
+        // The iterations start from the diagonal of the bounding box of the colors, which is already close to the axis.
+        glm::mat3 covariance(0.0f);
+        for(auto& color : colors) covariance += glm::outerProduct(color - mean, color - mean);
+        glm::vec3 axis = upper - lower;
+        if(glm::length(axis) > 0.0f){
+            axis = glm::normalize(axis);
+            for(int iteration = 0; iteration < 8; iteration++){
+                glm::vec3 next = covariance * axis;
+                float length = glm::length(next);
+                if(length < 1e-6f) break;
+                axis = next / length;
+            }
+        }
+        float minimum = 0.0f, maximum = 0.0f;
+        for(auto& color : colors){
+            float projection = glm::dot(color - mean, axis);
+            minimum = std::min(minimum, projection);
+            maximum = std::max(maximum, projection);
+        }
+
+        uint16_t color0 = 0, color1 = 0;
+        uint32_t indices = 0;
+        int bestError = INT32_MAX;
+        // Keeps the given endpoints if they give a smaller error than the best ones so far
+        auto tryEndpoints = [&](const glm::vec3& first, const glm::vec3& second){
+            uint16_t candidate0 = packColor(first), candidate1 = packColor(second);
+            if(candidate0 < candidate1) std::swap(candidate0, candidate1);
+            uint32_t candidateIndices = 0;
+            // Equal endpoints can only be drawn using the index 0 (the 3 color mode is never used)
+            int error = candidate0 == candidate1 ? fitIndices(colors, candidate0, candidate0, candidateIndices) : fitIndices(colors, candidate0, candidate1, candidateIndices);
+            if(candidate0 == candidate1) candidateIndices = 0;
+            if(error < bestError){
+                bestError = error;
+                color0 = candidate0;
+                color1 = candidate1;
+                indices = candidateIndices;
+            }
+        };
+        // The extremes along the axis, then the same endpoints inset a little (the extremes are rarely hit exactly)
+        tryEndpoints(mean + axis * maximum, mean + axis * minimum);
+        float inset = (maximum - minimum) / 16.0f;
+        tryEndpoints(mean + axis * (maximum - inset), mean + axis * (minimum + inset));
+
+        // Refine the endpoints by least squares given the chosen indices:
+        // each color is approximated by (weight * endpoint0 + (1 - weight) * endpoint1)
+        if(color0 != color1){
+            const float weights[4] = {1.0f, 0.0f, 2.0f / 3.0f, 1.0f / 3.0f};
+            float aa = 0.0f, ab = 0.0f, bb = 0.0f;
+            glm::vec3 ax(0.0f), bx(0.0f);
+            for(int index = 0; index < 16; index++){
+                float a = weights[(indices >> (2 * index)) & 3], b = 1.0f - a;
+                aa += a * a; ab += a * b; bb += b * b;
+                ax += a * colors[index]; bx += b * colors[index];
+            }
+            float determinant = aa * bb - ab * ab;
+            if(std::abs(determinant) > 1e-6f){
+                tryEndpoints((ax * bb - bx * ab) / determinant, (bx * aa - ax * ab) / determinant);
+            }
+        }
+
+        // The block is little endian: color0, color1 then 2 bits per pixel
+        block[0] = color0 & 0xFF; block[1] = color0 >> 8;
+        block[2] = color1 & 0xFF; block[3] = color1 >> 8;
+        for(int byte = 0; byte < 4; byte++) block[4 + byte] = (indices >> (8 * byte)) & 0xFF;
+    }
+
+    static void decodeColors(const unsigned char block[8], unsigned char pixels[64], bool forceFourColors){
+        uint16_t color0 = block[0] | (block[1] << 8), color1 = block[2] | (block[3] << 8);
+        uint32_t indices = block[4] | (block[5] << 8) | (block[6] << 16) | ((uint32_t)block[7] << 24);
+        glm::ivec4 palette[4];
+        palette[0] = glm::ivec4(unpackColor(color0), 255);
+        palette[1] = glm::ivec4(unpackColor(color1), 255);
+        if(forceFourColors || color0 > color1){
+            palette[2] = glm::ivec4((2 * glm::ivec3(palette[0]) + glm::ivec3(palette[1])) / 3, 255);
+            palette[3] = glm::ivec4((glm::ivec3(palette[0]) + 2 * glm::ivec3(palette[1])) / 3, 255);
+        } else {
+            // The 3 color mode where the last index is transparent black
+            palette[2] = glm::ivec4((glm::ivec3(palette[0]) + glm::ivec3(palette[1])) / 2, 255);
+            palette[3] = glm::ivec4(0);
+        }
+        for(int index = 0; index < 16; index++){
+            const glm::ivec4& color = palette[(indices >> (2 * index)) & 3];
+            for(int channel = 0; channel < 4; channel++) pixels[4 * index + channel] = (unsigned char)color[channel];
+        }
+    }
+
+    void encodeBC1Block(const unsigned char pixels[64], unsigned char block[8]){
+        encodeColors(pixels, block);
+    }
+
+    void encodeBC3Block(const unsigned char pixels[64], unsigned char block[16]){
+        // The alpha uses the 8 value mode between the largest and the smallest alpha of the block
+        int alpha0 = 0, alpha1 = 255;
+        for(int index = 0; index < 16; index++){
+            alpha0 = std::max(alpha0, (int)pixels[4 * index + 3]);
+            alpha1 = std::min(alpha1, (int)pixels[4 * index + 3]);
+        }
+        uint64_t indices = 0;
+        if(alpha0 != alpha1){
+            int palette[8] = {alpha0, alpha1};
+            for(int entry = 1; entry < 7; entry++) palette[entry + 1] = ((7 - entry) * alpha0 + entry * alpha1) / 7;
+            for(int index = 0; index < 16; index++){
+                int alpha = pixels[4 * index + 3], best = 0;
+                for(int entry = 1; entry < 8; entry++){
+                    if(std::abs(alpha - palette[entry]) < std::abs(alpha - palette[best])) best = entry;
+                }
+                indices |= (uint64_t)best << (3 * index);
+            }
+        }
+        block[0] = (unsigned char)alpha0;
+        block[1] = (unsigned char)alpha1;
+        for(int byte = 0; byte < 6; byte++) block[2 + byte] = (indices >> (8 * byte)) & 0xFF;
+        encodeColors(pixels, block + 8);
+    }
+
+    void decodeBC1Block(const unsigned char block[8], unsigned char pixels[64]){
+        decodeColors(block, pixels, false);
+    }
+
+    void decodeBC3Block(const unsigned char block[16], unsigned char pixels[64]){
+        // The color part of BC3 is always in the 4 color mode
+        decodeColors(block + 8, pixels, true);
+        int alpha0 = block[0], alpha1 = block[1];
+        int palette[8] = {alpha0, alpha1};
+        if(alpha0 > alpha1){
+            for(int entry = 1; entry < 7; entry++) palette[entry + 1] = ((7 - entry) * alpha0 + entry * alpha1) / 7;
+        } else {
+            for(int entry = 1; entry < 5; entry++) palette[entry + 1] = ((5 - entry) * alpha0 + entry * alpha1) / 5;
+            palette[6] = 0;
+            palette[7] = 255;
+        }
+        uint64_t indices = 0;
+        for(int byte = 0; byte < 6; byte++) indices |= (uint64_t)block[2 + byte] << (8 * byte);
+        for(int index = 0; index < 16; index++) pixels[4 * index + 3] = (unsigned char)palette[(indices >> (3 * index)) & 7];
+    }
+
+    void decodeLevel(Format format, const unsigned char* data, uint32_t width, uint32_t height, std::vector<unsigned char>& pixels){
+        pixels.resize((size_t)width * height * 4);
+        if(!isBlockCompressed(format)){
+            std::memcpy(pixels.data(), data, pixels.size());
+            return;
+        }
+        size_t blockSize = format == Format::BC1 ? 8 : 16;
+        unsigned char decoded[64];
+        for(uint32_t blockY = 0; blockY < height; blockY += 4){
+            for(uint32_t blockX = 0; blockX < width; blockX += 4, data += blockSize){
+                if(format == Format::BC1) decodeBC1Block(data, decoded);
+                else decodeBC3Block(data, decoded);
+                // The pixels of the blocks on the edges which are outside the level are dropped
+                for(uint32_t y = 0; y < 4 && blockY + y < height; y++){
+                    for(uint32_t x = 0; x < 4 && blockX + x < width; x++){
+                        std::memcpy(&pixels[4 * ((size_t)(blockY + y) * width + blockX + x)], &decoded[4 * (4 * y + x)], 4);
+                    }
+                }
+            }
+        }
+    }
+
+}
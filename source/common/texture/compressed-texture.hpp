@@ -0,0 +1,93 @@
+#pragma once
+
+#include "texture2d.hpp"
+#include "../utils/mapped-file.hpp"
+
+#include <glad/gl.h>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace our::compressed_texture {
+
+    // Increment this whenever the file layout or the baking pipeline changes so that the old files are rejected
+    constexpr uint32_t VERSION = 2;
+
+    // The pixel formats that can be stored in a ".ctex" file
+    enum class Format : uint32_t {
+        RGBA8 = 0,  // Uncompressed (4 bytes per pixel)
+        BC1 = 1,    // DXT1: 4x4 blocks of 8 bytes (RGB only, used for the opaque images)
+        BC3 = 2,    // DXT5: 4x4 blocks of 16 bytes (RGB as in BC1 + an interpolated alpha)
+    };
+
+    // The size & the modification time of a source image when it was baked. The loader compares them with the image first
+    // and only reads & hashes the image if one of them differs (e.g. the image was touched by a checkout without being changed).
+    struct SourceStamp {
+        uint64_t size = 0;
+        int64_t time = 0;       // The modification time in the units of the file system clock
+        bool operator==(const SourceStamp& other) const { return size == other.size && time == other.time; }
+        bool operator!=(const SourceStamp& other) const { return !(*this == other); }
+    };
+    // Reads the stamp of the given file. Returns false if the file doesn't exist.
+    bool getSourceStamp(const std::string& filename, SourceStamp& stamp);
+
+    // The header at the start of every ".ctex" file. It is followed by the data of every mip level (largest first).
+    struct Header {
+        char magic[4];          // "AXCT"
+        uint32_t version;       // Must be equal to VERSION
+        uint64_t sourceHash;    // The FNV-1a hash of the source image file
+        SourceStamp source;     // The stamp of the source image file when it was baked
+        Format format;
+        uint32_t width, height;
+        uint32_t levels;        // The number of mip levels stored in the file
+    };
+
+    // Returns true if the format is stored as 4x4 blocks
+    inline bool isBlockCompressed(Format format){ return format == Format::BC1 || format == Format::BC3; }
+    // Returns the number of bytes of a mip level of the given size
+    inline size_t getLevelSize(Format format, uint32_t width, uint32_t height){
+        if(!isBlockCompressed(format)) return (size_t)width * height * 4;
+        // The blocks cover the whole level even if its size is not a multiple of 4
+        size_t blocks = (size_t)((width + 3) / 4) * ((height + 3) / 4);
+        return blocks * (format == Format::BC1 ? 8 : 16);
+    }
+    // Returns the number of mip levels of a full chain down to 1x1
+    inline uint32_t getFullLevelCount(uint32_t width, uint32_t height){
+        uint32_t levels = 1;
+        while(width > 1 || height > 1){ width = width > 1 ? width / 2 : 1; height = height > 1 ? height / 2 : 1; levels++; }
+        return levels;
+    }
+
+    // Returns the path of the baked file of a source image (the file next to it with the extension ".ctex")
+    std::string getPath(const std::string& sourceFilename);
+
+    // A validated ".ctex" file which stays mapped until its data is uploaded
+    struct CompressedTexture {
+        MappedFile file;
+        Format format = Format::RGBA8;
+        uint32_t width = 0, height = 0;
+        SourceStamp source;     // The stamp stored in the file (it differs from the current one if only the hash matched)
+        std::vector<const unsigned char*> levels; // Points to the data of each level inside the mapped file
+    };
+
+    // Maps the given file and checks it without touching OpenGL (so it can be called from any thread).
+    // Returns false if the file doesn't exist, is invalid, is from another version or wasn't baked from the current source image.
+    // The source is only hashed if its stamp differs from the one in the file.
+    bool open(const std::string& path, const std::string& sourceFilename, CompressedTexture& texture);
+
+    // Returns true if the driver can sample the given format (if not, the blocks are decompressed before uploading)
+    bool isFormatSupported(Format format);
+
+    // Uploads all the mip levels of the texture as they are stored (no mipmaps are generated at runtime)
+    Texture2D* upload(const CompressedTexture& texture);
+
+    // The block codecs. A block is 4x4 pixels in RGBA8 stored row by row.
+    void encodeBC1Block(const unsigned char pixels[64], unsigned char block[8]);
+    void encodeBC3Block(const unsigned char pixels[64], unsigned char block[16]);
+    void decodeBC1Block(const unsigned char block[8], unsigned char pixels[64]);
+    void decodeBC3Block(const unsigned char block[16], unsigned char pixels[64]);
+
+    // Decompresses a whole level to RGBA8
+    void decodeLevel(Format format, const unsigned char* data, uint32_t width, uint32_t height, std::vector<unsigned char>& pixels);
+
+}
@@ -1,13 +1,24 @@
 #include "screenshot.hpp"
+#include "../utils/job-system.hpp"
 
 #define STB_IMAGE_WRITE_IMPLEMENTATION
 #include <stb/stb_image_write.h>
 
 #include <glad/gl.h>
 
+#include <algorithm>
+#include <iostream>
+#include <utility>
+#include <memory>
+#include <mutex>
 #include <vector>
 #include <filesystem>
 
+// The screenshots being encoded & the files that failed to be written (reported by "finish_screenshots")
+static our::JobCounter pendingScreenshots;
+static std::mutex failedMutex;
+static std::vector<std::string> failedScreenshots;
+
 bool our::screenshot_png(const std::string& filename, bool include_alpha) {
 
     // Read the current viewport parameters
@@ -15,12 +26,13 @@ bool our::screenshot_png(const std::string& filename, bool include_alpha) {
         int x = 0, y = 0, w = 0, h = 0;
     } viewport;
     glGetIntegerv(GL_VIEWPORT, (GLint*)&viewport);
+    if(viewport.w <= 0 || viewport.h <= 0) return false;
 
     // If alpha is included, we have 4 components (RGBA). Otherwise, we only have 3 (RGB).
     uint8_t components = include_alpha ? 4 : 3;
 
-    // Allocate memory to store image
-    std::vector<uint8_t> data(components * viewport.w * viewport.h);
+    // Allocate memory to store image (it is shared with the job that encodes it)
+    auto data = std::make_shared<std::vector<uint8_t>>(components * viewport.w * viewport.h);
 
     // If alpha is included, each pixel will use 4 bytes so the row would always be divisible by 4.
     // Otherwise, we can only be sure it is divisible by 1 (because everything is divisible by 1).
@@ -28,16 +40,33 @@ bool our::screenshot_png(const std::string& filename, bool include_alpha) {
     // Pick a format for reading pixels from framebuffer
     GLenum format = include_alpha ? GL_RGBA : GL_RGB;
     // Read Pixels from framebuffer
-    glReadPixels(viewport.x, viewport.y, viewport.w, viewport.h, format, GL_UNSIGNED_BYTE, data.data());
+    glReadPixels(viewport.x, viewport.y, viewport.w, viewport.h, format, GL_UNSIGNED_BYTE, data->data());
 
-    // Since texture row in OpenGL start from bottom and goes up, we need to flip since image formats start from top to bottom.
-    stbi_flip_vertically_on_write(true);
+    // The PNG encoding is the slow part, so it is done by the job system while the main thread continues
+    JobSystem::get().submit([filename, data, width = viewport.w, height = viewport.h, components](){
+        // Since texture row in OpenGL start from bottom and goes up, we need to flip since image formats start from top to bottom.
+        // The rows are flipped here instead of using "stbi_flip_vertically_on_write" since that is a global shared by all the jobs.
+        size_t stride = (size_t)width * components;
+        for(int row = 0; row < height / 2; row++){
+            std::swap_ranges(data->begin() + row * stride, data->begin() + (row + 1) * stride, data->begin() + (height - 1 - row) * stride);
+        }
 
-    // Make sure the directory in which we want to save screenshot exists. If not, create it.
-    std::error_code ec;
-    std::filesystem::create_directories(std::filesystem::path(filename).parent_path(), ec);
-    if(ec) return false;
+        // Make sure the directory in which we want to save screenshot exists. If not, create it.
+        std::error_code ec;
+        std::filesystem::create_directories(std::filesystem::path(filename).parent_path(), ec);
+        if(!ec && stbi_write_png(filename.c_str(), width, height, components, data->data(), 0)){
+            std::cout << "Screenshot saved to: " << filename << std::endl;
+        } else {
+            std::cerr << "Failed to save a screenshot to: " << filename << std::endl;
+            std::lock_guard<std::mutex> lock(failedMutex);
+            failedScreenshots.push_back(filename);
+        }
+    }, &pendingScreenshots, "encode screenshot");
+    return true;
+}
 
-    // Save image and return whether it succeeded or not
-    return stbi_write_png(filename.c_str(), viewport.w, viewport.h, components, data.data(), 0);
+std::vector<std::string> our::finish_screenshots() {
+    JobSystem::get().wait(pendingScreenshots);
+    std::lock_guard<std::mutex> lock(failedMutex);
+    return std::exchange(failedScreenshots, {});
 }
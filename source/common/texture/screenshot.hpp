@@ -2,11 +2,18 @@
 #define GFX_LAB_SCREENSHOT_H
 
 #include <string>
+#include <vector>
 
 namespace our {
 
+    // Reads the pixels of the current viewport and saves them to a PNG file.
+    // The file is encoded & written by the job system, so it prints whether it was saved once it is done.
+    // Returns false if the pixels couldn't be read (the write errors are returned by "finish_screenshots").
     bool screenshot_png(const std::string& filename, bool include_alpha = false);
 
+    // Waits for the screenshots that are still being encoded & returns the files that couldn't be written since the last call
+    std::vector<std::string> finish_screenshots();
+
 }
 
 #endif //GFX_LAB_SCREENSHOT_H
@@ -0,0 +1,45 @@
+#pragma once
+
+#include <glad/gl.h>
+
+namespace our {
+
+    // This class defines an OpenGL texture which will be used as a GL_TEXTURE_2D_ARRAY
+    // The layers all have the same size and each layer holds a whole texture (see "texture-packer.hpp")
+    class TextureArray {
+        // The OpenGL object name of this texture
+        GLuint name = 0;
+        GLsizei size = 0, layers = 0;
+    public:
+        // Creates a texture array of "layers" square layers of the given size (in RGBA8) with room for a full mip chain
+        TextureArray(GLsizei size, GLsizei layers) : size(size), layers(layers) {
+            glGenTextures(1, &name);
+            glBindTexture(GL_TEXTURE_2D_ARRAY, name);
+            glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, GL_RGBA8, size, size, layers, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+            glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+        }
+
+        // This deconstructor deletes the underlying OpenGL texture
+        ~TextureArray() {
+            glDeleteTextures(1, &name);
+        }
+
+        GLuint getOpenGLName() const { return name; }
+        GLsizei getSize() const { return size; }
+        GLsizei getLayerCount() const { return layers; }
+
+        // This method binds this texture to GL_TEXTURE_2D_ARRAY
+        void bind() const {
+            glBindTexture(GL_TEXTURE_2D_ARRAY, name);
+        }
+
+        // This static method ensures that no texture is bound to GL_TEXTURE_2D_ARRAY
+        static void unbind(){
+            glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+        }
+
+        TextureArray(const TextureArray&) = delete;
+        TextureArray& operator=(const TextureArray&) = delete;
+    };
+
+}
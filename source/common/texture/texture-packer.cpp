@@ -0,0 +1,164 @@
+#include "texture-packer.hpp"
+#include "texture-streamer.hpp"
+#include "sampler.hpp"
+#include "../asset-loader.hpp"
+#include "../material/material.hpp"
+#include "../shader/shader.hpp"
+
+#include <iostream>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+namespace our::texture_packer {
+
+    // Returns the textures read by the shader of a material (empty if it doesn't read any texture)
+    static std::vector<Texture2D*> getTextures(Material* material){
+        // The texture of the textured material is not read by the lighting shader so only the maps are returned
+        if(auto lit = dynamic_cast<LightingMaterial*>(material)){
+            return {lit->albedo, lit->specular, lit->emissive, lit->roughness, lit->ambient_occlusion};
+        }
+        if(auto textured = dynamic_cast<TexturedMaterial*>(material)) return {textured->texture};
+        return {};
+    }
+
+    static glm::ivec2 getSize(Texture2D* texture){
+        glm::ivec2 size;
+        texture->bind();
+        glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_WIDTH, &size.x);
+        glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_HEIGHT, &size.y);
+        Texture2D::unbind();
+        return size;
+    }
+
+    // Draws each texture into its layer using a fullscreen triangle. Sampling the textures (instead of copying their pixels)
+    // resamples them to the layer size from their mip levels and works the same for the block compressed textures.
+    static void copyLayers(TextureArray* array, const std::vector<Texture2D*>& textures){
+        ShaderProgram program;
+        program.attach("assets/shaders/fullscreen.vert", GL_VERTEX_SHADER);
+        program.attach("assets/shaders/blit.frag", GL_FRAGMENT_SHADER);
+        program.link();
+
+        // The textures that are smaller than the layer by an integer factor are replicated texel by texel so they stay sharp,
+        // the others are filtered (trilinearly if the texture is larger than the layer)
+        Sampler nearest, linear;
+        for(Sampler* sampler : {&nearest, &linear}){
+            sampler->set(GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+            sampler->set(GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        }
+        nearest.set(GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        nearest.set(GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        linear.set(GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+        linear.set(GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+
+        GLint previousViewport[4], previousFramebuffer;
+        glGetIntegerv(GL_VIEWPORT, previousViewport);
+        glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &previousFramebuffer);
+
+        GLuint framebuffer, vertexArray;
+        glGenFramebuffers(1, &framebuffer);
+        glGenVertexArrays(1, &vertexArray);
+        glBindFramebuffer(GL_DRAW_FRAMEBUFFER, framebuffer);
+        glViewport(0, 0, array->getSize(), array->getSize());
+        // The default pipeline state draws every pixel as it is (no depth testing, no blending, no culling)
+        PipelineState().setup();
+        program.use();
+        program.set("tex", (GLint)0);
+        glBindVertexArray(vertexArray);
+        glActiveTexture(GL_TEXTURE0);
+
+        for(size_t layer = 0; layer < textures.size(); layer++){
+            glFramebufferTextureLayer(GL_DRAW_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, array->getOpenGLName(), 0, (GLint)layer);
+            if(layer == 0 && glCheckFramebufferStatus(GL_DRAW_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE){
+                std::cerr << "The texture array can't be rendered to, the textures will not be packed" << std::endl;
+                break;
+            }
+            glm::ivec2 size = getSize(textures[layer]);
+            bool replicate = array->getSize() % size.x == 0 && array->getSize() % size.y == 0;
+            (replicate ? nearest : linear).bind(0);
+            textures[layer]->bind();
+            glDrawArrays(GL_TRIANGLES, 0, 3);
+        }
+
+        Sampler::unbind(0);
+        Texture2D::unbind();
+        glBindVertexArray(0);
+        glBindFramebuffer(GL_DRAW_FRAMEBUFFER, previousFramebuffer);
+        glViewport(previousViewport[0], previousViewport[1], previousViewport[2], previousViewport[3]);
+        glDeleteVertexArrays(1, &vertexArray);
+        glDeleteFramebuffers(1, &framebuffer);
+
+        array->bind();
+        glGenerateMipmap(GL_TEXTURE_2D_ARRAY);
+        TextureArray::unbind();
+    }
+
+    TextureArray* pack(const nlohmann::json& assetData, const nlohmann::json& options){
+        if(!assetData.contains("materials") || !assetData["materials"].is_object()) return nullptr;
+        int maxSize = options.value("maxSize", 512);
+        int layerSize = options.value("layerSize", 256);
+
+        // The textures may still be queued in the texture streamer, so their pixels are uploaded before they are copied
+        TextureStreamer::get().flush();
+
+        std::unordered_set<Texture2D*> candidates;
+        if(options.contains("textures") && options["textures"].is_array()){
+            for(auto& name : options["textures"]){
+                if(Texture2D* texture = AssetLoader<Texture2D>::get(name.get<std::string>())) candidates.insert(texture);
+            }
+        } else if(assetData.contains("textures") && assetData["textures"].is_object()){
+            for(auto& [name, desc] : assetData["textures"].items()){
+                Texture2D* texture = AssetLoader<Texture2D>::get(name);
+                if(texture == nullptr) continue;
+                glm::ivec2 size = getSize(texture);
+                if(size.x <= maxSize && size.y <= maxSize) candidates.insert(texture);
+            }
+        }
+
+        // A material is packed if all of its textures are candidates, and its textures get a layer the first time they are used
+        GLint maxLayers = 256;
+        glGetIntegerv(GL_MAX_ARRAY_TEXTURE_LAYERS, &maxLayers);
+        std::vector<Texture2D*> layers;
+        std::unordered_map<Texture2D*, int> layerOf;
+        std::vector<TexturedMaterial*> materials;
+        for(auto& [name, desc] : assetData["materials"].items()){
+            auto material = dynamic_cast<TexturedMaterial*>(AssetLoader<Material>::get(name));
+            if(material == nullptr || material->sampler == nullptr) continue;
+            std::vector<Texture2D*> textures = getTextures(material);
+            std::unordered_set<Texture2D*> newTextures;
+            bool packable = true;
+            for(Texture2D* texture : textures){
+                packable = packable && candidates.count(texture) > 0;
+                if(packable && !layerOf.count(texture)) newTextures.insert(texture);
+            }
+            if(!packable || (GLint)(layers.size() + newTextures.size()) > maxLayers) continue;
+            for(Texture2D* texture : textures){
+                if(layerOf.count(texture)) continue;
+                layerOf[texture] = (int)layers.size();
+                layers.push_back(texture);
+            }
+            materials.push_back(material);
+        }
+        // A single material would only pay for the copy
+        if(materials.size() < 2) return nullptr;
+
+        auto array = new TextureArray(layerSize, (GLsizei)layers.size());
+        copyLayers(array, layers);
+
+        for(TexturedMaterial* material : materials){
+            material->textureArray = array;
+            if(auto it = layerOf.find(material->texture); it != layerOf.end()) material->layer = it->second;
+            if(auto lit = dynamic_cast<LightingMaterial*>(material)){
+                lit->albedoLayer = layerOf[lit->albedo];
+                lit->specularLayer = layerOf[lit->specular];
+                lit->emissiveLayer = layerOf[lit->emissive];
+                lit->roughnessLayer = layerOf[lit->roughness];
+                lit->ambientOcclusionLayer = layerOf[lit->ambient_occlusion];
+            }
+        }
+        std::cout << "Packed " << layers.size() << " textures into a texture array of " << layerSize << "x" << layerSize
+                  << " layers shared by " << materials.size() << " materials" << std::endl;
+        return array;
+    }
+
+}
@@ -0,0 +1,22 @@
+#pragma once
+
+#include "texture-array.hpp"
+
+#include <json/json.hpp>
+
+namespace our::texture_packer {
+
+    // Copies the small textures of an asset set into the layers of a single texture array and points the materials of the set to it.
+    // Every layer has the same size, so each texture is resampled to fill its layer (the texture coordinates don't change).
+    // A material is only packed if all of its textures are packed, then the materials that only differ by their textures
+    // (and their tints) are drawn using a single bind & a single indirect call (see "Material::canShareDraw").
+    // The options are read from the "packing" object of the asset set:
+    //  - "textures": the names of the textures to pack. If missing, all the textures of the set up to "maxSize" pixels on each side are packed.
+    //    (a large texture with little detail, such as a solid color, can be listed explicitly to be packed anyway)
+    //  - "maxSize": see above (default: 512)
+    //  - "layerSize": the size of the layers (default: 256)
+    // This must be called after the textures & the materials of the set are loaded.
+    // Returns the texture array (the caller owns it) or nullptr if less than 2 materials could be packed.
+    TextureArray* pack(const nlohmann::json& assetData, const nlohmann::json& options);
+
+}
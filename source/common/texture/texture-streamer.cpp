@@ -0,0 +1,143 @@
+#include "texture-streamer.hpp"
+
+#include <glm/glm.hpp>
+#include <algorithm>
+#include <cstring>
+#include <limits>
+
+namespace our {
+
+    // The offsets of the images in a staging buffer are aligned such that the copies start at a friendly address
+    static constexpr GLsizeiptr STAGING_ALIGNMENT = 256;
+
+    // Called by the destructor of Texture2D if the texture still has a queued upload
+    void cancelTextureStreaming(const Texture2D* texture){
+        TextureStreamer::get().cancel(texture);
+    }
+
+    bool TextureStreamer::isSupported(){
+        return GLAD_GL_VERSION_4_2 || GLAD_GL_ARB_texture_storage;
+    }
+
+    void TextureStreamer::initialize(GLsizeiptr regionSize, size_t budget){
+        if(initialized) destroy();
+        if(!isSupported()) return;
+        this->regionSize = regionSize;
+        this->budget = budget;
+        persistent = GLAD_GL_VERSION_4_4 || GLAD_GL_ARB_buffer_storage;
+        glGenBuffers(REGIONS, buffers);
+        for(int index = 0; index < REGIONS; index++){
+            glBindBuffer(GL_PIXEL_UNPACK_BUFFER, buffers[index]);
+            if(persistent){
+                // The buffer stays mapped for its whole life and the writes are visible to the GPU without flushing (coherent)
+                GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+                glBufferStorage(GL_PIXEL_UNPACK_BUFFER, regionSize, nullptr, flags);
+                mapped[index] = (char*)glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, regionSize, flags);
+            } else {
+                glBufferData(GL_PIXEL_UNPACK_BUFFER, regionSize, nullptr, GL_STREAM_DRAW);
+            }
+        }
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+        region = 0;
+        initialized = true;
+    }
+
+    void TextureStreamer::destroy(){
+        for(auto& upload : pending) upload.texture->streaming = false;
+        pending.clear();
+        for(int index = 0; index < REGIONS; index++){
+            if(fences[index]) glDeleteSync(fences[index]);
+            fences[index] = nullptr;
+            if(mapped[index]){
+                glBindBuffer(GL_PIXEL_UNPACK_BUFFER, buffers[index]);
+                glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+                mapped[index] = nullptr;
+            }
+        }
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+        if(initialized) glDeleteBuffers(REGIONS, buffers);
+        std::fill(std::begin(buffers), std::end(buffers), 0);
+        initialized = false;
+    }
+
+    Texture2D* TextureStreamer::stream(texture_utils::ImageData&& image, bool generate_mipmap){
+        if(!initialized) return texture_utils::uploadImage(image, generate_mipmap);
+
+        // The storage is allocated now (with all its mip levels) so the texture can be bound by the materials right away
+        Texture2D* texture = new Texture2D();
+        texture->bind();
+        GLsizei levels = generate_mipmap ? 1 + (GLsizei)glm::floor(glm::log2((float)glm::max(image.size.x, image.size.y))) : 1;
+        glTexStorage2D(GL_TEXTURE_2D, levels, GL_RGBA8, image.size.x, image.size.y);
+        Texture2D::unbind();
+        // The contents of the storage are undefined, so they are cleared to black until the pixels arrive (if the context can do it)
+        if(GLAD_GL_VERSION_4_4 || GLAD_GL_ARB_clear_texture){
+            const GLubyte black[4] = {0, 0, 0, 255};
+            for(GLint level = 0; level < levels; level++) glClearTexImage(texture->getOpenGLName(), level, GL_RGBA, GL_UNSIGNED_BYTE, black);
+        }
+
+        texture->streaming = true;
+        pending.push_back({texture, std::move(image), generate_mipmap});
+        return texture;
+    }
+
+    void TextureStreamer::update(){
+        upload(budget);
+    }
+
+    void TextureStreamer::flush(){
+        while(!pending.empty()) upload(std::numeric_limits<size_t>::max());
+    }
+
+    void TextureStreamer::cancel(const Texture2D* texture){
+        pending.erase(std::remove_if(pending.begin(), pending.end(), [texture](const Upload& upload){ return upload.texture == texture; }), pending.end());
+    }
+
+    void TextureStreamer::upload(size_t maxBytes){
+        if(pending.empty()) return;
+
+        // Wait until the GPU is done with the frame which last used this buffer (usually, it finished long ago)
+        if(fences[region]){
+            while(glClientWaitSync(fences[region], GL_SYNC_FLUSH_COMMANDS_BIT, 1000000) == GL_TIMEOUT_EXPIRED);
+            glDeleteSync(fences[region]);
+            fences[region] = nullptr;
+        }
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, buffers[region]);
+        // Without persistent mapping, the buffer is orphaned so that we don't wait for the GPU to finish reading it
+        if(!persistent) glBufferData(GL_PIXEL_UNPACK_BUFFER, regionSize, nullptr, GL_STREAM_DRAW);
+
+        GLsizeiptr offset = 0;
+        size_t uploaded = 0;
+        while(!pending.empty()){
+            Upload& upload = pending.front();
+            GLsizeiptr size = (GLsizeiptr)upload.image.size.x * upload.image.size.y * 4;
+            // At least one image is uploaded per frame even if it is larger than the budget
+            if(uploaded > 0 && uploaded + size > maxBytes) break;
+
+            upload.texture->bind();
+            if(size > regionSize){
+                // The image doesn't fit in a staging buffer, so it is uploaded from the client memory
+                glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+                glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, upload.image.size.x, upload.image.size.y, GL_RGBA, GL_UNSIGNED_BYTE, upload.image.pixels);
+                glBindBuffer(GL_PIXEL_UNPACK_BUFFER, buffers[region]);
+            } else {
+                // The buffer of this frame is full, the rest waits for the next frame
+                if(offset + size > regionSize) break;
+                if(persistent) std::memcpy(mapped[region] + offset, upload.image.pixels, size);
+                else glBufferSubData(GL_PIXEL_UNPACK_BUFFER, offset, size, upload.image.pixels);
+                // With a bound unpack buffer, the pointer is an offset into the buffer
+                glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, upload.image.size.x, upload.image.size.y, GL_RGBA, GL_UNSIGNED_BYTE, (void*)offset);
+                offset += (size + STAGING_ALIGNMENT - 1) / STAGING_ALIGNMENT * STAGING_ALIGNMENT;
+            }
+            if(upload.generateMipmap) glGenerateMipmap(GL_TEXTURE_2D);
+            upload.texture->streaming = false;
+            uploaded += size;
+            pending.pop_front();
+        }
+        Texture2D::unbind();
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+
+        if(persistent) fences[region] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+        region = (region + 1) % REGIONS;
+    }
+
+}
@@ -0,0 +1,70 @@
+#pragma once
+
+#include "texture2d.hpp"
+#include "texture-utils.hpp"
+
+#include <deque>
+
+namespace our {
+
+    // Uploads decoded images to their textures over multiple frames instead of stalling the GL thread on every large texture.
+    // The texture is created immediately with immutable storage (glTexStorage2D) and its pixels are queued.
+    // Every frame, "update" copies the queued pixels into a ring of pixel unpack buffers (persistently mapped if supported)
+    // and issues glTexSubImage2D from there, so the driver copies them to the texture asynchronously.
+    // Each frame writes to its own buffer of the ring which is fenced such that it is only reused once the GPU is done with it.
+    // The number of bytes uploaded per frame is limited by a budget to keep the frame time stable while streaming.
+    // Until its upload is done, a texture is black if the context can clear textures (OpenGL 4.4 or ARB_clear_texture), otherwise its contents are undefined.
+    class TextureStreamer {
+        // The number of buffers in the ring (the GPU may still be reading the buffers of the previous frames)
+        static constexpr int REGIONS = 3;
+
+        struct Upload {
+            Texture2D* texture;
+            texture_utils::ImageData image;
+            bool generateMipmap;
+        };
+        std::deque<Upload> pending;
+
+        GLuint buffers[REGIONS] = {};
+        char* mapped[REGIONS] = {}; // Only used if the buffers are persistently mapped
+        GLsync fences[REGIONS] = {};
+        GLsizeiptr regionSize = 0;
+        size_t budget = 0;
+        int region = 0;
+        bool persistent = false;
+        bool initialized = false;
+
+        // Uploads the given number of bytes (at most) from the front of the queue
+        void upload(size_t maxBytes);
+
+        TextureStreamer() = default;
+    public:
+        static TextureStreamer& get(){
+            static TextureStreamer streamer;
+            return streamer;
+        }
+
+        // Returns true if the current context supports this path (immutable texture storage is required)
+        static bool isSupported();
+
+        // Creates the staging buffers. "regionSize" is the size of each buffer of the ring and "budget" is the maximum number of bytes uploaded per frame.
+        // If this is not called, the images are uploaded immediately.
+        void initialize(GLsizeiptr regionSize, size_t budget);
+        void destroy();
+
+        // Creates a texture for the given image and queues its pixels to be uploaded by the next frames
+        Texture2D* stream(texture_utils::ImageData&& image, bool generate_mipmap = true);
+        // Uploads the queued images within the per-frame budget (called once per frame before drawing)
+        void update();
+        // Uploads all the queued images now (e.g. before taking a screenshot)
+        void flush();
+        // Removes the queued upload of a texture (called when a texture is deleted before its upload is done)
+        void cancel(const Texture2D* texture);
+
+        size_t getPendingCount() const { return pending.size(); }
+
+        TextureStreamer(const TextureStreamer&) = delete;
+        TextureStreamer& operator=(const TextureStreamer&) = delete;
+    };
+
+}
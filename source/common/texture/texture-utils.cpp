@@ -5,6 +5,14 @@
 
 #include <iostream>
 #include <glm/glm.hpp>
+#include "texture-streamer.hpp"
+
+// Opens the baked file of an image if it exists and was baked from the current content of the image
+static bool openCompressed(const std::string& filename, our::compressed_texture::CompressedTexture& compressed) {
+    std::string path = our::compressed_texture::getPath(filename);
+    if(path == filename) return false;
+    return our::compressed_texture::open(path, filename, compressed);
+}
 
 our::Texture2D* our::texture_utils::empty(GLenum format, glm::ivec2 size){
     our::Texture2D* texture = new our::Texture2D();
@@ -19,11 +27,40 @@ our::Texture2D* our::texture_utils::empty(GLenum format, glm::ivec2 size){
 }
 
 our::Texture2D* our::texture_utils::loadImage(const std::string& filename, bool generate_mipmap) {
-    glm::ivec2 size;
+    // The baked files always have their mip levels, so they are only used if mipmaps are wanted
+    if(generate_mipmap){
+        compressed_texture::CompressedTexture compressed;
+        if(openCompressed(filename, compressed)) return compressed_texture::upload(compressed);
+    }
+    ImageData image;
+    if(!decodeImage(filename, image)) return nullptr;
+    return uploadImage(image, generate_mipmap);
+}
+
+bool our::texture_utils::prepareTexture(const std::string& filename, TextureData& data) {
+    auto compressed = std::make_unique<compressed_texture::CompressedTexture>();
+    if(openCompressed(filename, *compressed)){
+        data.compressed = std::move(compressed);
+        return true;
+    }
+    return decodeImage(filename, data.image);
+}
+
+our::Texture2D* our::texture_utils::createTexture(TextureData& data) {
+    if(data.compressed) return compressed_texture::upload(*data.compressed);
+    return TextureStreamer::get().stream(std::move(data.image));
+}
+
+our::texture_utils::ImageData::~ImageData(){
+    if(pixels) stbi_image_free(pixels); //Free image data after uploading to GPU
+}
+
+bool our::texture_utils::decodeImage(const std::string& filename, ImageData& image) {
     int channels;
     //Since OpenGL puts the texture origin at the bottom left while images typically has the origin at the top left,
     //We need to till stb to flip images vertically after loading them
-    stbi_set_flip_vertically_on_load(true);
+    //(the thread version of the flag is used since the images can be decoded by multiple threads at once)
+    stbi_set_flip_vertically_on_load_thread(true);
     //Load image data and retrieve width, height and number of channels in the image
     //The last argument is the number of channels we want and it can have the following values:
     //- 0: Keep number of channels the same as in the image file
@@ -32,25 +69,25 @@ our::Texture2D* our::texture_utils::loadImage(const std::string& filename, bool
     //- 3: RGB
     //- 4: RGB and Alpha (RGBA)
     //Note: channels (the 4th argument) always returns the original number of channels in the file
-    unsigned char* pixels = stbi_load(filename.c_str(), &size.x, &size.y, &channels, 4);
-    if(pixels == nullptr){
+    image.pixels = stbi_load(filename.c_str(), &image.size.x, &image.size.y, &channels, 4);
+    if(image.pixels == nullptr){
         std::cerr << "Failed to load image: " << filename << std::endl;
-        return nullptr;
+        return false;
     }
+    return true;
+}
+
+our::Texture2D* our::texture_utils::uploadImage(const ImageData& image, bool generate_mipmap) {
     // Create a texture
     our::Texture2D* texture = new our::Texture2D();
     //Bind the texture such that we upload the image data to its storage
     //TODO: (Req 5) Finish this function to fill the texture with the data found in "pixels"
     texture->bind();
 
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, size.x, size.y, 0, GL_RGBA, GL_UNSIGNED_BYTE, (void *)pixels);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, image.size.x, image.size.y, 0, GL_RGBA, GL_UNSIGNED_BYTE, (void *)image.pixels);
 
     if(generate_mipmap){
         glGenerateMipmap(GL_TEXTURE_2D);
     }
-//    glTexStorage2D(GL_TEXTURE_2D, 1, GL_RGBA8, size.x, size.y);
-//    //Unbinding the texture
-//    our::Texture2D::unbind();
-    stbi_image_free(pixels); //Free image data after uploading to GPU
     return texture;
-}
\ No newline at end of file
+}
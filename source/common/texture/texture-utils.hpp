@@ -1,7 +1,10 @@
 #pragma once
 
 #include "texture2d.hpp"
+#include "compressed-texture.hpp"
 #include <string>
+#include <utility>
+#include <memory>
 
 #include <glad/gl.h>
 #include <glm/vec2.hpp>
@@ -10,5 +13,40 @@ namespace our::texture_utils {
     // This function create an empty texture with a specific format (useful for framebuffers)
     Texture2D* empty(GLenum format, glm::ivec2 size);
     // This function loads an image and sends its data to the given Texture2D 
+    // If the image was baked to a ".ctex" file, the baked file is loaded instead
     Texture2D* loadImage(const std::string& filename, bool generate_mipmap = true);
+
+    // The decoded RGBA8 pixels of an image (flipped such that the origin is at the bottom left)
+    // The pixels are freed when the image is destroyed.
+    struct ImageData {
+        glm::ivec2 size = {0, 0};
+        unsigned char* pixels = nullptr;
+
+        ImageData() = default;
+        ~ImageData();
+        ImageData(ImageData&& other) noexcept : size(other.size), pixels(other.pixels) { other.pixels = nullptr; }
+        ImageData& operator=(ImageData&& other) noexcept {
+            std::swap(size, other.size);
+            std::swap(pixels, other.pixels);
+            return *this;
+        }
+        ImageData(const ImageData&) = delete;
+        ImageData& operator=(const ImageData&) = delete;
+    };
+    // Decodes an image file into memory. This doesn't use OpenGL so it can be called from any thread.
+    bool decodeImage(const std::string& filename, ImageData& image);
+    // Creates a texture from decoded pixels (this must be called on the thread which owns the GL context)
+    Texture2D* uploadImage(const ImageData& image, bool generate_mipmap = true);
+
+    // The data of a texture before it is uploaded: either the baked file next to the image (see "tools/texture-baker.cpp")
+    // if it exists and matches the image, or the decoded pixels of the image
+    struct TextureData {
+        ImageData image;
+        std::unique_ptr<compressed_texture::CompressedTexture> compressed;
+    };
+    // Reads a texture without touching OpenGL so it can be called from any thread
+    bool prepareTexture(const std::string& filename, TextureData& data);
+    // Creates a texture from the prepared data. The baked textures are uploaded with their mip levels as they are
+    // while the decoded images are given to the texture streamer.
+    Texture2D* createTexture(TextureData& data);
 }
\ No newline at end of file
@@ -4,10 +4,17 @@
 
 namespace our {
 
+    class Texture2D;
+    // Removes the queued upload of a texture from the texture streamer (defined in "texture-streamer.cpp")
+    void cancelTextureStreaming(const Texture2D* texture);
+
     // This class defined an OpenGL texture which will be used as a GL_TEXTURE_2D
     class Texture2D {
         // The OpenGL object name of this texture 
         GLuint name = 0;
+        // True while the texture streamer still has to upload the pixels of this texture
+        bool streaming = false;
+        friend class TextureStreamer;
     public:
         // This constructor creates an OpenGL texture and saves its object name in the member variable "name" 
         Texture2D() {
@@ -18,6 +25,7 @@ namespace our {
         // This deconstructor deletes the underlying OpenGL texture
         ~Texture2D() { 
             //TODO: (Req 5) Complete this function
+            if(streaming) cancelTextureStreaming(this);
             glDeleteTextures(1, &name);
         }
 
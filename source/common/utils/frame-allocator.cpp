@@ -0,0 +1,65 @@
+#include "frame-allocator.hpp"
+
+#include <algorithm>
+#include <cstdlib>
+#include <new>
+
+namespace our {
+
+    // The allocator set by the calling thread (if any)
+    static thread_local FrameAllocator* threadAllocator = nullptr;
+
+    FrameAllocator& FrameAllocator::get(){
+        return threadAllocator ? *threadAllocator : getMain();
+    }
+
+    FrameAllocator& FrameAllocator::getMain(){
+        static FrameAllocator instance;
+        return instance;
+    }
+
+    void FrameAllocator::setThreadAllocator(FrameAllocator* allocator){
+        threadAllocator = allocator;
+    }
+
+    FrameAllocator::~FrameAllocator(){
+        reset();
+        std::free(block);
+    }
+
+    void FrameAllocator::reserve(size_t bytes){
+        if(bytes <= capacity) return;
+        // The block is only replaced between frames, so nothing can be using it
+        std::free(block);
+        block = static_cast<unsigned char*>(std::malloc(bytes));
+        capacity = block ? bytes : 0;
+    }
+
+    void* FrameAllocator::allocate(size_t bytes, size_t alignment){
+        // The padding for the alignment is reserved with the allocation so that the offset is only touched once
+        size_t start = offset.fetch_add(bytes + alignment - 1, std::memory_order_relaxed);
+        size_t aligned = (start + alignment - 1) & ~(alignment - 1);
+        if(block && aligned + bytes <= capacity) return block + aligned;
+
+        std::lock_guard<std::mutex> lock(overflowMutex);
+        void* memory = ::operator new(bytes + alignment);
+        overflow.push_back(memory);
+        overflowBytes += bytes + alignment;
+        // operator new only guarantees the default alignment, so the pointer is aligned manually
+        size_t address = reinterpret_cast<size_t>(memory);
+        return reinterpret_cast<void*>((address + alignment - 1) & ~(alignment - 1));
+    }
+
+    void FrameAllocator::reset(){
+        size_t used = std::min(offset.load(std::memory_order_relaxed), capacity);
+        lastFrameBytes = used + overflowBytes;
+        for(void* memory : overflow) ::operator delete(memory);
+        overflow.clear();
+        // Grow the block (with some margin) so that the allocations of a frame like this one fit next time
+        if(overflowBytes > 0) reserve(std::max(capacity * 2, lastFrameBytes + lastFrameBytes / 2));
+        overflowBytes = 0;
+        offset.store(0, std::memory_order_relaxed);
+        frame.fetch_add(1, std::memory_order_relaxed);
+    }
+
+}
@@ -0,0 +1,85 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace our {
+
+    // A linear (bump) allocator for the data that only lives during a frame (e.g. the temporary lists built while rendering).
+    // An allocation is a single atomic add on the offset in a block that is reused every frame, and nothing is freed
+    // until "reset" is called once per frame by the application. Any thread (e.g. a job) can allocate from it.
+    // If the block is full, the allocation falls back to the heap and the block is grown on the next reset,
+    // so after a few frames the frame data fits in the block and no heap allocations are done.
+    // WARNING: The memory is invalid after the next reset, so nothing allocated here should be kept across frames.
+    // A thread that renders its frames at its own pace (the render thread) uses its own allocator (see "setThreadAllocator").
+    class FrameAllocator {
+        unsigned char* block = nullptr;
+        size_t capacity = 0;
+        std::atomic<size_t> offset{0};
+        // The allocations that didn't fit in the block (freed on reset)
+        std::mutex overflowMutex;
+        std::vector<void*> overflow;
+        size_t overflowBytes = 0;
+        size_t lastFrameBytes = 0;
+        std::atomic<uint64_t> frame{0}; // Read by the other threads (e.g. to know the frame of the main thread)
+
+    public:
+        FrameAllocator() = default;
+        ~FrameAllocator();
+
+        // Returns the allocator of the calling thread (the main allocator unless the thread set its own)
+        static FrameAllocator& get();
+        // Returns the allocator of the main thread (which is also used by the jobs)
+        static FrameAllocator& getMain();
+        // Makes the calling thread allocate from the given allocator (nullptr goes back to the main allocator)
+        static void setThreadAllocator(FrameAllocator* allocator);
+
+        // Allocates a block of the given size (it is grown automatically if the frame data doesn't fit)
+        void reserve(size_t bytes);
+        // Returns memory that stays valid until the next reset
+        void* allocate(size_t bytes, size_t alignment = alignof(std::max_align_t));
+        // Frees everything allocated in this frame. If some allocations didn't fit, the block is grown to fit them next frame.
+        void reset();
+
+        size_t getCapacity() const { return capacity; }
+        // The number of bytes allocated in the previous frame (between the last 2 resets)
+        size_t getLastFrameBytes() const { return lastFrameBytes; }
+        // The number of resets (which is the number of frames if it is reset once per frame)
+        uint64_t getFrame() const { return frame.load(std::memory_order_relaxed); }
+
+        FrameAllocator(const FrameAllocator&) = delete;
+        FrameAllocator& operator=(const FrameAllocator&) = delete;
+    };
+
+    // An STL allocator that allocates from the frame allocator, so the containers using it must not outlive the frame.
+    // Deallocating does nothing since the whole frame is freed at once.
+    template<typename T>
+    struct FrameStlAllocator {
+        using value_type = T;
+
+        FrameStlAllocator() = default;
+        template<typename U>
+        FrameStlAllocator(const FrameStlAllocator<U>&) {}
+
+        T* allocate(size_t count) { return static_cast<T*>(FrameAllocator::get().allocate(count * sizeof(T), alignof(T))); }
+        void deallocate(T*, size_t) {}
+
+        template<typename U>
+        bool operator==(const FrameStlAllocator<U>&) const { return true; }
+        template<typename U>
+        bool operator!=(const FrameStlAllocator<U>&) const { return false; }
+    };
+
+    // The containers that are only used during a frame
+    template<typename T>
+    using FrameVector = std::vector<T, FrameStlAllocator<T>>;
+    template<typename Key, typename Value, typename Hash = std::hash<Key>>
+    using FrameUnorderedMap = std::unordered_map<Key, Value, Hash, std::equal_to<Key>, FrameStlAllocator<std::pair<const Key, Value>>>;
+    using FrameString = std::basic_string<char, std::char_traits<char>, FrameStlAllocator<char>>;
+
+}
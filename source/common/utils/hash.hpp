@@ -0,0 +1,28 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+namespace our {
+
+    // The starting value of the 64-bit FNV-1a hash (a different seed can be used to chain multiple buffers)
+    constexpr uint64_t FNV1A_OFFSET_BASIS = 14695981039346656037ull;
+
+    // Computes the 64-bit FNV-1a hash of the given bytes. This is not a cryptographic hash,
+    // but it is fast and good enough to detect when a cached file no longer matches its source.
+    inline uint64_t hashFNV1a(const void* data, size_t size, uint64_t seed = FNV1A_OFFSET_BASIS){
+        const unsigned char* bytes = static_cast<const unsigned char*>(data);
+        uint64_t hash = seed;
+        for(size_t index = 0; index < size; index++){
+            hash ^= bytes[index];
+            hash *= 1099511628211ull;
+        }
+        return hash;
+    }
+
+    inline uint64_t hashFNV1a(const std::string& text, uint64_t seed = FNV1A_OFFSET_BASIS){
+        return hashFNV1a(text.data(), text.size(), seed);
+    }
+
+}
@@ -0,0 +1,41 @@
+#include "heap-counter.hpp"
+#include "frame-allocator.hpp"
+
+#include <atomic>
+#include <iostream>
+#include <mutex>
+#include <unordered_set>
+
+// The number of frames after which the checks start reporting allocations
+static const uint64_t WARM_UP_FRAMES = 10;
+// The frame (counted by the frame allocator) at which the current warm up ends
+static std::atomic<uint64_t> warmUpEnd{WARM_UP_FRAMES};
+
+// When the allocations are counted, the counters & the replaced operators are in "heap-operators.cpp"
+#if !defined(COUNT_HEAP_ALLOCATIONS)
+
+bool our::heap_counter::isEnabled() { return false; }
+uint64_t our::heap_counter::getThreadAllocations() { return 0; }
+uint64_t our::heap_counter::getTotalAllocations() { return 0; }
+
+#endif
+
+our::HeapAllocationCheck::HeapAllocationCheck(const char* name) : name(name), start(heap_counter::getThreadAllocations()) {}
+
+our::HeapAllocationCheck::~HeapAllocationCheck() {
+    uint64_t allocations = heap_counter::getThreadAllocations() - start;
+    if(allocations == 0) return;
+    uint64_t frame = FrameAllocator::getMain().getFrame();
+    if(frame < warmUpEnd.load(std::memory_order_relaxed)) return;
+    // Each hot path is only reported once so that the log is not flooded every frame
+    static std::mutex mutex;
+    static std::unordered_set<const char*> reported;
+    std::lock_guard<std::mutex> lock(mutex);
+    if(!reported.insert(name).second) return;
+    std::cerr << "Warning: \"" << name << "\" did " << allocations << " heap allocation(s) on frame " << frame
+              << " (use the frame allocator for the per-frame data)" << std::endl;
+}
+
+void our::HeapAllocationCheck::warmUp() {
+    warmUpEnd.store(FrameAllocator::getMain().getFrame() + WARM_UP_FRAMES, std::memory_order_relaxed);
+}
@@ -0,0 +1,39 @@
+#pragma once
+
+#include <cstdint>
+
+namespace our {
+
+    // When COUNT_HEAP_ALLOCATIONS is defined (by the CMake option of the same name), the global operator new is replaced
+    // (see "heap-operators.cpp") to count the heap allocations done by each thread, so that the code that must not allocate
+    // every frame can check it (see "HeapAllocationCheck"). Otherwise, nothing is replaced and the counts are always zero.
+    namespace heap_counter {
+        // Returns whether the allocations are counted in this build
+        bool isEnabled();
+        // Returns the number of heap allocations done by the calling thread since it started
+        uint64_t getThreadAllocations();
+        // Returns the number of heap allocations done by all the threads
+        uint64_t getTotalAllocations();
+    }
+
+    // Counts the heap allocations done by the calling thread while it is alive and warns (once per name) if there were any.
+    // Put it at the start of a hot path that should not allocate after the first frames (e.g. rendering).
+    // The first frames (counted by the resets of the main frame allocator) are not checked since the persistent containers are still growing.
+    // The same goes for the first frames after a state change, so the application restarts the warm up (see "warmUp").
+    // The allocations done by the jobs it submitted are not counted since they run on other threads (they should use the frame allocator).
+    class HeapAllocationCheck {
+        const char* name;
+        uint64_t start;
+    public:
+        // The name must be a string literal since it is also used to warn only once
+        explicit HeapAllocationCheck(const char* name);
+        ~HeapAllocationCheck();
+
+        // Stops reporting the allocations for the next few frames (e.g. while a new state creates its objects)
+        static void warmUp();
+
+        HeapAllocationCheck(const HeapAllocationCheck&) = delete;
+        HeapAllocationCheck& operator=(const HeapAllocationCheck&) = delete;
+    };
+
+}
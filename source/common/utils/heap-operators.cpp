@@ -0,0 +1,45 @@
+// The replacements of the global allocation operators that count the heap allocations (see "heap-counter.hpp").
+// This file is only compiled when the COUNT_HEAP_ALLOCATIONS option is enabled in CMake. It must not allocate anything itself
+// (no containers, no streams) since every allocation of the program goes through these functions.
+
+#include "heap-counter.hpp"
+
+#include <atomic>
+#include <cstdlib>
+#include <new>
+
+// The counters are trivially initialized, so they can be used by allocations done before main or while a thread starts
+static thread_local uint64_t threadAllocations = 0;
+static std::atomic<uint64_t> totalAllocations{0};
+
+// The replaced operators allocate with malloc like the default ones, but they count the allocations first.
+// The aligned versions are not replaced (they are rare and their default versions don't use these ones).
+void* operator new(std::size_t size){
+    threadAllocations++;
+    totalAllocations.fetch_add(1, std::memory_order_relaxed);
+    if(size == 0) size = 1;
+    while(true){
+        if(void* memory = std::malloc(size)) return memory;
+        // Like the default operator new, the new handler is called until it frees enough memory (or throws)
+        std::new_handler handler = std::get_new_handler();
+        if(!handler) throw std::bad_alloc();
+        handler();
+    }
+}
+void* operator new[](std::size_t size){ return ::operator new(size); }
+void* operator new(std::size_t size, const std::nothrow_t&) noexcept {
+    try { return ::operator new(size); } catch(...) { return nullptr; }
+}
+void* operator new[](std::size_t size, const std::nothrow_t&) noexcept {
+    try { return ::operator new(size); } catch(...) { return nullptr; }
+}
+void operator delete(void* memory) noexcept { std::free(memory); }
+void operator delete[](void* memory) noexcept { std::free(memory); }
+void operator delete(void* memory, std::size_t) noexcept { std::free(memory); }
+void operator delete[](void* memory, std::size_t) noexcept { std::free(memory); }
+void operator delete(void* memory, const std::nothrow_t&) noexcept { std::free(memory); }
+void operator delete[](void* memory, const std::nothrow_t&) noexcept { std::free(memory); }
+
+bool our::heap_counter::isEnabled() { return true; }
+uint64_t our::heap_counter::getThreadAllocations() { return threadAllocations; }
+uint64_t our::heap_counter::getTotalAllocations() { return totalAllocations.load(std::memory_order_relaxed); }
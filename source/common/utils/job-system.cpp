@@ -0,0 +1,207 @@
+#include "job-system.hpp"
+
+#include <iostream>
+#include <utility>
+
+namespace our {
+
+    // The index of the queue owned by the calling worker (or -1 if the calling thread is not a worker)
+    static thread_local long currentWorker = -1;
+
+    void JobSystem::Queue::pushBack(Job&& job){
+        if(count == jobs.size()){
+            // The ring is full, so the jobs are moved in order to a ring twice as big
+            std::vector<Job> grown(std::max<size_t>(jobs.size() * 2, 64));
+            for(size_t index = 0; index < count; index++) grown[index] = std::move(jobs[(head + index) % jobs.size()]);
+            jobs.swap(grown);
+            head = 0;
+        }
+        jobs[(head + count) % jobs.size()] = std::move(job);
+        count++;
+    }
+
+    bool JobSystem::Queue::popBack(Job& job){
+        if(count == 0) return false;
+        count--;
+        job = std::move(jobs[(head + count) % jobs.size()]);
+        return true;
+    }
+
+    bool JobSystem::Queue::popFront(Job& job){
+        if(count == 0) return false;
+        job = std::move(jobs[head]);
+        head = (head + 1) % jobs.size();
+        count--;
+        return true;
+    }
+
+    void JobSystem::start(unsigned int workerCount){
+        if(!workers.empty()) return;
+        if(workerCount == 0){
+            // hardware_concurrency may return 0 if it is unknown
+            unsigned int cores = std::thread::hardware_concurrency();
+            workerCount = cores > 1 ? cores - 1 : 1;
+        }
+        stopping = false;
+        queues.clear();
+        for(unsigned int index = 0; index <= workerCount; index++) queues.push_back(std::make_unique<Queue>());
+        workers.reserve(workerCount);
+        for(unsigned int index = 0; index < workerCount; index++) workers.emplace_back(&JobSystem::work, this, (size_t)index);
+    }
+
+    void JobSystem::stop(){
+        if(workers.empty()) return;
+        {
+            std::lock_guard<std::mutex> lock(sleepMutex);
+            stopping = true;
+        }
+        wakeCondition.notify_all();
+        for(auto& worker : workers) worker.join();
+        workers.clear();
+        // The workers only stop once the queues are empty, so there is nothing left to run here
+        queues.clear();
+    }
+
+    size_t JobSystem::getQueueIndex() const {
+        return currentWorker >= 0 ? (size_t)currentWorker : queues.size() - 1;
+    }
+
+    void JobSystem::push(Job job){
+        if(workers.empty()){
+            run(job);
+            return;
+        }
+        Queue& queue = *queues[getQueueIndex()];
+        {
+            std::lock_guard<std::mutex> lock(queue.mutex);
+            queue.pushBack(std::move(job));
+        }
+        bool notifyWaiting;
+        {
+            // The increment is done under the sleep mutex so that a worker can't miss it between checking & sleeping
+            std::lock_guard<std::mutex> lock(sleepMutex);
+            queued.fetch_add(1, std::memory_order_release);
+            notifyWaiting = waiting > 0;
+        }
+        wakeCondition.notify_one();
+        // The waiting threads help with the new job too
+        if(notifyWaiting) doneCondition.notify_all();
+    }
+
+    void JobSystem::submit(std::function<void()> function, JobCounter* counter, const char* name){
+        if(counter) counter->pending.fetch_add(1, std::memory_order_relaxed);
+        push({std::move(function), counter, name});
+    }
+
+    void JobSystem::submitAfter(JobCounter& dependency, std::function<void()> function, JobCounter* counter, const char* name){
+        if(counter) counter->pending.fetch_add(1, std::memory_order_relaxed);
+        Job job{std::move(function), counter, name};
+        {
+            // The last job of the dependency takes the continuations under the same lock, so the job is either queued here or by it
+            std::lock_guard<std::mutex> lock(dependency.mutex);
+            if(!dependency.isDone()){
+                // std::function must be copyable, so the job is held by a shared pointer
+                auto pendingJob = std::make_shared<Job>(std::move(job));
+                dependency.continuations.emplace_back([this, pendingJob](){ push(std::move(*pendingJob)); });
+                return;
+            }
+        }
+        push(std::move(job));
+    }
+
+    void JobSystem::run(Job& job){
+        if(traceHooks.begin) traceHooks.begin(job.name);
+        // The exception must not escape since it would terminate a worker, and the counter must still be decremented
+        std::exception_ptr exception;
+        try {
+            job.function();
+        } catch(...) {
+            exception = std::current_exception();
+        }
+        if(traceHooks.end) traceHooks.end(job.name);
+        if(JobCounter* counter = job.counter){
+            std::vector<std::function<void()>> continuations;
+            bool done;
+            {
+                // The waiting thread locks the mutex before it returns, so the counter is not destroyed while it is used here
+                std::lock_guard<std::mutex> lock(counter->mutex);
+                if(exception && !counter->exception) counter->exception = exception;
+                done = counter->pending.fetch_sub(1, std::memory_order_acq_rel) == 1;
+                if(done) continuations.swap(counter->continuations);
+            }
+            for(auto& continuation : continuations) continuation();
+            if(done){
+                bool notifyWaiting;
+                {
+                    // Taking the sleep mutex makes sure that a waiting thread is either sleeping or will see that the counter is done
+                    std::lock_guard<std::mutex> lock(sleepMutex);
+                    notifyWaiting = waiting > 0;
+                }
+                if(notifyWaiting) doneCondition.notify_all();
+            }
+        } else if(exception) {
+            // Nobody waits for this job, so the exception is only reported
+            try {
+                std::rethrow_exception(exception);
+            } catch(const std::exception& error) {
+                std::cerr << "ERROR: The job \"" << job.name << "\" failed: " << error.what() << std::endl;
+            } catch(...) {
+                std::cerr << "ERROR: The job \"" << job.name << "\" failed" << std::endl;
+            }
+        }
+    }
+
+    bool JobSystem::runOne(size_t queueIndex){
+        if(queued.load(std::memory_order_acquire) == 0) return false;
+        Job job;
+        bool found = false;
+        {
+            // The newest job of the own queue is taken first since its data is most likely still in the cache
+            Queue& own = *queues[queueIndex];
+            std::lock_guard<std::mutex> lock(own.mutex);
+            found = own.popBack(job);
+        }
+        // Otherwise, the oldest job of another queue is stolen (starting from the next queue so that the victims are spread)
+        for(size_t offset = 1; !found && offset < queues.size(); offset++){
+            Queue& victim = *queues[(queueIndex + offset) % queues.size()];
+            std::lock_guard<std::mutex> lock(victim.mutex);
+            found = victim.popFront(job);
+        }
+        if(!found) return false;
+        queued.fetch_sub(1, std::memory_order_acq_rel);
+        run(job);
+        return true;
+    }
+
+    void JobSystem::work(size_t index){
+        currentWorker = (long)index;
+        while(true){
+            if(runOne(index)) continue;
+            std::unique_lock<std::mutex> lock(sleepMutex);
+            wakeCondition.wait(lock, [this](){ return stopping || queued.load(std::memory_order_acquire) > 0; });
+            // The remaining jobs are finished before stopping so that no counter is left waiting
+            if(stopping && queued.load(std::memory_order_acquire) == 0) return;
+        }
+    }
+
+    void JobSystem::wait(JobCounter& counter){
+        size_t queueIndex = getQueueIndex();
+        while(!counter.isDone()){
+            // The waiting thread helps instead of blocking
+            if(!workers.empty() && runOne(queueIndex)) continue;
+            // If there is nothing to run, the remaining jobs are running on other threads, so it sleeps until one of them
+            // finishes the counter or queues another job (the jobs run on the submitting thread when there are no workers)
+            std::unique_lock<std::mutex> lock(sleepMutex);
+            waiting++;
+            doneCondition.wait(lock, [&](){ return counter.isDone() || queued.load(std::memory_order_acquire) > 0; });
+            waiting--;
+        }
+        std::exception_ptr exception;
+        {
+            std::lock_guard<std::mutex> lock(counter.mutex);
+            exception = std::exchange(counter.exception, nullptr);
+        }
+        if(exception) std::rethrow_exception(exception);
+    }
+
+}
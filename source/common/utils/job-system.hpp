@@ -0,0 +1,140 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace our {
+
+    class JobSystem;
+
+    // Counts the unfinished jobs that were submitted with it. A thread can wait for the counter to reach zero
+    // (see "JobSystem::wait") and jobs can be submitted to start only after it reaches zero (see "JobSystem::submitAfter").
+    // The counter must outlive the jobs that use it, so wait for it before destroying it.
+    class JobCounter {
+        friend class JobSystem;
+        std::atomic<int> pending{0};
+        std::mutex mutex; // Guards the continuations & the exception, and is held while the last job decrements the counter
+        std::vector<std::function<void()>> continuations; // Submit the jobs waiting for this counter
+        std::exception_ptr exception; // The first exception thrown by a job of this counter (rethrown by "JobSystem::wait")
+    public:
+        JobCounter() = default;
+        bool isDone() const { return pending.load(std::memory_order_acquire) == 0; }
+
+        JobCounter(const JobCounter&) = delete;
+        JobCounter& operator=(const JobCounter&) = delete;
+    };
+
+    // Called on the thread running a job before & after it runs (e.g. to record the jobs in a profile)
+    struct JobTraceHooks {
+        std::function<void(const char* name)> begin;
+        std::function<void(const char* name)> end;
+    };
+
+    // The engine-wide job system. Each worker has its own deque of jobs: it runs the jobs it submitted itself last in first out,
+    // and when it runs out of jobs, it steals the oldest jobs of the other workers (and of the main thread).
+    // A thread that waits for a counter runs jobs while it waits, so a job can wait for the jobs it submitted,
+    // and it sleeps when the remaining jobs of the counter are running on other threads.
+    // An exception thrown by a job is caught by the thread running it and rethrown by "wait" (or printed if the job has no counter).
+    // The jobs must not call OpenGL since the GL context is only current on the main thread.
+    // If the job system is not started (e.g. by a tool), the jobs run immediately on the thread that submits them.
+    class JobSystem {
+        struct Job {
+            std::function<void()> function;
+            JobCounter* counter;
+            const char* name;
+        };
+        // A queue per worker, and one more at the end for the jobs submitted by the other threads.
+        // It is a ring buffer that only allocates when it grows, so submitting jobs every frame doesn't allocate.
+        struct Queue {
+            std::vector<Job> jobs;
+            size_t head = 0, count = 0;
+            std::mutex mutex;
+
+            void pushBack(Job&& job);
+            bool popBack(Job& job);
+            bool popFront(Job& job);
+        };
+
+        std::vector<std::unique_ptr<Queue>> queues;
+        std::vector<std::thread> workers;
+        std::atomic<int> queued{0}; // The number of jobs in all the queues
+        std::mutex sleepMutex;
+        std::condition_variable wakeCondition;
+        // The threads waiting for a counter sleep on this condition until a job is queued or a counter reaches zero
+        std::condition_variable doneCondition;
+        int waiting = 0; // The number of threads sleeping in "wait" (guarded by the sleep mutex)
+        bool stopping = false;
+        JobTraceHooks traceHooks;
+
+        JobSystem() = default;
+
+        void work(size_t index);
+        void push(Job job);
+        // Runs one job from the queue of the given thread or stolen from another queue. Returns false if there were no jobs.
+        bool runOne(size_t queueIndex);
+        void run(Job& job);
+        // Returns the index of the queue of the calling thread
+        size_t getQueueIndex() const;
+    public:
+        static JobSystem& get() {
+            static JobSystem instance;
+            return instance;
+        }
+        ~JobSystem() { stop(); }
+
+        // Starts the given number of workers (0 uses one worker per core except the one of the main thread)
+        void start(unsigned int workerCount = 0);
+        // Finishes the remaining jobs then joins the workers (the jobs submitted after this run immediately)
+        void stop();
+        size_t getWorkerCount() const { return workers.size(); }
+
+        // Sets the functions called around each job (set them before starting the workers)
+        void setTraceHooks(JobTraceHooks hooks) { traceHooks = std::move(hooks); }
+
+        // Queues a job. If a counter is given, it is incremented now and decremented once the job is done.
+        // The name is shown by the trace hooks, so it must be a string literal (or live as long as the job).
+        void submit(std::function<void()> function, JobCounter* counter = nullptr, const char* name = "job");
+        // Queues a job once the dependency reaches zero (immediately if it is already zero)
+        void submitAfter(JobCounter& dependency, std::function<void()> function, JobCounter* counter = nullptr, const char* name = "job");
+        // Runs jobs on the calling thread until the counter reaches zero, then rethrows the first exception thrown by its jobs (if any)
+        void wait(JobCounter& counter);
+
+        // Splits [begin, end) into chunks of "grain" elements and calls function(chunkBegin, chunkEnd) for each chunk in parallel.
+        // It returns once all the chunks are done (the calling thread runs chunks too).
+        template<typename F>
+        void parallelFor(size_t begin, size_t end, size_t grain, F&& function, const char* name = "parallel for"){
+            if(begin >= end) return;
+            grain = std::max<size_t>(grain, 1);
+            if(workers.empty() || end - begin <= grain){
+                function(begin, end);
+                return;
+            }
+            // Each job only captures the shared range & its chunk index, which is small enough to be stored
+            // inside the std::function without allocating
+            struct Range {
+                F* function;
+                size_t begin, end, grain;
+            } range{&function, begin, end, grain};
+            JobCounter counter;
+            size_t chunkCount = (end - begin + grain - 1) / grain;
+            for(size_t chunk = 0; chunk < chunkCount; chunk++){
+                submit([&range, chunk](){
+                    size_t first = range.begin + chunk * range.grain;
+                    (*range.function)(first, std::min(first + range.grain, range.end));
+                }, &counter, name);
+            }
+            wait(counter);
+        }
+
+        JobSystem(const JobSystem&) = delete;
+        JobSystem& operator=(const JobSystem&) = delete;
+    };
+
+}
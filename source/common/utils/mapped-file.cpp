@@ -0,0 +1,99 @@
+#include "mapped-file.hpp"
+
+#include <functional>
+#include <sstream>
+#include <thread>
+
+#if defined(_WIN32)
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace our {
+
+    std::string getTemporaryPath(const std::string& path){
+#if defined(_WIN32)
+        unsigned long processId = GetCurrentProcessId();
+#else
+        unsigned long processId = (unsigned long)getpid();
+#endif
+        std::ostringstream stream;
+        stream << path << "." << processId << "-" << std::hex << std::hash<std::thread::id>()(std::this_thread::get_id()) << ".tmp";
+        return stream.str();
+    }
+
+#if defined(_WIN32)
+
+    bool MappedFile::open(const std::string& filename){
+        close();
+        HANDLE file = CreateFileA(filename.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+        if(file == INVALID_HANDLE_VALUE) return false;
+        LARGE_INTEGER fileSize;
+        // Empty files cannot be mapped
+        if(!GetFileSizeEx(file, &fileSize) || fileSize.QuadPart == 0){
+            CloseHandle(file);
+            return false;
+        }
+        HANDLE mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+        if(!mapping){
+            CloseHandle(file);
+            return false;
+        }
+        void* view = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+        if(!view){
+            CloseHandle(mapping);
+            CloseHandle(file);
+            return false;
+        }
+        fileHandle = file;
+        mappingHandle = mapping;
+        data = static_cast<const unsigned char*>(view);
+        size = (size_t)fileSize.QuadPart;
+        return true;
+    }
+
+    void MappedFile::close(){
+        if(data) UnmapViewOfFile(data);
+        if(mappingHandle) CloseHandle(mappingHandle);
+        if(fileHandle) CloseHandle(fileHandle);
+        data = nullptr;
+        size = 0;
+        fileHandle = mappingHandle = nullptr;
+    }
+
+#else
+
+    bool MappedFile::open(const std::string& filename){
+        close();
+        int file = ::open(filename.c_str(), O_RDONLY);
+        if(file < 0) return false;
+        struct stat status;
+        // Empty files cannot be mapped
+        if(fstat(file, &status) != 0 || status.st_size == 0){
+            ::close(file);
+            return false;
+        }
+        void* view = mmap(nullptr, (size_t)status.st_size, PROT_READ, MAP_PRIVATE, file, 0);
+        // The mapping stays valid after the file descriptor is closed
+        ::close(file);
+        if(view == MAP_FAILED) return false;
+        data = static_cast<const unsigned char*>(view);
+        size = (size_t)status.st_size;
+        return true;
+    }
+
+    void MappedFile::close(){
+        if(data) munmap(const_cast<unsigned char*>(data), size);
+        data = nullptr;
+        size = 0;
+    }
+
+#endif
+
+}
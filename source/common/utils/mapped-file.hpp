@@ -0,0 +1,38 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+
+namespace our {
+
+    // A read-only memory mapping of a whole file. The operating system pages the file in on demand,
+    // so the data can be read (or uploaded to the GPU) without copying it into our own buffers first.
+    class MappedFile {
+        const unsigned char* data = nullptr;
+        size_t size = 0;
+#if defined(_WIN32)
+        void* fileHandle = nullptr;
+        void* mappingHandle = nullptr;
+#endif
+    public:
+        MappedFile() = default;
+        // Opens and maps the given file (check isOpen to know if it succeeded)
+        explicit MappedFile(const std::string& filename){ open(filename); }
+        ~MappedFile(){ close(); }
+
+        bool open(const std::string& filename);
+        void close();
+
+        bool isOpen() const { return data != nullptr; }
+        const unsigned char* getData() const { return data; }
+        size_t getSize() const { return size; }
+
+        MappedFile(const MappedFile&) = delete;
+        MappedFile& operator=(const MappedFile&) = delete;
+    };
+
+    // Returns a path next to the given one which is unique to the calling process & thread.
+    // The cache files are written there then renamed to their final path, so concurrent writers never write to the same file.
+    std::string getTemporaryPath(const std::string& path);
+
+}
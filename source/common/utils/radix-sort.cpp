@@ -0,0 +1,58 @@
+#include "radix-sort.hpp"
+#include "frame-allocator.hpp"
+#include "job-system.hpp"
+
+#include <algorithm>
+#include <array>
+
+namespace our {
+
+    // The number of items counted & moved by each job
+    static const size_t RADIX_CHUNK_SIZE = 4096;
+    static const int RADIX_BITS = 8;
+    static const size_t RADIX_BUCKETS = 1 << RADIX_BITS;
+
+    void radixSort(RadixSortItem* items, RadixSortItem* scratch, size_t count){
+        if(count < 2) return;
+        JobSystem& jobs = JobSystem::get();
+        size_t chunkCount = (count + RADIX_CHUNK_SIZE - 1) / RADIX_CHUNK_SIZE;
+        // The number of items with each digit in each chunk, which is then turned into the position of the next item with this digit
+        FrameVector<std::array<uint32_t, RADIX_BUCKETS>> histograms(chunkCount);
+
+        RadixSortItem* source = items;
+        RadixSortItem* destination = scratch;
+        for(int shift = 0; shift < 32; shift += RADIX_BITS){
+            jobs.parallelFor(0, count, RADIX_CHUNK_SIZE, [&](size_t first, size_t last){
+                auto& histogram = histograms[first / RADIX_CHUNK_SIZE];
+                histogram.fill(0);
+                for(size_t index = first; index < last; index++) histogram[(source[index].key >> shift) & (RADIX_BUCKETS - 1)]++;
+            }, "radix sort count");
+
+            // The items are placed by digit then by chunk, so the items with the same digit stay in the same order (the sort is stable)
+            uint32_t position = 0;
+            bool skip = false;
+            for(size_t digit = 0; digit < RADIX_BUCKETS; digit++){
+                uint32_t start = position;
+                for(auto& histogram : histograms){
+                    uint32_t digitCount = histogram[digit];
+                    histogram[digit] = position;
+                    position += digitCount;
+                }
+                // If all the items have this digit, the pass wouldn't move anything
+                if(position - start == count) skip = true;
+            }
+            if(skip) continue;
+
+            jobs.parallelFor(0, count, RADIX_CHUNK_SIZE, [&](size_t first, size_t last){
+                auto& positions = histograms[first / RADIX_CHUNK_SIZE];
+                for(size_t index = first; index < last; index++){
+                    destination[positions[(source[index].key >> shift) & (RADIX_BUCKETS - 1)]++] = source[index];
+                }
+            }, "radix sort scatter");
+            std::swap(source, destination);
+        }
+        // After an odd number of passes, the sorted items are in the scratch
+        if(source != items) std::copy(source, source + count, items);
+    }
+
+}
@@ -0,0 +1,30 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+namespace our {
+
+    // A key to sort by & the index of the item it belongs to (so that only 8 bytes are moved per item in each pass)
+    struct RadixSortItem {
+        uint32_t key;
+        uint32_t index;
+    };
+
+    // Maps a float to a key such that comparing the keys as unsigned integers gives the same order as comparing the floats
+    inline uint32_t floatToRadixKey(float value) {
+        uint32_t bits;
+        std::memcpy(&bits, &value, sizeof(bits));
+        // The negative floats are ordered backwards, so all their bits are flipped. The positive floats only get their sign bit set
+        // so that they come after the negative ones.
+        return (bits & 0x80000000u) ? ~bits : (bits | 0x80000000u);
+    }
+
+    // Sorts the items by ascending key (the items with equal keys keep their order) using 4 passes over 8 bits of the keys.
+    // In each pass, the digits of each chunk of items are counted in parallel, then each chunk moves its items to their place in parallel.
+    // The passes where all the items have the same digit are skipped (e.g. the sign & exponent bits of depths in a small range).
+    // "scratch" must have room for "count" items. The histograms are allocated from the frame allocator.
+    void radixSort(RadixSortItem* items, RadixSortItem* scratch, size_t count);
+
+}
@@ -0,0 +1,53 @@
+#include "trace-recorder.hpp"
+
+#include <json/json.hpp>
+#include <filesystem>
+#include <fstream>
+
+namespace our {
+
+    void TraceRecorder::record(const char* name, char phase){
+        int64_t time = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count();
+        std::lock_guard<std::mutex> lock(mutex);
+        auto [it, inserted] = threads.try_emplace(std::this_thread::get_id(), (uint32_t)threads.size());
+        Event event = {name, phase, it->second, time};
+        if(events.size() < maxEvents){
+            events.push_back(event);
+        } else {
+            events[next] = event;
+            next = (next + 1) % maxEvents;
+            dropped++;
+        }
+    }
+
+    size_t TraceRecorder::getEventCount(){
+        std::lock_guard<std::mutex> lock(mutex);
+        return events.size();
+    }
+
+    size_t TraceRecorder::getDroppedCount(){
+        std::lock_guard<std::mutex> lock(mutex);
+        return dropped;
+    }
+
+    bool TraceRecorder::save(const std::string& path){
+        std::lock_guard<std::mutex> lock(mutex);
+        nlohmann::json traceEvents = nlohmann::json::array();
+        // The number of events that began and didn't end yet on each thread
+        std::vector<uint32_t> depths(threads.size(), 0);
+        for(size_t index = 0; index < events.size(); index++){
+            const Event& event = events[(next + index) % events.size()];
+            if(event.phase == 'B') depths[event.thread]++;
+            else if(depths[event.thread] > 0) depths[event.thread]--;
+            else continue;
+            traceEvents.push_back({{"name", event.name}, {"ph", std::string(1, event.phase)}, {"pid", 0}, {"tid", event.thread}, {"ts", event.time}});
+        }
+        std::error_code error;
+        std::filesystem::create_directories(std::filesystem::path(path).parent_path(), error);
+        std::ofstream file(path);
+        if(!file) return false;
+        file << nlohmann::json{{"traceEvents", traceEvents}, {"displayTimeUnit", "ms"}};
+        return (bool)file;
+    }
+
+}
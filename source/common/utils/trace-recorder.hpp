@@ -0,0 +1,47 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+namespace our {
+
+    // Records the begin & end of named events on each thread and saves them in the Chrome trace event format,
+    // so they can be seen on a timeline per thread by opening the file in "chrome://tracing" or "https://ui.perfetto.dev".
+    // It is used to record the jobs of the job system (see "JobTraceHooks").
+    // The events are kept in a ring of a fixed size, so a long session only keeps its most recent events instead of growing until exit.
+    class TraceRecorder {
+        struct Event {
+            const char* name;
+            char phase;         // 'B' for begin & 'E' for end
+            uint32_t thread;
+            int64_t time;       // In microseconds since the recorder was created
+        };
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        std::mutex mutex;
+        std::vector<Event> events;  // Grows up to "maxEvents" then the oldest event is overwritten by each new one
+        size_t maxEvents;
+        size_t next = 0;            // The index of the oldest event (where the next one goes) once the ring is full
+        size_t dropped = 0;         // The number of events that were overwritten
+        std::unordered_map<std::thread::id, uint32_t> threads; // A small number for each thread (0 is the first thread that recorded an event)
+
+        void record(const char* name, char phase);
+    public:
+        explicit TraceRecorder(size_t maxEvents = 1 << 20) : maxEvents(maxEvents > 0 ? maxEvents : 1) {}
+
+        // The name must be a string literal (or live as long as the recorder) since only the pointer is stored
+        void begin(const char* name) { record(name, 'B'); }
+        void end(const char* name) { record(name, 'E'); }
+        size_t getEventCount();
+        size_t getDroppedCount();
+
+        // Writes the events to the given file from the oldest to the newest. Returns false if it failed.
+        // The end events whose begin was overwritten are skipped so that every written end has its begin.
+        bool save(const std::string& path);
+    };
+
+}
@@ -3,9 +3,9 @@
 #include <application.hpp>
 #include <shader/shader.hpp>
 #include <texture/texture2d.hpp>
-#include <texture/texture-utils.hpp>
 #include <material/material.hpp>
 #include <mesh/mesh.hpp>
+#include <asset-loader.hpp>
 
 #include <functional>
 #include <array>
@@ -41,6 +41,9 @@ class Menustate: public our::State {
     our::TintedMaterial * highlightMaterial;
     // A rectangle mesh on which the menu material will be drawn
     our::Mesh* rectangle;
+    // The texture & the shaders are kept by the residency manager, so entering the menu again doesn't load them again
+    our::AssetHandle<our::Texture2D> menuTexture;
+    our::AssetHandle<our::ShaderProgram> menuShader, highlightShader;
     // A variable to record the time since the state is entered (it will be used for the fading effect).
     float time;
     // An array of the button that we can interact with
@@ -50,22 +53,19 @@ class Menustate: public our::State {
         // First, we create a material for the menu's background
         menuMaterial = new our::TexturedMaterial();
         // Here, we load the shader that will be used to draw the background
-        menuMaterial->shader = new our::ShaderProgram();
-        menuMaterial->shader->attach("assets/shaders/textured.vert", GL_VERTEX_SHADER);
-        menuMaterial->shader->attach("assets/shaders/textured.frag", GL_FRAGMENT_SHADER);
-        menuMaterial->shader->link();
+        menuShader = our::acquireShader("assets/shaders/textured.vert", "assets/shaders/textured.frag");
+        menuMaterial->shader = menuShader.get();
         // Then we load the menu texture
-        menuMaterial->texture = our::texture_utils::loadImage("assets/textures/finalMenu.png");
+        menuTexture = our::acquireTexture("assets/textures/finalMenu.png");
+        menuMaterial->texture = menuTexture.get();
         // Initially, the menu material will be black, then it will fade in
         menuMaterial->tint = glm::vec4(0.0f, 0.0f, 0.0f, 0.0f);
 
         // Second, we create a material to highlight the hovered buttons
         highlightMaterial = new our::TintedMaterial();
         // Since the highlight is not textured, we used the tinted material shaders
-        highlightMaterial->shader = new our::ShaderProgram();
-        highlightMaterial->shader->attach("assets/shaders/tinted.vert", GL_VERTEX_SHADER);
-        highlightMaterial->shader->attach("assets/shaders/tinted.frag", GL_FRAGMENT_SHADER);
-        highlightMaterial->shader->link();
+        highlightShader = our::acquireShader("assets/shaders/tinted.vert", "assets/shaders/tinted.frag");
+        highlightMaterial->shader = highlightShader.get();
         // The tint is white since we will subtract the background color from it to create a negative effect.
         highlightMaterial->tint = glm::vec4(1.0f, 1.0f, 1.0f, 1.0f);
         // To create a negative effect, we enable blending, set the equation to be subtract,
@@ -178,11 +178,13 @@ class Menustate: public our::State {
 
     void onDestroy() override {
         // Delete all the allocated resources
+        // The texture & the shaders are only released, so they stay resident unless they don't fit in the budget
         delete rectangle;
-        delete menuMaterial->texture;
-        delete menuMaterial->shader;
         delete menuMaterial;
-        delete highlightMaterial->shader;
         delete highlightMaterial;
+        menuTexture.reset();
+        menuShader.reset();
+        highlightShader.reset();
+        our::AssetResidency::get().trim();
     }
 };
\ No newline at end of file
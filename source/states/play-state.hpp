@@ -9,6 +9,7 @@
 #include <systems/keyboard-movement.hpp>
 #include <systems/collision.hpp>
 #include <systems/area-coverage.hpp>
+#include <systems/arena-batch.hpp>
 #include <asset-loader.hpp>
 
 // This state shows how to use the ECS framework and deserialization.
@@ -21,28 +22,46 @@ class Playstate: public our::State {
     our::KeyboardMovementSystem keyboardMovementSystem;
     our::CollisionSystem collisionSystem;
     our::AreaCoverageSystem areaCoverageSystem;
+    our::ArenaBatch arenaBatch;
+    // The references to the assets of the scene (they keep the assets resident while the state is running)
+    std::vector<our::AssetReference> assets;
+    // Whether to show the renderer statistics window (toggled using F3)
+    bool showStats = false;
+
+    // What "onUpdate" records for "onRender" to draw. In the render thread mode, a frame is drawn while the next one is recorded,
+    // so the state alternates between 2 frames.
+    struct Frame {
+        our::FramePacket scene;
+        std::vector<GLuint> cellMask; // A copy of the cell mask of the arena (only valid if it changed in this frame)
+        bool cellMaskChanged = false;
+    };
+    Frame frames[2];
+    unsigned int updatedFrames = 0, renderedFrames = 0;
 
     void onInitialize() override {
         // First of all, we get the scene configuration from the app config
         auto& config = getApp()->getConfig()["scene"];
         // If we have assets in the scene config, we deserialize them
         if(config.contains("assets")){
-            our::deserializeAllAssets(config["assets"]);
+            assets = our::deserializeAllAssets(config["assets"]);
         }
         // If we have a world in the scene config, we use it to populate our world
         if(config.contains("world")){
             world.deserialize(config["world"]);
-
+            // The arena cubes are merged into a few static batches
+            arenaBatch.build(&world, areaCoverageSystem.GRID_DIMENSION);
         }
         // We initialize systems that need a pointer to the app
         cameraController.enter(getApp());
         keyboardMovementSystem.enter(getApp());
-        areaCoverageSystem.enter(getApp());
+        areaCoverageSystem.enter(getApp(), &arenaBatch);
         collisionSystem.enter(getApp());
         // areaCoverageSystem.dieReset();
         // Then we initialize the renderer
         auto size = getApp()->getFrameBufferSize();
         renderer.initialize(size, config["renderer"]);
+        renderer.setCellMask(arenaBatch.getMaskBuffer());
+        updatedFrames = renderedFrames = 0;
 
         // game variables
         getApp()->paused = false;
@@ -50,7 +69,29 @@ class Playstate: public our::State {
         getApp()->coveredArea = 0;
     }
 
+    void onImmediateGui() override {
+        if(!showStats) return;
+        const auto& stats = renderer.getStats();
+        ImGui::Begin("Renderer Stats", &showStats, ImGuiWindowFlags_AlwaysAutoResize);
+        ImGui::Text("Renderables: %d", stats.renderables);
+        ImGui::Text("Visible: %d", stats.visible);
+        ImGui::Text("Culled: %d", stats.culled);
+        ImGui::Text("Moved proxies: %d", stats.movedProxies);
+        ImGui::Text("BVH nodes: %d (height %d)", stats.hierarchyNodes, stats.hierarchyHeight);
+        ImGui::Text("Draw calls: %d (%d objects drawn indirectly)", stats.drawCalls, stats.indirectDraws);
+        ImGui::Text("Early depth: %s (opaque pass %.3f ms)", our::toString(stats.depthMode), stats.opaqueMilliseconds);
+        ImGui::End();
+    }
+
+    // The simulation & the drawing are separate so that the frames can be drawn on the render thread
+    bool canRenderOnThread() const override { return true; }
+
     void onDraw(double deltaTime) override {
+        onUpdate(deltaTime);
+        onRender();
+    }
+
+    void onUpdate(double deltaTime) override {
         if(!getApp()->paused)
         {
             // Here, we just run a bunch of systems to control the world logic
@@ -65,12 +106,18 @@ class Playstate: public our::State {
             getApp()->coveredArea = (int)(areaCoverageSystem.calcCoveredPercentage() / FINISH_PERCENTAGE * 100);
         }
 
-        // And finally we use the renderer system to draw the scene
-        renderer.render(&world);
+        // And finally we record what to draw: the raised cells of the arena & the cameras, lights and draw items of the world
+        Frame& frame = frames[updatedFrames++ % 2];
+        frame.cellMaskChanged = arenaBatch.copyIfDirty(frame.cellMask);
+        renderer.extract(&world, frame.scene);
 
         // Get a reference to the keyboard object
         auto& keyboard = getApp()->getKeyboard();
 
+        if(keyboard.justPressed(GLFW_KEY_F3)){
+            showStats = !showStats;
+        }
+
         if(keyboard.justPressed(GLFW_KEY_ESCAPE)){
             // If the escape  key is pressed in this frame, go to the play state
             getApp()->changeState("menu");
@@ -81,6 +128,13 @@ class Playstate: public our::State {
         }
     }
 
+    void onRender() override {
+        // Draw the oldest recorded frame (after sending its raised cells of the arena to the GPU)
+        Frame& frame = frames[renderedFrames++ % 2];
+        if(frame.cellMaskChanged) arenaBatch.upload(frame.cellMask);
+        renderer.submit(frame.scene);
+    }
+
     void onDestroy() override {
         // Don't forget to destroy the renderer
         renderer.destroy();
@@ -88,8 +142,12 @@ class Playstate: public our::State {
         cameraController.exit();
         // Clear the world
         world.clear();
-        // and we delete all the loaded assets to free memory on the RAM and the VRAM
+        // The chunk entities were deleted with the world, so we can delete their meshes
+        arenaBatch.destroy();
         areaCoverageSystem.exit_reset();
-        our::clearAllAssets();
+        // The assets are not deleted, we only release them so that playing again doesn't load them again.
+        // The residency manager deletes the least recently used ones if the resident assets don't fit in the budget.
+        assets.clear();
+        our::AssetResidency::get().trim();
     }
 };
\ No newline at end of file
@@ -0,0 +1,98 @@
+// The scene compiler converts the world files (JSONC files read by "World::deserialize") into ".scene" files
+// (see "source/common/ecs/compiled-scene.hpp"). A compiled scene is memory mapped and its entities are created
+// from fixed size records, so loading it doesn't parse any json or compare any component type strings.
+// The compiled file is written to "cache/scenes" and is picked automatically by "World::load"
+// as long as the source doesn't change (the hash of the source is stored in the file).
+// The game also compiles a world file the first time it loads it, so this tool is only needed to compile them ahead of time.
+//
+// Usage: SCENE_COMPILER [-force=true] [path...]
+//  - path: a world file or a folder of world files (default: "config/worlds")
+//          A world inside a bigger file is given by a json pointer after "#" (e.g. "config/app.jsonc#/scene/world")
+//  - force: compile the files even if their compiled scenes are up to date
+// (the options take their value after "=" since a separate value would be read as the value of the option)
+
+#include <ecs/compiled-scene.hpp>
+#include <ecs/world-stream.hpp>
+#include <utils/hash.hpp>
+#include <utils/mapped-file.hpp>
+
+#include <flags/flags.h>
+
+#include <filesystem>
+#include <iostream>
+#include <vector>
+
+namespace cs = our::compiled_scene;
+
+// Compiles a world file into its ".scene" file. Returns false if it failed.
+static bool compileScene(const std::string& path, bool force){
+    size_t separator = path.find('#');
+    std::string filename = path.substr(0, separator);
+    std::string pointer = separator == std::string::npos ? "" : path.substr(separator + 1);
+    our::MappedFile source(filename);
+    if(!source.isOpen()){
+        std::cerr << "Failed to open world: " << filename << std::endl;
+        return false;
+    }
+    uint64_t sourceHash = our::hashFNV1a(pointer, our::hashFNV1a(source.getData(), source.getSize()));
+    std::string compiledPath = cs::getPath(path);
+    if(!force){
+        cs::CompiledScene existing;
+        if(cs::open(compiledPath, sourceHash, existing)){
+            std::cout << "Up to date: " << compiledPath << std::endl;
+            return true;
+        }
+    }
+
+    // The world is streamed into the compiler like "World::load" does
+    cs::Compiler compiler;
+    our::WorldStreamReader reader(pointer, [&](const nlohmann::json& prefabs){ compiler.addPrefabs(prefabs); },
+                                  [&](const nlohmann::json& entity){ compiler.addEntity(entity); });
+    const char* text = reinterpret_cast<const char*>(source.getData());
+    if(!our::streamWorld(text, text + source.getSize(), reader)){
+        std::cerr << "Failed to parse world: " << filename << std::endl;
+        return false;
+    }
+    if(!reader.foundWorld()){
+        std::cerr << "A world must be an array of entities or an object with prefabs & entities: " << path << std::endl;
+        return false;
+    }
+
+    std::vector<unsigned char> data = compiler.finish(sourceHash);
+    if(data.empty()){
+        std::cerr << "Failed to compile (it has components that can't be compiled): " << path << std::endl;
+        return false;
+    }
+    if(!cs::save(compiledPath, data)){
+        std::cerr << "Failed to write: " << compiledPath << std::endl;
+        return false;
+    }
+    const cs::Header& header = *reinterpret_cast<const cs::Header*>(data.data());
+    std::cout << "Compiled " << path << " -> " << compiledPath << " (" << header.sections[cs::ENTITIES].count << " entities, "
+              << header.sections[cs::COMPONENTS].count << " components, " << header.sections[cs::STRING_OFFSETS].count << " strings): "
+              << source.getSize() / 1024 << " KB -> " << data.size() / 1024 << " KB" << std::endl;
+    return true;
+}
+
+int main(int argc, char** argv){
+    flags::args args(argc, argv);
+    bool force = args.get<bool>("force", false);
+    std::vector<std::string> paths;
+    for(auto& path : args.positional()) paths.emplace_back(path);
+    if(paths.empty()) paths.emplace_back("config/worlds");
+
+    auto isWorld = [](const std::filesystem::path& path){
+        std::string extension = path.extension().string();
+        return extension == ".jsonc" || extension == ".json";
+    };
+
+    int failures = 0;
+    for(auto& path : paths){
+        if(std::filesystem::is_directory(path)){
+            for(auto& entry : std::filesystem::directory_iterator(path)){
+                if(entry.is_regular_file() && isWorld(entry.path()) && !compileScene(entry.path().string(), force)) failures++;
+            }
+        } else if(!compileScene(path, force)) failures++;
+    }
+    return failures == 0 ? 0 : 1;
+}
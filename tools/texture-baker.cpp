@@ -0,0 +1,212 @@
+// The texture baker converts the images used by the game into ".ctex" files (see "source/common/texture/compressed-texture.hpp")
+// which hold the whole mip chain in a block compressed format, so loading a texture is a straight upload:
+// no image decoding and no mipmap generation at runtime, and less VRAM than RGBA8 (BC1 is 8 times smaller, BC3 4 times:
+// the textures of "assets/textures" take 44 MB in RGBA8 with their mipmaps and 5.5 MB once baked, "sky.jpg" alone goes from 12.6 MB to 1.6 MB).
+// The baked file is written next to its image and is picked automatically by the texture loader
+// as long as the image doesn't change (the size, the modification time & the hash of the image are stored in the file).
+// The baked files are not committed: block compression is lossy and the texture screenshot tests expect the original texels,
+// so run the baker on the assets before packaging a release.
+//
+// Usage: TEXTURE_BAKER [-force=true] [-rgba=true] [path...]
+//  - path: an image or a folder of images, including its sub-folders (default: "assets/textures")
+//  - force: bake the images even if their baked files are up to date
+//  - rgba: store the levels uncompressed (only the mipmaps are precomputed)
+// (the options take their value after "=" since a separate value would be read as the value of the option)
+
+#include <texture/compressed-texture.hpp>
+#include <utils/hash.hpp>
+#include <utils/mapped-file.hpp>
+
+#define STB_IMAGE_IMPLEMENTATION
+#include <stb/stb_image.h>
+#include <flags/flags.h>
+
+#include <algorithm>
+#include <cstddef>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <vector>
+
+namespace ct = our::compressed_texture;
+
+// The images with at most this number of pixels are stored uncompressed
+constexpr size_t MIN_COMPRESSED_PIXELS = 32 * 32;
+
+struct Level {
+    uint32_t width, height;
+    std::vector<unsigned char> pixels; // RGBA8
+};
+
+// Builds the next mip level by averaging each 2x2 square of pixels (the pixels outside the level are clamped to the edge)
+static Level downsample(const Level& source){
+    Level level;
+    level.width = std::max(1u, source.width / 2);
+    level.height = std::max(1u, source.height / 2);
+    level.pixels.resize((size_t)level.width * level.height * 4);
+    for(uint32_t y = 0; y < level.height; y++){
+        for(uint32_t x = 0; x < level.width; x++){
+            for(int channel = 0; channel < 4; channel++){
+                int sum = 0;
+                for(uint32_t dy = 0; dy < 2; dy++){
+                    for(uint32_t dx = 0; dx < 2; dx++){
+                        uint32_t sx = std::min(2 * x + dx, source.width - 1), sy = std::min(2 * y + dy, source.height - 1);
+                        sum += source.pixels[4 * ((size_t)sy * source.width + sx) + channel];
+                    }
+                }
+                level.pixels[4 * ((size_t)y * level.width + x) + channel] = (unsigned char)((sum + 2) / 4);
+            }
+        }
+    }
+    return level;
+}
+
+// Compresses a level block by block (the blocks on the edges repeat the last row & column)
+static void compress(ct::Format format, const Level& level, std::vector<unsigned char>& output){
+    unsigned char pixels[64], block[16];
+    size_t blockSize = format == ct::Format::BC1 ? 8 : 16;
+    for(uint32_t blockY = 0; blockY < level.height; blockY += 4){
+        for(uint32_t blockX = 0; blockX < level.width; blockX += 4){
+            for(uint32_t y = 0; y < 4; y++){
+                for(uint32_t x = 0; x < 4; x++){
+                    uint32_t sx = std::min(blockX + x, level.width - 1), sy = std::min(blockY + y, level.height - 1);
+                    std::memcpy(&pixels[4 * (4 * y + x)], &level.pixels[4 * ((size_t)sy * level.width + sx)], 4);
+                }
+            }
+            if(format == ct::Format::BC1) ct::encodeBC1Block(pixels, block);
+            else ct::encodeBC3Block(pixels, block);
+            output.insert(output.end(), block, block + blockSize);
+        }
+    }
+}
+
+// Bakes an image into its ".ctex" file. Returns false if it failed.
+static bool bake(const std::string& filename, bool force, bool uncompressed){
+    ct::SourceStamp stamp;
+    if(!ct::getSourceStamp(filename, stamp)){
+        std::cerr << "Failed to open image: " << filename << std::endl;
+        return false;
+    }
+    std::string path = ct::getPath(filename);
+    if(!force){
+        bool upToDate, restamped = false;
+        {
+            ct::CompressedTexture existing;
+            upToDate = ct::open(path, filename, existing);
+            restamped = upToDate && existing.source != stamp;
+        }
+        if(upToDate){
+            // Only the stamp of the image changed, so the new stamp is written to spare the loader from hashing the image
+            if(restamped){
+                std::fstream file(path, std::ios::binary | std::ios::in | std::ios::out);
+                file.seekp(offsetof(ct::Header, source));
+                file.write(reinterpret_cast<const char*>(&stamp), sizeof(stamp));
+            }
+            std::cout << "Up to date: " << path << (restamped ? " (updated the stamp of the image)" : "") << std::endl;
+            return true;
+        }
+    }
+    uint64_t sourceHash;
+    {
+        our::MappedFile source(filename);
+        if(!source.isOpen()){
+            std::cerr << "Failed to open image: " << filename << std::endl;
+            return false;
+        }
+        sourceHash = our::hashFNV1a(source.getData(), source.getSize());
+    }
+
+    // The images are flipped like the runtime loader does, since OpenGL puts the texture origin at the bottom left
+    stbi_set_flip_vertically_on_load(true);
+    Level level;
+    int width, height, channels;
+    unsigned char* pixels = stbi_load(filename.c_str(), &width, &height, &channels, 4);
+    if(pixels == nullptr){
+        std::cerr << "Failed to load image: " << filename << std::endl;
+        return false;
+    }
+    level.width = width;
+    level.height = height;
+    level.pixels.assign(pixels, pixels + (size_t)width * height * 4);
+    stbi_image_free(pixels);
+
+    // The opaque images don't need the alpha so they use BC1 which is half the size of BC3.
+    // The tiny images (e.g. pixel art icons) are left uncompressed since they save almost nothing and have few colors per block.
+    bool opaque = true;
+    for(size_t index = 3; index < level.pixels.size() && opaque; index += 4) opaque = level.pixels[index] == 255;
+    bool tiny = (size_t)level.width * level.height <= MIN_COMPRESSED_PIXELS;
+    ct::Format format = uncompressed || tiny ? ct::Format::RGBA8 : (opaque ? ct::Format::BC1 : ct::Format::BC3);
+
+    ct::Header header = {};
+    std::memcpy(header.magic, "AXCT", 4);
+    header.version = ct::VERSION;
+    header.sourceHash = sourceHash;
+    header.source = stamp;
+    header.format = format;
+    header.width = level.width;
+    header.height = level.height;
+    header.levels = ct::getFullLevelCount(level.width, level.height);
+
+    std::vector<unsigned char> data;
+    size_t rgbaSize = 0;
+    for(uint32_t index = 0; index < header.levels; index++){
+        if(index > 0) level = downsample(level);
+        rgbaSize += level.pixels.size();
+        if(format == ct::Format::RGBA8) data.insert(data.end(), level.pixels.begin(), level.pixels.end());
+        else compress(format, level, data);
+    }
+
+    // We write to a temporary file then rename it, so a partially written file is never read
+    std::string temporaryPath = our::getTemporaryPath(path);
+    bool written;
+    {
+        std::ofstream file(temporaryPath, std::ios::binary | std::ios::trunc);
+        file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        file.write(reinterpret_cast<const char*>(data.data()), data.size());
+        file.close();
+        written = !file.fail();
+    }
+    std::error_code error;
+    if(written) std::filesystem::rename(temporaryPath, path, error);
+    if(!written || error){
+        std::filesystem::remove(temporaryPath, error);
+        std::cerr << "Failed to write: " << path << std::endl;
+        return false;
+    }
+
+    const char* formatNames[] = {"RGBA8", "BC1", "BC3"};
+    std::cout << "Baked " << filename << " -> " << path << " (" << header.width << "x" << header.height << ", "
+              << header.levels << " levels, " << formatNames[(int)format] << "): "
+              << rgbaSize / 1024 << " KB -> " << data.size() / 1024 << " KB of VRAM" << std::endl;
+    return true;
+}
+
+int main(int argc, char** argv){
+    flags::args args(argc, argv);
+    bool force = args.get<bool>("force", false);
+    bool uncompressed = args.get<bool>("rgba", false);
+    std::vector<std::string> paths;
+    for(auto& path : args.positional()) paths.emplace_back(path);
+    if(paths.empty()) paths.emplace_back("assets/textures");
+
+    const std::vector<std::string> extensions = {".png", ".jpg", ".jpeg", ".bmp", ".tga"};
+    auto isImage = [&](const std::filesystem::path& path){
+        std::string extension = path.extension().string();
+        std::transform(extension.begin(), extension.end(), extension.begin(), ::tolower);
+        return std::find(extensions.begin(), extensions.end(), extension) != extensions.end();
+    };
+
+    int failed = 0;
+    for(auto& path : paths){
+        if(std::filesystem::is_directory(path)){
+            // The sub-folders are baked too
+            for(auto& entry : std::filesystem::recursive_directory_iterator(path)){
+                if(entry.is_regular_file() && isImage(entry.path())) failed += !bake(entry.path().generic_string(), force, uncompressed);
+            }
+        } else {
+            failed += !bake(path, force, uncompressed);
+        }
+    }
+    return failed == 0 ? 0 : 1;
+}